@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+// Shared helpers for the host benchmark suites ([env:native]).
+
+// LED counts every effect benchmark is run at
+static const uint32_t kBenchLedCounts[] = {144, 1000, 10000, 100000};
+
+struct BenchResult {
+  uint64_t frames;
+  double nsPerFrame;
+  double fps;
+};
+
+// Run renderFrame() repeatedly until both minFrames and minSeconds are
+// reached, after a short warm-up, and return the average cost per call.
+template <typename F>
+BenchResult benchFrames(F&& renderFrame, uint64_t minFrames = 20, double minSeconds = 0.25) {
+  for(int i = 0; i < 3; i++) {
+    renderFrame();
+  }
+
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  uint64_t frames = 0;
+  double elapsedNs = 0;
+  do {
+    renderFrame();
+    frames++;
+    elapsedNs = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+  } while(frames < minFrames || elapsedNs < minSeconds * 1e9);
+
+  BenchResult result;
+  result.frames = frames;
+  result.nsPerFrame = elapsedNs / frames;
+  result.fps = 1e9 / result.nsPerFrame;
+  return result;
+}
+
+// Best of several short runs of a and b, interleaved so a noisy stretch on
+// the host hits both
+template <typename A, typename B>
+void bestOfPair(A&& a, B&& b, BenchResult& bestA, BenchResult& bestB, int rounds = 7, double seconds = 0.03) {
+  for(int i = 0; i < rounds; i++) {
+    BenchResult ra = benchFrames(a, 20, seconds);
+    BenchResult rb = benchFrames(b, 20, seconds);
+    if(i == 0 || ra.nsPerFrame < bestA.nsPerFrame) {
+      bestA = ra;
+    }
+    if(i == 0 || rb.nsPerFrame < bestB.nsPerFrame) {
+      bestB = rb;
+    }
+  }
+}
+
+inline void printBenchHeader(const char* suite) {
+  printf("\n== %s ==\n", suite);
+  printf("%-24s %8s %14s %12s %10s\n", "case", "leds", "ns/frame", "frames/s", "ns/led");
+}
+
+inline void printBenchRow(const char* name, uint32_t leds, const BenchResult& r) {
+  printf("%-24s %8u %14.0f %12.1f %10.2f\n", name, (unsigned)leds, r.nsPerFrame, r.fps,
+         leds ? r.nsPerFrame / leds : 0.0);
+}
+
+// Keeps the optimizer from discarding a rendered frame
+inline volatile uint8_t benchSink;
+
+inline void benchConsume(const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint8_t acc = 0;
+  for(size_t i = 0; i < len; i += 61) {
+    acc ^= p[i];
+  }
+  benchSink = acc;
+}
+
+// Suites, one per bench_*.cpp file. Each returns 0 on success.
+int runEffectsBench();
+int runParticlesBench();
+int runFireBench();
+int runKernelsBench();
+int runGammaBench();
+int runPaletteBench();
+int runOutputBench();
+int runLanesBench();
+int runMapBench();
+int runPowerBench();
+int runPreviewBench();
+int runTransitionBench();
+int runStreamBench();
+int runAnimBench();
+int runSchedulerBench();
+int runIdleBench();
+int runProfileBench();
+int runRegistryBench();
+int runAudioBench();
+int runQueueBench();
+int runBootBench();
+int runSerialBench();
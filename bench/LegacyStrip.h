@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Just enough of Adafruit_NeoPixel to reproduce its lossy brightness
+// handling: setPixelColor() stores scaled values, getPixelColor() scales
+// them back up.
+struct LegacyStrip {
+  std::vector<uint8_t> pixels;  // GRB, as stored by the library
+  uint8_t brightness = 0;       // Library stores brightness + 1; 0 = full
+
+  explicit LegacyStrip(uint32_t n) : pixels(n * 3, 0) {}
+
+  void setBrightness(uint8_t b) { brightness = b + 1; }
+
+  void setPixelColor(uint32_t n, uint8_t r, uint8_t g, uint8_t b) {
+    if(brightness) {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+    }
+    uint8_t* p = &pixels[n * 3];
+    p[0] = g;
+    p[1] = r;
+    p[2] = b;
+  }
+
+  uint32_t getPixelColor(uint32_t n) const {
+    const uint8_t* p = &pixels[n * 3];
+    if(brightness) {
+      return (((p[1] << 8) / brightness) << 16) | (((p[0] << 8) / brightness) << 8) |
+             ((p[2] << 8) / brightness);
+    }
+    return ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 8) | p[2];
+  }
+};
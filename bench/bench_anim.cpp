@@ -0,0 +1,150 @@
+// Recorded animations (.lan): compression ratio, encode and decode cost of
+// rainbow, fire and meteor captures at 144/1k/10k LEDs, played back from
+// memory and from a file through the player's fixed read buffer. Checks
+// that every frame round-trips exactly and that seeking lands on the same
+// pixels as playing through.
+
+#include <string.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "LedAnimation.h"
+
+static const uint32_t kFrameUs = 16667;
+static const uint32_t kCaptureFrames = 300;  // 5 s at 60 fps
+static const uint16_t kKeyInterval = 60;
+
+typedef std::vector<uint8_t> Frame8;
+
+// Render an effect for kCaptureFrames and keep each frame at 8 bits, as the
+// writer stores it
+static std::vector<Frame8> capture(const char* effect, uint32_t leds) {
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 fb = {pixels.data(), leds};
+  RainbowState rainbow;
+  FireEngine fire;
+  fire.begin(leds);
+  fire.seed(1);
+  MeteorState meteor;
+
+  std::vector<Frame8> frames(kCaptureFrames, Frame8(leds * 3));
+  for(Frame8& frame : frames) {
+    if(strcmp(effect, "rainbow") == 0) {
+      rainbowEffect(fb, rainbow, kFrameUs);
+    } else if(strcmp(effect, "fire") == 0) {
+      fire.update(fb, kFrameUs);
+    } else {
+      meteorEffect(fb, meteor, kFrameUs);
+    }
+    for(uint32_t i = 0; i < leds; i++) {
+      frame[i * 3] = pixels[i].r >> 8;
+      frame[i * 3 + 1] = pixels[i].g >> 8;
+      frame[i * 3 + 2] = pixels[i].b >> 8;
+    }
+  }
+  return frames;
+}
+
+static std::vector<uint8_t> encode(const std::vector<Frame8>& frames, uint32_t leds) {
+  FILE* file = tmpfile();
+  AnimWriter writer;
+  writer.begin(file, leds, kFrameUs, kKeyInterval);
+  for(const Frame8& frame : frames) {
+    writer.addFrame(frame.data());
+  }
+  writer.finish();
+  std::vector<uint8_t> bytes(writer.bytesWritten());
+  rewind(file);
+  size_t got = fread(bytes.data(), 1, bytes.size(), file);
+  bytes.resize(got);
+  fclose(file);
+  return bytes;
+}
+
+static bool matches(const Framebuffer16& fb, const Frame8& frame) {
+  for(uint32_t i = 0; i < fb.count * 3; i++) {
+    if(fb.channels()[i] != frame[i] * 257) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Play every frame in order, then seek to a spread of frames
+static bool checkRoundTrip(const std::vector<uint8_t>& file, const std::vector<Frame8>& frames, uint32_t leds) {
+  MemoryAnimSource source(file.data(), file.size());
+  AnimPlayer player;
+  if(!player.open(source) || player.header().frameCount != frames.size()) {
+    return false;
+  }
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 fb = {pixels.data(), leds};
+  bool ok = player.seek(fb, 0) && matches(fb, frames[0]);
+  for(uint32_t f = 1; ok && f < frames.size(); f++) {
+    player.update(fb, kFrameUs);
+    ok = player.frame() == f && matches(fb, frames[f]);
+  }
+  for(uint32_t f = 7; ok && f < frames.size(); f += 37) {
+    ok = player.seek(fb, f) && matches(fb, frames[f]);
+  }
+  return ok && player.decodeErrors() == 0;
+}
+
+int runAnimBench() {
+  printf("\n== anim ==\n");
+  printf("%-24s %8s %12s %12s %8s %12s %12s %12s %10s\n", "capture", "leds", "raw bytes", "file bytes",
+         "ratio", "encode ns/f", "decode ns/f", "file ns/f", "seek ns");
+  int failures = 0;
+  const char* effects[] = {"rainbow", "fire", "meteor"};
+  for(const char* effect : effects) {
+    for(uint32_t leds : {144u, 1000u, 10000u}) {
+      std::vector<Frame8> frames = capture(effect, leds);
+      const double raw = (double)leds * 3 * frames.size();
+
+      std::vector<uint8_t> file;
+      BenchResult encodeCost = benchFrames([&] { file = encode(frames, leds); }, 2, 0.1);
+      if(!checkRoundTrip(file, frames, leds)) {
+        printf("%s at %u LEDs does not round-trip\n", effect, (unsigned)leds);
+        failures++;
+      }
+
+      std::vector<Rgb16> pixels(leds);
+      Framebuffer16 fb = {pixels.data(), leds};
+
+      // Playback from memory (flash mapped) and from a stdio file
+      MemoryAnimSource memory(file.data(), file.size());
+      AnimPlayer player;
+      player.open(memory);
+      player.seek(fb, 0);
+      BenchResult decode = benchFrames([&] {
+        player.update(fb, kFrameUs);
+        benchConsume(pixels.data(), leds * sizeof(Rgb16));
+      });
+
+      FILE* tmp = tmpfile();
+      fwrite(file.data(), 1, file.size(), tmp);
+      fflush(tmp);
+      FileAnimSource fileSource;
+      fileSource.begin(tmp);
+      AnimPlayer filePlayer;
+      filePlayer.open(fileSource);
+      filePlayer.seek(fb, 0);
+      BenchResult fileDecode = benchFrames([&] {
+        filePlayer.update(fb, kFrameUs);
+        benchConsume(pixels.data(), leds * sizeof(Rgb16));
+      });
+      fclose(tmp);
+
+      // Worst case seek: the frame just before a keyframe
+      BenchResult seek = benchFrames([&] { player.seek(fb, kKeyInterval - 1); });
+
+      printf("%-24s %8u %12.0f %12zu %7.1fx %12.0f %12.0f %12.0f %10.0f\n", effect, (unsigned)leds, raw,
+             file.size(), raw / file.size(), encodeCost.nsPerFrame / frames.size(), decode.nsPerFrame,
+             fileDecode.nsPerFrame, seek.nsPerFrame);
+    }
+  }
+  printf("player RAM: %zu bytes plus the framebuffer it decodes into\n", sizeof(AnimPlayer));
+  return failures ? 1 : 0;
+}
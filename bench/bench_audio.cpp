@@ -0,0 +1,291 @@
+// Audio analysis for the music-reactive effects: fixed-point FFT accuracy
+// against a double-precision DFT, tones landing in their band, beats found
+// on a synthetic 120 BPM track read back from a WAV file (with detection
+// latency), silence staying dark, and cost per 256-sample hop. Set
+// BENCH_WAV=path/to/file.wav to also run a recording of your own through
+// it. Ends with the render cost of the three audio effects.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "AudioEffects.h"
+#include "BenchUtil.h"
+#include "FastRandom.h"
+
+static const uint32_t kRate = 16000;
+static const double kPi = 3.14159265358979323846;
+
+// Fixed-point FFT of random input at a given amplitude against a double DFT,
+// as signal-to-error ratio in dB
+static double fftAccuracy(int amplitude, uint32_t seed) {
+  const uint32_t n = AudioAnalyzer::kWindow;
+  std::vector<int16_t> re(n), im(n);
+  std::vector<double> input(n);
+  FastRandom rng(seed);
+  for(uint32_t i = 0; i < n; i++) {
+    re[i] = (int16_t)((int32_t)(rng.next() % (2 * amplitude + 1)) - amplitude);
+    im[i] = 0;
+    input[i] = re[i];
+  }
+  const int exponent = AudioAnalyzer::fft(re.data(), im.data());
+  double signal = 0, error = 0;
+  for(uint32_t k = 0; k < n / 2; k++) {
+    double sr = 0, si = 0;
+    for(uint32_t i = 0; i < n; i++) {
+      sr += input[i] * cos(2 * kPi * k * i / n);
+      si -= input[i] * sin(2 * kPi * k * i / n);
+    }
+    const double fr = ldexp(re[k], exponent), fi = ldexp(im[k], exponent);
+    signal += sr * sr + si * si;
+    error += (fr - sr) * (fr - sr) + (fi - si) * (fi - si);
+  }
+  return 10 * log10(signal / (error > 0 ? error : 1e-9));
+}
+
+// A tone at the middle of each band must peak in that band (or, for the
+// single-bin bands at the bottom, next to it)
+static bool checkBands() {
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  std::vector<int16_t> tone(kRate / 4);
+  int misses = 0;
+  printf("band peaks:");
+  for(uint8_t b = 0; b < kAudioBands; b++) {
+    const double hz = 40 * pow(8000.0 / 40, (b + 0.5) / kAudioBands);
+    for(uint32_t i = 0; i < tone.size(); i++) {
+      tone[i] = (int16_t)(8000 * sin(2 * kPi * hz * i / kRate));
+    }
+    analyzer->begin(kRate);
+    analyzer->process(tone.data(), tone.size());
+    const AudioFeatures& f = analyzer->features();
+    uint8_t peak = 0;
+    for(uint8_t i = 1; i < kAudioBands; i++) {
+      peak = f.bands[i] > f.bands[peak] ? i : peak;
+    }
+    const bool hit = peak == b || (b < 6 && (peak + 1 == b || peak == b + 1));
+    misses += !hit;
+    printf(" %.0fHz->%u%s", hz, (unsigned)peak, hit ? "" : "(!)");
+  }
+  printf("\n");
+  return misses == 0;
+}
+
+// 12 s at 120 BPM: a kick every 500 ms over a quieter chord and hi-hats
+static std::vector<int16_t> synthTrack(std::vector<uint32_t>& kicks) {
+  std::vector<int16_t> samples(kRate * 12);
+  FastRandom rng(3);
+  for(uint32_t start = kRate / 2; start < samples.size(); start += kRate / 2) {
+    kicks.push_back(start);
+  }
+  for(uint32_t i = 0; i < samples.size(); i++) {
+    const double t = (double)i / kRate;
+    double v = 1200 * (sin(2 * kPi * 220 * t) + sin(2 * kPi * 277 * t) + sin(2 * kPi * 330 * t));
+    // Hi-hat: short noise burst on the off-beats
+    const uint32_t offbeat = (i + kRate / 4) % (kRate / 2);
+    if(offbeat < kRate / 50) {
+      v += ((int32_t)(rng.next() % 4001) - 2000) * exp(-(double)offbeat / (kRate / 200));
+    }
+    samples[i] = (int16_t)v;
+  }
+  for(uint32_t start : kicks) {
+    for(uint32_t i = 0; i < kRate / 5 && start + i < samples.size(); i++) {
+      const double t = (double)i / kRate;
+      const double v = samples[start + i] + 20000 * exp(-t / 0.06) * sin(2 * kPi * (50 + 60 * exp(-t / 0.03)) * t);
+      samples[start + i] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+  }
+  return samples;
+}
+
+// Write samples to a temporary WAV and read them back through WavReader
+static bool roundTripWav(const std::vector<int16_t>& samples, std::vector<int16_t>& readBack) {
+  FILE* f = tmpfile();
+  if(f == nullptr) {
+    return false;
+  }
+  writeWavHeader(f, kRate, samples.size());
+  fwrite(samples.data(), 2, samples.size(), f);
+  rewind(f);
+  WavReader wav;
+  bool ok = wav.open(f) && wav.sampleRate() == kRate && wav.frames() == samples.size();
+  readBack.resize(samples.size());
+  ok = ok && wav.read(readBack.data(), readBack.size()) == samples.size() && wav.read(readBack.data(), 1) == 0;
+  fclose(f);
+  return ok && readBack == samples;
+}
+
+// Feed the track in blocks of blockSize and note the sample at which each
+// beat was reported: the end of the hop that saw it
+static std::vector<uint32_t> findBeats(AudioAnalyzer& analyzer, const std::vector<int16_t>& samples,
+                                       uint32_t blockSize) {
+  std::vector<uint32_t> beats;
+  analyzer.begin(kRate);
+  uint32_t lastBeats = 0;
+  for(uint32_t pos = 0; pos < samples.size(); pos += blockSize) {
+    const uint32_t n = samples.size() - pos < blockSize ? samples.size() - pos : blockSize;
+    if(analyzer.process(samples.data() + pos, n) > 0) {
+      const AudioFeatures& f = analyzer.features();
+      if(f.beats != lastBeats) {
+        beats.push_back(f.hops * AudioAnalyzer::kHop);
+        lastBeats = f.beats;
+      }
+    }
+  }
+  return beats;
+}
+
+static bool checkBeats(const std::vector<int16_t>& track, const std::vector<uint32_t>& kicks) {
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  std::vector<uint32_t> beats = findBeats(*analyzer, track, AudioAnalyzer::kHop);
+  uint32_t found = 0, falseBeats = 0;
+  double totalMs = 0, maxMs = 0;
+  size_t k = 0;
+  for(uint32_t beat : beats) {
+    while(k < kicks.size() && kicks[k] + kRate / 10 < beat) {
+      k++;
+    }
+    if(k < kicks.size() && beat >= kicks[k] && beat <= kicks[k] + kRate / 10) {
+      const double ms = (beat - kicks[k]) * 1000.0 / kRate;
+      totalMs += ms;
+      maxMs = ms > maxMs ? ms : maxMs;
+      found++;
+      k++;
+    } else {
+      falseBeats++;
+    }
+  }
+  const bool ok = found == kicks.size() && falseBeats == 0;
+  printf("beats: %u of %u kicks found, %u false, onset to beat %.1f ms avg, %.1f ms max: %s\n", (unsigned)found,
+         (unsigned)kicks.size(), (unsigned)falseBeats, found ? totalMs / found : 0.0, maxMs, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Same features whatever size the blocks arrive in
+static bool checkBlockSizes(const std::vector<int16_t>& track) {
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  const std::vector<uint32_t> reference = findBeats(*analyzer, track, AudioAnalyzer::kHop);
+  const AudioFeatures last = analyzer->features();
+  bool ok = true;
+  for(uint32_t block : {37u, 1000u, 4096u}) {
+    // Beats are reported at the end of the block holding their hop
+    const std::vector<uint32_t> beats = findBeats(*analyzer, track, block);
+    const AudioFeatures& f = analyzer->features();
+    ok &= beats.size() == reference.size() && memcmp(f.bands, last.bands, sizeof(f.bands)) == 0 &&
+          f.level == last.level && f.bass == last.bass && f.beats == last.beats && f.hops == last.hops;
+  }
+  printf("blocks of 37/256/1000/4096 samples give identical features: %s\n", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static bool checkSilence() {
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  std::vector<int16_t> quiet(kRate * 2);
+  FastRandom rng(9);
+  for(int16_t& s : quiet) {
+    s = (int16_t)((int32_t)(rng.next() % 9) - 4);  // Dither-level hiss
+  }
+  analyzer->begin(kRate);
+  analyzer->process(quiet.data(), quiet.size());
+  const AudioFeatures& f = analyzer->features();
+  uint32_t lit = f.level + f.bass;
+  for(uint8_t b = 0; b < kAudioBands; b++) {
+    lit += f.bands[b];
+  }
+  const bool ok = lit == 0 && f.beats == 0;
+  printf("silence: bands, level and beats all zero: %s\n", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// A recording of your own, if BENCH_WAV names one
+static void runWavFile(const char* path) {
+  FILE* f = fopen(path, "rb");
+  WavReader wav;
+  if(f == nullptr || !wav.open(f)) {
+    printf("BENCH_WAV %s: not a readable 16-bit PCM WAV\n", path);
+    if(f) {
+      fclose(f);
+    }
+    return;
+  }
+  std::vector<int16_t> samples(wav.frames());
+  samples.resize(wav.read(samples.data(), samples.size()));
+  fclose(f);
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  const auto start = std::chrono::steady_clock::now();
+  analyzer->begin(wav.sampleRate());
+  analyzer->process(samples.data(), samples.size());
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  const double seconds = (double)samples.size() / wav.sampleRate();
+  const AudioFeatures& features = analyzer->features();
+  printf("%s: %.1f s at %u Hz, %u ch, %u hops, %u beats (%.0f per minute), %.0f ns per hop, %.0fx real time\n", path,
+         seconds, (unsigned)wav.sampleRate(), (unsigned)wav.channels(), (unsigned)features.hops,
+         (unsigned)features.beats, features.beats * 60 / seconds, features.hops ? ns / features.hops : 0.0,
+         seconds * 1e9 / ns);
+}
+
+int runAudioBench() {
+  printf("\n== audio ==\n");
+  int failures = 0;
+
+  const double loud = fftAccuracy(32000, 1), normal = fftAccuracy(3000, 2), quiet = fftAccuracy(40, 3);
+  const bool fftOk = loud > 60 && normal > 60 && quiet > 40;
+  printf("fft vs double DFT: %.1f dB at full scale, %.1f dB at -20 dB, %.1f dB at -58 dB: %s\n", loud, normal, quiet,
+         fftOk ? "ok" : "FAIL");
+  failures += !fftOk;
+  failures += !checkBands();
+
+  std::vector<uint32_t> kicks;
+  std::vector<int16_t> track = synthTrack(kicks), wavTrack;
+  const bool wavOk = roundTripWav(track, wavTrack);
+  printf("WAV write and read back: %s\n", wavOk ? "ok" : "FAIL");
+  failures += !wavOk;
+  failures += !checkBeats(wavTrack, kicks);
+  failures += !checkBlockSizes(track);
+  failures += !checkSilence();
+
+  // Cost of one hop, and the share of a core it takes at 16 kHz
+  std::unique_ptr<AudioAnalyzer> analyzer(new AudioAnalyzer());
+  analyzer->begin(kRate);
+  uint32_t pos = 0;
+  BenchResult r = benchFrames([&] {
+    analyzer->process(track.data() + pos, AudioAnalyzer::kHop);
+    pos = pos + 2 * AudioAnalyzer::kHop <= track.size() ? pos + AudioAnalyzer::kHop : 0;
+  }, 1000, 0.25);
+  const double hopUs = AudioAnalyzer::kHop * 1e6 / kRate;
+  printf("per hop: %.0f ns (FFT %u, %u bands), %.3f%% of the %.0f us the hop lasts; analyzer RAM %zu bytes\n",
+         r.nsPerFrame, (unsigned)AudioAnalyzer::kWindow, (unsigned)kAudioBands, r.nsPerFrame / (hopUs * 10), hopUs,
+         sizeof(AudioAnalyzer));
+  printf("latency: a hop is analyzed %.0f us after its first sample, plus the cost above\n", hopUs);
+
+  if(const char* path = getenv("BENCH_WAV")) {
+    runWavFile(path);
+  }
+
+  // The effects, fed one hop of the track per frame
+  AudioFeed feed;
+  printf("%-24s %8s %14s %12s %10s\n", "case", "leds", "ns/frame", "frames/s", "ns/led");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds);
+    SpectrumState spectrum;
+    BeatState beat;
+    VuState vu;
+    spectrum.feed = beat.feed = vu.feed = &feed;
+    auto next = [&] {
+      if(analyzer->process(track.data() + pos, AudioAnalyzer::kHop) > 0) {
+        feed.publish(analyzer->features());
+      }
+      pos = pos + 2 * AudioAnalyzer::kHop <= track.size() ? pos + AudioAnalyzer::kHop : 0;
+    };
+    r = benchFrames([&] { next(); spectrumKernel(pixels.data(), leds, spectrum, feed.latest(), 16667); });
+    printBenchRow("spectrum (+ hop)", leds, r);
+    r = benchFrames([&] { next(); beatKernel(pixels.data(), leds, beat, feed.latest(), 16667); });
+    printBenchRow("beat (+ hop)", leds, r);
+    r = benchFrames([&] { next(); vuKernel(pixels.data(), leds, vu, feed.latest(), 16667); });
+    printBenchRow("vu (+ hop)", leds, r);
+    benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,326 @@
+// Fast boot. Checks that the saved settings are written once per burst of
+// changes (a slider drag at touch rate is one write, a drag longer than the
+// maximum delay two), that the last value is what is stored and that a
+// record from another version is ignored. Then the boot path to the first
+// LED frame, from the stored record to bytes on the (mock) wire, at
+// 144/1k/10k/100k LEDs, and the prebuilt UI image: size of a 720x1280
+// interface and of random pixels, decode time against copying it raw, and
+// stale or truncated files refused.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "EffectRegistry.h"
+#include "LedOutput.h"
+#include "PixelKernels.h"
+#include "SettingsStore.h"
+#include "TransitionEngine.h"
+#include "UiImage.h"
+
+static const uint32_t kQuietMs = 2000;
+static const uint32_t kMaxDelayMs = 10000;
+
+// Brightness dragged over lowest..lowest+99 every 16 ms for durationMs from
+// startMs, then left alone for 5 s. Returns the last value set.
+static uint8_t drag(SettingsStore& store, SavedSettings settings, uint32_t startMs, uint32_t durationMs,
+                    uint8_t lowest) {
+  uint32_t now = startMs;
+  for(; now < startMs + durationMs; now += 16) {
+    settings.brightness = (uint8_t)(lowest + (now / 16) % 100);
+    store.set(settings, now);
+    store.update(now);
+  }
+  for(; now < startMs + durationMs + 5000; now += 16) {
+    store.update(now);
+  }
+  return settings.brightness;
+}
+
+// Store that refuses writes while failing is set
+class FlakySettingsBackend : public MemorySettingsBackend {
+ public:
+  bool write(const void* data, size_t size) override {
+    return !failing && MemorySettingsBackend::write(data, size);
+  }
+  bool failing = false;
+};
+
+static bool checkSettings() {
+  bool ok = true;
+  const SavedSettings defaults = {5, 128, 0};
+  MemorySettingsBackend backend;
+  SettingsStore store;
+  store.begin(backend, defaults, kQuietMs, kMaxDelayMs);
+  ok &= !store.loaded() && store.settings() == defaults;
+
+  // A 3 s drag: one write, of the value it ended on
+  uint8_t last = drag(store, defaults, 0, 3000, 20);
+  ok &= store.stats().writes == 1 && !store.pending();
+  SettingsStore reloaded;
+  reloaded.begin(backend, defaults);
+  ok &= reloaded.loaded() && reloaded.settings().brightness == last;
+  printf("%-28s %u changes, %u writes %s\n", "3 s slider drag", (unsigned)store.stats().changes,
+         (unsigned)store.stats().writes, ok ? "ok" : "FAIL");
+
+  // A 15 s drag is saved once on the way, at the maximum delay. It stays
+  // clear of the stored value, which would cancel the pending write.
+  bool longOk = true;
+  store.begin(backend, defaults, kQuietMs, kMaxDelayMs);
+  last = drag(store, store.settings(), 100000, 15000, 140);
+  reloaded.begin(backend, defaults);
+  longOk &= store.stats().writes == 2 && reloaded.settings().brightness == last;
+  printf("%-28s %u changes, %u writes %s\n", "15 s slider drag", (unsigned)store.stats().changes,
+         (unsigned)store.stats().writes, longOk ? "ok" : "FAIL");
+  ok &= longOk;
+
+  // Changed and changed back before it was due: nothing to write
+  bool backOk = true;
+  store.begin(backend, defaults, kQuietMs, kMaxDelayMs);
+  SavedSettings changed = store.settings();
+  changed.effect = 2;
+  changed.color = 0x3080FF;
+  store.set(changed, 0);
+  store.set(reloaded.settings(), 500);
+  for(uint32_t now = 500; now < 20000; now += 16) {
+    store.update(now);
+  }
+  backOk &= store.stats().changes == 2 && store.stats().writes == 0;
+  // Effect and color come back too
+  store.set(changed, 30000);
+  backOk &= store.update(32000);
+  reloaded.begin(backend, defaults);
+  backOk &= reloaded.settings() == changed;
+  printf("%-28s %s\n", "change and change back", backOk ? "ok" : "FAIL");
+  ok &= backOk;
+
+  // Records that are not this version's fall back to the defaults
+  bool versionOk = true;
+  MemorySettingsBackend other = backend;
+  other.record[0] = SettingsStore::kVersion + 1;
+  reloaded.begin(other, defaults);
+  versionOk &= !reloaded.loaded() && reloaded.settings() == defaults;
+  other.record = backend.record;
+  other.record.pop_back();
+  reloaded.begin(other, defaults);
+  versionOk &= !reloaded.loaded() && reloaded.settings() == defaults;
+  printf("%-28s %s\n", "other version, short record", versionOk ? "ok" : "FAIL");
+  ok &= versionOk;
+
+  // A failed write stays pending and is tried again
+  bool retryOk = true;
+  FlakySettingsBackend flaky;
+  flaky.failing = true;
+  store.begin(flaky, defaults, kQuietMs, kMaxDelayMs);
+  store.set(changed, 0);
+  retryOk &= !store.update(kQuietMs) && store.pending() && store.stats().failedWrites == 1;
+  flaky.failing = false;
+  retryOk &= !store.update(kQuietMs + 100) && store.update(2 * kQuietMs);
+  reloaded.begin(flaky, defaults);
+  retryOk &= reloaded.settings() == changed && !store.flush();
+  printf("%-28s %s\n", "failed write retried", retryOk ? "ok" : "FAIL");
+  return ok && retryOk;
+}
+
+template <uint32_t N>
+using BootEffects = EffectRegistry<N, RainbowDef, FireDef, MeteorDef, KittDef, OffDef, SolidDef>;
+
+// setup() up to the first frame: stored record, output, effects at the
+// saved effect, one frame encoded at the saved brightness and started.
+// Returns the host time taken and checks what went out.
+template <uint32_t N>
+static double bootToFirstFrame(SettingsBackend& backend, bool& ok) {
+  using clock = std::chrono::steady_clock;
+  MockTransmitter mock;
+  mock.setTimeScale(0);
+  const auto start = clock::now();
+  SettingsStore store;
+  store.begin(backend, SavedSettings{});
+  const SavedSettings& saved = store.settings();
+  static BootEffects<N> effects;
+  effects.template state<SolidDef>().color = toRgb16(unpackColor(saved.color));
+  LedOutput output;
+  output.begin(mock, N, kOrderGRB);
+  TransitionEngine transitions;
+  transitions.begin(N, BootEffects<N>::renderFn, &effects);
+  effects.onSelect(saved.effect);
+  transitions.cut(saved.effect);
+  output.encode(transitions.render(0), saved.brightness);
+  output.present();
+  const double us = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+
+  output.waitDone();
+  std::vector<Rgb16> solid(N, toRgb16(unpackColor(saved.color)));
+  std::vector<uint8_t> expected(N * 3);
+  writeOutput(Framebuffer16{solid.data(), N}, expected.data(), saved.brightness, kOrderGRB);
+  ok &= mock.framesSent() == 1 && mock.lastFrame() == expected;
+  return us;
+}
+
+template <uint32_t N>
+static bool benchFirstFrame() {
+  MemorySettingsBackend backend;
+  SettingsStore store;
+  store.begin(backend, SavedSettings{});
+  store.set(SavedSettings{BootEffects<N>::template id<SolidDef>(), 77, 0xFF4010}, 0);
+  store.flush();
+  bool ok = true;
+  double best = 0;
+  for(int round = 0; round < 7; round++) {
+    const double us = bootToFirstFrame<N>(backend, ok);
+    best = round == 0 || us < best ? us : best;
+  }
+  printf("%-28s %8u %12.1f %s\n", "saved Solid at 77", (unsigned)N, best, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static const uint16_t kW = 720;
+static const uint16_t kH = 1280;
+
+// A screen built like the real one: flat background, cards, vertical
+// gradients, color bands, circles, diagonal lines and blocks of text-sized
+// detail
+static void drawUiLike(std::vector<uint16_t>& px) {
+  auto fill = [&](int x, int y, int w, int h, uint16_t c) {
+    for(int r = y; r < y + h; r++) {
+      for(int col = x; col < x + w; col++) {
+        px[r * kW + col] = c;
+      }
+    }
+  };
+  auto circle = [&](int cx, int cy, int radius, uint16_t c) {
+    for(int r = cy - radius; r <= cy + radius; r++) {
+      for(int col = cx - radius; col <= cx + radius; col++) {
+        if((r - cy) * (r - cy) + (col - cx) * (col - cx) <= radius * radius) {
+          px[r * kW + col] = c;
+        }
+      }
+    }
+  };
+  FastRandom rng;
+  auto text = [&](int x, int y, int chars, int scale) {
+    for(int i = 0; i < chars; i++) {
+      for(int gy = 0; gy < 7; gy++) {
+        for(int gx = 0; gx < 5; gx++) {
+          if(rng.below(2)) {
+            fill(x + (i * 6 + gx) * scale, y + gy * scale, scale, scale, 0xFFFF);
+          }
+        }
+      }
+    }
+  };
+  fill(0, 0, kW, kH, 0x0841);
+  circle(60, 70, 20, 0x07E0);
+  text(240, 56, 11, 4);
+  circle(660, 70, 20, 0x7BEF);
+  text(60, 140, 7, 3);
+  for(int t = 0; t < 4; t++) {
+    const int x = 60 + (t % 2) * 320, y = 190 + (t / 2) * 300;
+    fill(x, y, 280, 280, 0x2945);
+    if(t == 0) {
+      for(int b = 0; b < 8; b++) {
+        fill(x + 5 + b * 33, y + 5, 34, 240, kSineRainbowPalette.rgb565[b * 32]);
+      }
+    } else if(t == 1) {
+      for(int r = 0; r < 245; r++) {
+        fill(x + 5, y + 5 + r, 270, 1, kEmberPalette.rgb565[r * 255 / 244]);
+      }
+    } else if(t == 2) {
+      for(int l = 0; l < 4; l++) {
+        for(int r = 0; r < 240; r++) {
+          px[(y + 10 + r) * kW + x + 20 + l * 60 + r / 3] = 0xC618;
+        }
+      }
+    } else {
+      fill(x + 20, y + 216, 240, 16, 0xF800);
+    }
+    text(x + 90, y + 240, 5, 3);
+  }
+  for(int i = 0; i < 8; i++) {
+    circle(80 + i * 75, 850, 25, kSineRainbowPalette.rgb565[i * 32]);
+  }
+  text(35, 915, 10, 3);
+  fill(60, 960, 600, 10, 0x4208);
+  for(int b = 0; b < 12; b++) {
+    fill(60 + (b % 4) * 150, 1013 + (b / 4) * 62, 129, 54, 0x2945);
+    text(80 + (b % 4) * 150, 1025 + (b / 4) * 62, 5, 2);
+  }
+}
+
+static bool checkImage(const char* name, const std::vector<uint16_t>& pixels, double minRatio) {
+  std::vector<uint16_t> words;
+  encodeUiImage(pixels.data(), (uint32_t)pixels.size(), words);
+  std::vector<uint16_t> decoded(pixels.size());
+  bool ok = decodeUiImage(words.data(), (uint32_t)words.size(), decoded.data(), (uint32_t)decoded.size()) &&
+            decoded == pixels;
+  const double ratio = (double)pixels.size() / words.size();
+  ok &= ratio >= minRatio;
+  BenchResult decode = {}, copy = {};
+  bestOfPair(
+      [&] {
+        decodeUiImage(words.data(), (uint32_t)words.size(), decoded.data(), (uint32_t)decoded.size());
+        benchConsume(decoded.data(), decoded.size() * 2);
+      },
+      [&] {
+        memcpy(decoded.data(), pixels.data(), pixels.size() * 2);
+        benchConsume(decoded.data(), decoded.size() * 2);
+      },
+      decode, copy, 5, 0.05);
+  printf("%-28s %8u kB %8.1fx %10.0f us %10.0f us %s\n", name, (unsigned)(words.size() * 2 / 1024), ratio,
+         decode.nsPerFrame / 1000, copy.nsPerFrame / 1000, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static bool checkImageFile(const std::vector<uint16_t>& pixels) {
+  char path[] = "/tmp/ui-image-XXXXXX";
+  const int fd = mkstemp(path);
+  if(fd < 0) {
+    printf("%-28s could not create a temporary file\n", "image file");
+    return false;
+  }
+  close(fd);
+  std::vector<uint16_t> loaded(pixels.size());
+  bool ok = saveUiImage(path, 1234, pixels.data(), kW, kH) && loadUiImage(path, 1234, loaded.data(), kW, kH) &&
+            loaded == pixels;
+  // Another build or layout, another size
+  ok &= !loadUiImage(path, 1235, loaded.data(), kW, kH) && !loadUiImage(path, 1234, loaded.data(), kW, kH - 1);
+  // Cut short, e.g. power lost while it was written
+  FILE* f = fopen(path, "rb");
+  std::vector<uint8_t> bytes(1 << 20);
+  bytes.resize(fread(bytes.data(), 1, bytes.size(), f));
+  fclose(f);
+  f = fopen(path, "wb");
+  fwrite(bytes.data(), 1, bytes.size() - 2, f);
+  fclose(f);
+  ok &= !loadUiImage(path, 1234, loaded.data(), kW, kH);
+  remove(path);
+  printf("%-28s %s\n", "image file: stale, truncated", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int runBootBench() {
+  printf("\n== boot ==\n");
+  int failures = 0;
+  failures += !checkSettings();
+
+  printf("%-28s %8s %12s\n", "first LED frame", "leds", "host us");
+  failures += !benchFirstFrame<144>();
+  failures += !benchFirstFrame<1000>();
+  failures += !benchFirstFrame<10000>();
+  failures += !benchFirstFrame<100000>();
+
+  printf("%-28s %11s %9s %13s %13s\n", "UI image 720x1280", "size", "ratio", "decode", "raw copy");
+  std::vector<uint16_t> pixels(kW * kH);
+  drawUiLike(pixels);
+  failures += !checkImage("interface", pixels, 10);
+  failures += !checkImageFile(pixels);
+  FastRandom rng;
+  for(uint16_t& p : pixels) {
+    p = (uint16_t)rng.below(0x10000);
+  }
+  failures += !checkImage("random pixels", pixels, 0.5);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+// Render cost of each effect at increasing strip lengths.
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+
+// Effects advance by elapsed time; bench them at a 60 fps frame step
+static const uint32_t kFrameUs = 16667;
+
+int runEffectsBench() {
+  printBenchHeader("effects");
+
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds);
+    Framebuffer16 fb = {pixels.data(), leds};
+
+    RainbowState rainbow;
+    FireEngine fire;
+    MeteorState meteor;
+    KittState kitt;
+    const Rgb solid = unpackColor(0x3080FF);
+
+    BenchResult r;
+    r = benchFrames([&] { rainbowEffect(fb, rainbow, kFrameUs); });
+    printBenchRow("rainbow", leds, r);
+    r = benchFrames([&] { fire.render(fb); });
+    printBenchRow("fire", leds, r);
+    r = benchFrames([&] { meteorEffect(fb, meteor, kFrameUs); });
+    printBenchRow("meteor", leds, r);
+    r = benchFrames([&] { kittEffect(fb, kitt, kFrameUs); });
+    printBenchRow("kitt", leds, r);
+    r = benchFrames([&] { solidColorEffect(fb, solid); });
+    printBenchRow("solid", leds, r);
+
+    benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Fire kernel: the original per-LED random()/float implementation against
+// FireEngine, single flame and split into segments. The engine has to be at
+// least 10x cheaper per LED from kFireGoalLeds up. Below that, the default
+// 144-LED strip included, the fixed cost of a frame (cooling streams, block
+// setup, the spark) and the bench's clock read are a large share of the
+// total. That case is reported against the goal and held to
+// kFireShortFloor, so a regression still fails.
+
+#include <math.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "FireEngine.h"
+#include "LedPlatform.h"
+
+// The fire effect as it shipped in main.cpp, kept here as the baseline
+static void legacyFireEffect(Framebuffer& fb, std::vector<uint8_t>& heatCells) {
+  const int numLeds = fb.count;
+  uint8_t* heat = heatCells.data();
+
+  for(int i = 0; i < numLeds; i++) {
+    int cooling = heat[i] - random(0, ((55 * 10) / numLeds) + 2);
+    heat[i] = (cooling < 0) ? 0 : cooling;
+  }
+  for(int k = numLeds - 1; k >= 2; k--) {
+    heat[k] = (heat[k - 1] + heat[k - 2] + heat[k - 2]) / 3;
+  }
+  if(random(255) < 120) {
+    int y = random(7);
+    int heating = heat[y] + random(160, 255);
+    heat[y] = (heating > 255) ? 255 : heating;
+  }
+  for(int j = 0; j < numLeds; j++) {
+    uint8_t temperature = heat[j];
+    uint8_t t192 = round((temperature / 255.0) * 191);
+    uint8_t heatramp = (t192 & 0x3F) << 2;
+    if(t192 > 0x80) {
+      fb.pixels[j] = Rgb{255, 255, heatramp};
+    } else if(t192 > 0x40) {
+      fb.pixels[j] = Rgb{255, heatramp, 0};
+    } else {
+      fb.pixels[j] = Rgb{heatramp, 0, 0};
+    }
+  }
+}
+
+static const uint32_t kFireGoalLeds = 1000;
+static const double kFireGoal = 10;
+static const double kFireShortFloor = 5;
+
+int runFireBench() {
+  printBenchHeader("fire");
+  int failures = 0;
+
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb> legacyPixels(leds);
+    Framebuffer legacyFb = {legacyPixels.data(), leds};
+    std::vector<Rgb16> pixels(leds);
+    Framebuffer16 fb = {pixels.data(), leds};
+
+    std::vector<uint8_t> legacyHeat(leds, 0);
+    FireEngine single;
+    single.begin(leds, 1);
+    BenchResult legacy = {}, engine = {};
+    bestOfPair([&] { legacyFireEffect(legacyFb, legacyHeat); }, [&] { single.render(fb); }, legacy, engine, 15,
+               0.02);
+    printBenchRow("legacy", leds, legacy);
+    printBenchRow("engine 1 flame", leds, engine);
+
+    FireEngine split;
+    split.begin(leds, 8, true);
+    BenchResult segmented = benchFrames([&] { split.render(fb); });
+    printBenchRow("engine 8 flames", leds, segmented);
+
+    const double speedup = legacy.nsPerFrame / engine.nsPerFrame;
+    const double floor = leds >= kFireGoalLeds ? kFireGoal : kFireShortFloor;
+    printf("%-24s %8u %13.1fx", "speedup (1 flame)", (unsigned)leds, speedup);
+    if(speedup < floor) {
+      printf("  FAIL, under %.0fx\n", floor);
+      failures++;
+    } else if(speedup < kFireGoal) {
+      printf("  short strip, under the %.0fx goal\n", kFireGoal);
+    } else {
+      printf("\n");
+    }
+    benchConsume(legacyPixels.data(), legacyPixels.size() * sizeof(Rgb));
+    benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+  }
+  return failures ? 1 : 0;
+}
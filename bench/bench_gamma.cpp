@@ -0,0 +1,131 @@
+// Corrected output stage: cost of the fused gamma + brightness + dither
+// pass against the original per-pixel setPixelColor() path and the plain
+// linear output pass, plus how well each reproduces a dark gradient and
+// that full scale reaches 255.
+
+#include <math.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "LegacyStrip.h"
+#include "PixelKernels.h"
+
+// What the sketch did before the 16-bit frame: per pixel, pack the 8-bit
+// color and let Adafruit scale it by brightness in setPixelColor()
+static void legacyOutput(LegacyStrip& strip, const Framebuffer16& fb) {
+  for(uint32_t i = 0; i < fb.count; i++) {
+    strip.setPixelColor(i, fb.pixels[i].r >> 8, fb.pixels[i].g >> 8, fb.pixels[i].b >> 8);
+  }
+}
+
+// Exact 8-bit output level the gamma stage aims for
+static double idealLevel(uint16_t v, uint8_t brightness) {
+  double scale = (brightness + (brightness >> 7)) / 256.0;
+  return pow(v / 65535.0, 2.2) * 255 * scale;
+}
+
+// A dark-to-mid gradient over 1000 LEDs at night brightness. Compare the
+// time-averaged output over 256 frames with the ideal level: how many
+// distinct levels survive (banding) and the worst error.
+static bool gradientQuality(uint8_t brightness) {
+  const uint32_t leds = 1000;
+  std::vector<Rgb16> pixels(leds);
+  for(uint32_t i = 0; i < leds; i++) {
+    uint16_t v = (uint16_t)(i * 0x8000 / leds);
+    pixels[i] = Rgb16{v, v, v};
+  }
+  Framebuffer16 fb = {pixels.data(), leds};
+  std::vector<uint8_t> wire(leds * 3);
+
+  std::vector<double> plainSum(leds), ditherSum(leds);
+  for(int frame = 0; frame < 256; frame++) {
+    writeOutputCorrected(fb, wire.data(), brightness, kOrderRGB, true, false, frame);
+    for(uint32_t i = 0; i < leds; i++) {
+      plainSum[i] += wire[i * 3];
+    }
+    writeOutputCorrected(fb, wire.data(), brightness, kOrderRGB, true, true, frame);
+    for(uint32_t i = 0; i < leds; i++) {
+      ditherSum[i] += wire[i * 3];
+    }
+  }
+
+  int plainLevels = 0, ditherLevels = 0;
+  double plainErr = 0, ditherErr = 0, lastPlain = -1, lastDither = -1;
+  for(uint32_t i = 0; i < leds; i++) {
+    double ideal = idealLevel(pixels[i].r, brightness);
+    double plain = plainSum[i] / 256, dither = ditherSum[i] / 256;
+    plainErr = fmax(plainErr, fabs(plain - ideal));
+    ditherErr = fmax(ditherErr, fabs(dither - ideal));
+    plainLevels += plain != lastPlain;
+    ditherLevels += dither != lastDither;
+    lastPlain = plain;
+    lastDither = dither;
+  }
+  printf("%-24s %8u %10d %10.3f %10d %10.3f\n", "gradient 0-50%", (unsigned)brightness, plainLevels, plainErr,
+         ditherLevels, ditherErr);
+  // The dithered average must be within 1/256 of the ideal (table rounding)
+  return ditherErr < 0.05;
+}
+
+// Full white at full brightness goes out as 255 in every mode, and black
+// stays 0 under dithering
+static bool checkFullScale() {
+  Rgb16 pixels[2] = {{0xFFFF, 0xFFFF, 0xFFFF}, {0, 0, 0}};
+  Framebuffer16 fb = {pixels, 2};
+  uint8_t wire[6];
+  bool ok = true;
+  for(int mode = 0; mode < 4; mode++) {
+    for(int frame = 0; frame < 256; frame++) {
+      writeOutputCorrected(fb, wire, 255, kOrderRGB, mode & 1, mode & 2, frame);
+      for(int c = 0; c < 3; c++) {
+        ok &= wire[c] == 255 && wire[3 + c] == 0;
+      }
+    }
+  }
+  printf("%-24s %s\n", "full scale 0xFFFF -> 255", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int runGammaBench() {
+  printBenchHeader("gamma output stage");
+  int failures = 0;
+
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds);
+    for(uint32_t i = 0; i < leds; i++) {
+      pixels[i] = Rgb16{(uint16_t)(i * 37), (uint16_t)(i * 101), (uint16_t)(i * 7)};
+    }
+    Framebuffer16 fb = {pixels.data(), leds};
+    std::vector<uint8_t> wire(leds * 3);
+    LegacyStrip legacy(leds);
+    legacy.setBrightness(64);
+
+    BenchResult r = benchFrames([&] { legacyOutput(legacy, fb); });
+    printBenchRow("setPixelColor path", leds, r);
+    r = benchFrames([&] { writeOutput(fb, wire.data(), 64, kOrderGRB); });
+    printBenchRow("linear output", leds, r);
+    r = benchFrames([&] { writeOutputCorrected(fb, wire.data(), 64, kOrderGRB, true, false, 0); });
+    printBenchRow("gamma", leds, r);
+    uint8_t frame = 0;
+    r = benchFrames([&] { writeOutputCorrected(fb, wire.data(), 64, kOrderGRB, true, true, frame++); });
+    printBenchRow("gamma + dither", leds, r);
+    // Has to keep up with 240 fps at 10k LEDs with most of the frame to spare
+    if(leds == 10000 && r.nsPerFrame > 1e9 / 240 / 10) {
+      printf("gamma + dither too slow for 10k LEDs at 240 fps\n");
+      failures++;
+    }
+
+    benchConsume(legacy.pixels.data(), legacy.pixels.size());
+    benchConsume(wire.data(), wire.size());
+  }
+
+  printf("\n%-24s %8s %10s %10s %10s %10s\n", "quality (256 frames)", "bright", "gamma lvls", "max err", "dith lvls",
+         "max err");
+  failures += !gradientQuality(8);
+  failures += !gradientQuality(32);
+  failures += !gradientQuality(128);
+  printf("\n");
+  failures += !checkFullScale();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+// Idle frames: a scripted 30 s session on a virtual clock, run through the
+// same frame decisions as the render task (IdleGovernor, the registry's
+// still() flags, TransitionEngine, LedOutput with gamma and dithering).
+// Rainbow, then Solid, a color change while asleep, Off, a brightness change
+// while asleep and Rainbow again; each event is a touch that the UI loop
+// picks up at its next poll. Real host time is spent on the work, virtual
+// time on the waits. The same session with every frame rendered is the
+// baseline.
+//
+// Checks that every static stretch stops rendering and sending, that what
+// is left on the strip while asleep is the undithered frame, and that a
+// wake renders within a frame period of the command.
+
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "EffectRegistry.h"
+#include "FrameScheduler.h"
+#include "IdleGovernor.h"
+#include "LedOutput.h"
+#include "PixelKernels.h"
+#include "TransitionEngine.h"
+
+static const uint32_t kSleepAfterUs = 2000000;
+static const uint32_t kTickUs = 100000;      // Low-power tick
+static const uint32_t kPollUs = 5000;        // UI touch polling, awake
+static const uint32_t kIdlePollUs = 20000;   // and asleep
+static const uint32_t kSessionUs = 30000000;
+
+template <uint32_t N>
+using IdleEffects = EffectRegistry<N, RainbowDef, OffDef, SolidDef>;
+
+enum EventKind { EVENT_EFFECT, EVENT_COLOR, EVENT_BRIGHTNESS };
+
+struct SessionEvent {
+  uint32_t touchUs;
+  EventKind kind;
+  uint32_t value;
+};
+
+static const SessionEvent kSession[] = {
+  {4000000, EVENT_COLOR, 0x3080FF},  // Swatch: color, then Solid
+  {4000000, EVENT_EFFECT, 2},
+  {10000000, EVENT_COLOR, 0xFF4010},
+  {16000000, EVENT_EFFECT, 1},       // Off
+  {22000000, EVENT_BRIGHTNESS, 40},
+  {26000000, EVENT_EFFECT, 0},       // Rainbow
+};
+static const int kEvents = sizeof(kSession) / sizeof(kSession[0]);
+
+struct SessionResult {
+  IdleStats idle;
+  uint32_t sent = 0;
+  uint64_t busyUs = 0;
+  uint32_t maxTouchUs = 0;  // Touch to the first frame rendered after it
+  uint64_t totalTouchUs = 0;
+  uint32_t touches = 0;
+  bool settledOk = true;    // Strip shows the undithered frame while asleep
+  bool staticOk = true;     // Nothing rendered or sent once asleep
+};
+
+template <uint32_t N>
+static SessionResult runSession(bool skipIdle) {
+  IdleEffects<N> effects;
+  TransitionEngine transitions;
+  transitions.begin(N, IdleEffects<N>::renderFn, &effects);
+  MockTransmitter mock;
+  mock.setTimeScale(0);
+  LedOutput output;
+  output.begin(mock, N, kOrderGRB);
+  output.setCorrection(true, true);
+  FrameScheduler scheduler;
+  IdleGovernor governor;
+  uint8_t brightness = 200;
+
+  using clock = std::chrono::steady_clock;
+  SessionResult result;
+  uint32_t now = 0;
+  scheduler.begin(now, 60);
+  governor.begin(now, kSleepAfterUs);
+  const Framebuffer16* frame = &transitions.render(0);
+  bool ditherVisible = true;
+  int nextEvent = 0;
+  uint32_t commandUs = 0;   // UI poll that turned the latest touch into a command
+  uint32_t touchUs = 0;
+  bool touchPending = false;
+  std::vector<uint8_t> expected(N * 3);
+
+  // When the UI loop, polling every pollUs, sees a touch at t
+  auto polledAt = [](uint32_t t, uint32_t pollUs) { return (t + pollUs - 1) / pollUs * pollUs; };
+  auto eventDueUs = [&](int i) {
+    return polledAt(kSession[i].touchUs, governor.asleep() ? kIdlePollUs : kPollUs);
+  };
+
+  while(now < kSessionUs) {
+    if(scheduler.frameDue(now)) {
+      const auto start = clock::now();
+      bool commands = false;
+      while(nextEvent < kEvents && eventDueUs(nextEvent) <= now) {
+        const SessionEvent& e = kSession[nextEvent++];
+        if(!touchPending) {
+          touchUs = e.touchUs;
+          touchPending = true;
+        }
+        commandUs = eventDueUs(nextEvent - 1);
+        commands = true;
+        if(e.kind == EVENT_EFFECT) {
+          effects.onSelect(e.value);
+          transitions.select(e.value);
+        } else if(e.kind == EVENT_COLOR) {
+          effects.template state<SolidDef>().color = toRgb16(unpackColor(e.value));
+        } else {
+          brightness = e.value;
+        }
+      }
+      FrameWork work = FRAME_RENDER;
+      if(skipIdle) {
+        if(commands) {
+          governor.request(commandUs);
+        }
+        const bool dirty = commands || transitions.transitioning() || !effects.still(transitions.effect()) ||
+                           !output.limitSettled();
+        work = governor.frame(now, dirty, ditherVisible);
+      }
+      const uint32_t sentBefore = output.framesPresented();
+      switch(work) {
+        case FRAME_RENDER:
+          frame = &transitions.render(scheduler.frameDeltaUs());
+          output.encode(*frame, brightness);
+          output.present();
+          ditherVisible = true;
+          break;
+        case FRAME_REFRESH:
+          output.encode(*frame, brightness);
+          if(output.encodedUnchanged()) {
+            ditherVisible = false;
+          } else {
+            output.present();
+          }
+          break;
+        case FRAME_SETTLE:
+          output.setCorrection(true, false);
+          output.encode(*frame, brightness);
+          output.present();
+          output.setCorrection(true, true);
+          break;
+        case FRAME_SKIP:
+          break;
+      }
+      output.waitDone();
+      const uint32_t workUs =
+          1 + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+      if(governor.asleep() && work != FRAME_SETTLE && (work != FRAME_SKIP || output.framesPresented() != sentBefore)) {
+        result.staticOk = false;
+      }
+      now += workUs;
+      result.busyUs += workUs;
+      if(work == FRAME_RENDER) {
+        if(skipIdle) {
+          governor.frameRendered(now);
+        }
+        if(touchPending) {
+          const uint32_t latency = now - touchUs;
+          result.totalTouchUs += latency;
+          result.maxTouchUs = latency > result.maxTouchUs ? latency : result.maxTouchUs;
+          result.touches++;
+          touchPending = false;
+        }
+      }
+      scheduler.frameDone(now);
+    }
+
+    if(skipIdle && governor.asleep()) {
+      // What stays up must be the frame without dithering
+      writeOutputCorrected(*frame, expected.data(), output.limitedBrightness(), kOrderGRB, true, false, 0);
+      if(memcmp(output.frontPixels(), expected.data(), N * 3) != 0) {
+        result.settledOk = false;
+      }
+      // Block until the tick is up or a command arrives
+      uint32_t wake = now + kTickUs;
+      if(nextEvent < kEvents && eventDueUs(nextEvent) < wake) {
+        wake = eventDueUs(nextEvent) > now ? eventDueUs(nextEvent) : now;
+      }
+      governor.idle(wake - now);
+      now = wake;
+      scheduler.resume(now);
+      continue;
+    }
+    const uint32_t idleUs = scheduler.usUntilNextFrame(now);
+    governor.idle(idleUs);
+    now += idleUs;
+  }
+  result.sent = output.framesPresented();
+  if(skipIdle) {
+    result.idle = governor.stats();
+  } else {
+    // Not consulted: every slot rendered and sent, the rest spent waiting
+    result.idle.frames = result.idle.rendered = result.sent;
+    result.idle.idleUs = now - result.busyUs;
+    result.idle.elapsedUs = now;
+  }
+  return result;
+}
+
+static void printSession(const char* name, uint32_t leds, const SessionResult& r) {
+  printf("%-14s %6u %7u %8u %9u %7u %6u %7.2f%% %7.1f %7u %7u/%-7u %7u/%-7u\n", name, (unsigned)leds,
+         (unsigned)r.idle.frames, (unsigned)r.idle.rendered, (unsigned)r.idle.refreshed, (unsigned)r.idle.skipped,
+         (unsigned)r.sent, 100.0 * r.idle.idleFraction(), r.busyUs / (kSessionUs / 1e6) / 1000.0,
+         (unsigned)r.idle.wakeups, (unsigned)r.idle.avgWakeUs(), (unsigned)r.idle.maxWakeUs,
+         (unsigned)(r.touches ? r.totalTouchUs / r.touches : 0), (unsigned)r.maxTouchUs);
+}
+
+template <uint32_t N>
+static int runAt() {
+  int failures = 0;
+  SessionResult baseline = runSession<N>(false);
+  SessionResult idle = runSession<N>(true);
+  printSession("every frame", N, baseline);
+  printSession("skip idle", N, idle);
+
+  const uint32_t periodUs = 1000000 / 60;
+  if(!idle.staticOk || !idle.settledOk) {
+    printf("%u LEDs: %s\n", (unsigned)N, !idle.staticOk ? "frames rendered or sent while asleep"
+                                                        : "strip does not hold the undithered frame while asleep");
+    failures++;
+  }
+  // Four sleeps (Solid, Solid in the new color, Off, Off at the new
+  // brightness), each ended by the next touch
+  if(idle.idle.sleeps != 4 || idle.idle.wakeups != 4) {
+    printf("%u LEDs: %u sleeps, %u wakeups, expected 4 each\n", (unsigned)N, (unsigned)idle.idle.sleeps,
+           (unsigned)idle.idle.wakeups);
+    failures++;
+  }
+  if(idle.idle.maxWakeUs > periodUs || idle.maxTouchUs > kIdlePollUs + periodUs) {
+    printf("%u LEDs: waking takes too long\n", (unsigned)N);
+    failures++;
+  }
+  // Rainbow runs 8 of the 30 s; nearly everything else should be skipped
+  if(idle.idle.rendered > baseline.idle.rendered / 2 || idle.sent > baseline.sent / 2) {
+    printf("%u LEDs: static stretches still render\n", (unsigned)N);
+    failures++;
+  }
+  return failures;
+}
+
+int runIdleBench() {
+  printf("\n== idle ==\n");
+  printf("%-14s %6s %7s %8s %9s %7s %6s %8s %7s %7s %15s %15s\n", "session", "leds", "slots", "rendered",
+         "refreshed", "skipped", "sent", "idle", "busy/s", "wakeups", "wake us avg/max", "touch us avg/max");
+  int failures = 0;
+  failures += runAt<144>();
+  failures += runAt<10000>();
+  return failures ? 1 : 0;
+}
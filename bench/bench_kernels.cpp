@@ -0,0 +1,96 @@
+// Fade + output cost and trail quality: the original 8-bit path (fade by
+// reading back Adafruit's brightness-scaled pixel buffer, float multiply,
+// setPixelColor) against the Framebuffer16 kernels with a single output pass.
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "LegacyStrip.h"
+#include "PixelKernels.h"
+
+static void legacyFade(LegacyStrip& strip, uint32_t n, float factor) {
+  for(uint32_t i = 0; i < n; i++) {
+    uint32_t color = strip.getPixelColor(i);
+    uint8_t r = (color >> 16) & 0xFF;
+    uint8_t g = (color >> 8) & 0xFF;
+    uint8_t b = color & 0xFF;
+    strip.setPixelColor(i, r * factor, g * factor, b * factor);
+  }
+}
+
+// Follow one full-white pixel fading at 0.85/frame (the meteor tail) and
+// report how many frames it stays lit and how many distinct output levels it
+// passes through on the way down.
+static void traceTrail(uint8_t brightness) {
+  LegacyStrip legacy(1);
+  legacy.setBrightness(brightness);
+  legacy.setPixelColor(0, 255, 255, 255);
+
+  Rgb16 px = toRgb16(Rgb{255, 255, 255});
+  Framebuffer16 fb = {&px, 1};
+  uint8_t out[3];
+
+  int legacyFrames = 0, legacyLevels = 0, newFrames = 0, newLevels = 0;
+  int lastLegacy = -1, lastNew = -1;
+  for(int frame = 0; frame < 400; frame++) {
+    uint8_t l = legacy.pixels[1];
+    writeOutput(fb, out, brightness, kOrderGRB);
+    uint8_t v = out[1];
+
+    if(l) legacyFrames = frame + 1;
+    if(v) newFrames = frame + 1;
+    if(l != lastLegacy) { legacyLevels++; lastLegacy = l; }
+    if(v != lastNew) { newLevels++; lastNew = v; }
+
+    legacyFade(legacy, 1, 0.85f);
+    fadeFrame(fb, fadeScale(0.85f));
+  }
+  printf("%-24s %8u %11d/%-4d %12d/%-4d\n", "trail 0.85", (unsigned)brightness,
+         legacyFrames, legacyLevels, newFrames, newLevels);
+}
+
+int runKernelsBench() {
+  printBenchHeader("kernels");
+
+  for(uint32_t leds : kBenchLedCounts) {
+    LegacyStrip legacy(leds);
+    legacy.setBrightness(64);
+    for(uint32_t i = 0; i < leds; i++) {
+      legacy.setPixelColor(i, 200, 100, 50);
+    }
+    BenchResult r = benchFrames([&] { legacyFade(legacy, leds, 0.85f); });
+    printBenchRow("legacy fade", leds, r);
+
+    std::vector<Rgb16> pixels(leds, toRgb16(Rgb{200, 100, 50}));
+    std::vector<Rgb16> other(leds, toRgb16(Rgb{10, 20, 30}));
+    std::vector<uint8_t> wire(leds * 3);
+    Framebuffer16 fb = {pixels.data(), leds};
+    Framebuffer16 fbOther = {other.data(), leds};
+
+    r = benchFrames([&] { fadeFrame(fb, fadeScale(0.85f)); });
+    printBenchRow("fade16", leds, r);
+    r = benchFrames([&] { writeOutput(fb, wire.data(), 64, kOrderGRB); });
+    printBenchRow("output pass", leds, r);
+    r = benchFrames([&] {
+      fadeFrame(fb, fadeScale(0.85f));
+      writeOutput(fb, wire.data(), 64, kOrderGRB);
+    });
+    printBenchRow("fade16 + output", leds, r);
+    r = benchFrames([&] { addChannels(fb.channels(), fbOther.channels(), fb.channelCount()); });
+    printBenchRow("add16", leds, r);
+    r = benchFrames([&] {
+      blendChannels(fb.channels(), fb.channels(), fbOther.channels(), fb.channelCount(), 0x4000);
+    });
+    printBenchRow("blend16", leds, r);
+
+    benchConsume(legacy.pixels.data(), legacy.pixels.size());
+    benchConsume(wire.data(), wire.size());
+  }
+
+  printf("\n%-24s %8s %16s %17s\n", "quality", "bright", "legacy lit/levels", "16-bit lit/levels");
+  traceTrail(8);
+  traceTrail(32);
+  traceTrail(128);
+  traceTrail(255);
+  return 0;
+}
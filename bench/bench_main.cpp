@@ -0,0 +1,77 @@
+// Host benchmark runner for the LED engine.
+//
+//   pio run -e native && .pio/build/native/program [suite ...]
+//
+// With no arguments every suite runs in order.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "BenchUtil.h"
+
+struct BenchSuite {
+  const char* name;
+  const char* description;
+  int (*run)();
+};
+
+static const BenchSuite suites[] = {
+  {"effects", "per-effect render cost at 144/1k/10k/100k LEDs", runEffectsBench},
+  {"particles", "particle pool: bookkeeping, no heap per frame, cost per live particle", runParticlesBench},
+  {"fire", "legacy fire kernel vs FireEngine (1 and 8 flames)", runFireBench},
+  {"kernels", "16-bit fade/add/blend/output kernels vs 8-bit path, trail quality", runKernelsBench},
+  {"gamma", "fused gamma/brightness/dither output pass vs setPixelColor path", runGammaBench},
+  {"palette", "compile-time palette LUTs vs Wheel()/sin(), rainbow cost", runPaletteBench},
+  {"output", "double-buffered LedOutput vs blocking show() on MockTransmitter", runOutputBench},
+  {"lanes", "multi-lane output: parallel refresh and per-lane color order", runLanesBench},
+  {"map", "logical-to-physical pixel maps at 64x64: layouts, gaps, output-pass cost", runMapBench},
+  {"power", "current estimate and limiter: budget, recovery, output-pass cost", runPowerBench},
+  {"preview", "downsampled display preview of the presented frame", runPreviewBench},
+  {"registry", "compile-time effect registry vs runtime-sized kernels, parameters", runRegistryBench},
+  {"transition", "effect crossfades vs two effect frames plus a blend", runTransitionBench},
+  {"stream", "DDP/E1.31 UDP input: reassembly, stale drops, latency, packets/s", runStreamBench},
+  {"audio", "fixed-point FFT, bands and beats from WAV input, cost per audio hop", runAudioBench},
+  {"anim", "recorded animations: compression ratio, decode throughput, seek", runAnimBench},
+  {"scheduler", "frame pacing and load-independent animation on a virtual clock", runSchedulerBench},
+  {"idle", "idle-frame skipping and low-power sleep over a scripted session", runIdleBench},
+  {"profile", "stage profiler: timing cost, histogram p99 accuracy, concurrent rings", runProfileBench},
+  {"queue", "UI->render command queue stress test under contention", runQueueBench},
+  {"serial", "binary USB serial protocol: parser, batching, frame push over a pty", runSerialBench},
+  {"boot", "saved settings write coalescing, time to first LED frame, UI image codec", runBootBench},
+};
+
+static const int numSuites = sizeof(suites) / sizeof(suites[0]);
+
+static void printUsage(const char* argv0) {
+  printf("usage: %s [suite ...]\n\nsuites:\n", argv0);
+  for(int i = 0; i < numSuites; i++) {
+    printf("  %-12s %s\n", suites[i].name, suites[i].description);
+  }
+}
+
+int main(int argc, char** argv) {
+  int failures = 0;
+
+  if(argc < 2) {
+    for(int i = 0; i < numSuites; i++) {
+      failures += suites[i].run() != 0;
+    }
+    return failures ? 1 : 0;
+  }
+
+  for(int a = 1; a < argc; a++) {
+    const BenchSuite* suite = nullptr;
+    for(int i = 0; i < numSuites; i++) {
+      if(strcmp(argv[a], suites[i].name) == 0) {
+        suite = &suites[i];
+        break;
+      }
+    }
+    if(suite == nullptr) {
+      printUsage(argv[0]);
+      return 2;
+    }
+    failures += suite->run() != 0;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,238 @@
+// Pixel maps: a 64x64 matrix and strips folded, mirrored and with gaps. For
+// each layout the mapped output pass must send exactly the bytes the direct
+// pass sends for a frame rearranged by hand into wire order (worked out here
+// from the wiring, not from the table), also through LedOutput on four
+// lanes. Then the cost: the mapped pass against the direct pass over the
+// same number of LEDs, and against remapping into a second buffer first
+// (two passes).
+
+#include <string.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "LedOutput.h"
+#include "PixelKernels.h"
+#include "PixelMap.h"
+
+static const uint16_t kSide = 64;
+static const uint32_t kMatrixLeds = kSide * kSide;
+
+static_assert(pixelMapSize("64x64:s").logical == 4096 && pixelMapSize("64x64:s").physical == 4096, "matrix");
+static_assert(pixelMapSize("0-71,71-0").logical == 72 && pixelMapSize("0-71,71-0").physical == 144, "mirror");
+static_assert(pixelMapSize("0-9,gap:4,10-19").logical == 20 && pixelMapSize("0-9,gap:4,10-19").physical == 24, "gap");
+static_assert(pixelMapSize("8x8:q").physical == 0 && pixelMapSize("0-").physical == 0 &&
+              pixelMapSize("gap:0").physical == 0 && pixelMapSize("").physical == 0, "invalid maps");
+
+struct MapCase {
+  const char* name;
+  const char* spec;
+  // Logical pixel on wire LED p, or PixelMap::kGap, from the wiring
+  std::function<uint32_t(uint32_t)> expected;
+};
+
+static const MapCase kCases[] = {
+  {"rows", "64x64", [](uint32_t p) { return p; }},
+  {"serpentine", "64x64:s",
+   [](uint32_t p) {
+     const uint32_t y = p / kSide, x = p % kSide;
+     return y * kSide + (y & 1 ? kSide - 1 - x : x);
+   }},
+  // Columns, zig-zag, starting bottom right
+  {"columns, flipped", "64x64:scxy",
+   [](uint32_t p) {
+     const uint32_t column = p / kSide, k = p % kSide;
+     const uint32_t y = column & 1 ? k : kSide - 1 - k;
+     return y * kSide + (kSide - 1 - column);
+   }},
+  // One 2048-pixel effect running out from the middle both ways
+  {"mirrored", "2047-0,0-2047", [](uint32_t p) { return p < 2048 ? 2047 - p : p - 2048; }},
+  // Four reversed segments with 32 dark LEDs between them
+  {"reversed + gaps", "1000-0,gap:32,2001-1001,gap:32,3002-2002,gap:32,3999-3003",
+   [](uint32_t p) {
+     const uint32_t starts[4] = {0, 1033, 2066, 3099}, firsts[4] = {1000, 2001, 3002, 3999};
+     for(int s = 3; s >= 0; s--) {
+       if(p >= starts[s]) {
+         const uint32_t k = p - starts[s];
+         const uint32_t length = firsts[s] - (s ? firsts[s - 1] : (uint32_t)-1);
+         return k < length ? firsts[s] - k : PixelMap::kGap;
+       }
+     }
+     return PixelMap::kGap;
+   }},
+};
+
+// Logical frame with every pixel distinct
+static void fillLogical(std::vector<Rgb16>& pixels) {
+  for(uint32_t i = 0; i < pixels.size(); i++) {
+    pixels[i] = Rgb16{(uint16_t)(i * 16), (uint16_t)(0xFFFF - i * 7), (uint16_t)(i * 40503u)};
+  }
+}
+
+static bool checkCase(const MapCase& c) {
+  PixelMap map;
+  if(!parsePixelMap(c.spec, map) || map.physicalCount() != kMatrixLeds) {
+    printf("%s: \"%s\" does not parse to %u LEDs\n", c.name, c.spec, (unsigned)kMatrixLeds);
+    return false;
+  }
+  const PixelMapSize size = pixelMapSize(c.spec);
+  bool ok = size.logical == map.logicalCount() && size.physical == map.physicalCount();
+
+  std::vector<Rgb16> logical(map.logicalCount()), physical(kMatrixLeds);
+  fillLogical(logical);
+  for(uint32_t p = 0; p < kMatrixLeds; p++) {
+    const uint32_t l = c.expected(p);
+    physical[p] = l == PixelMap::kGap ? Rgb16{0, 0, 0} : logical[l];
+  }
+  const Framebuffer16 src = {logical.data(), (uint32_t)logical.size()};
+  const Framebuffer16 direct = {physical.data(), kMatrixLeds};
+  std::vector<PixelRun> runs;
+  map.runsFor(0, kMatrixLeds, runs);
+  std::vector<uint8_t> a(kMatrixLeds * 3), b(kMatrixLeds * 3);
+  for(int options = 0; options < 4 && ok; options++) {
+    const bool gamma = options & 1, dither = options & 2;
+    const uint32_t sumA = writeOutputCorrected(direct, a.data(), 200, kOrderGRB, gamma, dither, 7);
+    const uint32_t sumB =
+        writeOutputCorrectedMapped(src, runs.data(), runs.size(), b.data(), 200, kOrderGRB, gamma, dither, 7);
+    ok = sumA == sumB && a == b;
+  }
+  ok = ok && writeOutput(direct, a.data(), 99, kOrderRGB) ==
+                 writeOutputMapped(src, runs.data(), runs.size(), b.data(), 99, kOrderRGB) &&
+       a == b;
+
+  // Through LedOutput, the matrix split over four lanes of 16 rows
+  StripTopology topology;
+  parseTopology("1:1024:GRB,2:1024:RGB,3:1024:BRG,4:1024:GRB", topology);
+  std::unique_ptr<MockTransmitter> mocks[4];
+  LedTransmitter* transmitters[4];
+  for(int i = 0; i < 4; i++) {
+    mocks[i].reset(new MockTransmitter());
+    mocks[i]->setTimeScale(0);
+    transmitters[i] = mocks[i].get();
+  }
+  LedOutput mapped, plain;
+  mapped.begin(topology, transmitters);
+  plain.begin(topology, transmitters);
+  mapped.setCorrection(true, true);
+  plain.setCorrection(true, true);
+  ok = ok && mapped.setPixelMap(&map);
+  mapped.encode(src, 180);
+  mapped.present();
+  mapped.waitDone();
+  plain.encode(direct, 180);
+  plain.present();
+  plain.waitDone();
+  ok = ok && memcmp(mapped.frontPixels(), plain.frontPixels(), kMatrixLeds * 3) == 0;
+  printf("%-18s %-62s %4u runs %s\n", c.name, c.spec, (unsigned)runs.size(), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Builder calls and odd specs
+static bool checkBuilder() {
+  PixelMap map;
+  bool ok = !parsePixelMap("0-9,x", map) && !parsePixelMap("4x4:ss", map) && map.physicalCount() == 0;
+  ok &= parsePixelMap("3,0-2,gap:2,2x2:s", map);
+  const uint32_t expected[] = {3, 0, 1, 2, PixelMap::kGap, PixelMap::kGap, 4, 5, 7, 6};
+  ok &= map.physicalCount() == 10 && memcmp(map.table(), expected, sizeof(expected)) == 0;
+  ok &= map.logicalCount() == 8 && map.width() == 2 && map.height() == 2 && map.xy(1, 1) == 7;
+  // 3; 0; 1-2; gap; 4-5; 7-6 (the pair 3, 0 is as evenly spaced as any)
+  std::vector<PixelRun> runs;
+  map.runsFor(0, 10, runs);
+  ok &= runs.size() == 5 && runs[0].step == -3 && runs[1].first == 1 && runs[2].first == PixelMap::kGap &&
+        runs[2].length == 2 && runs[4].first == 7 && runs[4].step == -1;
+  map.runsFor(5, 2, runs);
+  ok &= runs.size() == 2 && runs[0].first == PixelMap::kGap && runs[0].length == 1 && runs[1].first == 4;
+
+  map.setIdentity(5);
+  ok &= map.physicalCount() == 5 && map.table()[4] == 4 && map.width() == 5 && map.height() == 1;
+
+  // A short frame leaves the LEDs past its end dark, whichever way the run
+  // goes
+  map.runsFor(0, 5, runs);
+  Rgb16 white[2] = {{0xFFFF, 0xFFFF, 0xFFFF}, {0xFFFF, 0xFFFF, 0xFFFF}};
+  uint8_t wire[15];
+  ok &= writeOutputMapped(Framebuffer16{white, 2}, runs.data(), runs.size(), wire, 255, kOrderRGB) == 6 * 255;
+  parsePixelMap("4-0", map);
+  map.runsFor(0, 5, runs);
+  ok &= writeOutputCorrectedMapped(Framebuffer16{white, 2}, runs.data(), runs.size(), wire, 255, kOrderRGB, true,
+                                   true, 0) == 6 * 255 &&
+        wire[12] == 255 && wire[8] == 0;
+  printf("%-18s %-72s %s\n", "builder", "table entries, runs, xy(), short frames", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int runMapBench() {
+  printBenchHeader("map");
+  int failures = 0;
+  for(const MapCase& c : kCases) {
+    failures += !checkCase(c);
+  }
+  failures += !checkBuilder();
+
+  PixelMap map;
+  parsePixelMap("64x64:s", map);
+  std::vector<PixelRun> runs;
+  map.runsFor(0, kMatrixLeds, runs);
+  std::vector<Rgb16> logical(kMatrixLeds), physical(kMatrixLeds);
+  Framebuffer16 src = {logical.data(), kMatrixLeds};
+  Framebuffer16 remapped = {physical.data(), kMatrixLeds};
+  RainbowState rainbow;
+  rainbowEffect(src, rainbow, 16667);
+  std::vector<uint8_t> wire(kMatrixLeds * 3);
+  volatile uint32_t sink = 0;
+
+  struct Mode {
+    const char* name;
+    bool gamma, dither;
+  };
+  for(const Mode& mode : {Mode{"plain", false, false}, Mode{"corrected", true, true}}) {
+    BenchResult direct = {}, mapped = {}, twoPass = {}, unused = {};
+    auto directPass = [&] {
+      sink = mode.gamma ? writeOutputCorrected(src, wire.data(), 200, kOrderGRB, true, true, 3)
+                        : writeOutput(src, wire.data(), 200, kOrderGRB);
+      benchConsume(wire.data(), wire.size());
+    };
+    bestOfPair(directPass,
+               [&] {
+                 sink = mode.gamma ? writeOutputCorrectedMapped(src, runs.data(), runs.size(), wire.data(), 200,
+                                                                kOrderGRB, true, true, 3)
+                                   : writeOutputMapped(src, runs.data(), runs.size(), wire.data(), 200, kOrderGRB);
+                 benchConsume(wire.data(), wire.size());
+               },
+               direct, mapped, 40, 0.005);
+    bestOfPair(
+        [&] {
+          const uint32_t* table = map.table();
+          for(uint32_t i = 0; i < kMatrixLeds; i++) {
+            physical[i] = logical[table[i]];
+          }
+          sink = mode.gamma ? writeOutputCorrected(remapped, wire.data(), 200, kOrderGRB, true, true, 3)
+                            : writeOutput(remapped, wire.data(), 200, kOrderGRB);
+          benchConsume(wire.data(), wire.size());
+        },
+        directPass, twoPass, unused);
+    char label[40];
+    snprintf(label, sizeof(label), "%s, direct", mode.name);
+    printBenchRow(label, kMatrixLeds, direct);
+    snprintf(label, sizeof(label), "%s, mapped", mode.name);
+    printBenchRow(label, kMatrixLeds, mapped);
+    snprintf(label, sizeof(label), "%s, two passes", mode.name);
+    printBenchRow(label, kMatrixLeds, twoPass);
+
+    const double overhead = mapped.nsPerFrame / direct.nsPerFrame - 1;
+    printf("%-24s %8u %13.1f%%\n", "map overhead", (unsigned)kMatrixLeds, overhead * 100);
+    // The corrected pass is what runs on the device. A serpentine matrix is
+    // 64 runs, half of them backwards, and what they cost on the host is
+    // mostly a mispredicted loop exit each (a few percent); anything past
+    // that means the runs went per-LED.
+    if(mode.gamma && (overhead > 0.15 || mapped.nsPerFrame > twoPass.nsPerFrame)) {
+      printf("mapped output pass is measurably slower than direct\n");
+      failures++;
+    }
+  }
+  (void)sink;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// Output driver: blocking show() against the double-buffered LedOutput,
+// driven through MockTransmitter in real time. Also checks buffer handoff:
+// nothing may be written to a buffer while it is on the wire, and the last
+// frame the mock decoded must match what was encoded.
+
+#include <string.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "LedOutput.h"
+
+// Stands in for the effect compute time on the device. A sleep rather than
+// a spin so the result does not depend on the host having a spare core for
+// the mock transmitter thread.
+static void computeFor(std::chrono::nanoseconds duration) {
+  std::this_thread::sleep_for(duration);
+}
+
+struct OutputRun {
+  double fps;
+  uint32_t corrupt;
+  uint32_t overlapped;
+  bool lastFrameMatches;
+};
+
+static OutputRun runOutput(uint32_t leds, bool doubleBuffered, uint32_t frames, double computeShare) {
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 fb = {pixels.data(), leds};
+  RainbowState rainbow;
+
+  MockTransmitter tx;
+  LedOutput output;
+  output.begin(tx, leds, kOrderGRB);
+  auto compute = std::chrono::nanoseconds((uint64_t)(output.frameWireUs() * 1000 * computeShare));
+
+  auto start = std::chrono::steady_clock::now();
+  for(uint32_t f = 0; f < frames; f++) {
+    rainbowEffect(fb, rainbow, 16667);
+    computeFor(compute);
+    output.encode(fb, 200);
+    output.present();
+    if(!doubleBuffered) {
+      output.waitDone();  // What strip.show() does
+    }
+  }
+  output.waitDone();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  OutputRun run;
+  run.fps = frames / seconds;
+  run.corrupt = tx.corruptFrames();
+  run.overlapped = tx.overlappedCalls();
+  std::vector<uint8_t> sent = tx.lastFrame();
+  run.lastFrameMatches = sent.size() == leds * 3 &&
+                         memcmp(sent.data(), output.frontPixels(), sent.size()) == 0;
+  return run;
+}
+
+int runOutputBench() {
+  printf("\n== output ==\n");
+  printf("%-8s %8s %10s %12s %12s %10s %8s\n", "leds", "compute", "wire fps", "blocking", "double buf", "speedup", "handoff");
+
+  int failures = 0;
+  const uint32_t ledCounts[] = {144, 1000, 10000};
+  const double computeShares[] = {0.25, 0.5, 0.9};
+  for(uint32_t leds : ledCounts) {
+    for(double share : computeShares) {
+      MockTransmitter probeTx;
+      LedOutput probe;
+      probe.begin(probeTx, leds, kOrderGRB);
+      double wireFps = 1e6 / probe.frameWireUs();
+      uint32_t frames = leds >= 10000 ? 10 : leds >= 1000 ? 40 : 120;
+
+      OutputRun blocking = runOutput(leds, false, frames, share);
+      OutputRun buffered = runOutput(leds, true, frames, share);
+      bool ok = blocking.corrupt == 0 && buffered.corrupt == 0 && blocking.overlapped == 0 &&
+                buffered.overlapped == 0 && blocking.lastFrameMatches && buffered.lastFrameMatches;
+      failures += !ok;
+      printf("%-8u %7.0f%% %10.1f %12.1f %12.1f %9.2fx %8s\n", (unsigned)leds, share * 100, wireFps,
+             blocking.fps, buffered.fps, buffered.fps / blocking.fps, ok ? "ok" : "FAIL");
+    }
+  }
+
+  // Encoding cost alone, which now happens on the render side
+  printBenchHeader("output encode");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds, Rgb16{0x8000, 0x4000, 0xFFFF});
+    Framebuffer16 fb = {pixels.data(), leds};
+    MockTransmitter tx;
+    LedOutput output;
+    output.begin(tx, leds, kOrderGRB);
+    BenchResult r = benchFrames([&] { output.encode(fb, 128); });
+    printBenchRow("encode ws2812", leds, r);
+  }
+  return failures ? 1 : 0;
+}
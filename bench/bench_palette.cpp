@@ -0,0 +1,93 @@
+// Palette LUTs: checks the compile-time tables reproduce the old per-pixel
+// Wheel() and the sin() swatch colors exactly, that the LUT rainbow matches
+// the old divide-per-pixel version bit for bit, and compares their cost.
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "Palette.h"
+
+// The rainbow effect before palettes: a branchy Wheel() and a division per
+// pixel
+static Rgb legacyWheel(uint8_t WheelPos) {
+  WheelPos = 255 - WheelPos;
+  if(WheelPos < 85) {
+    return Rgb{(uint8_t)(255 - WheelPos * 3), 0, (uint8_t)(WheelPos * 3)};
+  }
+  if(WheelPos < 170) {
+    WheelPos -= 85;
+    return Rgb{0, (uint8_t)(WheelPos * 3), (uint8_t)(255 - WheelPos * 3)};
+  }
+  WheelPos -= 170;
+  return Rgb{(uint8_t)(WheelPos * 3), (uint8_t)(255 - WheelPos * 3), 0};
+}
+
+static void legacyRainbow(Framebuffer16& fb, uint32_t offset) {
+  for(uint32_t i = 0; i < fb.count; i++) {
+    int pixelHue = ((i * 256 / fb.count) + offset) & 255;
+    fb.pixels[i] = toRgb16(legacyWheel(pixelHue));
+  }
+}
+
+static bool sameRgb(Rgb a, Rgb b) {
+  return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+int runPaletteBench() {
+  printf("\n== palette ==\n");
+  int failures = 0;
+
+  bool wheelOk = true;
+  for(int i = 0; i < 256; i++) {
+    wheelOk &= sameRgb(kRainbowPalette.rgb[i], legacyWheel(i));
+  }
+  failures += !wheelOk;
+  printf("rainbow palette == Wheel()        %s\n", wheelOk ? "ok" : "FAIL");
+
+  bool swatchOk = true;
+  for(int i = 0; i < 8; i++) {
+    float hue = (float)i / 8;
+    Rgb expected = {(uint8_t)(sin(hue * 6.28318 + 0) * 127 + 128), (uint8_t)(sin(hue * 6.28318 + 2.094395) * 127 + 128),
+                    (uint8_t)(sin(hue * 6.28318 + 4.18879) * 127 + 128)};
+    swatchOk &= sameRgb(kSineRainbowPalette.rgb[i * 32], expected);
+  }
+  failures += !swatchOk;
+  printf("swatches == sin() colors          %s\n", swatchOk ? "ok" : "FAIL");
+
+  bool lookupOk = findPalette("Heat") == &kHeatPalette && findPalette("nope") == nullptr;
+  Rgb16 mid = samplePalette(kRainbowPalette, 0x0080);  // Half way from entry 0 to 1
+  lookupOk &= mid.r == (kRainbowPalette.rgb16[0].r + kRainbowPalette.rgb16[1].r) / 2;
+  static Palette blended;
+  blendPalettes(kRainbowPalette, kHeatPalette, 255, blended);
+  lookupOk &= memcmp(blended.rgb16.data(), kHeatPalette.rgb16.data(), sizeof(blended.rgb16)) == 0;
+  failures += !lookupOk;
+  printf("lookup, sample, blend             %s\n", lookupOk ? "ok" : "FAIL");
+
+  printBenchHeader("rainbow: Wheel() vs palette LUT");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> legacy(leds), lut(leds);
+    Framebuffer16 legacyFb = {legacy.data(), leds};
+    Framebuffer16 lutFb = {lut.data(), leds};
+
+    // Same hue offset on both sides: one frame from phase 37
+    RainbowState state;
+    state.phase = 37u << kSubPixelShift;
+    rainbowEffect(lutFb, state, 0);
+    legacyRainbow(legacyFb, 37);
+    bool same = memcmp(legacy.data(), lut.data(), leds * sizeof(Rgb16)) == 0;
+    failures += !same;
+
+    uint32_t offset = 0;
+    BenchResult r = benchFrames([&] { legacyRainbow(legacyFb, offset++); });
+    printBenchRow("Wheel()", leds, r);
+    RainbowState bench;
+    r = benchFrames([&] { rainbowEffect(lutFb, bench, 16667); });
+    printBenchRow(same ? "palette (identical)" : "palette (DIFFERS)", leds, r);
+    benchConsume(lut.data(), leds * sizeof(Rgb16));
+  }
+  return failures ? 1 : 0;
+}
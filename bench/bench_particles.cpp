@@ -0,0 +1,243 @@
+// Particle pool and the effects built on it. Checks the pool's bookkeeping
+// (spawning up to capacity, removal, lifetimes), that a particle lands where
+// its fixed-point position and velocity say, split between two LEDs and
+// added onto what is there, and that no effect touches the heap once its
+// state exists. Then the cost: update plus draw against the number of live
+// particles, which should grow in step with it whatever the capacity, and
+// every particle effect at 144/1k/10k/100k LEDs.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "ParticleEffects.h"
+
+static const uint32_t kFrameUs = 16667;
+
+// Heap allocations by anyone in the program, to catch one per frame
+static size_t heapAllocations = 0;
+
+void* operator new(size_t size) {
+  heapAllocations++;
+  if(void* p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static int32_t fixed(double leds) {
+  return (int32_t)(leds * (1 << kParticleShift));
+}
+
+static const Rgb16 kWhite = {0xFFFF, 0xFFFF, 0xFFFF};
+
+static bool checkPool() {
+  bool ok = true;
+  ParticlePool<16> pool;
+  for(int i = 0; i < 20; i++) {
+    ok &= pool.spawn(Particle{fixed(i), 0, kWhite, i < 8 ? 100000u : 0u, 0}) == (i < 16);
+  }
+  ok &= pool.full() && pool.live() == 16;
+  // Removing from the middle moves the last one in
+  pool.kill(3);
+  ok &= pool.live() == 15 && pool.pos(3) == fixed(15);
+  // Lifetimes of 100 ms: still there after 5 frames, gone after 6
+  for(int frame = 0; frame < 5; frame++) {
+    pool.update(kFrameUs);
+  }
+  ok &= pool.live() == 15;
+  pool.update(kFrameUs);
+  ok &= pool.live() == 8;
+  pool.removeIf([&](uint16_t i) { return pool.pos(i) >= fixed(12); });
+  ok &= pool.live() == 4;
+  pool.truncate(1);
+  ok &= pool.live() == 1;
+
+  // 100 LEDs per second for a second of frames, then back under drag
+  pool.clear();
+  pool.spawn(Particle{0, fixed(100), kWhite, 0, 0});
+  for(int frame = 0; frame < 60; frame++) {
+    pool.update(kFrameUs);
+  }
+  ok &= abs(pool.pos(0) - fixed(100)) < fixed(0.05);
+  pool.update(kFrameUs, ParticleForces{0, 0x8000});
+  ok &= abs(pool.vel(0) - fixed(50)) < fixed(0.01);
+  // Bouncing off the end reflects the overshoot
+  pool.pos(0) = fixed(98);
+  pool.vel(0) = fixed(300);
+  pool.update(20000);
+  pool.bounce(0, fixed(99));
+  ok &= abs(pool.pos(0) - fixed(94)) < fixed(0.01) && pool.vel(0) < 0;
+  printf("%-24s %s\n", "pool", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static bool checkDraw() {
+  bool ok = true;
+  std::vector<Rgb16> pixels(20);
+  ParticlePool<8> pool;
+  // A quarter of the way from LED 10 to 11
+  pool.spawn(Particle{fixed(10.25), 0, kWhite, 0, 0});
+  pool.draw(pixels.data(), 20u);
+  ok &= abs(pixels[10].g - 0xBFFF) < 2 && abs(pixels[11].g - 0x4000) < 2 && pixels[9].g == 0 && pixels[12].g == 0;
+  // Added on, saturating
+  pool.clear();
+  pool.spawn(Particle{fixed(3), 0, Rgb16{0x4000, 0x9000, 0}, 0, 0});
+  pool.spawn(Particle{fixed(3), 0, Rgb16{0x4000, 0x9000, 0}, 0, 0});
+  std::fill(pixels.begin(), pixels.end(), Rgb16{0, 0, 0});
+  pool.draw(pixels.data(), 20u);
+  ok &= pixels[3].r > 0x7FF0 && pixels[3].r <= 0x8000 && pixels[3].g == 0xFFFF;
+  // Tails trail the direction of travel, dimming, and clip at both ends
+  pool.clear();
+  pool.spawn(Particle{fixed(8), fixed(10), kWhite, 0, 4});
+  pool.spawn(Particle{fixed(17), fixed(-10), kWhite, 0, 6});
+  pool.spawn(Particle{fixed(1), fixed(10), kWhite, 0, 9});
+  std::fill(pixels.begin(), pixels.end(), Rgb16{0, 0, 0});
+  pool.draw(pixels.data(), 20u);
+  ok &= pixels[8].b == 0xFFFF && pixels[7].b > pixels[6].b && pixels[6].b > pixels[5].b && pixels[4].b > 0 &&
+        pixels[3].b == 0;
+  ok &= pixels[18].b > pixels[19].b && pixels[19].b > 0 && pixels[16].b == 0;
+  ok &= pixels[0].b > 0 && pixels[1].b == 0xFFFF;
+  // A dying particle dims
+  pool.clear();
+  pool.spawn(Particle{fixed(5), 0, kWhite, 200000, 0});
+  pool.update(100000);
+  std::fill(pixels.begin(), pixels.end(), Rgb16{0, 0, 0});
+  pool.draw(pixels.data(), 20u);
+  ok &= abs(pixels[5].r - 0x8000) < 0x100;
+  printf("%-24s %s\n", "draw", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Run every particle effect for 20 s of frames and count allocations
+static bool checkNoHeap() {
+  const uint32_t leds = 1000;
+  std::vector<Rgb16> pixels(leds);
+  MeteorState meteor;
+  meteor.count = kMeteorMax;
+  SparkleState sparkle;
+  sparkle.rate = 2000;
+  CometState comet;
+  comet.count = kCometMax;
+  FireworkState firework;
+  firework.launchMs = 200;
+  const size_t before = heapAllocations;
+  uint32_t peak = 0;
+  for(int frame = 0; frame < 1200; frame++) {
+    meteorKernel(pixels.data(), leds, meteor, kFrameUs);
+    sparkleKernel(pixels.data(), leds, sparkle, kFrameUs);
+    cometKernel(pixels.data(), leds, comet, kFrameUs);
+    fireworkKernel(pixels.data(), leds, firework, kFrameUs);
+    const uint32_t live = meteor.meteors.live() + sparkle.sparks.live() + comet.heads.live() + comet.dust.live() +
+                          firework.rockets.live() + firework.sparks.live();
+    peak = live > peak ? live : peak;
+  }
+  const bool ok = heapAllocations == before && peak > 1000;
+  printf("%-24s %u allocations, up to %u particles at once %s\n", "no heap per frame",
+         (unsigned)(heapAllocations - before), (unsigned)peak, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static const uint16_t kScaleCapacity = 1024;
+
+// Update and draw with live particles moving over 10k LEDs, tails of 4
+static BenchResult benchLive(ParticlePool<kScaleCapacity>& pool, std::vector<Rgb16>& pixels, uint16_t live,
+                             double seconds) {
+  pool.clear();
+  FastRandom rng;
+  for(uint16_t i = 0; i < live; i++) {
+    pool.spawn(Particle{(int32_t)rng.below(10000) << kParticleShift, fixed(50) - (int32_t)rng.below(fixed(100)),
+                        kRainbowPalette.rgb16[i & 255], 0, 4});
+  }
+  return benchFrames(
+      [&] {
+        pool.update(kFrameUs);
+        pool.wrap(0, fixed(10000));
+        pool.draw(pixels.data(), (uint32_t)pixels.size());
+        benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+      },
+      20, seconds);
+}
+
+static int benchScaling() {
+  printf("%-24s %8s %14s %12s %10s\n", "live particles", "capacity", "ns/frame", "ns/particle", "");
+  static ParticlePool<kScaleCapacity> pool;
+  std::vector<Rgb16> pixels(10000);
+  const uint16_t counts[] = {16, 128, 256, 512, 1024};
+  double best[5] = {};
+  for(int round = 0; round < 5; round++) {
+    for(int i = 0; i < 5; i++) {
+      const BenchResult r = benchLive(pool, pixels, counts[i], 0.02);
+      if(round == 0 || r.nsPerFrame < best[i]) {
+        best[i] = r.nsPerFrame;
+      }
+    }
+  }
+  for(int i = 0; i < 5; i++) {
+    printf("%-24u %8u %14.0f %12.2f\n", (unsigned)counts[i], (unsigned)kScaleCapacity, best[i], best[i] / counts[i]);
+  }
+  // Per particle, 1024 live may cost at most half again what 128 do, and
+  // 16 live must be far cheaper than a full pool: cost follows the live
+  // particles, not the capacity
+  int failures = 0;
+  if(best[4] / 1024 > 1.5 * best[1] / 128 || best[0] * 8 > best[4]) {
+    printf("particle cost does not scale with the live particles\n");
+    failures++;
+  }
+  return failures;
+}
+
+static void benchEffects() {
+  printBenchHeader("particle effects");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds);
+    Framebuffer16 fb = {pixels.data(), leds};
+    MeteorState meteor;
+    SparkleState sparkle;
+    CometState comet;
+    FireworkState firework;
+    // A few seconds in, so the pools have filled up to their usual level
+    for(int frame = 0; frame < 300; frame++) {
+      sparkleKernel(fb.pixels, leds, sparkle, kFrameUs);
+      cometKernel(fb.pixels, leds, comet, kFrameUs);
+      fireworkKernel(fb.pixels, leds, firework, kFrameUs);
+    }
+
+    char label[40];
+    BenchResult r = benchFrames([&] { meteorEffect(fb, meteor, kFrameUs); });
+    snprintf(label, sizeof(label), "meteor (%u live)", (unsigned)meteor.meteors.live());
+    printBenchRow(label, leds, r);
+    r = benchFrames([&] { sparkleKernel(fb.pixels, leds, sparkle, kFrameUs); });
+    snprintf(label, sizeof(label), "sparkle (%u live)", (unsigned)sparkle.sparks.live());
+    printBenchRow(label, leds, r);
+    r = benchFrames([&] { cometKernel(fb.pixels, leds, comet, kFrameUs); });
+    snprintf(label, sizeof(label), "comet (%u live)", (unsigned)(comet.heads.live() + comet.dust.live()));
+    printBenchRow(label, leds, r);
+    r = benchFrames([&] { fireworkKernel(fb.pixels, leds, firework, kFrameUs); });
+    snprintf(label, sizeof(label), "firework (%u live)", (unsigned)(firework.rockets.live() + firework.sparks.live()));
+    printBenchRow(label, leds, r);
+    benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+  }
+}
+
+int runParticlesBench() {
+  printf("\n== particles ==\n");
+  int failures = 0;
+  failures += !checkPool();
+  failures += !checkDraw();
+  failures += !checkNoHeap();
+  failures += benchScaling();
+  benchEffects();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+// Display preview: cost of downsampling the presented wire buffer to a
+// 600 px bar at 144/1k/10k/100k LEDs, checked against the per-update budget
+// at 10k. Also checks mixed color orders decode to the same color, that
+// columns average rather than sample, and that a read overlapped by a
+// present is reported rather than shown.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "LedOutput.h"
+#include "LedPreview.h"
+#include "StripTopology.h"
+
+static const uint32_t kPreviewWidth = 600;
+
+// Present one frame through instant mock transmitters
+static void presentFrame(LedOutput& output, const Framebuffer16& fb) {
+  output.encode(fb, 255);
+  output.present();
+  output.waitDone();
+}
+
+static bool checkSolid(const char* spec) {
+  StripTopology topology;
+  parseTopology(spec, topology);
+  MockTransmitter mocks[StripTopology::kMaxLanes];
+  LedTransmitter* transmitters[StripTopology::kMaxLanes];
+  for(uint8_t i = 0; i < topology.laneCount; i++) {
+    mocks[i].setTimeScale(0);
+    transmitters[i] = &mocks[i];
+  }
+  LedOutput output;
+  output.begin(topology, transmitters);
+
+  std::vector<Rgb16> pixels(topology.totalLeds(), toRgb16(Rgb{200, 100, 40}));
+  Framebuffer16 fb = {pixels.data(), (uint32_t)pixels.size()};
+  presentFrame(output, fb);
+
+  std::vector<uint16_t> bar(kPreviewWidth);
+  previewFrame(output, bar.data(), kPreviewWidth);
+  for(uint16_t c : bar) {
+    if(c != toRgb565(200, 100, 40)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Alternating black/white LEDs must average to grey, not alias
+static bool checkAveraging() {
+  MockTransmitter tx;
+  tx.setTimeScale(0);
+  LedOutput output;
+  output.begin(tx, kPreviewWidth * 4, kOrderGRB);
+  std::vector<Rgb16> pixels(kPreviewWidth * 4);
+  for(size_t i = 0; i < pixels.size(); i += 2) {
+    pixels[i] = toRgb16(Rgb{255, 255, 255});
+  }
+  Framebuffer16 fb = {pixels.data(), (uint32_t)pixels.size()};
+  presentFrame(output, fb);
+
+  std::vector<uint16_t> bar(kPreviewWidth);
+  previewFrame(output, bar.data(), kPreviewWidth);
+  for(uint16_t c : bar) {
+    if(c != toRgb565(127, 127, 127)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A thread presents solid red, green and blue frames back to back (three,
+// so each slot keeps changing color) while this one previews them: every
+// preview accepted must be one solid color
+static bool checkTornFrames(uint32_t& accepted, uint32_t& dropped) {
+  const uint32_t leds = 10000;
+  MockTransmitter tx;
+  tx.setTimeScale(0);
+  LedOutput output;
+  output.begin(tx, leds, kOrderGRB);
+  const Rgb colors[3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+  std::vector<Rgb16> pixels[3];
+  Framebuffer16 frames[3];
+  for(int i = 0; i < 3; i++) {
+    pixels[i].assign(leds, toRgb16(colors[i]));
+    frames[i] = Framebuffer16{pixels[i].data(), leds};
+  }
+  presentFrame(output, frames[0]);
+
+  std::atomic<bool> running(true);
+  std::thread render([&] {
+    for(uint32_t i = 1; running; i++) {
+      presentFrame(output, frames[i % 3]);
+    }
+  });
+  std::vector<uint16_t> bar(kPreviewWidth);
+  bool ok = true;
+  accepted = dropped = 0;
+  const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+  while(std::chrono::steady_clock::now() < end) {
+    if(!previewFrame(output, bar.data(), kPreviewWidth)) {
+      dropped++;
+      continue;
+    }
+    accepted++;
+    bool solid = false;
+    for(const Rgb& c : colors) {
+      solid |= bar[0] == toRgb565(c.r, c.g, c.b);
+    }
+    for(uint16_t c : bar) {
+      solid &= c == bar[0];
+    }
+    ok &= solid;
+  }
+  running = false;
+  render.join();
+  return ok && accepted > 0;
+}
+
+int runPreviewBench() {
+  printf("\n== preview ==\n");
+  int failures = 0;
+  const char* specs[] = {"1:144:GRB", "1:600:RGB", "1:1000:GRB,2:337:RGB,3:2000:BRG"};
+  for(const char* spec : specs) {
+    bool ok = checkSolid(spec);
+    failures += !ok;
+    printf("solid color %-32s %s\n", spec, ok ? "ok" : "FAIL");
+  }
+  bool averaged = checkAveraging();
+  failures += !averaged;
+  printf("box filter averages        %s\n", averaged ? "ok" : "FAIL");
+  uint32_t accepted, dropped;
+  bool whole = checkTornFrames(accepted, dropped);
+  failures += !whole;
+  printf("torn frames dropped        %s (%u shown, %u dropped)\n", whole ? "ok" : "FAIL", (unsigned)accepted,
+         (unsigned)dropped);
+
+  printBenchHeader("preview 600 px");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> pixels(leds);
+    Framebuffer16 fb = {pixels.data(), leds};
+    RainbowState rainbow;
+    rainbowEffect(fb, rainbow, 16667);
+    MockTransmitter tx;
+    tx.setTimeScale(0);
+    LedOutput output;
+    output.begin(tx, leds, kOrderGRB);
+    presentFrame(output, fb);
+
+    std::vector<uint16_t> bar(kPreviewWidth);
+    BenchResult r = benchFrames([&] {
+      previewFrame(output, bar.data(), kPreviewWidth);
+      benchConsume(bar.data(), bar.size() * sizeof(uint16_t));
+    });
+    printBenchRow("downsample", leds, r);
+    if(leds == 10000 && r.nsPerFrame / 1000 > kPreviewBudgetUs) {
+      printf("over the %u us budget at 10k LEDs\n", (unsigned)kPreviewBudgetUs);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+// Stage profiler: cost of timing one stage (two counter reads and a ring
+// push), p99 from the log-scale histogram against the exact percentile of
+// the same samples, and a producer thread recording against a concurrent
+// collector: every sample is either collected once or counted as dropped.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "FastRandom.h"
+#include "StageProfiler.h"
+
+static const char* const kNames[] = {"a", "b"};
+
+// Every value must land in a bucket whose upper edge is at most 12.5% above it
+static bool checkBuckets() {
+  uint32_t previous = 0;
+  for(uint64_t v = 0; v <= 0xFFFFFFFFull; v = v < 4096 ? v + 1 : v + v / 97 + 1) {
+    uint32_t bucket = StageProfiler::bucketOf((uint32_t)v);
+    uint32_t edge = StageProfiler::bucketUpperEdge(bucket);
+    if(bucket >= StageProfiler::kBuckets || bucket < previous || edge < v || edge - v > v / 8) {
+      printf("value %llu: bucket %u, upper edge %u\n", (unsigned long long)v, (unsigned)bucket, (unsigned)edge);
+      return false;
+    }
+    previous = bucket;
+  }
+  return StageProfiler::bucketOf(0xFFFFFFFFu) == StageProfiler::kBuckets - 1;
+}
+
+// Feed samples through the profiler and compare p99 with the exact value
+static bool checkP99(const char* name, std::vector<uint32_t> samples) {
+  std::unique_ptr<StageProfiler> profiler(new StageProfiler());
+  profiler->begin(kNames, 1);
+  for(size_t i = 0; i < samples.size(); i++) {
+    profiler->record(0, samples[i]);
+    if(i % StageProfiler::kRingSize == StageProfiler::kRingSize - 1) {
+      profiler->collect();
+    }
+  }
+  profiler->collect();
+  StageSummary s = profiler->summary(0);
+  std::sort(samples.begin(), samples.end());
+  const float perUs = (float)profileCyclesPerUs();
+  const float exact = samples[samples.size() - samples.size() / 100 - 1] / perUs;
+  const float minUs = samples.front() / perUs;
+  const float maxUs = samples.back() / perUs;
+  bool ok = s.count == samples.size() && s.dropped == 0 && s.minUs == minUs && s.maxUs == maxUs &&
+            s.p99Us >= exact && s.p99Us <= exact * 1.125f + 0.01f;
+  printf("%-24s %8u %10.2f %10.2f %10.2f %10.2f %8s\n", name, (unsigned)s.count, s.avgUs, exact, s.p99Us, s.maxUs,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// One thread records, the main thread collects as it goes
+static bool checkConcurrent() {
+  std::unique_ptr<StageProfiler> profiler(new StageProfiler());
+  profiler->begin(kNames, 2);
+  const uint32_t kSamples = 200000;
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    for(uint32_t i = 0; i < kSamples; i++) {
+      profiler->record(i & 1, 1000 + (i & 1023));
+      if(i % 64 == 63) {
+        std::this_thread::yield();
+      }
+    }
+    done = true;
+  });
+  while(!done) {
+    profiler->collect();
+  }
+  producer.join();
+  profiler->collect();
+  StageSummary a = profiler->summary(0);
+  StageSummary b = profiler->summary(1);
+  uint32_t total = a.count + a.dropped + b.count + b.dropped;
+  bool ok = total == kSamples && a.count > 0 && b.count > 0;
+  printf("concurrent: %u samples, %u collected, %u dropped on a full ring: %s\n", (unsigned)kSamples,
+         (unsigned)(a.count + b.count), (unsigned)(a.dropped + b.dropped), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int runProfileBench() {
+  printf("\n== profile ==\n");
+  int failures = 0;
+  if(!checkBuckets()) {
+    printf("histogram buckets are off\n");
+    failures++;
+  }
+
+  printf("%-24s %8s %10s %10s %10s %10s %8s\n", "distribution", "samples", "avg us", "exact p99", "p99 us", "max us",
+         "check");
+  FastRandom rng(7);
+  std::vector<uint32_t> uniform(100000), tail(100000), spikes(100000);
+  for(uint32_t i = 0; i < uniform.size(); i++) {
+    uniform[i] = 2000 + rng.next() % 3000;
+    // Mostly ~1 ms with an exponential-ish tail
+    uint32_t extra = 0;
+    while(rng.next() % 4 == 0 && extra < 40) {
+      extra++;
+    }
+    tail[i] = 1000000 + extra * 250000 + rng.next() % 1000;
+    // A frame stage: 2 ms with 2% blocked for a 30 ms redraw
+    spikes[i] = rng.next() % 50 == 0 ? 30000000 + rng.next() % 100000 : 2000000 + rng.next() % 5000;
+  }
+  failures += !checkP99("uniform 2-5 us", uniform);
+  failures += !checkP99("1 ms, long tail", tail);
+  failures += !checkP99("2 ms, 2% at 30 ms", spikes);
+
+  if(!checkConcurrent()) {
+    failures++;
+  }
+
+  // What PROFILE_STAGE adds around a stage, collected every 100 samples as
+  // the UI loop would
+  std::unique_ptr<StageProfiler> profiler(new StageProfiler());
+  profiler->begin(kNames, 1);
+  uint32_t n = 0;
+  BenchResult r = benchFrames([&] {
+    const uint32_t start = profileCycles();
+    profiler->record(0, profileCycles() - start);
+    if(++n % 100 == 0) {
+      profiler->collect();
+    }
+  }, 100000, 0.2);
+  printf("timing one stage: %.1f ns (record + collect), profiler RAM %zu bytes for %u stages\n", r.nsPerFrame,
+         sizeof(StageProfiler), (unsigned)StageProfiler::kMaxStages);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+// SpscQueue under contention: a producer and a consumer thread hammer the
+// LedCommand queue; every command must arrive exactly once and in order.
+
+#include <thread>
+
+#include "BenchUtil.h"
+#include "LedCommand.h"
+
+struct QueueRun {
+  double opsPerSec;
+  uint64_t fullRetries;
+  uint64_t emptyPolls;
+  uint64_t errors;
+};
+
+// spinLimit: failed pushes/pops to busy-retry before yielding the thread
+static QueueRun hammer(uint32_t count, uint32_t spinLimit) {
+  static LedCommandQueue queue;
+  QueueRun run = {};
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&] {
+    for(uint32_t i = 0; i < count; i++) {
+      // Cycle through the command types so the whole struct moves
+      LedCommand cmd = {(LedCommandType)(i % 3), i};
+      uint32_t spins = 0;
+      while(!queue.push(cmd)) {
+        run.fullRetries++;
+        if(++spins >= spinLimit) {
+          std::this_thread::yield();
+          spins = 0;
+        }
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  uint32_t spins = 0;
+  while(expected < count) {
+    LedCommand cmd;
+    if(!queue.pop(cmd)) {
+      run.emptyPolls++;
+      if(++spins >= spinLimit) {
+        std::this_thread::yield();
+        spins = 0;
+      }
+      continue;
+    }
+    if(cmd.value != expected || cmd.type != (LedCommandType)(expected % 3)) {
+      run.errors++;
+      expected = cmd.value;  // Resync so one error is not counted forever
+    }
+    expected++;
+  }
+  producer.join();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  run.opsPerSec = count / seconds;
+  run.errors += !queue.empty();
+  return run;
+}
+
+int runQueueBench() {
+  printf("\n== queue (SpscQueue<LedCommand, %u>, %u hw threads) ==\n",
+         (unsigned)LedCommandQueue::capacity(), std::thread::hardware_concurrency());
+  printf("%-24s %10s %14s %14s %14s %8s\n", "case", "commands", "cmds/s", "full retries", "empty polls", "errors");
+
+  int failures = 0;
+  const uint32_t count = 2000000;
+  const uint32_t spinLimits[] = {1, 64, 4096};
+  for(uint32_t spinLimit : spinLimits) {
+    QueueRun run = hammer(count, spinLimit);
+    char name[32];
+    snprintf(name, sizeof(name), "spin %u then yield", (unsigned)spinLimit);
+    printf("%-24s %10u %14.0f %14llu %14llu %8llu\n", name, (unsigned)count, run.opsPerSec,
+           (unsigned long long)run.fullRetries, (unsigned long long)run.emptyPolls, (unsigned long long)run.errors);
+    failures += run.errors != 0;
+  }
+  return failures ? 1 : 0;
+}
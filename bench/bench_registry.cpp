@@ -0,0 +1,119 @@
+// Effect registry: the kernels specialized on a compile-time strip length
+// against the same kernels sized at run time (rainbowEffect() and friends).
+// Both must render bit-identical frames; the table shows what the constant
+// loop bounds buy. Also checks parameter clamping and the constexpr topology
+// length the registry is sized from.
+
+#include <string.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "EffectRegistry.h"
+#include "StripTopology.h"
+
+static const uint32_t kFrameUs = 16667;
+
+template <uint32_t N>
+using BenchEffects = EffectRegistry<N, RainbowDef, FireDef, MeteorDef, KittDef, OffDef, SolidDef>;
+
+static_assert(BenchEffects<144>::id<RainbowDef>() == 0 && BenchEffects<144>::id<SolidDef>() == 5, "ids follow the list");
+static_assert(BenchEffects<144>::buttonCount(EFFECT_TILE) == 4, "four tiles");
+static_assert(topologyLeds("54:144:GRB") == 144, "one lane");
+static_assert(topologyLeds("54:144:GRB:2000,1:300:RGB") == 444, "two lanes");
+static_assert(topologyLeds("54:144:GGB") == 0 && topologyLeds("54:0") == 0 && topologyLeds("") == 0,
+              "invalid topologies");
+
+// Run both paths for a few hundred frames and compare every one
+template <uint32_t N, typename Def, typename Runtime>
+static bool sameFrames(const char* name, typename Def::State runtimeState, Runtime runtime) {
+  BenchEffects<N> effects;
+  effects.template state<Def>() = runtimeState;
+  std::vector<Rgb16> a(N), b(N);
+  Framebuffer16 fa = {a.data(), N};
+  Framebuffer16 fb = {b.data(), N};
+  for(int frame = 0; frame < 300; frame++) {
+    effects.render(BenchEffects<N>::template id<Def>(), fa, kFrameUs + frame * 37);
+    runtime(fb, runtimeState, kFrameUs + frame * 37);
+    if(memcmp(a.data(), b.data(), N * sizeof(Rgb16)) != 0) {
+      printf("%s at %u LEDs differs on frame %d\n", name, (unsigned)N, frame);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <uint32_t N, typename Def, typename Runtime>
+static void benchPair(const char* name, Runtime runtime) {
+  BenchEffects<N> effects;
+  typename Def::State state;
+  std::vector<Rgb16> pixels(N);
+  Framebuffer16 fb = {pixels.data(), N};
+  BenchResult r = benchFrames([&] { runtime(fb, state, kFrameUs); });
+  char label[32];
+  snprintf(label, sizeof(label), "%s, runtime", name);
+  printBenchRow(label, N, r);
+  r = benchFrames([&] { effects.render(BenchEffects<N>::template id<Def>(), fb, kFrameUs); });
+  snprintf(label, sizeof(label), "%s, registry", name);
+  printBenchRow(label, N, r);
+  benchConsume(pixels.data(), pixels.size() * sizeof(Rgb16));
+}
+
+template <uint32_t N>
+static int runAt() {
+  int failures = 0;
+  MeteorState meteor;
+  meteor.tail = 5;
+  KittState kitt;
+  kitt.tail = 3;
+  SolidState solid;
+  solid.color = toRgb16(unpackColor(0x3080FF));
+  failures += !sameFrames<N, RainbowDef>("rainbow", RainbowState(), [](Framebuffer16& fb, RainbowState& s, uint32_t dt) {
+    rainbowEffect(fb, s, dt);
+  });
+  failures += !sameFrames<N, MeteorDef>("meteor", meteor, [](Framebuffer16& fb, MeteorState& s, uint32_t dt) {
+    meteorEffect(fb, s, dt);
+  });
+  failures += !sameFrames<N, KittDef>("kitt", kitt, [](Framebuffer16& fb, KittState& s, uint32_t dt) {
+    kittEffect(fb, s, dt);
+  });
+  failures += !sameFrames<N, SolidDef>("solid", solid, [](Framebuffer16& fb, SolidState& s, uint32_t) {
+    fillKernel(fb.pixels, fb.count, s.color);
+  });
+
+  benchPair<N, RainbowDef>("rainbow", [](Framebuffer16& fb, RainbowState& s, uint32_t dt) { rainbowEffect(fb, s, dt); });
+  benchPair<N, MeteorDef>("meteor", [](Framebuffer16& fb, MeteorState& s, uint32_t dt) { meteorEffect(fb, s, dt); });
+  benchPair<N, KittDef>("kitt", [](Framebuffer16& fb, KittState& s, uint32_t dt) { kittEffect(fb, s, dt); });
+  benchPair<N, SolidDef>("solid", [](Framebuffer16& fb, SolidState& s, uint32_t) {
+    fillKernel(fb.pixels, fb.count, s.color);
+  });
+  return failures;
+}
+
+// Parameters land in the effect's state, clamped to their range
+static bool checkParams() {
+  BenchEffects<144> effects;
+  const uint8_t kitt = BenchEffects<144>::id<KittDef>();
+  const uint8_t fire = BenchEffects<144>::id<FireDef>();
+  bool ok = BenchEffects<144>::paramCount(kitt) == 2 && BenchEffects<144>::paramCount(BenchEffects<144>::id<OffDef>()) == 0;
+  ok &= effects.setParam(kitt, 0, 500) && effects.state<KittDef>().speed == 500;
+  ok &= effects.setParam(kitt, 1, 99) && effects.state<KittDef>().tail == kKittTailMax;
+  ok &= effects.setParam(fire, 0, 0) && effects.state<FireDef>().cooling == 20;
+  ok &= effects.param(fire, 0) == 20 && strcmp(BenchEffects<144>::paramInfo(fire, 1).name, "sparking") == 0;
+  ok &= !effects.setParam(kitt, 2, 1) && !effects.setParam(BenchEffects<144>::kCount, 0, 1);
+  printf("parameters: typed fields, clamped to range, bad ids refused: %s\n", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int runRegistryBench() {
+  printBenchHeader("registry");
+  int failures = 0;
+  failures += runAt<144>();
+  failures += runAt<1000>();
+  failures += runAt<10000>();
+  if(failures == 0) {
+    printf("registry frames match the runtime kernels at 144, 1000 and 10000 LEDs\n");
+  }
+  failures += !checkParams();
+  return failures ? 1 : 0;
+}
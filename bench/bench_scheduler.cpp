@@ -0,0 +1,98 @@
+// FrameScheduler on a virtual clock: frame pacing under a varying load, and
+// whether effect animation speed stays independent of that load.
+
+#include <math.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "FastRandom.h"
+#include "FrameScheduler.h"
+
+struct PacingRun {
+  FrameStats stats;
+  uint32_t lastFrameUs;  // Virtual time the last frame started
+  double kittPosition;
+  double rainbowHue;
+};
+
+// Where the KITT scanner should be after t seconds at 200 LEDs/s bouncing
+// over 0..span: a triangle wave
+static double expectedKitt(double t, double span) {
+  double d = fmod(200.0 * t, 2 * span);
+  return d <= span ? d : 2 * span - d;
+}
+
+// Simulate seconds of a loop() that polls touch every pollUs and spends a
+// random workUs in [minWorkUs, maxWorkUs) per rendered frame
+static PacingRun simulate(uint16_t fps, uint32_t minWorkUs, uint32_t maxWorkUs, uint32_t seconds) {
+  const uint32_t leds = 144;
+  const uint32_t pollUs = 300;
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 fb = {pixels.data(), leds};
+  KittState kitt;
+  MeteorState meteor;
+  RainbowState rainbow;
+  FastRandom rng(1234);
+
+  FrameScheduler scheduler;
+  uint32_t now = 0;
+  scheduler.begin(now, fps);
+  const uint32_t end = seconds * 1000000;
+  uint32_t lastFrameUs = 0;
+  while(now < end) {
+    if(scheduler.frameDue(now)) {
+      lastFrameUs = now;
+      uint32_t dt = scheduler.frameDeltaUs();
+      kittEffect(fb, kitt, dt);
+      meteorEffect(fb, meteor, dt);
+      rainbowEffect(fb, rainbow, dt);
+      now += rng.range(minWorkUs, maxWorkUs);
+      scheduler.frameDone(now);
+    }
+    uint32_t idle = scheduler.usUntilNextFrame(now);
+    // Millisecond sleeps like delay(), then poll
+    now += idle >= 1000 ? (idle / 1000) * 1000 : pollUs;
+  }
+
+  PacingRun run;
+  run.stats = scheduler.stats();
+  run.lastFrameUs = lastFrameUs;
+  run.kittPosition = kitt.position / (double)(1 << kSubPixelShift);
+  run.rainbowHue = rainbow.phase / (double)(1 << kSubPixelShift);
+  return run;
+}
+
+int runSchedulerBench() {
+  printf("\n== scheduler (virtual clock, 10 s per run) ==\n");
+  printf("%-5s %-12s %8s %8s %10s %10s %12s %12s\n", "fps", "work us", "frames", "missed",
+         "avg jit us", "max jit us", "kitt err", "hue err");
+
+  int failures = 0;
+  const uint16_t rates[] = {60, 120, 240};
+  for(uint16_t fps : rates) {
+    const uint32_t period = 1000000 / fps;
+    // Light load, heavy load, and overload (some frames longer than a period)
+    const uint32_t loads[][2] = {{period / 10, period / 5}, {period / 2, period * 9 / 10}, {period / 2, period * 3 / 2}};
+    for(const auto& load : loads) {
+      PacingRun run = simulate(fps, load[0], load[1], 10);
+
+      // Each frame advances by the time since the previous one, so after the
+      // last frame the state should match the ideal position at its start
+      double t = run.lastFrameUs / 1e6;
+      double kittErr = fabs(run.kittPosition - expectedKitt(t, 143));
+      double hueErr = fmod(fabs(run.rainbowHue - fmod(50.0 * t, 256.0)), 256.0);
+      bool ok = kittErr < 0.05 && (hueErr < 0.05 || hueErr > 255.95);
+      failures += !ok;
+
+      char work[24];
+      snprintf(work, sizeof(work), "%u-%u", (unsigned)load[0], (unsigned)load[1]);
+      printf("%-5u %-12s %8u %8u %10u %10u %11.2f%s %12.2f\n", (unsigned)fps, work,
+             (unsigned)run.stats.frames, (unsigned)run.stats.missedDeadlines,
+             (unsigned)run.stats.avgJitterUs(), (unsigned)run.stats.maxJitterUs,
+             kittErr, ok ? " " : "!", hueErr);
+    }
+  }
+  return failures ? 1 : 0;
+}
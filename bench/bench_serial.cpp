@@ -0,0 +1,457 @@
+// Serial link: the binary protocol on the USB CDC port. Checks the parser
+// on frames split at every byte and interleaved with text, drops corrupt
+// and oversized frames and finds the next good one, and that the device end
+// applies batched commands in order, assembles pixel frames larger than one
+// message and answers queries and malformed requests.
+//
+// Then a client against the device end over a pseudo-terminal pair, the
+// device polling once per frame slot like the render task: pixel frames
+// pushed with an ack each and up to two in flight, commands one per
+// message against batched, ping round trips, and what one poll() costs
+// the render task under a flood of pixels.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "FastRandom.h"
+#include "PixelStream.h"
+#include "SerialLink.h"
+
+// Parser output, kept for comparison
+class RecordingSink : public SerialSink {
+ public:
+  void frame(const SerialFrame& frame) override {
+    types.push_back(frame.type);
+    payloads.emplace_back(frame.payload, frame.payload + frame.length);
+  }
+  void text(uint8_t c) override { texts.push_back(c); }
+
+  std::vector<uint8_t> types;
+  std::vector<std::vector<uint8_t>> payloads;
+  std::vector<uint8_t> texts;
+};
+
+static bool checkParser() {
+  bool ok = true;
+  FastRandom rng;
+  std::vector<uint8_t> stream;
+  std::vector<std::vector<uint8_t>> sent;
+  std::vector<uint8_t> text;
+  const uint16_t lengths[] = {0, 1, 5, 100, 1000, kSerialMaxPayload};
+  for(uint16_t length : lengths) {
+    std::vector<uint8_t> payload(length);
+    for(uint8_t& b : payload) {
+      b = (uint8_t)rng.next();
+    }
+    const char* line = "Stream: 60 frames/s\n";
+    stream.insert(stream.end(), line, line + strlen(line));
+    text.insert(text.end(), line, line + strlen(line));
+    appendSerialFrame(stream, SERIAL_PING, (uint8_t)length, payload.data(), length);
+    sent.push_back(payload);
+  }
+
+  // Whole, then one byte at a time
+  for(int split = 0; split < 2; split++) {
+    SerialParser parser;
+    RecordingSink sink;
+    if(split == 0) {
+      parser.feed(stream.data(), stream.size(), sink);
+    } else {
+      for(uint8_t b : stream) {
+        parser.feed(&b, 1, sink);
+      }
+    }
+    ok &= sink.payloads == sent && sink.texts == text && parser.stats().badCrc == 0;
+  }
+
+  // A flipped bit costs that frame only; an impossible length is skipped
+  std::vector<uint8_t> damaged;
+  const uint8_t payload[3] = {1, 2, 3};
+  appendSerialFrame(damaged, SERIAL_PING, 1, payload, 3);
+  damaged[6] ^= 0x10;
+  const uint8_t overlong[] = {kSerialSync, SERIAL_PING, 2, 0xFF, 0xFF};
+  damaged.insert(damaged.end(), overlong, overlong + sizeof(overlong));
+  appendSerialFrame(damaged, SERIAL_PING, 3, payload, 3);
+  SerialParser parser;
+  RecordingSink sink;
+  parser.feed(damaged.data(), damaged.size(), sink);
+  ok &= sink.payloads.size() == 1 && parser.stats().badCrc == 1 && parser.stats().badLength == 1;
+
+  // A sync byte in text takes the real frame after it into a bogus one of
+  // 770 bytes; once that fails its CRC, the frame and text are found again
+  std::vector<uint8_t> stray = {'n', 'o', 'i', 's', 'e', kSerialSync};
+  appendSerialFrame(stray, SERIAL_PING, 2, payload, 3);
+  std::vector<uint8_t> strayText = {'n', 'o', 'i', 's', 'e'};
+  strayText.insert(strayText.end(), 1000, '.');
+  stray.insert(stray.end(), 1000, '.');
+  for(int split = 0; split < 2; split++) {
+    SerialParser strayParser;
+    RecordingSink straySink;
+    if(split == 0) {
+      strayParser.feed(stray.data(), stray.size(), straySink);
+    } else {
+      for(uint8_t b : stray) {
+        strayParser.feed(&b, 1, straySink);
+      }
+    }
+    ok &= straySink.payloads.size() == 1 && straySink.payloads[0] == std::vector<uint8_t>(payload, payload + 3) &&
+          straySink.texts == strayText && strayParser.stats().badCrc == 1;
+  }
+  printf("%-28s %s\n", "parser: splits, text, damage", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// In-memory transport: what one end writes, the other reads
+struct MemoryPipe {
+  std::vector<uint8_t> bytes;
+  size_t readPos = 0;
+};
+
+class MemoryPort : public SerialPort {
+ public:
+  MemoryPort(MemoryPipe& in, MemoryPipe& out) : in_(in), out_(out) {}
+
+  size_t read(uint8_t* data, size_t size) override {
+    const size_t n = std::min(size, in_.bytes.size() - in_.readPos);
+    memcpy(data, in_.bytes.data() + in_.readPos, n);
+    in_.readPos += n;
+    return n;
+  }
+  size_t write(const uint8_t* data, size_t size) override {
+    out_.bytes.insert(out_.bytes.end(), data, data + size);
+    return size;
+  }
+
+ private:
+  MemoryPipe& in_;
+  MemoryPipe& out_;
+};
+
+static uint32_t nowUs() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The device side as main.cpp has it: commands applied in order, pixels
+// into a PixelStream
+class BenchLinkHandler : public SerialLinkHandler {
+ public:
+  bool command(const LedCommand& cmd) override {
+    if(cmd.type == CMD_SET_EFFECT && cmd.value >= 14) {
+      return false;
+    }
+    commands.push_back(cmd);
+    return true;
+  }
+  void pixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push) override {
+    stream.handlePixels(firstLed, rgb, count, push, nowUs());
+  }
+  void stats(SerialStatsReply& reply) override {
+    reply.effect = 3;
+    reply.brightness = 200;
+    reply.framesShown = stream.stats().framesShown;
+  }
+  void text(uint8_t c) override { texts.push_back(c); }
+
+  std::vector<LedCommand> commands;
+  std::vector<uint8_t> texts;
+  PixelStream stream;
+};
+
+static bool checkLink() {
+  bool ok = true;
+  const uint32_t leds = 3000;
+  MemoryPipe toDevice, toClient;
+  MemoryPort devicePort(toDevice, toClient);
+  MemoryPort clientPort(toClient, toDevice);
+  BenchLinkHandler handler;
+  handler.stream.begin(leds, 0, 0);
+  SerialLink link;
+  link.begin(devicePort, handler);
+  SerialClient client(clientPort);
+
+  // 1000 commands, one invalid, batched into two messages
+  std::vector<LedCommand> cmds;
+  for(uint32_t i = 0; i < 1000; i++) {
+    cmds.push_back(LedCommand{CMD_SET_BRIGHTNESS, i & 0xFF});
+  }
+  cmds[500] = LedCommand{CMD_SET_EFFECT, 99};
+  client.commands(cmds.data(), (uint32_t)cmds.size());
+  const char* typed = "p";
+  toDevice.bytes.insert(toDevice.bytes.end(), typed, typed + 1);
+  // A frame of 3000 LEDs, three messages, the last pushing
+  std::vector<uint8_t> rgb(leds * 3);
+  FastRandom rng;
+  for(uint8_t& b : rgb) {
+    b = (uint8_t)rng.next();
+  }
+  client.pixels(0, rgb.data(), leds, true, true);
+  client.query();
+  client.send();
+  // Malformed: 7 bytes of commands
+  const uint8_t junk[7] = {};
+  appendSerialFrame(toDevice.bytes, SERIAL_COMMANDS, 9, junk, sizeof(junk));
+  while(link.poll() > 0) {
+  }
+  client.receive();
+
+  ok &= handler.commands.size() == 999 && handler.commands[500].value == (501 & 0xFF);
+  ok &= client.acks() == 3 && client.lastAckValue() == leds - 2 * kSerialMaxPixels;
+  ok &= client.statsReplies() == 1 && client.lastStats().effect == 3 && client.lastStats().commands == 999;
+  ok &= client.errors() == 1 && handler.texts.size() == 1 && handler.texts[0] == 'p';
+  const Framebuffer16& frame = handler.stream.frame();
+  for(uint32_t i = 0; i < leds * 3 && ok; i++) {
+    ok &= frame.channels()[i] == rgb[i] * 257u;
+  }
+
+  // Partial frames, 10 LEDs each at two places: every other LED keeps its
+  // last value rather than the one from two frames back
+  for(uint32_t firstLed : {0u, 2000u}) {
+    for(uint32_t i = firstLed * 3; i < (firstLed + 10) * 3; i++) {
+      rgb[i] = (uint8_t)(rgb[i] + 1);
+    }
+    client.pixels(firstLed, rgb.data() + firstLed * 3, 10, true, false);
+    client.send();
+    while(link.poll() > 0) {
+    }
+    const Framebuffer16& partial = handler.stream.frame();
+    for(uint32_t i = 0; i < leds * 3 && ok; i++) {
+      ok &= partial.channels()[i] == rgb[i] * 257u;
+    }
+  }
+
+  // The largest reply, a PONG of a full payload, with another behind it
+  std::vector<uint8_t> big(kSerialMaxPayload, 0x5A);
+  client.ping(big.data(), kSerialMaxPayload);
+  client.query();
+  client.send();
+  while(link.poll() > 0) {
+  }
+  client.receive();
+  ok &= client.pongs() == 1 && client.statsReplies() == 2 && link.stats().repliesDropped == 0;
+  printf("%-28s %s\n", "link: batches, pixels, query", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Both ends of a pseudo-terminal, raw and non-blocking
+static bool openPty(int& client, int& device) {
+  client = posix_openpt(O_RDWR | O_NOCTTY);
+  if(client < 0 || grantpt(client) != 0 || unlockpt(client) != 0) {
+    return false;
+  }
+  device = open(ptsname(client), O_RDWR | O_NOCTTY);
+  if(device < 0) {
+    return false;
+  }
+  termios tio;
+  tcgetattr(device, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(device, TCSANOW, &tio);
+  fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+  fcntl(device, F_SETFL, fcntl(device, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+// The device end on its own thread, polling every periodUs as the render
+// task does once per frame slot, and picking up finished pixel frames
+class DeviceThread {
+ public:
+  DeviceThread(int fd, uint32_t leds, uint32_t periodUs) : port_(fd), periodUs_(periodUs) {
+    handler_.stream.begin(leds, 0, 0);
+    link_.begin(port_, handler_);
+    thread_ = std::thread([this] { run(); });
+  }
+  ~DeviceThread() {
+    stop_ = true;
+    thread_.join();
+  }
+
+  uint32_t framesShown() const { return handler_.stream.stats().framesShown; }
+  // Cost of every poll() that handled something, in ns
+  std::vector<double> pollNs;
+
+ private:
+  void run() {
+    using clock = std::chrono::steady_clock;
+    auto next = clock::now();
+    while(!stop_) {
+      const auto start = clock::now();
+      const uint32_t handled = link_.poll();
+      if(handled > 0) {
+        pollNs.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count());
+      }
+      if(handler_.stream.frameReady()) {
+        benchConsume(handler_.stream.frame().pixels, 64);
+      }
+      next += std::chrono::microseconds(periodUs_);
+      std::this_thread::sleep_until(next);
+    }
+  }
+
+  FdSerialPort port_;
+  BenchLinkHandler handler_;
+  SerialLink link_;
+  uint32_t periodUs_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+// Wait up to timeoutMs for the client end to become readable or writable
+static void waitPty(int fd, bool writable, int timeoutMs) {
+  pollfd p = {fd, (short)(writable ? POLLIN | POLLOUT : POLLIN), 0};
+  ::poll(&p, 1, timeoutMs);
+}
+
+// Full frames of leds pushed for seconds, each acked, at most two in
+// flight. Returns frames/s; shown is what the device picked up.
+static double pushFrames(int fd, int deviceFd, uint32_t leds, uint32_t periodUs, double seconds, uint32_t& shown,
+                         double& p99PollUs) {
+  DeviceThread device(deviceFd, leds, periodUs);
+  FdSerialPort port(fd);
+  SerialClient client(port);
+  std::vector<uint8_t> rgb(leds * 3);
+  for(uint32_t i = 0; i < rgb.size(); i++) {
+    rgb[i] = (uint8_t)i;
+  }
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  uint32_t pushed = 0;
+  while(std::chrono::duration<double>(clock::now() - start).count() < seconds) {
+    if(pushed - client.acks() < 2 && !client.sending()) {
+      client.pixels(0, rgb.data(), leds, true, true);
+      pushed++;
+    }
+    client.send();
+    client.receive();
+    waitPty(fd, client.sending(), 1);
+  }
+  const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  while(client.acks() < pushed && std::chrono::duration<double>(clock::now() - start).count() < seconds + 1) {
+    client.send();
+    client.receive();
+    waitPty(fd, client.sending(), 1);
+  }
+  const uint32_t acked = client.acks();
+  std::this_thread::sleep_for(std::chrono::microseconds(2 * periodUs));
+  shown = device.framesShown();
+  std::vector<double>& polls = device.pollNs;
+  std::sort(polls.begin(), polls.end());
+  p99PollUs = polls.empty() ? 0 : polls[polls.size() * 99 / 100] / 1000;
+  return acked / elapsed;
+}
+
+// count commands, batch per message, each message waited for. Returns
+// commands/s.
+static double sendCommands(int fd, int deviceFd, uint32_t count, uint32_t batch, uint32_t periodUs, bool& ok) {
+  DeviceThread device(deviceFd, 144, periodUs);
+  FdSerialPort port(fd);
+  SerialClient client(port);
+  std::vector<LedCommand> cmds(batch, LedCommand{CMD_SET_BRIGHTNESS, 100});
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  uint32_t sent = 0, accepted = 0;
+  while(sent < count) {
+    client.commands(cmds.data(), batch);
+    const uint32_t acks = client.acks();
+    while(client.acks() == acks) {
+      client.send();
+      client.receive();
+      waitPty(fd, client.sending(), 1);
+    }
+    accepted += client.lastAckValue();
+    sent += batch;
+  }
+  ok &= accepted == sent;
+  return sent / std::chrono::duration<double>(clock::now() - start).count();
+}
+
+// Ping round trips, one at a time. Returns the p50 and p99 in us.
+static void pingRoundTrips(int fd, int deviceFd, uint32_t periodUs, int count, double& p50, double& p99) {
+  DeviceThread device(deviceFd, 144, periodUs);
+  FdSerialPort port(fd);
+  SerialClient client(port);
+  std::vector<double> rtts;
+  const uint8_t payload[16] = {};
+  for(int i = 0; i < count; i++) {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const uint32_t pongs = client.pongs();
+    client.ping(payload, sizeof(payload));
+    while(client.pongs() == pongs) {
+      client.send();
+      client.receive();
+      waitPty(fd, client.sending(), 1);
+    }
+    rtts.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+  }
+  std::sort(rtts.begin(), rtts.end());
+  p50 = rtts[rtts.size() / 2];
+  p99 = rtts[rtts.size() * 99 / 100];
+}
+
+static int benchPty() {
+  int clientFd, deviceFd;
+  if(!openPty(clientFd, deviceFd)) {
+    printf("%-28s no pseudo-terminal, skipped\n", "pty");
+    return 0;
+  }
+  int failures = 0;
+  const uint32_t kFrameUs = 16667;
+
+  printf("%-28s %8s %10s %10s %10s %12s\n", "pixel frames, pty", "leds", "frames/s", "kB/s", "shown",
+         "p99 poll us");
+  const uint32_t ledCounts[] = {144, 1000, 4000};
+  for(uint32_t leds : ledCounts) {
+    uint32_t shown;
+    double p99PollUs;
+    const double fps = pushFrames(clientFd, deviceFd, leds, kFrameUs / 4, 0.5, shown, p99PollUs);
+    printf("%-28s %8u %10.1f %10.0f %10u %12.1f\n", "pushed, 240 Hz polls", (unsigned)leds, fps,
+           fps * leds * 3 / 1024, (unsigned)shown, p99PollUs);
+    // Every frame acked is one the device completed; it must have shown
+    // some, and never spend a quarter frame in one poll
+    if(fps <= 0 || shown == 0 || p99PollUs > kFrameUs / 4) {
+      printf("pixel frames of %u LEDs did not get through\n", (unsigned)leds);
+      failures++;
+    }
+  }
+
+  bool ok = true;
+  const double single = sendCommands(clientFd, deviceFd, 60, 1, kFrameUs, ok);
+  const double batched = sendCommands(clientFd, deviceFd, 60 * 64, 64, kFrameUs, ok);
+  printf("%-28s %10.0f commands/s\n", "1 command per message", single);
+  printf("%-28s %10.0f commands/s\n", "64 commands per message", batched);
+  if(!ok || batched < 10 * single) {
+    printf("batched commands are not faster than one per message\n");
+    failures++;
+  }
+
+  double p50, p99;
+  pingRoundTrips(clientFd, deviceFd, kFrameUs, 60, p50, p99);
+  printf("%-28s p50 %8.0f us  p99 %8.0f us\n", "ping, 60 Hz polls", p50, p99);
+  pingRoundTrips(clientFd, deviceFd, 1000, 200, p50, p99);
+  printf("%-28s p50 %8.0f us  p99 %8.0f us\n", "ping, 1 kHz polls", p50, p99);
+
+  close(deviceFd);
+  close(clientFd);
+  return failures;
+}
+
+int runSerialBench() {
+  printf("\n== serial ==\n");
+  int failures = 0;
+  failures += !checkParser();
+  failures += !checkLink();
+  failures += benchPty();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,357 @@
+// Network pixel input: DDP and E1.31 reassembly, push/sync handling, stale
+// frame/packet dropping and partial DDP updates fed packet by packet, then
+// real UDP over loopback - decode cost per packet, send-to-ready latency and
+// sustained packets/s with a sender thread blasting frames at the receiver.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "PixelStream.h"
+
+// Loopback test ports, away from the standard ones a real sender might use
+static const uint16_t kTestDdpPort = 14048;
+static const uint16_t kTestE131Port = 15568;
+
+// 480 RGB LEDs per DDP packet keeps datagrams under a 1500 byte MTU
+static const uint32_t kDdpMaxData = 1440;
+
+typedef std::vector<uint8_t> Packet;
+
+static Packet ddpPacket(uint8_t sequence, uint32_t offset, const uint8_t* data, uint16_t len, bool push) {
+  Packet p(10 + len);
+  p[0] = 0x40 | (push ? 0x01 : 0);
+  p[1] = sequence & 0x0F;
+  p[2] = 0x0B;
+  p[3] = 1;
+  p[4] = offset >> 24;
+  p[5] = offset >> 16;
+  p[6] = offset >> 8;
+  p[7] = offset;
+  p[8] = len >> 8;
+  p[9] = len;
+  memcpy(p.data() + 10, data, len);
+  return p;
+}
+
+// Split RGB data into DDP packets, push on the last. It lands from channel
+// `first` of the strip on.
+static std::vector<Packet> ddpFrame(const std::vector<uint8_t>& rgb, uint8_t sequence, uint32_t first = 0) {
+  std::vector<Packet> packets;
+  for(uint32_t offset = 0; offset < rgb.size(); offset += kDdpMaxData) {
+    uint16_t len = std::min<uint32_t>(kDdpMaxData, rgb.size() - offset);
+    packets.push_back(ddpPacket(sequence, first + offset, rgb.data() + offset, len, offset + len == rgb.size()));
+  }
+  return packets;
+}
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+  putU16(p, v >> 16);
+  putU16(p + 2, v);
+}
+
+static void e131Root(Packet& p, uint32_t vector) {
+  putU16(&p[0], 0x0010);
+  static const char acn[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+  memcpy(&p[4], acn, sizeof(acn));
+  putU16(&p[16], 0x7000 | (p.size() - 16));
+  putU32(&p[18], vector);
+  putU16(&p[38], 0x7000 | (p.size() - 38));
+}
+
+static Packet e131Data(uint16_t universe, uint8_t sequence, const uint8_t* slots, uint16_t count,
+                       uint16_t syncAddress = 0) {
+  Packet p(126 + count);
+  e131Root(p, 0x00000004);
+  putU32(&p[40], 0x00000002);
+  strcpy((char*)&p[44], "bench");
+  p[108] = 100;  // Priority
+  putU16(&p[109], syncAddress);
+  p[111] = sequence;
+  putU16(&p[113], universe);
+  putU16(&p[115], 0x7000 | (p.size() - 115));
+  p[117] = 0x02;
+  p[118] = 0xA1;
+  putU16(&p[121], 1);
+  putU16(&p[123], count + 1);
+  memcpy(&p[126], slots, count);
+  return p;
+}
+
+static Packet e131Sync(uint16_t syncAddress, uint8_t sequence) {
+  Packet p(49);
+  e131Root(p, 0x00000008);
+  putU32(&p[40], 0x00000001);
+  p[44] = sequence;
+  putU16(&p[45], syncAddress);
+  return p;
+}
+
+// One E1.31 packet per universe of 170 LEDs
+static std::vector<Packet> e131Frame(const std::vector<uint8_t>& rgb, uint8_t sequence, uint16_t syncAddress = 0) {
+  std::vector<Packet> packets;
+  const uint32_t perUniverse = PixelStream::kLedsPerUniverse * 3;
+  for(uint32_t offset = 0, universe = 1; offset < rgb.size(); offset += perUniverse, universe++) {
+    uint16_t len = std::min<uint32_t>(perUniverse, rgb.size() - offset);
+    packets.push_back(e131Data(universe, sequence, rgb.data() + offset, len, syncAddress));
+  }
+  return packets;
+}
+
+static std::vector<uint8_t> testFrame(uint32_t leds, uint8_t seed) {
+  std::vector<uint8_t> rgb(leds * 3);
+  for(uint32_t i = 0; i < rgb.size(); i++) {
+    rgb[i] = (uint8_t)(i * 7 + seed * 31);
+  }
+  return rgb;
+}
+
+static bool frameEquals(const Framebuffer16& fb, const std::vector<uint8_t>& rgb) {
+  const uint16_t* ch = fb.channels();
+  for(uint32_t i = 0; i < rgb.size(); i++) {
+    if(ch[i] != rgb[i] * 257) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool checkDdp() {
+  const uint32_t leds = 1000;
+  PixelStream stream;
+  stream.begin(leds, 0, 0);
+  bool ok = true;
+
+  // Out of order: the push packet still arrives last
+  std::vector<uint8_t> a = testFrame(leds, 1);
+  std::vector<Packet> packets = ddpFrame(a, 1);
+  stream.handleDdp(packets[1].data(), packets[1].size(), 0);
+  stream.handleDdp(packets[0].data(), packets[0].size(), 0);
+  ok &= !stream.frameReady();  // No push yet
+  stream.handleDdp(packets[2].data(), packets[2].size(), 0);
+  ok &= stream.frameReady() && frameEquals(stream.frame(), a);
+  ok &= !stream.frameReady();
+
+  // Two frames before the render task looks: only the newest is shown
+  std::vector<uint8_t> b = testFrame(leds, 2), c = testFrame(leds, 3);
+  for(const Packet& p : ddpFrame(b, 2)) {
+    stream.handleDdp(p.data(), p.size(), 0);
+  }
+  for(const Packet& p : ddpFrame(c, 3)) {
+    stream.handleDdp(p.data(), p.size(), 0);
+  }
+  ok &= frameEquals(stream.frame(), c) && stream.stats().framesDropped == 1;
+
+  // A late packet of frame 2 must not overwrite frame 3
+  packets = ddpFrame(b, 2);
+  stream.handleDdp(packets[0].data(), packets[0].size(), 0);
+  ok &= stream.stats().stalePackets == 1;
+  for(const Packet& p : ddpFrame(c, 4)) {
+    stream.handleDdp(p.data(), p.size(), 0);
+  }
+  ok &= frameEquals(stream.frame(), c);
+
+  // Partial updates: each frame pushes only the LEDs that changed, the rest
+  // of the strip must still show the frame before
+  const uint32_t changed[][2] = {{0, 10}, {500, 20}, {990, 10}, {0, 1000}, {123, 1}};
+  uint8_t sequence = 5;
+  for(const uint32_t* span : changed) {
+    for(uint32_t i = span[0] * 3; i < (span[0] + span[1]) * 3; i++) {
+      c[i] = (uint8_t)(c[i] + 1);
+    }
+    std::vector<uint8_t> rgb(c.begin() + span[0] * 3, c.begin() + (span[0] + span[1]) * 3);
+    for(const Packet& p : ddpFrame(rgb, sequence, span[0] * 3)) {
+      stream.handleDdp(p.data(), p.size(), 0);
+    }
+    sequence = sequence % 15 + 1;
+    ok &= stream.frameReady() && frameEquals(stream.frame(), c);
+  }
+
+  // Queries and other destinations are not pixel data
+  Packet query = ddpPacket(0, 0, a.data(), 3, true);
+  query[0] |= 0x02;
+  stream.handleDdp(query.data(), query.size(), 0);
+  ok &= !stream.frameReady() && stream.stats().invalidPackets == 1;
+  return ok;
+}
+
+static bool checkE131() {
+  const uint32_t leds = 1000;  // 6 universes
+  PixelStream stream;
+  stream.begin(leds, 0, 0);
+  bool ok = stream.universeCount() == 6;
+
+  // Universes in any order; complete once all have arrived
+  std::vector<uint8_t> a = testFrame(leds, 4);
+  std::vector<Packet> packets = e131Frame(a, 1);
+  std::reverse(packets.begin(), packets.end());
+  for(size_t i = 0; i < packets.size(); i++) {
+    ok &= !stream.frameReady();
+    stream.handleE131(packets[i].data(), packets[i].size(), 0);
+  }
+  ok &= stream.frameReady() && frameEquals(stream.frame(), a);
+
+  // Synchronized: nothing shows until the sync packet
+  std::vector<uint8_t> b = testFrame(leds, 5);
+  for(const Packet& p : e131Frame(b, 2, 7999)) {
+    stream.handleE131(p.data(), p.size(), 0);
+  }
+  ok &= !stream.frameReady();
+  Packet sync = e131Sync(7999, 1);
+  stream.handleE131(sync.data(), sync.size(), 0);
+  ok &= stream.frameReady() && frameEquals(stream.frame(), b);
+
+  // A universe with an older sequence number is dropped
+  packets = e131Frame(a, 1);
+  stream.handleE131(packets[0].data(), packets[0].size(), 0);
+  ok &= stream.stats().stalePackets == 1 && !stream.frameReady();
+  return ok;
+}
+
+static int openSender() {
+  return socket(AF_INET, SOCK_DGRAM, 0);
+}
+
+static void sendTo(int fd, uint16_t port, const Packet& p) {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(fd, p.data(), p.size(), 0, (sockaddr*)&addr, sizeof(addr));
+}
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Send a frame and poll until it is ready, one thread: the kernel loopback
+// path plus decode, without scheduler wake-ups in the way
+static int benchLatency(uint32_t leds, bool e131) {
+  PixelStream stream;
+  if(!stream.begin(leds, kTestDdpPort, kTestE131Port)) {
+    printf("%-24s %8u  could not bind UDP %u/%u\n", e131 ? "e131 latency" : "ddp latency", (unsigned)leds,
+           kTestDdpPort, kTestE131Port);
+    return 1;
+  }
+  int fd = openSender();
+  std::vector<uint8_t> rgb = testFrame(leds, 9);
+  std::vector<double> latencies;
+  int lost = 0;
+  for(int i = 0; i < 2000; i++) {
+    std::vector<Packet> packets = e131 ? e131Frame(rgb, i) : ddpFrame(rgb, 1 + i % 15);
+    const double start = nowUs();
+    for(const Packet& p : packets) {
+      sendTo(fd, e131 ? kTestE131Port : kTestDdpPort, p);
+    }
+    while(!stream.frameReady() && nowUs() - start < 100000) {
+      stream.poll();
+    }
+    if(!stream.frameReady()) {
+      lost++;
+      continue;
+    }
+    stream.frame();
+    latencies.push_back(nowUs() - start);
+  }
+  close(fd);
+  std::sort(latencies.begin(), latencies.end());
+  const size_t n = latencies.size();
+  printf("%-24s %8u %10.1f us p50 %8.1f us p99 %6d lost\n", e131 ? "e131 send->ready" : "ddp send->ready",
+         (unsigned)leds, n ? latencies[n / 2] : 0.0, n ? latencies[n * 99 / 100] : 0.0, lost);
+  return lost > 20;  // Loopback should not lose more than a stray 1%
+}
+
+// A sender thread blasts whole DDP frames while the receiver polls once per
+// millisecond, like a render task at high frame rate
+static int benchThroughput(uint32_t leds) {
+  PixelStream stream;
+  if(!stream.begin(leds, kTestDdpPort, 0)) {
+    return 1;
+  }
+  std::vector<uint8_t> rgb = testFrame(leds, 11);
+  std::atomic<bool> running(true);
+  std::atomic<uint32_t> sent(0);
+  std::thread sender([&] {
+    int fd = openSender();
+    uint8_t sequence = 1;
+    while(running) {
+      for(const Packet& p : ddpFrame(rgb, sequence)) {
+        sendTo(fd, kTestDdpPort, p);
+        sent++;
+      }
+      sequence = sequence % 15 + 1;
+      std::this_thread::yield();
+    }
+    close(fd);
+  });
+
+  const double start = nowUs();
+  uint32_t shown = 0;
+  while(nowUs() - start < 500000) {
+    stream.poll();
+    if(stream.frameReady()) {
+      stream.frame();
+      shown++;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(1000));
+  }
+  running = false;
+  sender.join();
+  stream.poll();
+
+  const double seconds = (nowUs() - start) / 1e6;
+  const StreamStats& stats = stream.stats();
+  printf("%-24s %8u %10.0f pkt/s sent %10.0f pkt/s received %6.0f frames/s shown, %u dropped stale\n",
+         "ddp throughput", (unsigned)leds, sent / seconds, stats.packets / seconds, shown / seconds,
+         (unsigned)stats.framesDropped);
+  // Frames must come out, and never more than one per poll
+  return shown == 0 || stats.invalidPackets || stats.framesShown != shown;
+}
+
+int runStreamBench() {
+  printf("\n== stream ==\n");
+  int failures = 0;
+  bool ddp = checkDdp();
+  failures += !ddp;
+  printf("ddp reassembly, push, partial  %s\n", ddp ? "ok" : "FAIL");
+  bool e131 = checkE131();
+  failures += !e131;
+  printf("e1.31 universes, sync, stale   %s\n", e131 ? "ok" : "FAIL");
+
+  printBenchHeader("stream decode");
+  for(uint32_t leds : kBenchLedCounts) {
+    PixelStream stream;
+    stream.begin(leds, 0, 0);
+    // Sequence 0 (unused), or every repeat after the first would be stale
+    std::vector<Packet> packets = ddpFrame(testFrame(leds, 6), 0);
+    BenchResult r = benchFrames([&] {
+      for(const Packet& p : packets) {
+        stream.handleDdp(p.data(), p.size(), 0);
+      }
+      benchConsume(stream.frame().pixels, leds * sizeof(Rgb16));
+    });
+    printBenchRow("ddp frame", leds, r);
+  }
+
+  printf("\n");
+  for(uint32_t leds : {144u, 1000u, 10000u}) {
+    failures += benchLatency(leds, false);
+    failures += benchLatency(leds, true);
+  }
+  failures += benchThroughput(1000);
+  failures += benchThroughput(10000);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// Effect crossfades: a transition frame (outgoing + incoming effect + blend)
+// against the two effect frames and the blend kernel on their own, at
+// 144/1k/10k/100k LEDs. Also checks that an effect switched to starts from a
+// black buffer rather than the previous effect's pixels, and that reversing
+// a transition midway does not jump.
+
+#include <string.h>
+
+#include <vector>
+
+#include "BenchUtil.h"
+#include "Effects.h"
+#include "PixelKernels.h"
+#include "TransitionEngine.h"
+
+static const uint32_t kFrameUs = 16667;
+
+// Allowed cost of a transition frame beyond rainbow + meteor + blend, for
+// the engine's own bookkeeping and timing noise
+static const double kOverheadBudget = 0.15;
+
+// The budget check compares four timings taken at different moments, so use
+// the fastest of several short runs of each to keep scheduler noise out
+template <typename F>
+static BenchResult bestOf(F&& renderFrame) {
+  BenchResult best = benchFrames(renderFrame, 20, 0.05);
+  for(int i = 1; i < 5; i++) {
+    BenchResult r = benchFrames(renderFrame, 20, 0.05);
+    if(r.nsPerFrame < best.nsPerFrame) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+enum { kRainbow, kMeteor, kKitt };
+
+struct BenchEffects {
+  RainbowState rainbow;
+  MeteorState meteor;
+  KittState kitt;
+};
+
+static const Framebuffer16& renderBenchEffect(Framebuffer16& fb, uint8_t effect, uint32_t dtUs, void* context) {
+  BenchEffects& effects = *(BenchEffects*)context;
+  switch(effect) {
+    case kRainbow:
+      rainbowEffect(fb, effects.rainbow, dtUs);
+      break;
+    case kMeteor:
+      meteorEffect(fb, effects.meteor, dtUs);
+      break;
+    case kKitt:
+      kittEffect(fb, effects.kitt, dtUs);
+      break;
+  }
+  return fb;
+}
+
+// Meteor faded in over rainbow must end up exactly where meteor rendered
+// from a cleared buffer does
+static bool checkCleanStart() {
+  const uint32_t leds = 1000;
+  BenchEffects effects;
+  TransitionEngine engine;
+  engine.begin(leds, renderBenchEffect, &effects);
+  engine.setDurationUs(200000);
+  for(int i = 0; i < 10; i++) {
+    engine.render(kFrameUs);
+  }
+  engine.select(kMeteor);
+  const Framebuffer16* shown = nullptr;
+  int frames = 0;
+  do {
+    shown = &engine.render(kFrameUs);
+    frames++;
+  } while(engine.transitioning());
+
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 reference = {pixels.data(), leds};
+  MeteorState meteor;
+  for(int i = 0; i < frames; i++) {
+    meteorEffect(reference, meteor, kFrameUs);
+  }
+  return memcmp(shown->pixels, reference.pixels, leds * sizeof(Rgb16)) == 0;
+}
+
+// Going back to the outgoing effect mid-transition continues from the
+// current mix instead of restarting the fade
+static bool checkReverse() {
+  BenchEffects effects;
+  TransitionEngine engine;
+  engine.begin(144, renderBenchEffect, &effects);
+  engine.setDurationUs(500000);
+  engine.select(kKitt);
+  for(int i = 0; i < 9; i++) {
+    engine.render(kFrameUs);
+  }
+  const uint32_t before = engine.weight();
+  engine.select(kRainbow);
+  engine.render(0);
+  const uint32_t after = engine.weight();
+  // The old outgoing layer now fades in: its share is what it had before
+  const uint32_t expected = 0x10000 - before;
+  return engine.transitioning() && engine.effect() == kRainbow &&
+         (after > expected ? after - expected : expected - after) <= 2;
+}
+
+int runTransitionBench() {
+  printf("\n== transition ==\n");
+  int failures = 0;
+  bool clean = checkCleanStart();
+  failures += !clean;
+  printf("incoming effect starts black  %s\n", clean ? "ok" : "FAIL");
+  bool reversed = checkReverse();
+  failures += !reversed;
+  printf("reverse midway keeps the mix  %s\n", reversed ? "ok" : "FAIL");
+
+  printBenchHeader("transition rainbow->meteor");
+  for(uint32_t leds : kBenchLedCounts) {
+    std::vector<Rgb16> a(leds), b(leds), mixed(leds);
+    Framebuffer16 fbA = {a.data(), leds};
+    Framebuffer16 fbB = {b.data(), leds};
+    BenchEffects effects;
+
+    BenchResult rainbow = bestOf([&] { rainbowEffect(fbA, effects.rainbow, kFrameUs); });
+    printBenchRow("rainbow", leds, rainbow);
+    BenchResult meteor = bestOf([&] { meteorEffect(fbB, effects.meteor, kFrameUs); });
+    printBenchRow("meteor", leds, meteor);
+    BenchResult blend = bestOf([&] {
+      blendChannels(&mixed[0].r, fbA.channels(), fbB.channels(), leds * 3, 0x8000);
+      benchConsume(mixed.data(), leds * sizeof(Rgb16));
+    });
+    printBenchRow("blend", leds, blend);
+
+    TransitionEngine engine;
+    engine.begin(leds, renderBenchEffect, &effects);
+    engine.setDurationUs(1000000000);  // Long enough never to finish while timed
+    BenchResult transition = bestOf([&] {
+      if(!engine.transitioning()) {
+        engine.select(engine.effect() == kRainbow ? kMeteor : kRainbow);
+      }
+      const Framebuffer16& shown = engine.render(kFrameUs);
+      benchConsume(shown.pixels, leds * sizeof(Rgb16));
+    });
+    printBenchRow("transition frame", leds, transition);
+
+    const double parts = rainbow.nsPerFrame + meteor.nsPerFrame + blend.nsPerFrame;
+    const double overhead = transition.nsPerFrame / parts - 1.0;
+    printf("%-24s %8u %13.1f%%\n", "vs effects + blend", (unsigned)leds, overhead * 100.0);
+    // Below 1k LEDs a frame is a few microseconds and timer noise dominates
+    if(leds >= 1000 && overhead > kOverheadBudget) {
+      printf("transition frame over budget at %u LEDs\n", (unsigned)leds);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,333 @@
+#include "AudioAnalyzer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <array>
+
+static const uint32_t kBins = AudioAnalyzer::kWindow / 2;
+
+// Levels are log2 of power in Q8: 256 = one octave of power, about 3 dB
+static const int32_t kRangeQ8 = 12 * 256;              // 36 dB mapped to 0-255
+static const int32_t kReferenceDecayQ8 = 4;            // Gain recovers ~3 dB/s at 62 hops/s
+static const int32_t kMinBandReferenceQ8 = 36 * 256;   // Quietest band reference, ~27 dB below full scale
+static const int32_t kMinLevelReferenceQ8 = 20 * 256;  // Same for the mean square of a hop
+static const int32_t kBeatRiseQ8 = 384;                // Bass this far above its average is a beat (~4.5 dB)
+static const uint32_t kLowHz = 40;
+static const uint32_t kHighHz = 8000;
+static const uint32_t kBassHz = 150;
+
+// Tables, built at compile time
+static constexpr double constSin(double x) {
+  const double pi = 3.14159265358979323846;
+  while(x > pi) {
+    x -= 2 * pi;
+  }
+  while(x < -pi) {
+    x += 2 * pi;
+  }
+  double term = x, sum = x;
+  for(int n = 1; n < 12; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+static constexpr int16_t toQ15(double v) {
+  return (int16_t)(v >= 32767.0 / 32768.0 ? 32767 : v * 32768.0 + (v >= 0 ? 0.5 : -0.5));
+}
+
+struct FftTables {
+  std::array<int16_t, kBins> cos;   // Twiddle e^(-2 pi i k / N): cos(2 pi k / N)
+  std::array<int16_t, kBins> sin;   // and -sin(2 pi k / N)
+  std::array<int16_t, AudioAnalyzer::kWindow> hann;
+  std::array<uint16_t, AudioAnalyzer::kWindow> bitReverse;
+};
+
+static constexpr FftTables buildTables() {
+  const double pi = 3.14159265358979323846;
+  const uint32_t n = AudioAnalyzer::kWindow;
+  FftTables t = {};
+  for(uint32_t k = 0; k < kBins; k++) {
+    t.cos[k] = toQ15(constSin(2 * pi * k / n + pi / 2));
+    t.sin[k] = toQ15(-constSin(2 * pi * k / n));
+  }
+  for(uint32_t i = 0; i < n; i++) {
+    t.hann[i] = toQ15(0.5 - 0.5 * constSin(2 * pi * i / n + pi / 2));
+    uint32_t r = 0;
+    for(uint32_t bit = 1; bit < n; bit <<= 1) {
+      r = (r << 1) | ((i & bit) ? 1 : 0);
+    }
+    t.bitReverse[i] = r;
+  }
+  return t;
+}
+
+static constexpr FftTables kTables = buildTables();
+
+int32_t AudioAnalyzer::log2Q8(uint64_t x) {
+  if(x == 0) {
+    return 0;
+  }
+  // Octave from the top bit, the 8 bits below it as a linear fraction
+  const int32_t msb = 63 - __builtin_clzll(x);
+  const uint32_t frac = msb >= 8 ? (uint32_t)(x >> (msb - 8)) & 255 : (uint32_t)(x << (8 - msb)) & 255;
+  return msb * 256 + frac;
+}
+
+int AudioAnalyzer::fft(int16_t* re, int16_t* im) {
+  for(uint32_t i = 0; i < kWindow; i++) {
+    const uint32_t j = kTables.bitReverse[i];
+    if(j > i) {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  // OR of every magnitude: below 2^13 exactly when the largest one is
+  uint32_t bits = 0;
+  for(uint32_t i = 0; i < kWindow; i++) {
+    bits |= (uint32_t)(re[i] < 0 ? -re[i] : re[i]) | (uint32_t)(im[i] < 0 ? -im[i] : im[i]);
+  }
+
+  int exponent = 0;
+  for(uint32_t half = 1; half < kWindow; half <<= 1) {
+    // A butterfly can grow a value by 1 + sqrt(2): halve the stage if its
+    // inputs reach 2^13 and quarter it if they reach 2^14
+    const int shift = bits >= (1u << 14) ? 2 : bits >= (1u << 13) ? 1 : 0;
+    exponent += shift;
+    bits = 0;
+    const uint32_t stride = kWindow / (2 * half);
+    for(uint32_t k = 0; k < half; k++) {
+      const int32_t wr = kTables.cos[k * stride];
+      const int32_t wi = kTables.sin[k * stride];
+      for(uint32_t i = k; i < kWindow; i += 2 * half) {
+        const uint32_t j = i + half;
+        const int32_t tr = (wr * re[j] - wi * im[j] + (1 << 14)) >> 15;
+        const int32_t ti = (wr * im[j] + wi * re[j] + (1 << 14)) >> 15;
+        const int32_t r0 = (re[i] + tr) >> shift;
+        const int32_t i0 = (im[i] + ti) >> shift;
+        const int32_t r1 = (re[i] - tr) >> shift;
+        const int32_t i1 = (im[i] - ti) >> shift;
+        re[i] = r0;
+        im[i] = i0;
+        re[j] = r1;
+        im[j] = i1;
+        bits |= (uint32_t)(r0 < 0 ? -r0 : r0) | (uint32_t)(i0 < 0 ? -i0 : i0) | (uint32_t)(r1 < 0 ? -r1 : r1) |
+                (uint32_t)(i1 < 0 ? -i1 : i1);
+      }
+    }
+  }
+  return exponent;
+}
+
+void AudioAnalyzer::begin(uint32_t sampleRate) {
+  sampleRate_ = sampleRate > 0 ? sampleRate : 16000;
+
+  // Log-spaced band edges in bins, at least one bin per band
+  const float high = (float)(kHighHz < sampleRate_ / 2 ? kHighHz : sampleRate_ / 2);
+  const float ratio = high / kLowHz;
+  for(uint8_t b = 0; b <= kAudioBands; b++) {
+    const float hz = kLowHz * powf(ratio, (float)b / kAudioBands);
+    uint32_t bin = (uint32_t)(hz * kWindow / sampleRate_ + 0.5f);
+    const uint32_t lowest = b == 0 ? 1 : bandEdges_[b - 1] + 1;
+    const uint32_t highest = kBins - (kAudioBands - b);
+    bin = bin < lowest ? lowest : bin;
+    bandEdges_[b] = bin > highest ? highest : bin;
+  }
+  const uint32_t bass = kBassHz * kWindow / sampleRate_;
+  bassBins_ = bass < 1 ? 1 : bass;
+  const uint32_t hold = sampleRate_ / 4 / kHop;
+  beatHoldHops_ = hold < 1 ? 1 : hold;
+
+  memset(history_, 0, sizeof(history_));
+  fill_ = 0;
+  hopEnergy_ = 0;
+  bandReferenceQ8_ = kMinBandReferenceQ8;
+  levelReferenceQ8_ = kMinLevelReferenceQ8;
+  bassAverageQ8_ = 0;
+  previousBassQ8_ = 0;
+  hopsSinceBeat_ = beatHoldHops_;
+  features_ = AudioFeatures();
+}
+
+uint32_t AudioAnalyzer::process(const int16_t* samples, uint32_t count) {
+  uint32_t hops = 0;
+  while(count > 0) {
+    // The newest hop fills the end of the window
+    uint32_t n = kHop - fill_;
+    n = n < count ? n : count;
+    int16_t* dst = history_ + (kWindow - kHop) + fill_;
+    uint64_t energy = 0;
+    for(uint32_t i = 0; i < n; i++) {
+      dst[i] = samples[i];
+      energy += (int32_t)samples[i] * samples[i];
+    }
+    hopEnergy_ += energy;
+    fill_ += n;
+    samples += n;
+    count -= n;
+
+    if(fill_ == kHop) {
+      analyze();
+      memmove(history_, history_ + kHop, (kWindow - kHop) * sizeof(int16_t));
+      fill_ = 0;
+      hopEnergy_ = 0;
+      hops++;
+    }
+  }
+  return hops;
+}
+
+// 0-255 over the kRangeQ8 below the reference
+static uint8_t scaleLevel(int32_t levelQ8, int32_t referenceQ8) {
+  const int32_t v = (levelQ8 - (referenceQ8 - kRangeQ8)) * 255 / kRangeQ8;
+  return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+// Follow the loudest recent level: jump up to it, sink slowly, never below
+// the noise gate's reference
+static void track(int32_t& referenceQ8, int32_t loudestQ8, int32_t minReferenceQ8) {
+  int32_t r = referenceQ8 - kReferenceDecayQ8;
+  r = loudestQ8 > r ? loudestQ8 : r;
+  referenceQ8 = r > minReferenceQ8 ? r : minReferenceQ8;
+}
+
+void AudioAnalyzer::analyze() {
+  for(uint32_t i = 0; i < kWindow; i++) {
+    re_[i] = (int16_t)(((int32_t)history_[i] * kTables.hann[i] + (1 << 14)) >> 15);
+    im_[i] = 0;
+  }
+  const int32_t exponentQ8 = 2 * fft(re_, im_) * 256;
+
+  // Band power from the bins below Nyquist, in log2 Q8
+  int32_t bandsQ8[kAudioBands];
+  int32_t loudestQ8 = 0;
+  for(uint8_t b = 0; b < kAudioBands; b++) {
+    uint64_t power = 0;
+    for(uint32_t k = bandEdges_[b]; k < bandEdges_[b + 1]; k++) {
+      power += (uint32_t)((int32_t)re_[k] * re_[k] + (int32_t)im_[k] * im_[k]);
+    }
+    bandsQ8[b] = power ? log2Q8(power) + exponentQ8 : 0;
+    loudestQ8 = bandsQ8[b] > loudestQ8 ? bandsQ8[b] : loudestQ8;
+  }
+  uint64_t bassPower = 0;
+  for(uint32_t k = 1; k <= bassBins_; k++) {
+    bassPower += (uint32_t)((int32_t)re_[k] * re_[k] + (int32_t)im_[k] * im_[k]);
+  }
+  const int32_t bassQ8 = bassPower ? log2Q8(bassPower) + exponentQ8 : 0;
+  const int32_t levelQ8 = log2Q8(hopEnergy_ / kHop);
+
+  track(bandReferenceQ8_, loudestQ8, kMinBandReferenceQ8);
+  track(levelReferenceQ8_, levelQ8, kMinLevelReferenceQ8);
+  for(uint8_t b = 0; b < kAudioBands; b++) {
+    features_.bands[b] = scaleLevel(bandsQ8[b], bandReferenceQ8_);
+  }
+  features_.bass = scaleLevel(bassQ8, bandReferenceQ8_);
+  features_.level = scaleLevel(levelQ8, levelReferenceQ8_);
+
+  // Beat: a rising bass level well above its average, within 18 dB of the
+  // loudest band (so hiss and cymbals leaking into the bass bins do not
+  // count) and not too soon after the last one. The average starts from the
+  // first full window rather than from silence.
+  hopsSinceBeat_++;
+  if(features_.hops < kWindow / kHop) {
+    bassAverageQ8_ = bassQ8;
+  } else if(bassQ8 > bassAverageQ8_ + kBeatRiseQ8 && bassQ8 > previousBassQ8_ && bassQ8 > bandReferenceQ8_ - kRangeQ8 / 2 &&
+     hopsSinceBeat_ >= beatHoldHops_) {
+    features_.beats++;
+    hopsSinceBeat_ = 0;
+  }
+  bassAverageQ8_ += (bassQ8 - bassAverageQ8_) / 16;
+  previousBassQ8_ = bassQ8;
+  features_.hops++;
+}
+
+// WAV files are little-endian, like both targets
+static bool readBytes(FILE* f, void* dst, size_t len) {
+  return fread(dst, 1, len, f) == len;
+}
+
+bool WavReader::open(FILE* f) {
+  file_ = nullptr;
+  char id[4];
+  uint32_t size;
+  if(!readBytes(f, id, 4) || memcmp(id, "RIFF", 4) != 0 || !readBytes(f, &size, 4) || !readBytes(f, id, 4) ||
+     memcmp(id, "WAVE", 4) != 0) {
+    return false;
+  }
+  bool haveFormat = false;
+  while(readBytes(f, id, 4) && readBytes(f, &size, 4)) {
+    if(memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+      uint16_t format, bits, blockAlign;
+      uint32_t byteRate;
+      if(!readBytes(f, &format, 2) || !readBytes(f, &channels_, 2) || !readBytes(f, &sampleRate_, 4) ||
+         !readBytes(f, &byteRate, 4) || !readBytes(f, &blockAlign, 2) || !readBytes(f, &bits, 2)) {
+        return false;
+      }
+      // PCM, or WAVE_FORMAT_EXTENSIBLE carrying PCM
+      if((format != 1 && format != 0xFFFE) || bits != 16 || channels_ == 0 || sampleRate_ == 0) {
+        return false;
+      }
+      haveFormat = true;
+      size -= 16;
+    } else if(memcmp(id, "data", 4) == 0) {
+      if(!haveFormat) {
+        return false;
+      }
+      frames_ = size / (2 * channels_);
+      remaining_ = frames_;
+      file_ = f;
+      return true;
+    }
+    if(fseek(f, size + (size & 1), SEEK_CUR) != 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+uint32_t WavReader::read(int16_t* samples, uint32_t count) {
+  if(file_ == nullptr) {
+    return 0;
+  }
+  int16_t buffer[512];
+  const uint32_t perRead = sizeof(buffer) / sizeof(buffer[0]) / channels_;
+  uint32_t done = 0;
+  while(done < count && remaining_ > 0 && perRead > 0) {
+    uint32_t n = count - done;
+    n = n < perRead ? n : perRead;
+    n = n < remaining_ ? n : remaining_;
+    const uint32_t got = fread(buffer, 2 * channels_, n, file_);
+    for(uint32_t i = 0; i < got; i++) {
+      int32_t sum = 0;
+      for(uint16_t c = 0; c < channels_; c++) {
+        sum += buffer[i * channels_ + c];
+      }
+      samples[done + i] = (int16_t)(sum / channels_);
+    }
+    done += got;
+    remaining_ -= got;
+    if(got < n) {
+      remaining_ = 0;
+    }
+  }
+  return done;
+}
+
+bool writeWavHeader(FILE* f, uint32_t sampleRate, uint32_t frames) {
+  const uint32_t dataBytes = frames * 2;
+  const uint32_t riffSize = 36 + dataBytes;
+  const uint32_t fmtSize = 16;
+  const uint16_t format = 1, channels = 1, blockAlign = 2, bits = 16;
+  const uint32_t byteRate = sampleRate * 2;
+  return fwrite("RIFF", 1, 4, f) == 4 && fwrite(&riffSize, 4, 1, f) == 1 && fwrite("WAVEfmt ", 1, 8, f) == 8 &&
+         fwrite(&fmtSize, 4, 1, f) == 1 && fwrite(&format, 2, 1, f) == 1 && fwrite(&channels, 2, 1, f) == 1 &&
+         fwrite(&sampleRate, 4, 1, f) == 1 && fwrite(&byteRate, 4, 1, f) == 1 && fwrite(&blockAlign, 2, 1, f) == 1 &&
+         fwrite(&bits, 2, 1, f) == 1 && fwrite("data", 1, 4, f) == 4 && fwrite(&dataBytes, 4, 1, f) == 1;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "SpscQueue.h"
+
+static const uint8_t kAudioBands = 16;
+
+// What the audio-reactive effects draw from, updated once per hop
+struct AudioFeatures {
+  uint8_t bands[kAudioBands];  // Level per band, 40 Hz up, log spaced; 0-255 over the top 36 dB
+  uint8_t level;               // Loudness of the last hop (VU), 0-255 over the top 36 dB
+  uint8_t bass;                // Level below 150 Hz, 0-255
+  uint32_t beats;              // Beats since begin(); changes on every beat
+  uint32_t hops;               // Hops analyzed since begin()
+};
+
+// Streaming audio analysis for the music-reactive effects.
+//
+// Mono 16-bit samples are pushed in blocks of any size. Every kHop samples
+// the last kWindow are windowed and run through a 16-bit fixed-point FFT
+// with block floating point (a stage is halved only when it could overflow,
+// so quiet input keeps its precision). The bins are summed into log-spaced
+// bands and everything is taken to a log2 scale in Q8, then mapped to 0-255
+// against a reference that follows the loudest recent level (an automatic
+// gain that never goes below a noise gate). A beat is a bass level that
+// jumps well above its running average, at most every 250 ms.
+//
+// All buffers and tables are members or constants: no allocation, and
+// process() does the same work for every hop.
+class AudioAnalyzer {
+ public:
+  static const uint32_t kWindow = 512;  // FFT size
+  static const uint32_t kHop = 256;     // New samples per analysis, 16 ms at 16 kHz
+
+  void begin(uint32_t sampleRate);
+  uint32_t sampleRate() const { return sampleRate_; }
+
+  // Feed samples. Returns how many hops completed (features() changed).
+  uint32_t process(const int16_t* samples, uint32_t count);
+
+  const AudioFeatures& features() const { return features_; }
+
+  // In-place fixed-point FFT of kWindow complex Q15 values, input in natural
+  // order. Returns the block exponent: the true spectrum is the result
+  // shifted left by it.
+  static int fft(int16_t* re, int16_t* im);
+
+  // log2(x) in Q8, 0 for x = 0
+  static int32_t log2Q8(uint64_t x);
+
+ private:
+  void analyze();
+
+  uint32_t sampleRate_ = 16000;
+  uint16_t bandEdges_[kAudioBands + 1];  // First bin of each band, then the end
+  uint16_t bassBins_ = 4;                // Bins 1..bassBins_ are bass
+  uint16_t beatHoldHops_ = 16;           // Minimum hops between beats
+
+  int16_t history_[kWindow];  // Last kWindow samples, oldest first
+  uint32_t fill_ = 0;         // Samples in history_ not yet analyzed
+  int16_t re_[kWindow];
+  int16_t im_[kWindow];
+  uint64_t hopEnergy_ = 0;    // Sum of squares of the newest hop
+
+  int32_t bandReferenceQ8_ = 0;
+  int32_t levelReferenceQ8_ = 0;
+  int32_t bassAverageQ8_ = 0;
+  int32_t previousBassQ8_ = 0;
+  uint32_t hopsSinceBeat_ = 0;
+  AudioFeatures features_ = {};
+};
+
+// Hands features from the audio task to the render core. The audio side
+// publishes every hop; the render side takes the newest, and any number of
+// effects may read it in one frame.
+class AudioFeed {
+ public:
+  // Producer side. False if the render core has fallen 4 hops behind; the
+  // counts in the next features still carry any beat in the one dropped.
+  bool publish(const AudioFeatures& features) { return queue_.push(features); }
+
+  // Consumer side
+  const AudioFeatures& latest() {
+    AudioFeatures features;
+    while(queue_.pop(features)) {
+      latest_ = features;
+    }
+    return latest_;
+  }
+
+ private:
+  SpscQueue<AudioFeatures, 4> queue_;
+  AudioFeatures latest_ = {};
+};
+
+// 16-bit PCM WAV input for the host tools and benchmarks. Stereo is mixed
+// down to mono as it is read.
+class WavReader {
+ public:
+  // Reads the header from f, which stays owned by the caller. False if it
+  // is not a 16-bit PCM WAV.
+  bool open(FILE* f);
+  uint32_t sampleRate() const { return sampleRate_; }
+  uint16_t channels() const { return channels_; }
+  uint32_t frames() const { return frames_; }
+
+  // Read up to count mono samples. Returns how many were read, 0 at the end.
+  uint32_t read(int16_t* samples, uint32_t count);
+
+ private:
+  FILE* file_ = nullptr;
+  uint32_t sampleRate_ = 0;
+  uint16_t channels_ = 0;
+  uint32_t frames_ = 0;
+  uint32_t remaining_ = 0;  // Frames left in the data chunk
+};
+
+// Write a mono 16-bit WAV header for frames samples; the samples follow
+bool writeWavHeader(FILE* f, uint32_t sampleRate, uint32_t frames);
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "AudioAnalyzer.h"
+#include "EffectRegistry.h"
+
+// Music-reactive effects, drawn from the AudioFeatures an AudioFeed hands
+// over. With no feed (or no audio yet) they show silence: dark bars, no
+// pulses and an empty meter. Kernels follow EffectKernels.h: templated on
+// the pixel count type, inline, every pixel written.
+
+inline constexpr AudioFeatures kSilence = {};
+
+// Jump up to target, fall back to it at full scale per fallMs
+inline uint16_t fallTowards(uint16_t current, uint16_t target, uint32_t fallMs, uint32_t dtUs) {
+  if(target >= current) {
+    return target;
+  }
+  const uint64_t drop = fallMs > 0 ? (uint64_t)65535 * dtUs / (fallMs * 1000) : 65535;
+  return (uint64_t)(current - target) > drop ? (uint16_t)(current - drop) : target;
+}
+
+// Fill length pixels with color up to level (0-65535 of the run), the
+// pixel at the edge partly lit, and black after
+inline void drawBar(Rgb16* pixels, uint32_t length, uint16_t level, Rgb16 color) {
+  const uint32_t lit = level * length;  // 16.16 pixels
+  const uint32_t full = lit >> 16;
+  const uint32_t edge = (lit >> 8) & 255;
+  for(uint32_t i = 0; i < full; i++) {
+    pixels[i] = color;
+  }
+  if(full < length) {
+    pixels[full] = Rgb16{(uint16_t)(color.r * edge >> 8), (uint16_t)(color.g * edge >> 8), (uint16_t)(color.b * edge >> 8)};
+    for(uint32_t i = full + 1; i < length; i++) {
+      pixels[i] = Rgb16{0, 0, 0};
+    }
+  }
+}
+
+static const Rgb16 kPeakColor = {0x6000, 0x6000, 0x6000};
+
+struct SpectrumState {
+  AudioFeed* feed = nullptr;
+  uint16_t fallMs = 400;  // Bars drop from full to empty in this long
+  uint16_t heights[kAudioBands] = {};
+  uint16_t peaks[kAudioBands] = {};
+};
+
+// One bar per band along the strip, bass first, with a falling peak dot
+template <typename Count>
+inline void spectrumKernel(Rgb16* pixels, Count count, SpectrumState& state, const AudioFeatures& audio,
+                           uint32_t dtUs) {
+  for(uint8_t b = 0; b < kAudioBands; b++) {
+    state.heights[b] = fallTowards(state.heights[b], audio.bands[b] * 257, state.fallMs, dtUs);
+    state.peaks[b] = fallTowards(state.peaks[b], state.heights[b], state.fallMs * 3, dtUs);
+
+    const uint32_t start = b * count / kAudioBands;
+    const uint32_t length = (b + 1) * count / kAudioBands - start;
+    drawBar(pixels + start, length, state.heights[b], kRainbowPalette.rgb16[b * 170 / kAudioBands]);
+    const uint32_t peak = (state.peaks[b] * length) >> 16;
+    if(peak > (state.heights[b] * length) >> 16 && peak < length) {
+      pixels[start + peak] = kPeakColor;
+    }
+  }
+}
+
+struct BeatState {
+  AudioFeed* feed = nullptr;
+  uint16_t decayMs = 150;  // Pulse brightness halves in this long
+  uint32_t beats = 0;      // AudioFeatures::beats last seen
+  uint16_t flash = 0;
+  uint8_t hue = 0;
+};
+
+// Every beat sends a pulse out from the middle in the next color, fading as
+// it spreads; between beats the strip glows faintly with the bass
+template <typename Count>
+inline void beatKernel(Rgb16* pixels, Count count, BeatState& state, const AudioFeatures& audio, uint32_t dtUs) {
+  if(audio.beats != state.beats) {
+    state.beats = audio.beats;
+    state.flash = 65535;
+    state.hue += 37;
+  } else {
+    state.flash = ((uint32_t)state.flash * fadeScaleFor(0.5f, dtUs, state.decayMs * 1000u)) >> 16;
+  }
+
+  const Rgb16 color = kRainbowPalette.rgb16[state.hue];
+  const uint32_t glow = audio.bass * 64;  // Up to a quarter
+  const uint32_t inner = state.flash > glow ? state.flash : glow;
+  const Rgb16 pulse = {(uint16_t)(color.r * inner >> 16), (uint16_t)(color.g * inner >> 16),
+                       (uint16_t)(color.b * inner >> 16)};
+  const Rgb16 outer = {(uint16_t)(color.r * glow >> 16), (uint16_t)(color.g * glow >> 16),
+                       (uint16_t)(color.b * glow >> 16)};
+  const uint32_t half = count / 2;
+  const uint32_t radius = ((uint64_t)(65535 - state.flash) * (half + 1)) >> 16;
+  for(uint32_t i = 0; i < count; i++) {
+    const uint32_t distance = i < half ? half - i : i - half;
+    pixels[i] = distance <= radius ? pulse : outer;
+  }
+}
+
+struct VuState {
+  AudioFeed* feed = nullptr;
+  uint16_t fallMs = 600;
+  uint16_t level = 0;
+  uint16_t peak = 0;
+};
+
+// Level meter from the start of the strip, green to red, with a peak hold
+template <typename Count>
+inline void vuKernel(Rgb16* pixels, Count count, VuState& state, const AudioFeatures& audio, uint32_t dtUs) {
+  state.level = fallTowards(state.level, audio.level * 257, state.fallMs, dtUs);
+  state.peak = fallTowards(state.peak, state.level, state.fallMs * 4, dtUs);
+
+  const uint64_t level = (uint64_t)state.level * count;  // 16.16 pixels
+  const uint32_t lit = level >> 16;
+  const uint32_t edge = (level >> 8) & 255;
+  // Palette entry i * 256 / count, as a 8.24 step so long strips need no
+  // division per pixel
+  const uint64_t step = ((uint64_t)256 << 24) / count;
+  for(uint32_t i = 0; i < lit && i < count; i++) {
+    pixels[i] = kVuPalette.rgb16[(i * step >> 24) & 255];
+  }
+  if(lit < count) {
+    const Rgb16 c = kVuPalette.rgb16[(lit * step >> 24) & 255];
+    pixels[lit] = Rgb16{(uint16_t)(c.r * edge >> 8), (uint16_t)(c.g * edge >> 8), (uint16_t)(c.b * edge >> 8)};
+    for(uint32_t i = lit + 1; i < count; i++) {
+      pixels[i] = Rgb16{0, 0, 0};
+    }
+  }
+  const uint32_t peak = ((uint64_t)state.peak * count) >> 16;
+  if(peak > lit && peak < count) {
+    pixels[peak] = kPeakColor;
+  }
+}
+
+struct SpectrumDef : EffectDef {
+  static constexpr const char* kName = "Spectrum";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = SpectrumState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("fall", &SpectrumState::fallMs, (uint16_t)50, (uint16_t)3000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    spectrumKernel(fb.pixels, count, state, state.feed ? state.feed->latest() : kSilence, dtUs);
+    return fb;
+  }
+};
+
+struct BeatDef : EffectDef {
+  static constexpr const char* kName = "Beat";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = BeatState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("decay", &BeatState::decayMs, (uint16_t)30, (uint16_t)2000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    beatKernel(fb.pixels, count, state, state.feed ? state.feed->latest() : kSilence, dtUs);
+    return fb;
+  }
+  // Only beats from now on start a pulse
+  static void onSelect(State& state) {
+    if(state.feed) {
+      state.beats = state.feed->latest().beats;
+    }
+  }
+};
+
+struct VuDef : EffectDef {
+  static constexpr const char* kName = "VU";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = VuState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("fall", &VuState::fallMs, (uint16_t)50, (uint16_t)3000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    vuKernel(fb.pixels, count, state, state.feed ? state.feed->latest() : kSilence, dtUs);
+    return fb;
+  }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <type_traits>
+
+#include "Effects.h"
+#include "PixelKernels.h"
+
+// Effect kernels, templated on the type of the pixel count: uint32_t for a
+// strip sized at run time (rainbowEffect() and friends), FixedCount<N> when
+// the length is known at compile time (EffectRegistry). They are inline, so
+// with a FixedCount every loop bound, clip and division by the count reaches
+// the compiler as a constant.
+
+// KITT tail colors, head first, so drawing the tail is a straight copy
+static constexpr std::array<Rgb16, kKittTailMax> buildKittTail() {
+  std::array<Rgb16, kKittTailMax> tail = {};
+  for(int i = 0; i < kKittTailMax; i++) {
+    tail[i] = toRgb16(Rgb{(uint8_t)(255 - (i * 30)), 0, 0});
+  }
+  return tail;
+}
+
+inline constexpr std::array<Rgb16, kKittTailMax> kKittTailColors = buildKittTail();
+
+// Fade count pixels towards black, like fadeFrame()
+template <typename Count>
+inline void fadePixels(Rgb16* pixels, Count count, uint16_t scale) {
+  uint16_t* __restrict data = &pixels[0].r;
+  for(uint32_t i = 0; i < count * 3; i++) {
+    data[i] = ((uint32_t)data[i] * scale) >> 16;
+  }
+}
+
+// Copy a tail ending at head (tail[0]) and running backwards, clipped to the
+// strip up front so the copy loop has no bounds check
+template <typename Count>
+inline void drawTail(Rgb16* pixels, Count count, int head, const Rgb16* tail, int length) {
+  const int numLeds = count;
+  const int first = head >= numLeds ? head - numLeds + 1 : 0;
+  const int last = head < length - 1 ? head : length - 1;
+  for(int i = first; i <= last; i++) {
+    pixels[head - i] = tail[i];
+  }
+}
+
+template <typename Count>
+inline void fillKernel(Rgb16* pixels, Count count, Rgb16 color) {
+  for(uint32_t i = 0; i < count; i++) {
+    pixels[i] = color;
+  }
+}
+
+template <typename Count>
+inline void rainbowKernel(Rgb16* pixels, Count count, RainbowState& state, uint32_t dtUs) {
+  const Rgb16* colors = state.palette->rgb16.data();
+  if constexpr(!std::is_integral<Count>::value) {
+    // Pixel i shows hue offset + i * 256 / count. With the count a constant
+    // the division is a multiply and shift, cheaper than carrying.
+    const uint32_t offset = (state.phase >> kSubPixelShift) & 255;
+    for(uint32_t i = 0; i < count; i++) {
+      pixels[i] = colors[(offset + i * 256 / count) & 255];
+    }
+  } else if(count > 0) {
+    // Step the quotient and carry the remainder instead of dividing per
+    // pixel
+    const uint32_t step = 256 / count;
+    const uint32_t rem = 256 % count;
+    uint32_t hue = (state.phase >> kSubPixelShift) & 255;
+    uint32_t acc = 0;
+    for(uint32_t i = 0; i < count; i++) {
+      pixels[i] = colors[hue & 255];
+      acc += rem;
+      const uint32_t carry = acc >= count;
+      acc -= carry * count;
+      hue += step + carry;
+    }
+  }
+  state.phase = (state.phase + advanceFixed(state.speed, dtUs)) & ((256 << kSubPixelShift) - 1);
+}
+
+// Meteor colors and speeds (in halves of MeteorState::speed), taken in
+// turn: blue-white, purple, cyan
+inline constexpr Rgb16 kMeteorColors[3] = {toRgb16(Rgb{255, 127, 255}), toRgb16(Rgb{255, 63, 127}),
+                                           toRgb16(Rgb{127, 255, 85})};
+static const uint8_t kMeteorPace[3] = {2, 3, 2};
+
+template <typename Count>
+inline void meteorKernel(Rgb16* pixels, Count count, MeteorState& state, uint32_t dtUs) {
+  const int numLeds = count;
+  const int tail = state.tail < 1 ? 1 : state.tail > kMeteorTailMax ? kMeteorTailMax : state.tail;
+  const int meteors = state.count < 1 ? 1 : state.count > kMeteorMax ? kMeteorMax : state.count;
+  ParticlePool<kMeteorMax>& pool = state.meteors;
+
+  // Top up to the number asked for: spread along the strip at the start,
+  // afterwards in from just before it
+  pool.truncate(meteors);
+  const bool spread = pool.live() == 0;
+  while(pool.live() < meteors) {
+    const int k = state.launched++ % 3;
+    const int32_t pos = spread ? (int32_t)((int64_t)pool.live() * numLeds / meteors) : -tail;
+    pool.spawn(Particle{pos << kSubPixelShift, (int32_t)(state.speed * kMeteorPace[k] / 2) << kSubPixelShift,
+                        kMeteorColors[k], 0, 0});
+  }
+  // The tail counts the head
+  for(uint16_t i = 0; i < pool.live(); i++) {
+    pool.tail(i) = tail - 1;
+  }
+
+  fillKernel(pixels, count, Rgb16{0, 0, 0});
+  pool.draw(pixels, count);
+
+  // Move the meteors, wrapping round to just before the start of the strip
+  pool.update(dtUs);
+  pool.wrap(-tail << kSubPixelShift, (numLeds + tail) << kSubPixelShift);
+}
+
+template <typename Count>
+inline void kittKernel(Rgb16* pixels, Count count, KittState& state, uint32_t dtUs) {
+  const int numLeds = count;
+  const int tail = state.tail < 1 ? 1 : state.tail > kKittTailMax ? kKittTailMax : state.tail;
+
+  // Fade all LEDs
+  fadePixels(pixels, count, fadeScaleFor(0.75f, dtUs, kEffectStepUs));
+
+  // Draw the scanner with trailing effect
+  drawTail(pixels, count, state.position >> kSubPixelShift, kKittTailColors.data(), tail);
+
+  // Move the scanner
+  state.position += state.direction * advanceFixed(state.speed, dtUs);
+
+  // Bounce at the ends, reflecting any overshoot so no travel is lost
+  const int32_t last = (numLeds - 1) << kSubPixelShift;
+  if(state.position >= last) {
+    state.direction = -1;
+    state.position = last > 0 ? last - (state.position - last) % last : 0;
+  } else if(state.position <= 0) {
+    state.direction = 1;
+    state.position = last > 0 ? -state.position % last : 0;
+  }
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "EffectKernels.h"
+#include "Effects.h"
+#include "FireEngine.h"
+#include "Framebuffer.h"
+
+// Compile-time effect registry.
+//
+// An effect is a definition struct: a name, how the UI offers it, a State
+// struct holding everything it animates, typed parameters pointing into that
+// state, and a render function templated on the pixel count type:
+//
+//   struct RainbowDef : EffectDef {
+//     static constexpr const char* kName = "Rainbow";
+//     using State = RainbowState;
+//     static constexpr auto params() {
+//       return std::make_tuple(effectParam("speed", &RainbowState::speed, uint16_t(1), uint16_t(1000)));
+//     }
+//     template <typename Count>
+//     static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs);
+//   };
+//
+// EffectRegistry<N, Defs...> owns one State per effect and numbers the
+// effects in the order listed. It renders through a table generated from the
+// list, calling each render() with FixedCount<N>, so the kernels of a build
+// are specialized on its strip length. Adding an effect is a definition and
+// an entry in the list; ids, names, buttons and parameters follow from it.
+
+// How the UI offers an effect
+enum EffectButton : uint8_t {
+  EFFECT_TILE,    // Picture tile in the effect grid
+  EFFECT_BUTTON,  // Text button in the row below the grid
+  EFFECT_HIDDEN,  // Selected some other way (the color swatches pick Solid)
+};
+
+// A parameter: a field of the effect's State and the range it may take
+template <typename State, typename T>
+struct EffectParam {
+  const char* name;
+  T State::*field;
+  T min;
+  T max;
+};
+
+template <typename State, typename T>
+constexpr EffectParam<State, T> effectParam(const char* name, T State::*field, T min, T max) {
+  return EffectParam<State, T>{name, field, min, max};
+}
+
+// A parameter's name and range, whatever its type
+struct EffectParamInfo {
+  const char* name;
+  int32_t min;
+  int32_t max;
+};
+
+// Defaults for effect definitions, which derive from it and hide what they
+// change
+struct EffectDef {
+  static constexpr EffectButton kButton = EFFECT_TILE;
+  static constexpr std::tuple<> params() { return std::tuple<>(); }
+  // Called when the effect is selected, before its first frame
+  template <typename State>
+  static void onSelect(State&) {}
+  // True if rendering now would give the same frame as the last render, so
+  // the render core may skip it. Only for frames that follow from the state
+  // alone; state changes arrive as commands, which always render.
+  template <typename State>
+  static bool still(State&) { return false; }
+};
+
+template <uint32_t N, typename... Defs>
+class EffectRegistry {
+  typedef std::tuple<Defs...> DefList;
+  template <size_t I>
+  using Def = typename std::tuple_element<I, DefList>::type;
+  typedef std::make_index_sequence<sizeof...(Defs)> Indices;
+
+ public:
+  static constexpr uint8_t kCount = sizeof...(Defs);
+  static constexpr uint32_t kLeds = N;
+  static_assert(kCount > 0 && kCount < 255, "1-254 effects");
+
+  // Id of an effect definition: its position in the list
+  template <typename D>
+  static constexpr uint8_t id() {
+    constexpr bool matches[] = {std::is_same<D, Defs>::value...};
+    for(uint8_t i = 0; i < kCount; i++) {
+      if(matches[i]) {
+        return i;
+      }
+    }
+    return 255;
+  }
+
+  template <typename D>
+  typename D::State& state() {
+    static_assert(id<D>() != 255, "effect is not in this registry");
+    return std::get<id<D>()>(states_);
+  }
+
+  static constexpr const char* name(uint8_t effect) { return effect < kCount ? kNames[effect] : ""; }
+  static constexpr EffectButton button(uint8_t effect) { return effect < kCount ? kButtons[effect] : EFFECT_HIDDEN; }
+
+  // How many effects the UI shows as b
+  static constexpr uint8_t buttonCount(EffectButton b) {
+    uint8_t n = 0;
+    for(uint8_t i = 0; i < kCount; i++) {
+      n += kButtons[i] == b;
+    }
+    return n;
+  }
+
+  static uint8_t paramCount(uint8_t effect) {
+    uint8_t n = 0;
+    visit(effect, [&](auto i) { n = std::tuple_size<decltype(Def<decltype(i)::value>::params())>::value; });
+    return n;
+  }
+
+  static EffectParamInfo paramInfo(uint8_t effect, uint8_t param) {
+    EffectParamInfo info = {"", 0, 0};
+    visitParam(effect, param, [&](auto, const auto& p) { info = EffectParamInfo{p.name, (int32_t)p.min, (int32_t)p.max}; });
+    return info;
+  }
+
+  // Set a parameter, clamped to its range. False if there is no such
+  // effect or parameter.
+  bool setParam(uint8_t effect, uint8_t param, int32_t value) {
+    return visitParam(effect, param, [&](auto i, const auto& p) {
+      const int32_t clamped = value < (int32_t)p.min ? (int32_t)p.min : value > (int32_t)p.max ? (int32_t)p.max : value;
+      std::get<decltype(i)::value>(states_).*p.field = (decltype(p.min))clamped;
+    });
+  }
+
+  int32_t param(uint8_t effect, uint8_t param) {
+    int32_t value = 0;
+    visitParam(effect, param, [&](auto i, const auto& p) { value = (int32_t)(std::get<decltype(i)::value>(states_).*p.field); });
+    return value;
+  }
+
+  void onSelect(uint8_t effect) {
+    visit(effect, [&](auto i) {
+      constexpr size_t I = decltype(i)::value;
+      Def<I>::onSelect(std::get<I>(states_));
+    });
+  }
+
+  // Def::still() of effect
+  bool still(uint8_t effect) {
+    bool result = false;
+    visit(effect, [&](auto i) {
+      constexpr size_t I = decltype(i)::value;
+      result = Def<I>::still(std::get<I>(states_));
+    });
+    return result;
+  }
+
+  // Render effect into fb, which must hold N pixels, and return the frame
+  // to show (fb, or a buffer of the effect's own)
+  const Framebuffer16& render(uint8_t effect, Framebuffer16& fb, uint32_t dtUs) {
+    if(effect >= kCount || fb.count != N) {
+      return fb;
+    }
+    return kRender[effect](*this, fb, dtUs);
+  }
+
+  // Matches TransitionEngine's EffectRenderFn, with the registry as context
+  static const Framebuffer16& renderFn(Framebuffer16& fb, uint8_t effect, uint32_t dtUs, void* registry) {
+    return static_cast<EffectRegistry*>(registry)->render(effect, fb, dtUs);
+  }
+
+ private:
+  typedef const Framebuffer16& (*RenderFn)(EffectRegistry&, Framebuffer16&, uint32_t);
+
+  template <size_t I>
+  static const Framebuffer16& renderAt(EffectRegistry& registry, Framebuffer16& fb, uint32_t dtUs) {
+    return Def<I>::render(fb, FixedCount<N>(), std::get<I>(registry.states_), dtUs);
+  }
+
+  template <size_t... I>
+  static constexpr std::array<RenderFn, kCount> renderTable(std::index_sequence<I...>) {
+    return {{&renderAt<I>...}};
+  }
+
+  // Call f(integral_constant<size_t, I>) for I == effect
+  template <typename F, size_t... I>
+  static bool visit(uint8_t effect, F&& f, std::index_sequence<I...>) {
+    return ((effect == I ? (f(std::integral_constant<size_t, I>()), true) : false) || ...);
+  }
+  template <typename F>
+  static bool visit(uint8_t effect, F&& f) {
+    return visit(effect, f, Indices());
+  }
+
+  // Call f(integral_constant<size_t, I>, EffectParam) for parameter param of
+  // effect I == effect
+  template <typename F, typename Params, size_t... P>
+  static bool visitParamOf(const Params& params, uint8_t param, F&& f, std::index_sequence<P...>) {
+    return ((param == P ? (f(std::get<P>(params)), true) : false) || ...);
+  }
+  template <typename F>
+  static bool visitParam(uint8_t effect, uint8_t param, F&& f) {
+    bool found = false;
+    visit(effect, [&](auto i) {
+      constexpr auto params = Def<decltype(i)::value>::params();
+      found = visitParamOf(params, param, [&](const auto& p) { f(i, p); },
+                           std::make_index_sequence<std::tuple_size<decltype(params)>::value>());
+    });
+    return found;
+  }
+
+  static constexpr const char* kNames[] = {Defs::kName...};
+  static constexpr EffectButton kButtons[] = {Defs::kButton...};
+  static constexpr std::array<RenderFn, kCount> kRender = renderTable(Indices());
+
+  std::tuple<typename Defs::State...> states_;
+};
+
+// The engine's own effects
+
+struct RainbowDef : EffectDef {
+  static constexpr const char* kName = "Rainbow";
+  using State = RainbowState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("speed", &RainbowState::speed, (uint16_t)1, (uint16_t)1000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    rainbowKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
+
+struct FireState {
+  FireEngine engine;  // Sized by render() or begin() for more than one flame
+  uint8_t cooling = 55;
+  uint8_t sparking = 120;
+};
+
+struct FireDef : EffectDef {
+  static constexpr const char* kName = "Fire";
+  using State = FireState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("cooling", &FireState::cooling, (uint8_t)20, (uint8_t)100),
+                           effectParam("sparking", &FireState::sparking, (uint8_t)50, (uint8_t)200));
+  }
+  // The heat model runs per segment at run time; its length comes from begin()
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count, State& state, uint32_t dtUs) {
+    state.engine.setCooling(state.cooling);
+    state.engine.setSparking(state.sparking);
+    state.engine.update(fb, dtUs);
+    return fb;
+  }
+};
+
+struct MeteorDef : EffectDef {
+  static constexpr const char* kName = "Meteor";
+  using State = MeteorState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("tail", &MeteorState::tail, (uint8_t)1, (uint8_t)kMeteorTailMax),
+                           effectParam("count", &MeteorState::count, (uint8_t)1, (uint8_t)kMeteorMax));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    meteorKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
+
+struct KittDef : EffectDef {
+  static constexpr const char* kName = "KITT";
+  using State = KittState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("speed", &KittState::speed, (uint16_t)10, (uint16_t)2000),
+                           effectParam("tail", &KittState::tail, (uint8_t)1, (uint8_t)kKittTailMax));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    kittKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
+
+// Dark: the layer starts cleared and nothing is drawn
+struct OffDef : EffectDef {
+  static constexpr const char* kName = "Off";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  struct State {};
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count, State&, uint32_t) {
+    return fb;
+  }
+  static bool still(State&) { return true; }
+};
+
+struct SolidState {
+  Rgb16 color = {0, 0, 0};
+};
+
+struct SolidDef : EffectDef {
+  static constexpr const char* kName = "Solid";
+  static constexpr EffectButton kButton = EFFECT_HIDDEN;
+  using State = SolidState;
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t) {
+    fillKernel(fb.pixels, count, state.color);
+    return fb;
+  }
+  static bool still(State&) { return true; }
+};
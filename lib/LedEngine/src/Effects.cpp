@@ -0,0 +1,19 @@
+#include "Effects.h"
+
+#include "EffectKernels.h"
+
+void rainbowEffect(Framebuffer16& fb, RainbowState& state, uint32_t dtUs) {
+  rainbowKernel(fb.pixels, fb.count, state, dtUs);
+}
+
+void meteorEffect(Framebuffer16& fb, MeteorState& state, uint32_t dtUs) {
+  meteorKernel(fb.pixels, fb.count, state, dtUs);
+}
+
+void kittEffect(Framebuffer16& fb, KittState& state, uint32_t dtUs) {
+  kittKernel(fb.pixels, fb.count, state, dtUs);
+}
+
+void solidColorEffect(Framebuffer16& fb, Rgb color) {
+  fillKernel(fb.pixels, fb.count, toRgb16(color));
+}
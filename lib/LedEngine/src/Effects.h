@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "FireEngine.h"
+#include "Framebuffer.h"
+#include "Palette.h"
+#include "ParticlePool.h"
+
+// LED effects, rendered into a 16-bit Framebuffer16 instead of straight into
+// the NeoPixel strip. Each effect keeps its animation state in its own struct so
+// several strips (or benchmark runs of different lengths) can coexist.
+
+// Effect speeds were originally tuned per call of a loop() paced by
+// delay(20). They are now expressed per second and advanced by the elapsed
+// time (dtUs) each call, so animation speed no longer depends on frame rate.
+static const uint32_t kEffectStepUs = 20000;
+
+// Positions are fixed point with 12 fractional bits, which leaves room for
+// strips of up to 512k LEDs in an int32_t
+static const int kSubPixelShift = 12;
+static_assert(kSubPixelShift == kParticleShift, "effects and particles share positions");
+
+// Fixed-point distance covered at speed (LEDs or hue steps per second) in
+// dtUs, rounded so per-frame error does not accumulate in one direction
+inline int32_t advanceFixed(uint32_t perSecond, uint32_t dtUs) {
+  return (int32_t)((((uint64_t)perSecond * dtUs << kSubPixelShift) + 500000) / 1000000);
+}
+
+// Longest meteor and KITT tails; MeteorState/KittState::tail can be shorter
+static const int kMeteorTailMax = 12;
+static const int kMeteorMax = 32;  // Meteors in flight at once
+static const int kKittTailMax = 8;
+
+struct RainbowState {
+  uint32_t phase = 0;   // Hue offset, fixed point
+  uint16_t speed = 50;  // Hue steps (of 256) per second
+  const Palette* palette = &kRainbowPalette;  // Any named palette works
+};
+
+// Meteors are particles that wrap round the strip; the first ones start
+// spread evenly along it, later ones come in from the start. They take
+// their colors and speeds from three in turn.
+struct MeteorState {
+  ParticlePool<kMeteorMax> meteors;
+  uint8_t count = 3;              // Meteors in flight
+  uint8_t tail = kMeteorTailMax;  // Tail length in LEDs
+  uint16_t speed = 100;           // LEDs per second of the slowest
+  uint16_t launched = 0;          // Meteors started so far
+};
+
+struct KittState {
+  int32_t position = 0;  // Fixed point
+  int8_t direction = 1;
+  uint16_t speed = 200;  // LEDs per second - much faster than the meteors
+  uint8_t tail = kKittTailMax;
+};
+
+// Runtime-length entry points. EffectKernels.h has the kernels behind them,
+// for callers that know the strip length at compile time.
+
+// Effect 1: Moving Rainbow
+void rainbowEffect(Framebuffer16& fb, RainbowState& state, uint32_t dtUs);
+
+// Effect 2: Fire effect with flickering flames - see FireEngine
+
+// Effect 3: Meteor shower effect
+void meteorEffect(Framebuffer16& fb, MeteorState& state, uint32_t dtUs);
+
+// Effect 4: KITT Knight Rider scanner effect
+void kittEffect(Framebuffer16& fb, KittState& state, uint32_t dtUs);
+
+// Solid color effect - fill entire strip with selected color
+void solidColorEffect(Framebuffer16& fb, Rgb color);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// Small inline PRNG (xorshift32) for per-pixel use in effect kernels. It only
+// has to look random on an LED strip; Arduino random() costs a modulo and a
+// library call per draw, which dominates kernels that need one per LED.
+struct FastRandom {
+  uint32_t state;
+
+  explicit FastRandom(uint32_t seed = 0x9E3779B9u) : state(seed ? seed : 1) {}
+
+  void seed(uint32_t s) {
+    state = s ? s : 1;
+  }
+
+  uint32_t next() {
+    uint32_t x = state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    state = x;
+    return x;
+  }
+
+  // Uniform value in [0, bound) without a division
+  uint32_t below(uint32_t bound) {
+    return (uint32_t)(((uint64_t)next() * bound) >> 32);
+  }
+
+  // Uniform value in [low, high)
+  uint32_t range(uint32_t low, uint32_t high) {
+    return low + below(high - low);
+  }
+};
@@ -0,0 +1,227 @@
+#include "FireEngine.h"
+
+#include <string.h>
+
+#include <array>
+
+// Sparks land in the bottom cells of each flame
+static const uint32_t kSparkZone = 7;
+
+// The heat palette's Rgb16 entries in the low 48 bits of a word, so four
+// pixels go out as three 64-bit stores. Both targets are little-endian.
+static std::array<uint64_t, 256> packHeatPalette() {
+  std::array<uint64_t, 256> words;
+  for(int i = 0; i < 256; i++) {
+    const Rgb16& c = kHeatPalette.rgb16[i];
+    words[i] = c.r | (uint64_t)c.g << 16 | (uint64_t)c.b << 32;
+  }
+  return words;
+}
+
+static const std::array<uint64_t, 256> kHeatWords = packHeatPalette();
+
+// Cooling range scales with flame length, as in the original effect. Up
+// to 256 the product fits 16 bits, which doubles the vector width; only
+// flames of a few LEDs at high cooling go past it.
+static inline void coolCells(const uint8_t* __restrict cells, const uint8_t* __restrict random, uint32_t count,
+                             uint32_t maxCool, uint8_t* __restrict cooled) {
+  if(maxCool <= 256) {
+    const uint16_t scale = (uint16_t)maxCool;
+    for(uint32_t i = 0; i < count; i++) {
+      const uint8_t c = (uint16_t)(random[i] * scale) >> 8;
+      cooled[i] = cells[i] > c ? cells[i] - c : 0;
+    }
+  } else {
+    for(uint32_t i = 0; i < count; i++) {
+      const uint32_t c = (random[i] * maxCool) >> 8;
+      cooled[i] = cells[i] > c ? cells[i] - c : 0;
+    }
+  }
+}
+
+// Heat drifts up: cells[i] = (cooled[i + 1] + 2 * cooled[i]) / 3, with
+// cooled[] starting two cells below cells[]
+static inline void diffuseCells(const uint8_t* __restrict cooled, uint32_t count, uint8_t* __restrict cells) {
+  for(uint32_t i = 0; i < count; i++) {
+    const uint16_t sum = cooled[i + 1] + 2 * cooled[i];
+    cells[i] = (uint16_t)(((uint32_t)sum * 21846) >> 16);  // Exact /3 for 0..765, a 16-bit high multiply
+  }
+}
+
+static inline bool anyWarm(const uint8_t* cells, uint32_t count) {
+  uint8_t warm = 0;
+  for(uint32_t i = 0; i < count; i++) {
+    warm |= cells[i];
+  }
+  return warm != 0;
+}
+
+// Colors count cells into out[0..count), reading them top down when Reversed
+template <bool Reversed>
+static void colorCells(const uint8_t* cells, uint32_t count, Rgb16* out) {
+  auto cell = [&](uint32_t i) { return cells[Reversed ? count - 1 - i : i]; };
+  uint32_t i = 0;
+  for(; i + 4 <= count; i += 4) {
+    const uint64_t p0 = kHeatWords[cell(i)];
+    const uint64_t p1 = kHeatWords[cell(i + 1)];
+    const uint64_t p2 = kHeatWords[cell(i + 2)];
+    const uint64_t p3 = kHeatWords[cell(i + 3)];
+    // One copy per word: an array copied at once goes through the stack
+    const uint64_t w0 = p0 | p1 << 48;
+    const uint64_t w1 = p1 >> 16 | p2 << 32;
+    const uint64_t w2 = p2 >> 32 | p3 << 16;
+    uint8_t* to = (uint8_t*)(out + i);
+    memcpy(to, &w0, 8);
+    memcpy(to + 8, &w1, 8);
+    memcpy(to + 16, &w2, 8);
+  }
+  for(; i < count; i++) {
+    out[i] = kHeatPalette.rgb16[cell(i)];
+  }
+}
+
+FireEngine::FireEngine() {
+  seed(FastRandom().state);
+}
+
+void FireEngine::seed(uint32_t s) {
+  rng_.seed(s);
+  // The cooling streams start from the spark stream's next states, so one
+  // seed still fixes the whole flame
+  FastRandom split(s);
+  for(uint32_t i = 0; i < kCoolStreams; i++) {
+    cool_[i] = split.next();
+  }
+}
+
+void FireEngine::begin(uint32_t numLeds, uint8_t segments, bool mirrored) {
+  if(segments == 0) {
+    segments = 1;
+  }
+  if(segments > kMaxSegments) {
+    segments = kMaxSegments;
+  }
+  if(segments > numLeds && numLeds > 0) {
+    segments = numLeds;
+  }
+
+  numLeds_ = numLeds;
+  heat_.assign(numLeds, 0);
+  segmentCount_ = segments;
+  mirrored_ = mirrored;
+
+  uint32_t start = 0;
+  for(uint8_t s = 0; s < segments; s++) {
+    // Spread the remainder over the first segments
+    uint32_t length = numLeds / segments + (s < numLeds % segments ? 1 : 0);
+    segments_[s] = Segment{start, length, mirrored && (s & 1)};
+    start += length;
+  }
+}
+
+void FireEngine::render(Framebuffer16& fb) {
+  if(fb.count != numLeds_ || segmentCount_ == 0) {
+    begin(fb.count, segmentCount_ ? segmentCount_ : 1, mirrored_);
+  }
+  for(uint8_t s = 0; s < segmentCount_; s++) {
+    if(segments_[s].reversed) {
+      renderSegment<true>(segments_[s], fb.pixels + segments_[s].start);
+    } else {
+      renderSegment<false>(segments_[s], fb.pixels + segments_[s].start);
+    }
+  }
+}
+
+void FireEngine::update(Framebuffer16& fb, uint32_t dtUs) {
+  pendingUs_ += dtUs;
+  if(fb.count != numLeds_) {
+    pendingUs_ = stepUs_;  // Fresh buffer: render right away
+  }
+  uint8_t steps = 0;
+  while(pendingUs_ >= stepUs_ && steps < kMaxStepsPerUpdate) {
+    render(fb);
+    pendingUs_ -= stepUs_;
+    steps++;
+  }
+  if(pendingUs_ >= stepUs_) {
+    pendingUs_ = 0;  // Too far behind; drop the backlog instead of catching up
+  }
+}
+
+// kBlock bytes from the cooling streams. The streams are independent, so
+// the loop over them vectorizes.
+void FireEngine::drawCooling(uint8_t* bytes) {
+  for(uint32_t round = 0; round < kBlock / (4 * kCoolStreams); round++) {
+    uint32_t words[kCoolStreams];
+    for(uint32_t i = 0; i < kCoolStreams; i++) {
+      uint32_t x = cool_[i];
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      cool_[i] = x;
+      words[i] = x;
+    }
+    memcpy(bytes + round * sizeof(words), words, sizeof(words));
+  }
+}
+
+template <bool Reversed>
+void FireEngine::renderSegment(const Segment& seg, Rgb16* out) {
+  uint8_t* heat = heat_.data() + seg.start;
+  const uint32_t n = seg.length;
+  if(n == 0) {
+    return;
+  }
+  auto put = [&](uint32_t k, uint8_t h) {
+    out[Reversed ? n - 1 - k : k] = kHeatPalette.rgb16[h];
+  };
+
+  const uint32_t maxCool = (cooling_ * 10) / n + 2;
+  // The bottom two cells just cool. Walking up a block at a time, cooled[]
+  // holds the two cooled cells under the block followed by the block's own,
+  // so every cell is cooled once and the block is written only after it has
+  // been read.
+  uint8_t random[kBlock];
+  uint8_t cooled[kBlock + 2] = {};
+  for(uint32_t lo = 0; lo < n; lo += kBlock) {
+    const uint32_t len = n - lo < kBlock ? n - lo : kBlock;
+    uint8_t* cells = heat + lo;
+    Rgb16* to = Reversed ? out + n - lo - len : out + lo;
+    // Whole blocks pass the loops a constant trip count, so they need no
+    // remainder handling
+    const bool whole = len == kBlock;
+    // Above the flame everything is cold and stays so: no cooling to draw,
+    // and the palette starts at black
+    if((cooled[0] | cooled[1]) == 0 && !(whole ? anyWarm(cells, kBlock) : anyWarm(cells, len))) {
+      memset(cooled, 0, sizeof(cooled));
+      memset(to, 0, len * sizeof(Rgb16));
+      continue;
+    }
+    drawCooling(random);
+    if(whole) {
+      coolCells(cells, random, kBlock, maxCool, cooled + 2);
+      diffuseCells(cooled, kBlock, cells);
+    } else {
+      coolCells(cells, random, len, maxCool, cooled + 2);
+      diffuseCells(cooled, len, cells);
+    }
+    if(lo == 0) {
+      cells[0] = cooled[2];
+      if(len > 1) {
+        cells[1] = cooled[3];
+      }
+    }
+    colorCells<Reversed>(cells, len, to);
+    cooled[0] = cooled[len];
+    cooled[1] = cooled[len + 1];
+  }
+
+  // Randomly ignite new sparks near the bottom
+  const uint32_t zone = n < kSparkZone ? n : kSparkZone;
+  if(rng_.below(255) < sparking_) {
+    uint32_t y = rng_.below(zone);
+    uint32_t heating = heat[y] + rng_.range(160, 255);
+    heat[y] = heating > 255 ? 255 : heating;
+    put(y, heat[y]);
+  }
+}
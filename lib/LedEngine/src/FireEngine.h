@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "FastRandom.h"
+#include "Framebuffer.h"
+#include "Palette.h"
+
+// Heat-diffusion fire simulation sized to the strip.
+//
+// Per LED and frame the kernel costs a byte of xorshift output for cooling,
+// a multiply-shift for diffusion and a palette lookup. A flame is walked in
+// blocks of kBlock cells that stay in registers and L1: eight xorshift
+// streams fill the block's cooling bytes, cooling and diffusion run as
+// branch-free loops the compiler vectorizes, and the palette lookup writes
+// the block out. The strip can be split into several independent flames,
+// each with its own base, optionally mirrored so neighbouring flames burn
+// towards each other.
+class FireEngine {
+ public:
+  static const uint8_t kMaxSegments = 16;
+
+  FireEngine();
+
+  // Size the heat buffer and lay out the flame segments. Called automatically
+  // with one segment when render() sees a framebuffer of a different length.
+  void begin(uint32_t numLeds, uint8_t segments = 1, bool mirrored = false);
+
+  void setCooling(uint8_t cooling) { cooling_ = cooling; }    // Higher = shorter flames
+  void setSparking(uint8_t sparking) { sparking_ = sparking; }  // Chance of a new spark (of 255)
+  void seed(uint32_t s);
+
+  // Simulation step length. The heat model is inherently per step, so it
+  // runs at a fixed rate whatever the frame rate (default 50 Hz, the rate it
+  // was tuned at).
+  void setStepInterval(uint32_t stepUs) { stepUs_ = stepUs ? stepUs : 1; }
+
+  uint8_t segmentCount() const { return segmentCount_; }
+
+  // Advance by dtUs, running as many simulation steps as are due (at most
+  // kMaxStepsPerUpdate). The framebuffer is left untouched when none are.
+  void update(Framebuffer16& fb, uint32_t dtUs);
+
+  // Run exactly one simulation step and render it
+  void render(Framebuffer16& fb);
+
+  static const uint8_t kMaxStepsPerUpdate = 4;
+
+ private:
+  static const uint32_t kBlock = 128;
+  static const uint32_t kCoolStreams = 8;  // 32 cooling bytes per draw
+  struct Segment {
+    uint32_t start;
+    uint32_t length;
+    bool reversed;
+  };
+
+  template <bool Reversed>
+  void renderSegment(const Segment& seg, Rgb16* out);
+  void drawCooling(uint8_t* bytes);
+
+  std::vector<uint8_t> heat_;
+  Segment segments_[kMaxSegments];
+  uint8_t segmentCount_ = 0;
+  bool mirrored_ = false;
+  uint32_t numLeds_ = 0;
+  uint8_t cooling_ = 55;
+  uint8_t sparking_ = 120;
+  uint32_t stepUs_ = 20000;
+  uint32_t pendingUs_ = 0;
+  FastRandom rng_;  // Sparks
+  uint32_t cool_[kCoolStreams];
+};
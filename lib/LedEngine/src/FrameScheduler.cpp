@@ -0,0 +1,60 @@
+#include "FrameScheduler.h"
+
+void FrameScheduler::begin(uint32_t nowUs, uint16_t fps) {
+  setTargetFps(fps);
+  nextDeadlineUs_ = nowUs;
+  frameStartUs_ = nowUs;
+  deltaUs_ = 0;
+  resetStats();
+}
+
+void FrameScheduler::setTargetFps(uint16_t fps) {
+  if(fps == 0) {
+    fps = 1;
+  }
+  fps_ = fps;
+  periodUs_ = 1000000 / fps;
+}
+
+void FrameScheduler::resume(uint32_t nowUs) {
+  nextDeadlineUs_ = nowUs;
+  frameStartUs_ = nowUs - periodUs_;
+}
+
+bool FrameScheduler::frameDue(uint32_t nowUs) {
+  // Signed difference so micros() wrap-around is harmless
+  int32_t lateness = (int32_t)(nowUs - nextDeadlineUs_);
+  if(lateness < 0) {
+    return false;
+  }
+
+  uint32_t missed = lateness / periodUs_;
+  stats_.missedDeadlines += missed;
+  nextDeadlineUs_ += periodUs_ * (missed + 1);
+
+  uint32_t jitter = lateness - missed * periodUs_;
+  if(jitter > stats_.maxJitterUs) {
+    stats_.maxJitterUs = jitter;
+  }
+  stats_.totalJitterUs += jitter;
+  stats_.frames++;
+
+  deltaUs_ = nowUs - frameStartUs_;
+  if(deltaUs_ > kMaxDeltaUs) {
+    deltaUs_ = kMaxDeltaUs;
+  }
+  frameStartUs_ = nowUs;
+  return true;
+}
+
+void FrameScheduler::frameDone(uint32_t nowUs) {
+  stats_.lastWorkUs = nowUs - frameStartUs_;
+  if(stats_.lastWorkUs > stats_.maxWorkUs) {
+    stats_.maxWorkUs = stats_.lastWorkUs;
+  }
+}
+
+uint32_t FrameScheduler::usUntilNextFrame(uint32_t nowUs) const {
+  int32_t remaining = (int32_t)(nextDeadlineUs_ - nowUs);
+  return remaining > 0 ? remaining : 0;
+}
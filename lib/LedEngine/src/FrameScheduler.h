@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+// Frame pacing statistics, reset with FrameScheduler::resetStats()
+struct FrameStats {
+  uint32_t frames = 0;
+  uint32_t missedDeadlines = 0;  // Frame slots skipped because we ran late
+  uint32_t maxJitterUs = 0;      // Worst lateness of a frame start
+  uint64_t totalJitterUs = 0;
+  uint32_t lastWorkUs = 0;       // frameDue() to frameDone()
+  uint32_t maxWorkUs = 0;
+
+  uint32_t avgJitterUs() const { return frames ? totalJitterUs / frames : 0; }
+};
+
+// Fixed-timestep frame clock. Deadlines sit on a fixed grid of 1/fps, so
+// the frame rate no longer depends on how long touch handling or rendering
+// took; frames that are late by a whole period are counted and skipped
+// rather than caught up. Each due frame reports the real time elapsed since
+// the previous one so effects can animate in time rather than per call.
+class FrameScheduler {
+ public:
+  // Longest delta handed to effects; bigger stalls would make them jump
+  static const uint32_t kMaxDeltaUs = 250000;
+
+  void begin(uint32_t nowUs, uint16_t fps = 60);
+  void setTargetFps(uint16_t fps);
+  uint16_t targetFps() const { return fps_; }
+  uint32_t periodUs() const { return periodUs_; }
+
+  // Start the grid over at nowUs after sleeping through frames on purpose:
+  // a frame is due at once with a delta of one period, and the gap does not
+  // count as missed deadlines
+  void resume(uint32_t nowUs);
+
+  // True when the next frame deadline has passed. Call once per loop.
+  bool frameDue(uint32_t nowUs);
+
+  // Time since the previous frame started, for the frame just made due
+  uint32_t frameDeltaUs() const { return deltaUs_; }
+
+  // Record the end of the frame's work (render + output)
+  void frameDone(uint32_t nowUs);
+
+  // How long the caller may sleep before the next frame is due
+  uint32_t usUntilNextFrame(uint32_t nowUs) const;
+
+  const FrameStats& stats() const { return stats_; }
+  void resetStats() { stats_ = FrameStats(); }
+
+ private:
+  uint16_t fps_ = 60;
+  uint32_t periodUs_ = 1000000 / 60;
+  uint32_t nextDeadlineUs_ = 0;
+  uint32_t frameStartUs_ = 0;
+  uint32_t deltaUs_ = 0;
+  FrameStats stats_;
+};
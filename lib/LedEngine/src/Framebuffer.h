@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <type_traits>
+
+// One LED worth of color, in logical RGB order
+struct Rgb {
+  uint8_t r, g, b;
+};
+
+// Working-precision color: 16 bits per channel, 0xFFFF = full on
+struct Rgb16 {
+  uint16_t r, g, b;
+};
+
+// Widen 8-bit to 16-bit so that 0xFF maps exactly to 0xFFFF
+constexpr Rgb16 toRgb16(Rgb c) {
+  return Rgb16{(uint16_t)(c.r * 257), (uint16_t)(c.g * 257), (uint16_t)(c.b * 257)};
+}
+
+// 16-bit RGB565 as used by the display
+constexpr uint16_t toRgb565(uint8_t r, uint8_t g, uint8_t b) {
+  return (uint16_t)(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+}
+
+// Byte offsets of R, G and B inside one LED's slot on the wire
+struct ColorOrder {
+  uint8_t r, g, b;
+};
+
+static const ColorOrder kOrderRGB = {0, 1, 2};
+static const ColorOrder kOrderGRB = {1, 0, 2};  // WS2812B
+static const ColorOrder kOrderBRG = {1, 2, 0};
+
+// Pack/unpack the 0x00RRGGBB format used by Adafruit_NeoPixel::Color()
+inline uint32_t packColor(Rgb c) {
+  return ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+}
+
+inline Rgb unpackColor(uint32_t color) {
+  return Rgb{(uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color};
+}
+
+// Pixel count known at compile time. Kernels templated on their count type
+// take this or a plain uint32_t (see EffectKernels.h).
+template <uint32_t N>
+using FixedCount = std::integral_constant<uint32_t, N>;
+
+// Plain view onto the pixels an effect renders into. The storage is owned by
+// the caller so the same effect code runs against a static array on the
+// Tab5 and against heap buffers of any length in the native benchmarks.
+struct Framebuffer {
+  Rgb* pixels;
+  uint32_t count;
+
+  void fill(Rgb color) {
+    for(uint32_t i = 0; i < count; i++) {
+      pixels[i] = color;
+    }
+  }
+
+  void clear() {
+    fill(Rgb{0, 0, 0});
+  }
+};
+
+// High-precision working buffer the effects render into. Fades and blends
+// happen at 16 bits per channel; the output pass (see PixelKernels.h) applies
+// global brightness and drops to 8 bits exactly once per frame, so trails
+// keep their shape at low brightness instead of posterizing.
+struct Framebuffer16 {
+  Rgb16* pixels;
+  uint32_t count;
+
+  // Interleaved channels as one flat array of count * 3 values, for the
+  // batched kernels
+  uint16_t* channels() { return &pixels[0].r; }
+  const uint16_t* channels() const { return &pixels[0].r; }
+  uint32_t channelCount() const { return count * 3; }
+
+  void fill(Rgb16 color) {
+    for(uint32_t i = 0; i < count; i++) {
+      pixels[i] = color;
+    }
+  }
+
+  void clear() {
+    fill(Rgb16{0, 0, 0});
+  }
+};
@@ -0,0 +1,65 @@
+#include "IdleGovernor.h"
+
+void IdleGovernor::begin(uint32_t nowUs, uint32_t sleepAfterUs) {
+  sleepAfterUs_ = sleepAfterUs;
+  lastDirtyUs_ = nowUs;
+  asleep_ = false;
+  waking_ = false;
+  resetStats(nowUs);
+}
+
+void IdleGovernor::resetStats(uint32_t nowUs) {
+  stats_ = IdleStats();
+  statsStartUs_ = nowUs;
+}
+
+FrameWork IdleGovernor::frame(uint32_t nowUs, bool dirty, bool dithering) {
+  stats_.frames++;
+  stats_.elapsedUs = nowUs - statsStartUs_;
+  if(dirty) {
+    lastDirtyUs_ = nowUs;
+    asleep_ = false;
+    stats_.rendered++;
+    return FRAME_RENDER;
+  }
+  if(asleep_) {
+    stats_.skipped++;
+    return FRAME_SKIP;
+  }
+  if(nowUs - lastDirtyUs_ >= sleepAfterUs_) {
+    asleep_ = true;
+    stats_.sleeps++;
+    if(dithering) {
+      stats_.refreshed++;
+      return FRAME_SETTLE;
+    }
+    stats_.skipped++;
+    return FRAME_SKIP;
+  }
+  if(dithering) {
+    stats_.refreshed++;
+    return FRAME_REFRESH;
+  }
+  stats_.skipped++;
+  return FRAME_SKIP;
+}
+
+void IdleGovernor::request(uint32_t requestUs) {
+  if(asleep_ && !waking_) {
+    waking_ = true;
+    wakeRequestUs_ = requestUs;
+    stats_.wakeups++;
+  }
+}
+
+void IdleGovernor::frameRendered(uint32_t nowUs) {
+  if(!waking_) {
+    return;
+  }
+  waking_ = false;
+  stats_.lastWakeUs = nowUs - wakeRequestUs_;
+  if(stats_.lastWakeUs > stats_.maxWakeUs) {
+    stats_.maxWakeUs = stats_.lastWakeUs;
+  }
+  stats_.totalWakeUs += stats_.lastWakeUs;
+}
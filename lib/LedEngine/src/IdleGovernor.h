@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+// What the render core does in a frame slot
+enum FrameWork : uint8_t {
+  FRAME_RENDER,   // Render the effect and send the frame
+  FRAME_REFRESH,  // Same frame, sent again so temporal dithering keeps averaging
+  FRAME_SETTLE,   // Last frame before sleeping: sent undithered, it stays up
+  FRAME_SKIP,     // Nothing changed and nothing to send
+};
+
+// Idle statistics, reset with IdleGovernor::resetStats()
+struct IdleStats {
+  uint32_t frames = 0;      // Frame slots decided
+  uint32_t rendered = 0;
+  uint32_t refreshed = 0;   // Sent again for dithering without rendering
+  uint32_t skipped = 0;     // Neither rendered nor sent
+  uint32_t sleeps = 0;      // Times the low-power tick took over
+  uint32_t wakeups = 0;     // Requests that ended a sleep
+  uint32_t lastWakeUs = 0;  // Request to the first frame rendered after it
+  uint32_t maxWakeUs = 0;
+  uint64_t totalWakeUs = 0;
+  uint64_t idleUs = 0;      // Render core blocked
+  uint64_t elapsedUs = 0;   // Up to the last frame slot
+
+  uint32_t avgWakeUs() const { return wakeups ? totalWakeUs / wakeups : 0; }
+  float idleFraction() const { return elapsedUs ? (float)idleUs / elapsedUs : 0.0f; }
+};
+
+// Idle-frame elimination for the render core.
+//
+// Every frame slot the caller says whether anything changed: a command
+// arrived, a transition is running, the effect animates or the current
+// limiter is still adjusting. Unchanged frames are neither rendered nor
+// sent, except that with dithering on the last frame keeps going out so the
+// dither still averages to the exact level. After sleepAfterUs without a
+// change the frame is sent once more without dithering and the governor
+// goes to sleep: the caller drops to a slow tick and blocks until a command
+// or touch wakes it. Wake latency is measured from the request to the first
+// frame rendered after it.
+class IdleGovernor {
+ public:
+  void begin(uint32_t nowUs, uint32_t sleepAfterUs);
+
+  // Decide the frame slot at nowUs. dithering: the output is dithered and
+  // the dither still changes what the strip shows.
+  FrameWork frame(uint32_t nowUs, bool dirty, bool dithering);
+
+  bool asleep() const { return asleep_; }
+
+  // A command or touch at requestUs asked for a change. If it ends a sleep,
+  // its latency is taken at the next frameRendered().
+  void request(uint32_t requestUs);
+  void frameRendered(uint32_t nowUs);
+
+  // The render core was blocked for us
+  void idle(uint32_t us) { stats_.idleUs += us; }
+
+  const IdleStats& stats() const { return stats_; }
+  void resetStats(uint32_t nowUs);
+
+ private:
+  uint32_t sleepAfterUs_ = 2000000;
+  uint32_t lastDirtyUs_ = 0;
+  uint32_t statsStartUs_ = 0;
+  uint32_t wakeRequestUs_ = 0;
+  bool asleep_ = false;
+  bool waking_ = false;  // A wakeup waits for its first frame
+  IdleStats stats_;
+};
@@ -0,0 +1,361 @@
+#include "LedAnimation.h"
+
+#include <string.h>
+
+enum : uint8_t {
+  kFrameKey = 0,
+  kFrameDelta = 1,
+};
+
+// Token ranges, see LedAnimation.h
+static const uint8_t kTokenLiteral = 0x80;
+static const uint8_t kTokenFill = 0xC0;
+static const uint8_t kTokenAdd = 0xE0;
+static const uint32_t kMaxSkip = 128;
+static const uint32_t kMaxLiteral = 64;
+static const uint32_t kMaxRun = 32;  // Fill and add
+
+static const uint32_t kFrameHeaderSize = 5;  // Type + length
+
+static void putU16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+  putU16(p, v);
+  putU16(p + 2, v >> 16);
+}
+
+static uint16_t getU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t* p) {
+  return getU16(p) | ((uint32_t)getU16(p + 2) << 16);
+}
+
+uint32_t MemoryAnimSource::read(uint32_t offset, uint8_t* dst, uint32_t len) {
+  if(offset >= size_) {
+    return 0;
+  }
+  if(len > size_ - offset) {
+    len = size_ - offset;
+  }
+  memcpy(dst, data_ + offset, len);
+  return len;
+}
+
+uint32_t FileAnimSource::read(uint32_t offset, uint8_t* dst, uint32_t len) {
+  if(file_ == nullptr) {
+    return 0;
+  }
+  if(offset != position_ && fseek(file_, offset, SEEK_SET) != 0) {
+    position_ = UINT32_MAX;
+    return 0;
+  }
+  uint32_t got = fread(dst, 1, len, file_);
+  position_ = offset + got;
+  return got;
+}
+
+// --- Writer ---
+
+bool AnimWriter::begin(FILE* out, uint32_t numLeds, uint32_t frameUs, uint16_t keyInterval) {
+  out_ = out;
+  header_ = AnimHeader{numLeds, 0, frameUs, keyInterval ? keyInterval : (uint16_t)1, 0};
+  previous_.assign(numLeds * 3, 0);
+  current_.assign(numLeds * 3, 0);
+  tokens_.clear();
+  tokens_.reserve(numLeds * 3 + numLeds / kMaxLiteral + 16);
+  index_.clear();
+  offset_ = 0;
+  ok_ = out != nullptr;
+
+  // Placeholder, rewritten by finish()
+  uint8_t header[kAnimHeaderSize] = {};
+  return write(header, sizeof(header));
+}
+
+bool AnimWriter::addFrame(const Framebuffer16& fb) {
+  const uint32_t n = header_.numLeds < fb.count ? header_.numLeds : fb.count;
+  for(uint32_t i = 0; i < n; i++) {
+    current_[i * 3] = fb.pixels[i].r >> 8;
+    current_[i * 3 + 1] = fb.pixels[i].g >> 8;
+    current_[i * 3 + 2] = fb.pixels[i].b >> 8;
+  }
+  memset(current_.data() + n * 3, 0, (header_.numLeds - n) * 3);
+  return addFrame(current_.data());
+}
+
+bool AnimWriter::addFrame(const uint8_t* rgb) {
+  if(rgb != current_.data()) {
+    memcpy(current_.data(), rgb, current_.size());
+  }
+  const bool keyframe = index_.size() % header_.keyInterval == 0;
+  encode(keyframe);
+
+  uint8_t frameHeader[kFrameHeaderSize];
+  frameHeader[0] = keyframe ? kFrameKey : kFrameDelta;
+  putU32(frameHeader + 1, tokens_.size());
+  index_.push_back(offset_);
+  write(frameHeader, sizeof(frameHeader));
+  write(tokens_.data(), tokens_.size());
+  previous_.swap(current_);
+  return ok_;
+}
+
+void AnimWriter::encode(bool keyframe) {
+  const uint8_t* c = current_.data();
+  const uint8_t* p = previous_.data();
+  const uint32_t n = header_.numLeds;
+  tokens_.clear();
+
+  auto same = [&](uint32_t i) {
+    return !keyframe && c[i * 3] == p[i * 3] && c[i * 3 + 1] == p[i * 3 + 1] && c[i * 3 + 2] == p[i * 3 + 2];
+  };
+  auto sameColor = [&](uint32_t i, uint32_t j) {
+    return c[i * 3] == c[j * 3] && c[i * 3 + 1] == c[j * 3 + 1] && c[i * 3 + 2] == c[j * 3 + 2];
+  };
+  auto sameChange = [&](uint32_t i, uint32_t j) {
+    return !keyframe && (uint8_t)(c[i * 3] - p[i * 3]) == (uint8_t)(c[j * 3] - p[j * 3]) &&
+           (uint8_t)(c[i * 3 + 1] - p[i * 3 + 1]) == (uint8_t)(c[j * 3 + 1] - p[j * 3 + 1]) &&
+           (uint8_t)(c[i * 3 + 2] - p[i * 3 + 2]) == (uint8_t)(c[j * 3 + 2] - p[j * 3 + 2]);
+  };
+
+  uint32_t i = 0;
+  while(i < n) {
+    if(same(i)) {
+      uint32_t run = 1;
+      while(i + run < n && run < kMaxSkip && same(i + run)) {
+        run++;
+      }
+      tokens_.push_back(run - 1);
+      i += run;
+      continue;
+    }
+
+    uint32_t fill = 1;
+    while(i + fill < n && fill < kMaxRun && sameColor(i + fill, i)) {
+      fill++;
+    }
+    uint32_t add = 1;
+    while(i + add < n && add < kMaxRun && sameChange(i + add, i)) {
+      add++;
+    }
+    if(fill >= 2 && fill >= add) {
+      tokens_.push_back(kTokenFill | (fill - 1));
+      tokens_.insert(tokens_.end(), c + i * 3, c + i * 3 + 3);
+      i += fill;
+      continue;
+    }
+    if(add >= 2) {
+      tokens_.push_back(kTokenAdd | (add - 1));
+      for(int ch = 0; ch < 3; ch++) {
+        tokens_.push_back(c[i * 3 + ch] - p[i * 3 + ch]);
+      }
+      i += add;
+      continue;
+    }
+
+    // Literal pixels up to the next skip, fill or add run
+    const uint32_t start = i;
+    uint32_t count = 1;
+    i++;
+    while(i < n && count < kMaxLiteral && !same(i) &&
+          !(i + 1 < n && (sameColor(i + 1, i) || sameChange(i + 1, i)))) {
+      count++;
+      i++;
+    }
+    tokens_.push_back(kTokenLiteral | (count - 1));
+    tokens_.insert(tokens_.end(), c + start * 3, c + (start + count) * 3);
+  }
+}
+
+bool AnimWriter::write(const void* data, uint32_t len) {
+  if(ok_ && len) {
+    ok_ = fwrite(data, 1, len, out_) == len;
+    offset_ += len;
+  }
+  return ok_;
+}
+
+bool AnimWriter::finish() {
+  header_.frameCount = index_.size();
+  header_.indexOffset = offset_;
+  for(uint32_t offset : index_) {
+    uint8_t entry[4];
+    putU32(entry, offset);
+    write(entry, sizeof(entry));
+  }
+
+  uint8_t header[kAnimHeaderSize] = {};
+  putU32(header, kAnimMagic);
+  header[4] = kAnimVersion;
+  putU16(header + 6, header_.keyInterval);
+  putU32(header + 8, header_.numLeds);
+  putU32(header + 12, header_.frameCount);
+  putU32(header + 16, header_.frameUs);
+  putU32(header + 20, header_.indexOffset);
+  if(ok_) {
+    ok_ = fseek(out_, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), out_) == sizeof(header) &&
+          fseek(out_, 0, SEEK_END) == 0 && fflush(out_) == 0;
+  }
+  return ok_;
+}
+
+// --- Player ---
+
+bool AnimPlayer::open(AnimSource& source) {
+  source_ = nullptr;
+  uint8_t header[kAnimHeaderSize];
+  if(source.read(0, header, sizeof(header)) != sizeof(header) || getU32(header) != kAnimMagic ||
+     header[4] != kAnimVersion) {
+    return false;
+  }
+  header_.keyInterval = getU16(header + 6);
+  header_.numLeds = getU32(header + 8);
+  header_.frameCount = getU32(header + 12);
+  header_.frameUs = getU32(header + 16);
+  header_.indexOffset = getU32(header + 20);
+  if(header_.frameCount == 0 || header_.keyInterval == 0 || header_.frameUs == 0) {
+    return false;
+  }
+  source_ = &source;
+  frame_ = 0;
+  pendingUs_ = 0;
+  target_ = nullptr;
+  bufferLength_ = 0;
+  return true;
+}
+
+const uint8_t* AnimPlayer::take(uint32_t len) {
+  if(position_ < bufferOffset_ || position_ + len > bufferOffset_ + bufferLength_) {
+    bufferOffset_ = position_;
+    bufferLength_ = source_->read(position_, buffer_, kBufferSize);
+    if(bufferLength_ < len) {
+      return nullptr;
+    }
+  }
+  const uint8_t* data = buffer_ + (position_ - bufferOffset_);
+  position_ += len;
+  return data;
+}
+
+bool AnimPlayer::decodeFrame(Framebuffer16& fb, bool keyframe) {
+  const uint8_t* frameHeader = take(kFrameHeaderSize);
+  if(frameHeader == nullptr || frameHeader[0] != (keyframe ? kFrameKey : kFrameDelta)) {
+    return false;
+  }
+  const uint32_t end = position_ + getU32(frameHeader + 1);
+  if(keyframe && fb.count > header_.numLeds) {
+    // Strip longer than the recording: keep the rest dark
+    for(uint32_t i = header_.numLeds; i < fb.count; i++) {
+      fb.pixels[i] = Rgb16{0, 0, 0};
+    }
+  }
+
+  Rgb16* out = fb.pixels;
+  const uint32_t count = fb.count;
+  uint32_t pos = 0;
+  while(position_ < end) {
+    const uint8_t* token = take(1);
+    if(token == nullptr) {
+      return false;
+    }
+    const uint8_t t = *token;
+    if(t < kTokenLiteral) {
+      pos += t + 1;
+      continue;
+    }
+
+    const uint32_t run = t < kTokenFill ? (t & 0x3F) + 1 : (t & 0x1F) + 1;
+    const uint8_t* data = take(t < kTokenFill ? run * 3 : 3);
+    if(data == nullptr) {
+      return false;
+    }
+    // Clip to the strip
+    const uint32_t n = pos >= count ? 0 : run < count - pos ? run : count - pos;
+    Rgb16* px = out + pos;
+    if(t < kTokenFill) {
+      for(uint32_t i = 0; i < n; i++) {
+        px[i] = Rgb16{(uint16_t)(data[i * 3] * 257), (uint16_t)(data[i * 3 + 1] * 257),
+                      (uint16_t)(data[i * 3 + 2] * 257)};
+      }
+    } else if(t < kTokenAdd) {
+      const Rgb16 color = {(uint16_t)(data[0] * 257), (uint16_t)(data[1] * 257), (uint16_t)(data[2] * 257)};
+      for(uint32_t i = 0; i < n; i++) {
+        px[i] = color;
+      }
+    } else {
+      for(uint32_t i = 0; i < n; i++) {
+        px[i] = Rgb16{(uint16_t)((uint8_t)((px[i].r >> 8) + data[0]) * 257),
+                      (uint16_t)((uint8_t)((px[i].g >> 8) + data[1]) * 257),
+                      (uint16_t)((uint8_t)((px[i].b >> 8) + data[2]) * 257)};
+      }
+    }
+    pos += run;
+  }
+  return position_ == end;
+}
+
+bool AnimPlayer::seek(Framebuffer16& fb, uint32_t frame) {
+  if(source_ == nullptr) {
+    return false;
+  }
+  frame %= header_.frameCount;
+  const uint32_t key = frame - frame % header_.keyInterval;
+  position_ = header_.indexOffset + key * 4;
+  const uint8_t* entry = take(4);
+  bool ok = entry != nullptr;
+  if(ok) {
+    position_ = getU32(entry);
+    ok = decodeFrame(fb, true);
+  }
+  for(uint32_t f = key + 1; ok && f <= frame; f++) {
+    ok = decodeFrame(fb, false);
+  }
+  if(!ok) {
+    errors_++;
+    target_ = nullptr;
+    return false;
+  }
+  frame_ = frame;
+  target_ = fb.pixels;
+  return true;
+}
+
+bool AnimPlayer::decodeNext(Framebuffer16& fb) {
+  if(frame_ + 1 >= header_.frameCount) {
+    return seek(fb, 0);
+  }
+  // Frames are stored in order, so the next one starts where this one ended
+  if(!decodeFrame(fb, (frame_ + 1) % header_.keyInterval == 0)) {
+    errors_++;
+    target_ = nullptr;
+    return false;
+  }
+  frame_++;
+  return true;
+}
+
+void AnimPlayer::update(Framebuffer16& fb, uint32_t dtUs) {
+  if(source_ == nullptr) {
+    return;
+  }
+  if(fb.pixels != target_) {
+    pendingUs_ = 0;
+    seek(fb, frame_);
+    return;
+  }
+  pendingUs_ += dtUs;
+  uint32_t due = pendingUs_ / header_.frameUs;
+  pendingUs_ -= due * header_.frameUs;
+  if(due > header_.keyInterval) {
+    // Far behind (a stall): jumping via the keyframe is cheaper
+    seek(fb, (uint32_t)(((uint64_t)frame_ + due) % header_.frameCount));
+    return;
+  }
+  while(due-- && decodeNext(fb)) {
+  }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "Framebuffer.h"
+
+// Recorded LED animations (.lan files).
+//
+// A file is a 32-byte header, the frames, and an index with the file offset
+// of every frame; integers are little endian. Every keyInterval-th frame is a
+// keyframe, the others only describe how they differ from the frame before.
+// Each frame is a type byte (0 keyframe, 1 delta), a 32-bit length and a
+// stream of one-byte tokens over the strip's pixels (8-bit RGB):
+//
+//   0x00-0x7F  skip n+1 pixels (unchanged from the previous frame)
+//   0x80-0xBF  n+1 literal pixels follow, 3 bytes each
+//   0xC0-0xDF  fill n+1 pixels with the 3 bytes that follow
+//   0xE0-0xFF  add the 3 signed bytes that follow to n+1 pixels
+//
+// Skips cover whatever did not move (meteor's dark strip), fills cover flat
+// color and the add run covers smooth motion: a scrolling rainbow changes
+// every pixel each frame, but by the same amount along each palette segment.
+//
+// Playback decodes straight into the framebuffer the effect renders into and
+// reads the file through a small fixed buffer, so it needs a few hundred
+// bytes of RAM whatever the length of the file or strip. Seeking reads one
+// index entry and decodes at most keyInterval frames.
+
+static const uint32_t kAnimMagic = 0x4144454C;  // "LEDA"
+static const uint8_t kAnimVersion = 1;
+static const uint32_t kAnimHeaderSize = 32;
+
+struct AnimHeader {
+  uint32_t numLeds;
+  uint32_t frameCount;
+  uint32_t frameUs;       // Frame period
+  uint16_t keyInterval;   // Frames per keyframe
+  uint32_t indexOffset;   // Offset of frameCount uint32_t frame offsets
+};
+
+// Random-access byte source a player reads from
+class AnimSource {
+ public:
+  virtual ~AnimSource() {}
+
+  // Copy up to len bytes at offset into dst, returning how many were read
+  virtual uint32_t read(uint32_t offset, uint8_t* dst, uint32_t len) = 0;
+};
+
+// A file in RAM or memory-mapped flash (esp_partition_mmap)
+class MemoryAnimSource : public AnimSource {
+ public:
+  MemoryAnimSource(const uint8_t* data = nullptr, uint32_t size = 0) : data_(data), size_(size) {}
+  void begin(const uint8_t* data, uint32_t size) { data_ = data; size_ = size; }
+  uint32_t read(uint32_t offset, uint8_t* dst, uint32_t len) override;
+
+ private:
+  const uint8_t* data_;
+  uint32_t size_;
+};
+
+// A stdio file: the host, or LittleFS / SD through the ESP-IDF VFS
+class FileAnimSource : public AnimSource {
+ public:
+  void begin(FILE* file) { file_ = file; position_ = UINT32_MAX; }
+  uint32_t read(uint32_t offset, uint8_t* dst, uint32_t len) override;
+
+ private:
+  FILE* file_ = nullptr;
+  uint32_t position_ = UINT32_MAX;  // Where the file is positioned, to skip redundant seeks
+};
+
+// Encodes frames into a .lan file. Keeps the previous frame and the index in
+// RAM, so it runs on the host (tools/ledanim) rather than the render core.
+class AnimWriter {
+ public:
+  bool begin(FILE* out, uint32_t numLeds, uint32_t frameUs, uint16_t keyInterval = 60);
+
+  // Add a rendered frame (16-bit channels are stored at 8 bits)
+  bool addFrame(const Framebuffer16& fb);
+  // Add a frame of numLeds * 3 bytes, RGB
+  bool addFrame(const uint8_t* rgb);
+
+  // Write the index and final header. The file is unusable without it.
+  bool finish();
+
+  uint32_t framesWritten() const { return (uint32_t)index_.size(); }
+  uint32_t bytesWritten() const { return offset_; }
+
+ private:
+  void encode(bool keyframe);
+  bool write(const void* data, uint32_t len);
+
+  FILE* out_ = nullptr;
+  AnimHeader header_ = {};
+  std::vector<uint8_t> previous_;
+  std::vector<uint8_t> current_;
+  std::vector<uint8_t> tokens_;
+  std::vector<uint32_t> index_;
+  uint32_t offset_ = 0;
+  bool ok_ = false;
+};
+
+// Plays a .lan file into a framebuffer
+class AnimPlayer {
+ public:
+  // Read and check the header. Frames decode into framebuffers of any
+  // length: pixels past the end of the strip are dropped and a longer strip
+  // keeps the rest dark.
+  bool open(AnimSource& source);
+  bool isOpen() const { return source_ != nullptr; }
+  const AnimHeader& header() const { return header_; }
+
+  // Decode frame n into fb: its keyframe, then the deltas up to it
+  bool seek(Framebuffer16& fb, uint32_t frame);
+
+  // Advance by dtUs, looping at the end, and decode the frames that are due.
+  // Starts over from a keyframe whenever fb is not the buffer the previous
+  // frame was decoded into.
+  void update(Framebuffer16& fb, uint32_t dtUs);
+
+  // Forget what is in the buffer (it was cleared or drawn over), so the next
+  // update() decodes from a keyframe
+  void resync() { target_ = nullptr; }
+
+  // Frame last decoded
+  uint32_t frame() const { return frame_; }
+  uint32_t decodeErrors() const { return errors_; }
+
+ private:
+  static const uint32_t kBufferSize = 256;
+
+  bool decodeFrame(Framebuffer16& fb, bool keyframe);
+  bool decodeNext(Framebuffer16& fb);
+  // Next len bytes (at most kBufferSize) from the source, or nullptr
+  const uint8_t* take(uint32_t len);
+
+  AnimSource* source_ = nullptr;
+  AnimHeader header_ = {};
+  uint32_t frame_ = 0;
+  uint32_t pendingUs_ = 0;
+  const Rgb16* target_ = nullptr;  // Buffer the last frame went into
+  uint32_t errors_ = 0;
+
+  // Read-ahead over the source
+  uint8_t buffer_[kBufferSize];
+  uint32_t bufferOffset_ = 0;  // File offset of buffer_[0]
+  uint32_t bufferLength_ = 0;
+  uint32_t position_ = 0;      // Next file offset to read
+};
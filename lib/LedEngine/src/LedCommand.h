@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "SpscQueue.h"
+
+// Changes the UI asks the render core to make. The render core owns the
+// effect, brightness and color it renders with and only changes them when it
+// drains these from the command queue at the start of a frame.
+enum LedCommandType : uint8_t {
+  CMD_SET_EFFECT,      // value = effect id (its position in the effect registry)
+  CMD_SET_BRIGHTNESS,  // value = 0-255
+  CMD_SET_COLOR,       // value = 0x00RRGGBB, used by the solid color effect
+  CMD_SET_PARAM,       // value = effect << 24 | parameter << 16 | value (0-65535), clamped to its range
+};
+
+struct LedCommand {
+  LedCommandType type;
+  uint32_t value;
+};
+
+typedef SpscQueue<LedCommand, 64> LedCommandQueue;
@@ -0,0 +1,392 @@
+#include "LedOutput.h"
+
+#include <string.h>
+
+#include "LedPlatform.h"
+#include "PixelKernels.h"
+
+// Symbols for every 4-bit pattern, so each byte is two 16-byte copies
+struct NibbleSymbols {
+  uint32_t s[4];
+};
+
+static constexpr NibbleSymbols nibbleSymbols(int n) {
+  return NibbleSymbols{{(n & 8) ? kWs2812One : kWs2812Zero, (n & 4) ? kWs2812One : kWs2812Zero,
+                        (n & 2) ? kWs2812One : kWs2812Zero, (n & 1) ? kWs2812One : kWs2812Zero}};
+}
+
+static constexpr NibbleSymbols kNibbleSymbols[16] = {
+  nibbleSymbols(0), nibbleSymbols(1), nibbleSymbols(2), nibbleSymbols(3),
+  nibbleSymbols(4), nibbleSymbols(5), nibbleSymbols(6), nibbleSymbols(7),
+  nibbleSymbols(8), nibbleSymbols(9), nibbleSymbols(10), nibbleSymbols(11),
+  nibbleSymbols(12), nibbleSymbols(13), nibbleSymbols(14), nibbleSymbols(15),
+};
+
+void encodeWs2812(const uint8_t* __restrict bytes, uint32_t count, uint32_t* __restrict symbols) {
+  NibbleSymbols* out = reinterpret_cast<NibbleSymbols*>(symbols);
+  for(uint32_t i = 0; i < count; i++) {
+    out[0] = kNibbleSymbols[bytes[i] >> 4];
+    out[1] = kNibbleSymbols[bytes[i] & 0x0F];
+    out += 2;
+  }
+}
+
+bool LedOutput::begin(const StripTopology& topology, LedTransmitter* const* transmitters) {
+  laneCount_ = 0;
+  numLeds_ = 0;
+  longestLane_ = 0;
+  mapped_ = false;
+  for(uint8_t i = 0; i < topology.laneCount; i++) {
+    if(transmitters[i] == nullptr) {
+      return false;
+    }
+    const LaneConfig& config = topology.lanes[i];
+    lanes_[i] = Lane{transmitters[i], numLeds_, config.length, config.order, config.maxMa, 0, 0, {}};
+    numLeds_ += config.length;
+    if(config.length > longestLane_) {
+      longestLane_ = config.length;
+    }
+  }
+  laneCount_ = topology.laneCount;
+
+  for(Slot& slot : slots_) {
+    slot.wire.assign(numLeds_ * 3, 0);
+    slot.symbols.assign(numLeds_ * 24 + laneCount_, kWs2812Zero);
+    for(uint8_t i = 0; i < laneCount_; i++) {
+      slot.symbols[symbolOffset(i) + lanes_[i].length * 24] = kWs2812Reset;
+    }
+  }
+  front_ = 0;
+  limit_ = kFullScale;
+  return laneCount_ > 0;
+}
+
+bool LedOutput::begin(LedTransmitter& tx, uint32_t numLeds, ColorOrder order) {
+  StripTopology topology;
+  topology.lanes[0] = LaneConfig{-1, numLeds, order};
+  topology.laneCount = 1;
+  LedTransmitter* transmitters[1] = {&tx};
+  return begin(topology, transmitters);
+}
+
+void LedOutput::setCorrection(bool gamma, bool dither) {
+  gamma_ = gamma;
+  dither_ = dither;
+}
+
+bool LedOutput::setPixelMap(const PixelMap* map) {
+  if(map != nullptr && map->physicalCount() != numLeds_) {
+    return false;
+  }
+  mapped_ = map != nullptr;
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    if(map != nullptr) {
+      map->runsFor(lanes_[i].offset, lanes_[i].length, lanes_[i].runs);
+    } else {
+      lanes_[i].runs.clear();
+    }
+  }
+  return true;
+}
+
+void LedOutput::setPowerLimit(uint32_t maxMa, uint16_t channelMa, uint16_t idleUa) {
+  maxMa_ = maxMa;
+  channelMa_ = channelMa;
+  idleUa_ = idleUa;
+}
+
+void LedOutput::encode(const Framebuffer16& frame, uint8_t brightness) {
+  uint32_t start = micros();
+  Slot& back = slots_[front_ ^ 1];
+  limitedBrightness_ = (brightness * limit_) >> 16;
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    Lane& lane = lanes_[i];
+    uint8_t* wire = back.wire.data() + lane.offset * 3;
+    if(mapped_) {
+      // Every LED is looked up in the logical frame, so short frames just
+      // leave the LEDs they do not reach dark
+      const PixelRun* runs = lane.runs.data();
+      const uint32_t runCount = (uint32_t)lane.runs.size();
+      if(gamma_ || dither_) {
+        lane.levelSum = writeOutputCorrectedMapped(frame, runs, runCount, wire, limitedBrightness_, lane.order,
+                                                   gamma_, dither_, ditherFrame_);
+      } else {
+        lane.levelSum = writeOutputMapped(frame, runs, runCount, wire, limitedBrightness_, lane.order);
+      }
+      encodeWs2812(wire, lane.length * 3, back.symbols.data() + symbolOffset(i));
+      continue;
+    }
+    // As with a map, LEDs past the end of a short frame go dark rather than
+    // keep what the back slot held two frames ago
+    Framebuffer16 src = {frame.pixels + lane.offset, 0};
+    if(frame.count > lane.offset) {
+      src.count = frame.count - lane.offset < lane.length ? frame.count - lane.offset : lane.length;
+    }
+    lane.levelSum = 0;
+    if(src.count > 0) {
+      if(gamma_ || dither_) {
+        lane.levelSum =
+            writeOutputCorrected(src, wire, limitedBrightness_, lane.order, gamma_, dither_, ditherFrame_);
+      } else {
+        lane.levelSum = writeOutput(src, wire, limitedBrightness_, lane.order);
+      }
+    }
+    memset(wire + src.count * 3, 0, (lane.length - src.count) * 3);
+    encodeWs2812(wire, lane.length * 3, back.symbols.data() + symbolOffset(i));
+  }
+  ditherFrame_++;
+  updatePowerLimit(brightness);
+  lastEncodeUs_ = micros() - start;
+}
+
+void LedOutput::updatePowerLimit(uint8_t brightness) {
+  framesLimited_ += limitedBrightness_ < brightness;
+  uint32_t target = kFullScale;
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    Lane& lane = lanes_[i];
+    const uint64_t levelUa = (uint64_t)lane.levelSum * channelMa_ * 1000 / 255;
+    const uint64_t idleUa = (uint64_t)lane.length * idleUa_;
+    lane.currentMa = (uint32_t)((levelUa + idleUa) / 1000);
+
+    const uint32_t maxMa = lane.maxMa ? lane.maxMa : maxMa_;
+    if(maxMa == 0 || levelUa == 0 || brightness == 0) {
+      continue;
+    }
+    // Levels scale with brightness, so this lane stays within budget up to
+    // limitedBrightness_ * headroom / levelUa
+    const uint64_t budgetUa = (uint64_t)maxMa * 1000;
+    const uint64_t headroomUa = budgetUa > idleUa ? budgetUa - idleUa : 0;
+    const uint64_t laneTarget = headroomUa * limitedBrightness_ * kFullScale / (levelUa * brightness);
+    if(laneTarget < target) {
+      target = (uint32_t)laneTarget;
+    }
+  }
+  if(target < limit_) {
+    limit_ = target;
+  } else {
+    limit_ += (target - limit_ + kReleaseFrames - 1) / kReleaseFrames;
+  }
+  limitSettled_ = limit_ == target;
+}
+
+bool LedOutput::encodedUnchanged() const {
+  return slots_[front_ ^ 1].wire == slots_[front_].wire;
+}
+
+uint32_t LedOutput::currentMa() const {
+  uint32_t total = 0;
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    total += lanes_[i].currentMa;
+  }
+  return total;
+}
+
+void LedOutput::present() {
+  if(laneCount_ == 0) {
+    return;
+  }
+  if(busy()) {
+    uint32_t start = micros();
+    waitDone();
+    totalBlockedUs_ += micros() - start;
+    framesBlocked_++;
+  }
+  front_ ^= 1;
+  const Slot& slot = slots_[front_];
+  // Start every lane before any finishes so they run in parallel
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    if(!lanes_[i].tx->transmit(slot.symbols.data() + symbolOffset(i), lanes_[i].length * 24 + 1)) {
+      transmitErrors_++;
+    }
+  }
+  framesPresented_++;
+}
+
+bool LedOutput::busy() const {
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    if(lanes_[i].tx->busy()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LedOutput::waitDone() {
+  for(uint8_t i = 0; i < laneCount_; i++) {
+    lanes_[i].tx->waitDone();
+  }
+}
+
+uint32_t LedOutput::frameWireUs() const {
+  // 24 bits of 1.2 us per LED plus the 300 us latch
+  return (longestLane_ * 24 * 12) / 10 + 300;
+}
+
+#if defined(ESP_PLATFORM)
+#include "esp_attr.h"
+
+bool RmtTransmitter::begin(int gpio, bool withDma) {
+  rmt_tx_channel_config_t config = {};
+  config.gpio_num = (gpio_num_t)gpio;
+  config.clk_src = RMT_CLK_SRC_DEFAULT;
+  config.resolution_hz = kWs2812TickHz;
+  config.mem_block_symbols = withDma ? 1024 : 64;
+  config.trans_queue_depth = 2;
+  config.flags.with_dma = withDma;
+  esp_err_t err = rmt_new_tx_channel(&config, &channel_);
+  if(err != ESP_OK && withDma) {
+    // Not every RMT channel has DMA; fall back to ping-pong channel memory
+    config.mem_block_symbols = 64;
+    config.flags.with_dma = false;
+    err = rmt_new_tx_channel(&config, &channel_);
+  }
+  if(err != ESP_OK) {
+    return false;
+  }
+
+  rmt_copy_encoder_config_t encoderConfig = {};
+  if(rmt_new_copy_encoder(&encoderConfig, &encoder_) != ESP_OK) {
+    return false;
+  }
+
+  rmt_tx_event_callbacks_t callbacks = {};
+  callbacks.on_trans_done = onDone;
+  rmt_tx_register_event_callbacks(channel_, &callbacks, this);
+  return rmt_enable(channel_) == ESP_OK;
+}
+
+bool IRAM_ATTR RmtTransmitter::onDone(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t* event, void* ctx) {
+  (void)channel;
+  (void)event;
+  static_cast<RmtTransmitter*>(ctx)->busy_ = false;
+  return false;  // No task woken
+}
+
+bool RmtTransmitter::transmit(const uint32_t* symbols, uint32_t count) {
+  if(channel_ == nullptr) {
+    return false;
+  }
+  rmt_transmit_config_t config = {};
+  config.loop_count = 0;
+  busy_ = true;
+  if(rmt_transmit(channel_, encoder_, symbols, count * sizeof(uint32_t), &config) != ESP_OK) {
+    busy_ = false;
+    return false;
+  }
+  return true;
+}
+
+void RmtTransmitter::waitDone() {
+  if(channel_ != nullptr) {
+    rmt_tx_wait_all_done(channel_, -1);
+  }
+  busy_ = false;
+}
+#endif
+
+#ifndef ARDUINO
+#include <chrono>
+
+MockTransmitter::MockTransmitter() {
+  worker_ = std::thread([this] { run(); });
+}
+
+MockTransmitter::~MockTransmitter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+}
+
+bool MockTransmitter::transmit(const uint32_t* symbols, uint32_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(busy_) {
+    // The real peripheral would queue or clobber; either is a driver bug
+    overlappedCalls_++;
+    return false;
+  }
+  pending_ = symbols;
+  pendingCount_ = count;
+  busy_ = true;
+  cv_.notify_all();
+  return true;
+}
+
+bool MockTransmitter::busy() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return busy_;
+}
+
+void MockTransmitter::waitDone() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return !busy_; });
+}
+
+uint32_t MockTransmitter::framesSent() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return framesSent_;
+}
+
+uint32_t MockTransmitter::corruptFrames() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return corruptFrames_;
+}
+
+uint32_t MockTransmitter::overlappedCalls() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return overlappedCalls_;
+}
+
+std::vector<uint8_t> MockTransmitter::lastFrame() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lastFrame_;
+}
+
+static uint64_t hashSymbols(const uint32_t* symbols, uint32_t count) {
+  uint64_t h = 1469598103934665603ull;  // FNV-1a
+  for(uint32_t i = 0; i < count; i++) {
+    h = (h ^ symbols[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+void MockTransmitter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    cv_.wait(lock, [this] { return stop_ || pending_ != nullptr; });
+    if(stop_) {
+      return;
+    }
+    const uint32_t* symbols = pending_;
+    const uint32_t count = pendingCount_;
+    pending_ = nullptr;
+    lock.unlock();
+
+    // Decode and time the frame the way the strip would see it
+    uint64_t before = hashSymbols(symbols, count);
+    std::vector<uint8_t> bytes(count / 8);
+    uint64_t ticks = 0;
+    for(uint32_t i = 0; i < count; i++) {
+      uint32_t s = symbols[i];
+      ticks += (s & 0x7FFF) + ((s >> 16) & 0x7FFF);
+      if(i / 8 < bytes.size() && (s & 0x7FFF) > ((s >> 16) & 0x7FFF)) {
+        bytes[i / 8] |= 0x80 >> (i % 8);
+      }
+    }
+    if(timeScale_ > 0) {
+      auto wire = std::chrono::nanoseconds((uint64_t)(ticks * (1e9 / kWs2812TickHz) * timeScale_));
+      std::this_thread::sleep_for(wire);
+    }
+    bool corrupt = hashSymbols(symbols, count) != before;
+
+    lock.lock();
+    lastFrame_.swap(bytes);
+    framesSent_++;
+    corruptFrames_ += corrupt;
+    busy_ = false;
+    cv_.notify_all();
+  }
+}
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "PixelMap.h"
+#include "StripTopology.h"
+
+// WS2812 output pipeline.
+//
+// A frame is encoded up front into transmitter symbols (one 32-bit word per
+// bit on the wire, plus a trailing reset/latch symbol) and handed to a
+// LedTransmitter that clocks it out in the background. LedOutput keeps two
+// such buffers: while one is on the wire the next frame is rendered and
+// encoded into the other, so the CPU never sits idle waiting for the strip.
+//
+// The output can be split over several lanes (StripTopology), each with its
+// own transmitter, length and color order. All lanes are started back to back
+// and clock out in parallel, so refresh time follows the longest lane rather
+// than the total LED count.
+
+// Symbol layout matches ESP-IDF's rmt_symbol_word_t:
+//   bits 0-14 duration0, bit 15 level0, bits 16-30 duration1, bit 31 level1
+// Durations are in ticks of kWs2812TickHz.
+static const uint32_t kWs2812TickHz = 10000000;  // 100 ns per tick
+
+constexpr uint32_t ws2812Symbol(uint16_t highTicks, uint16_t lowTicks) {
+  return (uint32_t)highTicks | (1u << 15) | ((uint32_t)lowTicks << 16);
+}
+
+static const uint32_t kWs2812Zero = ws2812Symbol(4, 8);  // 0.4 us high, 0.8 us low
+static const uint32_t kWs2812One = ws2812Symbol(8, 4);   // 0.8 us high, 0.4 us low
+// Line held low for 300 us so the strip latches the frame
+static const uint32_t kWs2812Reset = 1500u | (1500u << 16);
+
+// Expand wire-order bytes into one symbol per bit, MSB first
+void encodeWs2812(const uint8_t* bytes, uint32_t count, uint32_t* symbols);
+
+// Something that can clock a symbol buffer out to a strip asynchronously
+class LedTransmitter {
+ public:
+  virtual ~LedTransmitter() {}
+
+  // Start sending count symbols and return immediately. The buffer must stay
+  // untouched until busy() goes false. False if the frame was not started.
+  virtual bool transmit(const uint32_t* symbols, uint32_t count) = 0;
+  virtual bool busy() const = 0;
+  virtual void waitDone() = 0;
+};
+
+class LedOutput {
+ public:
+  // One transmitter per lane, in topology order
+  bool begin(const StripTopology& topology, LedTransmitter* const* transmitters);
+  // Single strip shorthand
+  bool begin(LedTransmitter& tx, uint32_t numLeds, ColorOrder order);
+
+  // Gamma correction and temporal dithering in the output pass (see
+  // writeOutputCorrected). Both off by default.
+  void setCorrection(bool gamma, bool dither);
+
+  // Read frames through a logical-to-physical map (PixelMap.h) instead of
+  // straight through. The map must cover exactly numLeds() LEDs (false
+  // otherwise) and is compressed into runs per lane here, so it is not
+  // needed afterwards; frames are then its logical size. nullptr goes back
+  // to straight through.
+  bool setPixelMap(const PixelMap* map);
+
+  // Current limiter. The output pass sums the levels it writes, so each
+  // lane's draw is estimated at no extra cost: idleUa per LED plus channelMa
+  // per channel at level 255. When a lane's estimate passes its budget
+  // (LaneConfig::maxMa, or maxMa here for lanes without one; 0 = no limit)
+  // every lane is dimmed from the next frame on, by as much as the most
+  // loaded lane needs, so the strips keep matching. Dimming is immediate;
+  // recovery closes 1/8 of the gap per frame. Off by default.
+  void setPowerLimit(uint32_t maxMa, uint16_t channelMa = 20, uint16_t idleUa = 1000);
+
+  // Apply gamma, brightness (after the current limiter) and dithering,
+  // convert to wire order and encode into the back buffer. Safe to call while
+  // the previous frame is still being transmitted.
+  void encode(const Framebuffer16& frame, uint8_t brightness);
+
+  // True if the frame just encoded is byte for byte what the strips show, so
+  // presenting it would change nothing
+  bool encodedUnchanged() const;
+
+  // Hand the encoded back buffer to the transmitters and swap. Only blocks if
+  // the frame before is still on the wire on some lane.
+  void present();
+
+  // True while any lane is transmitting
+  bool busy() const;
+  void waitDone();
+
+  // Wire-order bytes of the last presented frame (what the strips show),
+  // lanes concatenated in topology order. The slot is encoded over from the
+  // second present() after, so a reader on another core checks
+  // framesPresented() around the read (see previewFrame).
+  const uint8_t* frontPixels() const { return slots_[front_].wire.data(); }
+  uint32_t numLeds() const { return numLeds_; }
+  uint8_t laneCount() const { return laneCount_; }
+  uint32_t laneLength(uint8_t lane) const { return lanes_[lane].length; }
+  ColorOrder laneOrder(uint8_t lane) const { return lanes_[lane].order; }
+
+  // Stats
+  uint32_t framesPresented() const { return framesPresented_.load(std::memory_order_acquire); }
+  uint32_t framesBlocked() const { return framesBlocked_; }  // present() had to wait
+  uint32_t transmitErrors() const { return transmitErrors_; }  // Lane frames a transmitter refused
+  uint32_t lastEncodeUs() const { return lastEncodeUs_; }
+  uint64_t totalBlockedUs() const { return totalBlockedUs_; }
+
+  // Power telemetry for the last encoded frame: estimated draw, overall and
+  // per lane, and the brightness it went out at after limiting
+  uint32_t currentMa() const;
+  uint32_t laneCurrentMa(uint8_t lane) const { return lanes_[lane].currentMa; }
+  uint8_t limitedBrightness() const { return limitedBrightness_; }
+  uint32_t framesLimited() const { return framesLimited_; }  // Encoded below the requested brightness
+  // False while the limiter will still change the brightness of an
+  // unchanged frame (dimming into budget or easing back up)
+  bool limitSettled() const { return limitSettled_; }
+
+  // Time one frame occupies the wire, latch included (longest lane)
+  uint32_t frameWireUs() const;
+
+ private:
+  struct Lane {
+    LedTransmitter* tx;
+    uint32_t offset;  // First LED, counting across the lanes before
+    uint32_t length;
+    ColorOrder order;
+    uint32_t maxMa;
+    uint32_t levelSum;   // Sum of the levels in the last encoded frame
+    uint32_t currentMa;  // Estimated from levelSum
+    std::vector<PixelRun> runs;  // This lane's stretch of the pixel map
+  };
+
+  struct Slot {
+    std::vector<uint8_t> wire;      // numLeds * 3, in each lane's color order
+    std::vector<uint32_t> symbols;  // Per lane: length * 24 + reset
+  };
+
+  // Lane i's symbols start after the preceding lanes and their resets
+  uint32_t symbolOffset(uint8_t lane) const { return lanes_[lane].offset * 24 + lane; }
+
+  // Estimate each lane's draw and set limit_ for the next frame
+  void updatePowerLimit(uint8_t brightness);
+
+  static const uint32_t kFullScale = 1u << 16;  // limit_ of 1.0
+  static const uint32_t kReleaseFrames = 8;
+
+  Lane lanes_[StripTopology::kMaxLanes];
+  uint8_t laneCount_ = 0;
+  Slot slots_[2];
+  uint8_t front_ = 0;  // Slot last handed to the transmitters
+  uint32_t numLeds_ = 0;
+  uint32_t longestLane_ = 0;
+  bool mapped_ = false;
+  bool gamma_ = false;
+  bool dither_ = false;
+  uint8_t ditherFrame_ = 0;
+  uint32_t maxMa_ = 0;
+  uint16_t channelMa_ = 20;
+  uint16_t idleUa_ = 1000;
+  uint32_t limit_ = kFullScale;  // Brightness factor, 16.16
+  uint8_t limitedBrightness_ = 0;
+  uint32_t framesLimited_ = 0;
+  bool limitSettled_ = true;
+
+  std::atomic<uint32_t> framesPresented_{0};  // Counted before the old front slot is encoded over
+  uint32_t framesBlocked_ = 0;
+  uint32_t transmitErrors_ = 0;
+  uint32_t lastEncodeUs_ = 0;
+  uint64_t totalBlockedUs_ = 0;
+};
+
+#if defined(ESP_PLATFORM)
+#include "driver/rmt_tx.h"
+
+// RMT channel with a copy encoder: the symbols are already encoded, so the
+// driver only has to move them into (DMA) channel memory.
+class RmtTransmitter : public LedTransmitter {
+ public:
+  bool begin(int gpio, bool withDma = true);
+
+  bool transmit(const uint32_t* symbols, uint32_t count) override;
+  bool busy() const override { return busy_; }
+  void waitDone() override;
+
+ private:
+  static bool onDone(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t* event, void* ctx);
+
+  rmt_channel_handle_t channel_ = nullptr;
+  rmt_encoder_handle_t encoder_ = nullptr;
+  volatile bool busy_ = false;
+};
+#endif
+
+#ifndef ARDUINO
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Host stand-in for the RMT transmitter. A worker thread "sends" each frame
+// by sleeping for its real wire time, decodes the symbols back into bytes and
+// checks the buffer was not modified while it was in flight.
+class MockTransmitter : public LedTransmitter {
+ public:
+  MockTransmitter();
+  ~MockTransmitter() override;
+
+  bool transmit(const uint32_t* symbols, uint32_t count) override;
+  bool busy() const override;
+  void waitDone() override;
+
+  // Scale simulated wire time (1.0 = real time, 0 = instant)
+  void setTimeScale(double scale) { timeScale_ = scale; }
+
+  uint32_t framesSent() const;
+  uint32_t corruptFrames() const;   // Buffer changed during transmission
+  uint32_t overlappedCalls() const; // transmit() while still busy
+  // Bytes decoded from the most recently completed frame
+  std::vector<uint8_t> lastFrame() const;
+
+ private:
+  void run();
+
+  std::thread worker_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  const uint32_t* pending_ = nullptr;
+  uint32_t pendingCount_ = 0;
+  bool busy_ = false;
+  bool stop_ = false;
+  double timeScale_ = 1.0;
+
+  uint32_t framesSent_ = 0;
+  uint32_t corruptFrames_ = 0;
+  uint32_t overlappedCalls_ = 0;
+  std::vector<uint8_t> lastFrame_;
+};
+#endif
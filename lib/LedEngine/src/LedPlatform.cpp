@@ -0,0 +1,53 @@
+#include "LedPlatform.h"
+
+#ifndef ARDUINO
+#include <chrono>
+
+// Host replacement for the Arduino PRNG. Seeded so runs are repeatable.
+static uint32_t hostRandomState = 0x12345678;
+
+static uint32_t hostRandomNext() {
+  // xorshift32
+  uint32_t x = hostRandomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  hostRandomState = x;
+  return x;
+}
+
+long random(long howbig) {
+  if(howbig <= 0) {
+    return 0;
+  }
+  return hostRandomNext() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if(howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if(seed != 0) {
+    hostRandomState = seed;
+  }
+}
+
+static std::chrono::steady_clock::time_point hostStartTime() {
+  static const auto start = std::chrono::steady_clock::now();
+  return start;
+}
+
+uint32_t micros() {
+  auto elapsed = std::chrono::steady_clock::now() - hostStartTime();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t millis() {
+  auto elapsed = std::chrono::steady_clock::now() - hostStartTime();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+#endif
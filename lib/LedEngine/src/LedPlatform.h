@@ -0,0 +1,18 @@
+#pragma once
+
+// Small shims so the effect engine builds both under the Arduino core and on
+// the host ([env:native]). Only the handful of Arduino calls the effects use
+// are provided.
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <cstdint>
+#include <cstdlib>
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+uint32_t micros();
+uint32_t millis();
+#endif
@@ -0,0 +1,69 @@
+#include "LedPreview.h"
+
+#include <atomic>
+
+// Strip at least as long as the bar: each column averages the LEDs that fall
+// into it. Columns are advanced Bresenham-style, so there is no division per
+// LED and exactly `width` columns come out.
+static void downsample(const LedOutput& output, uint16_t* out, uint32_t width) {
+  const uint8_t* wire = output.frontPixels();
+  const uint32_t numLeds = output.numLeds();
+  uint32_t acc = 0;
+  uint32_t r = 0, g = 0, b = 0, n = 0;
+  for(uint8_t lane = 0; lane < output.laneCount(); lane++) {
+    const ColorOrder order = output.laneOrder(lane);
+    const uint32_t length = output.laneLength(lane);
+    for(uint32_t i = 0; i < length; i++, wire += 3) {
+      r += wire[order.r];
+      g += wire[order.g];
+      b += wire[order.b];
+      n++;
+      acc += width;
+      if(acc >= numLeds) {
+        acc -= numLeds;
+        *out++ = toRgb565(r / n, g / n, b / n);
+        r = g = b = n = 0;
+      }
+    }
+  }
+}
+
+// Strip shorter than the bar: nearest LED per column
+static void stretch(const LedOutput& output, uint16_t* out, uint32_t width) {
+  const uint8_t* wire = output.frontPixels();
+  const uint32_t numLeds = output.numLeds();
+  uint8_t lane = 0;
+  uint32_t laneEnd = output.laneLength(0);
+  ColorOrder order = output.laneOrder(0);
+  uint32_t led = 0;
+  uint32_t acc = 0;
+  for(uint32_t c = 0; c < width; c++) {
+    const uint8_t* px = wire + led * 3;
+    *out++ = toRgb565(px[order.r], px[order.g], px[order.b]);
+    acc += numLeds;
+    if(acc >= width) {
+      acc -= width;
+      led++;
+      if(led == laneEnd && lane + 1 < output.laneCount()) {
+        lane++;
+        laneEnd += output.laneLength(lane);
+        order = output.laneOrder(lane);
+      }
+    }
+  }
+}
+
+bool previewFrame(const LedOutput& output, uint16_t* out, uint32_t width) {
+  if(output.numLeds() == 0 || width == 0) {
+    return true;
+  }
+  const uint32_t presented = output.framesPresented();
+  if(output.numLeds() >= width) {
+    downsample(output, out, width);
+  } else {
+    stretch(output, out, width);
+  }
+  // The wire reads above must not move past the second count
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return output.framesPresented() == presented;
+}
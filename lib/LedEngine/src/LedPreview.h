@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LedOutput.h"
+
+// Time one preview update (downsample + blit) may take on the UI core
+static const uint32_t kPreviewBudgetUs = 2000;
+
+// On-screen preview of what the strips are showing.
+//
+// Reads the wire bytes of the last presented frame in place (no copy) and
+// box-filters them down to `width` RGB565 pixels, one per screen column;
+// strips shorter than the bar are stretched instead. Each lane is decoded in
+// its own color order. Brightness is already applied in those bytes, so the
+// preview dims with the strip.
+//
+// The render core may present and then encode over the slot while this
+// runs. framesPresented() is read before and after: if it moved, out may
+// mix two frames and false is returned, so the caller drops it and tries
+// again on the next update.
+bool previewFrame(const LedOutput& output, uint16_t* out, uint32_t width);
@@ -0,0 +1,111 @@
+#include "Palette.h"
+
+#include <string.h>
+
+// Same piecewise-linear wheel the old Wheel() computed per pixel
+static constexpr GradientStop kRainbowStops[] = {
+  {0, {255, 0, 0}}, {85, {0, 255, 0}}, {170, {0, 0, 255}}, {255, {255, 0, 0}},
+};
+
+constexpr Palette kRainbowPalette = makeGradientPalette("Rainbow", kRainbowStops);
+
+// The UI swatches used sin(hue * 2pi + phase) * 127 + 128 per channel. A
+// compile-time Taylor series reproduces them exactly, so swatch i is entry
+// i * 32.
+static constexpr double constSin(double x) {
+  const double pi = 3.14159265358979323846;
+  while(x > pi) {
+    x -= 2 * pi;
+  }
+  while(x < -pi) {
+    x += 2 * pi;
+  }
+  double term = x, sum = x;
+  for(int n = 1; n < 12; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+static constexpr std::array<Rgb, 256> buildSineRainbow() {
+  std::array<Rgb, 256> colors = {};
+  for(int i = 0; i < 256; i++) {
+    double hue = i / 256.0;
+    colors[i] = Rgb{(uint8_t)(constSin(hue * 6.28318 + 0) * 127 + 128),
+                    (uint8_t)(constSin(hue * 6.28318 + 2.094395) * 127 + 128),
+                    (uint8_t)(constSin(hue * 6.28318 + 4.18879) * 127 + 128)};
+  }
+  return colors;
+}
+
+constexpr Palette kSineRainbowPalette = makePalette("Sine Rainbow", buildSineRainbow());
+
+// Same ramp the float fire produced: t192 = round(heat / 255 * 191), then
+// the low six bits of t192 drive whichever channel is currently rising.
+static constexpr std::array<Rgb, 256> buildHeat() {
+  std::array<Rgb, 256> colors = {};
+  for(int t = 0; t < 256; t++) {
+    uint8_t t192 = (t * 191 + 127) / 255;
+    uint8_t heatramp = (t192 & 0x3F) << 2;
+    if(t192 > 0x80) {
+      colors[t] = Rgb{255, 255, heatramp};  // Hottest: white
+    } else if(t192 > 0x40) {
+      colors[t] = Rgb{255, heatramp, 0};    // Medium: yellow to orange
+    } else {
+      colors[t] = Rgb{heatramp, 0, 0};      // Coolest: black to red
+    }
+  }
+  return colors;
+}
+
+constexpr Palette kHeatPalette = makePalette("Heat", buildHeat());
+
+static constexpr GradientStop kEmberStops[] = {
+  {0, {255, 140, 0}}, {255, {255, 40, 0}},
+};
+
+constexpr Palette kEmberPalette = makeGradientPalette("Ember", kEmberStops);
+
+static constexpr GradientStop kVuStops[] = {
+  {0, {0, 255, 0}}, {150, {160, 255, 0}}, {200, {255, 200, 0}}, {255, {255, 0, 0}},
+};
+
+constexpr Palette kVuPalette = makeGradientPalette("VU", kVuStops);
+
+static const Palette* const kPalettes[] = {
+  &kRainbowPalette,
+  &kSineRainbowPalette,
+  &kHeatPalette,
+  &kEmberPalette,
+  &kVuPalette,
+};
+
+const Palette* const* allPalettes() {
+  return kPalettes;
+}
+
+uint8_t paletteCount() {
+  return sizeof(kPalettes) / sizeof(kPalettes[0]);
+}
+
+const Palette* findPalette(const char* name) {
+  for(const Palette* p : kPalettes) {
+    if(strcmp(p->name, name) == 0) {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+void blendPalettes(const Palette& a, const Palette& b, uint8_t amount, Palette& out) {
+  for(int i = 0; i < 256; i++) {
+    const Rgb ca = a.rgb[i];
+    const Rgb cb = b.rgb[i];
+    const Rgb c = {lerpChannel(ca.r, cb.r, amount, 255), lerpChannel(ca.g, cb.g, amount, 255),
+                   lerpChannel(ca.b, cb.b, amount, 255)};
+    out.rgb[i] = c;
+    out.rgb16[i] = toRgb16(c);
+    out.rgb565[i] = toRgb565(c.r, c.g, c.b);
+  }
+}
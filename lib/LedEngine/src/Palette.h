@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+
+#include "Framebuffer.h"
+
+// 256-entry color tables shared by the effects and the UI.
+//
+// Every palette is generated at compile time in the three formats its users
+// need: Rgb16 for effects rendering into a Framebuffer16, RGB888 for colors
+// sent to the render core and RGB565 for the display. A lookup is a single
+// indexed load, so effects never evaluate trig or branch per pixel to pick a
+// color.
+struct Palette {
+  const char* name;
+  std::array<Rgb16, 256> rgb16;
+  std::array<Rgb, 256> rgb;
+  std::array<uint16_t, 256> rgb565;
+};
+
+// Gradient palettes are defined by stops at increasing indexes; entries in
+// between are interpolated linearly. The first stop should be at 0 and the
+// last at 255.
+struct GradientStop {
+  uint8_t index;
+  Rgb color;
+};
+
+constexpr Palette makePalette(const char* name, const std::array<Rgb, 256>& colors) {
+  Palette p = {name, {}, {}, {}};
+  for(int i = 0; i < 256; i++) {
+    p.rgb[i] = colors[i];
+    p.rgb16[i] = toRgb16(colors[i]);
+    p.rgb565[i] = toRgb565(colors[i].r, colors[i].g, colors[i].b);
+  }
+  return p;
+}
+
+constexpr uint8_t lerpChannel(uint8_t a, uint8_t b, int num, int den) {
+  return (uint8_t)(a + ((b - a) * num + (b >= a ? den / 2 : -(den / 2))) / den);
+}
+
+template <size_t N>
+constexpr Palette makeGradientPalette(const char* name, const GradientStop (&stops)[N]) {
+  std::array<Rgb, 256> colors = {};
+  for(size_t s = 0; s + 1 < N; s++) {
+    const GradientStop& a = stops[s];
+    const GradientStop& b = stops[s + 1];
+    const int span = b.index - a.index;
+    for(int i = a.index; i <= b.index; i++) {
+      const int t = i - a.index;
+      colors[i] = span == 0 ? b.color
+                            : Rgb{lerpChannel(a.color.r, b.color.r, t, span), lerpChannel(a.color.g, b.color.g, t, span),
+                                  lerpChannel(a.color.b, b.color.b, t, span)};
+    }
+  }
+  return makePalette(name, colors);
+}
+
+// Named palettes
+extern const Palette kRainbowPalette;      // Red-green-blue wheel of the rainbow effect
+extern const Palette kSineRainbowPalette;  // Softer sine rainbow of the UI color swatches
+extern const Palette kHeatPalette;         // Black-red-yellow-white fire ramp
+extern const Palette kEmberPalette;        // Orange to red, the Fire button gradient
+extern const Palette kVuPalette;           // Green-yellow-red level meter
+
+const Palette* const* allPalettes();
+uint8_t paletteCount();
+// nullptr if no palette has that name
+const Palette* findPalette(const char* name);
+
+// Color at a 16-bit position: the high byte picks the entry, the low byte
+// blends towards the next one (wrapping from 255 to 0). Lets slow effects
+// move smoothly between entries.
+inline Rgb16 samplePalette(const Palette& p, uint16_t position) {
+  const Rgb16 a = p.rgb16[position >> 8];
+  const Rgb16 b = p.rgb16[(uint8_t)((position >> 8) + 1)];
+  const int32_t f = position & 0xFF;
+  return Rgb16{(uint16_t)(a.r + (((int32_t)b.r - a.r) * f >> 8)), (uint16_t)(a.g + (((int32_t)b.g - a.g) * f >> 8)),
+               (uint16_t)(a.b + (((int32_t)b.b - a.b) * f >> 8))};
+}
+
+// Mix two palettes into out, amount = share of b (0-255). For fading
+// between named palettes at run time.
+void blendPalettes(const Palette& a, const Palette& b, uint8_t amount, Palette& out);
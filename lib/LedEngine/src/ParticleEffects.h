@@ -0,0 +1,214 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "EffectKernels.h"
+#include "EffectRegistry.h"
+#include "FastRandom.h"
+#include "ParticlePool.h"
+
+// Particle effects: sparkle, comet and firework, built on ParticlePool like
+// the meteors. Each frame starts black and every live particle is added
+// onto it, so apart from clearing the frame the cost follows the number of
+// particles alive. Kernels follow EffectKernels.h: templated on the pixel
+// count type, inline.
+
+// Whole particles due at perSecond over dtUs. carry keeps the fraction
+// (in millionths of a particle) for the next frame.
+inline uint32_t particlesDue(uint32_t perSecond, uint32_t dtUs, uint32_t& carry) {
+  const uint64_t total = (uint64_t)perSecond * dtUs + carry;
+  carry = (uint32_t)(total % 1000000);
+  return (uint32_t)(total / 1000000);
+}
+
+// Random value in [low, high) of a fixed-point speed or length, for
+// spreading particles out
+inline int32_t randomBetween(FastRandom& rng, int32_t low, int32_t high) {
+  return low + (int32_t)rng.below((uint32_t)(high - low));
+}
+
+static const uint16_t kSparkleMax = 512;
+
+struct SparkleState {
+  ParticlePool<kSparkleMax> sparks;
+  FastRandom rng;
+  uint16_t rate = 150;    // New sparks per second
+  uint16_t lifeMs = 600;  // Longest a spark takes to fade out
+  uint32_t carry = 0;
+  const Palette* palette = &kRainbowPalette;
+};
+
+// Single LEDs lighting up in random palette colors and fading out
+template <typename Count>
+inline void sparkleKernel(Rgb16* pixels, Count count, SparkleState& state, uint32_t dtUs) {
+  const uint32_t numLeds = count;
+  state.sparks.update(dtUs);
+  const uint32_t due = particlesDue(state.rate, dtUs, state.carry);
+  for(uint32_t i = 0; i < due && !state.sparks.full(); i++) {
+    const int32_t pos = (int32_t)state.rng.below(numLeds) << kParticleShift;
+    const Rgb16 color = state.palette->rgb16[state.rng.below(256)];
+    // Between half and all of lifeMs, so they do not go out in step
+    const uint32_t lifeUs = state.lifeMs * state.rng.range(500, 1000);
+    state.sparks.spawn(Particle{pos, 0, color, lifeUs, 0});
+  }
+  fillKernel(pixels, count, Rgb16{0, 0, 0});
+  state.sparks.draw(pixels, count);
+}
+
+static const uint8_t kCometMax = 8;
+static const uint16_t kCometDustMax = 384;
+
+struct CometState {
+  ParticlePool<kCometMax> heads;
+  ParticlePool<kCometDustMax> dust;
+  FastRandom rng;
+  uint8_t count = 2;    // Comets
+  uint16_t speed = 60;  // LEDs per second
+  uint16_t shed = 120;  // Dust particles per second from each comet
+  uint32_t carry = 0;
+};
+
+// Comets bouncing between the ends of the strip, each shedding dust that
+// drifts after it, slows down and fades
+template <typename Count>
+inline void cometKernel(Rgb16* pixels, Count count, CometState& state, uint32_t dtUs) {
+  const int32_t numLeds = count;
+  const int comets = state.count < 1 ? 1 : state.count > kCometMax ? kCometMax : state.count;
+  const int32_t speed = (int32_t)state.speed << kParticleShift;
+
+  // Spread along the strip, every other one heading back, hues well apart
+  state.heads.truncate(comets);
+  while(state.heads.live() < comets) {
+    const uint16_t k = state.heads.live();
+    const int32_t pos = (int32_t)((int64_t)k * numLeds / comets) << kParticleShift;
+    state.heads.spawn(Particle{pos, k & 1 ? -speed : speed, kRainbowPalette.rgb16[(k * 96) & 255], 0, 6});
+  }
+  for(uint16_t i = 0; i < state.heads.live(); i++) {
+    state.heads.vel(i) = state.heads.vel(i) < 0 ? -speed : speed;
+  }
+
+  state.dust.update(dtUs, ParticleForces{0, fadeScaleFor(0.9f, dtUs, kEffectStepUs)});
+  state.dust.removeOutside(numLeds);
+  state.heads.update(dtUs);
+  state.heads.bounce(0, (numLeds - 1) << kParticleShift);
+
+  // Dust leaves at up to a quarter of the comet's speed, give or take
+  // 8 LEDs per second, in its color at half strength
+  const uint32_t due = particlesDue(state.shed * comets, dtUs, state.carry);
+  const int32_t jitter = 8 << kParticleShift;
+  for(uint32_t i = 0; i < due && !state.dust.full(); i++) {
+    const uint16_t from = i % comets;
+    const Rgb16 c = state.heads.color(from);
+    const int32_t vel = state.heads.vel(from) / 4 * (int32_t)state.rng.below(256) / 256 +
+                        randomBetween(state.rng, -jitter, jitter);
+    state.dust.spawn(Particle{state.heads.pos(from), vel, Rgb16{(uint16_t)(c.r / 2), (uint16_t)(c.g / 2), (uint16_t)(c.b / 2)},
+                              state.rng.range(300000, 900000), 0});
+  }
+
+  fillKernel(pixels, count, Rgb16{0, 0, 0});
+  state.dust.draw(pixels, count);
+  state.heads.draw(pixels, count);
+}
+
+static const uint8_t kRocketMax = 8;
+static const uint16_t kFireworkSparkMax = 768;
+
+static const Rgb16 kRocketColor = {0x6000, 0x4000, 0x1800};
+
+struct FireworkState {
+  ParticlePool<kRocketMax> rockets;
+  ParticlePool<kFireworkSparkMax> sparks;
+  FastRandom rng;
+  uint16_t launchMs = 900;  // Average time between launches
+  uint8_t burst = 60;       // Sparks per burst
+  uint32_t untilLaunchUs = 0;
+  const Palette* palette = &kRainbowPalette;
+};
+
+// Rockets rise from the start of the strip and slow under gravity; at the
+// top of their climb each bursts into sparks flying both ways, which drag,
+// fall back and fade. Heights and speeds scale with the strip, so a burst
+// looks the same on 144 LEDs as on 10000.
+template <typename Count>
+inline void fireworkKernel(Rgb16* pixels, Count count, FireworkState& state, uint32_t dtUs) {
+  const int32_t numLeds = count;
+  // Gravity of 0.8 strip lengths per second squared
+  const int32_t gravity = (int32_t)(((int64_t)numLeds << kParticleShift) * 4 / 5);
+
+  if(dtUs >= state.untilLaunchUs) {
+    // Bursts between 45% and 90% of the way up: v = sqrt(2 * g * height)
+    const float height = (float)state.rng.range(450, 900) / 1000;
+    const int32_t vel = (int32_t)(numLeds * sqrtf(1.6f * height) * (1 << kParticleShift));
+    state.rockets.spawn(Particle{0, vel, kRocketColor, 0, 3});
+    state.untilLaunchUs = state.launchMs * state.rng.range(500, 1500);
+  } else {
+    state.untilLaunchUs -= dtUs;
+  }
+  state.rockets.update(dtUs, ParticleForces{-gravity, 0x10000});
+
+  // Sparks at up to 0.3 strip lengths per second, a few of them white
+  const int32_t spread = (int32_t)(((int64_t)numLeds << kParticleShift) * 3 / 10) + 1;
+  state.rockets.removeIf([&](uint16_t r) {
+    if(state.rockets.vel(r) > 0) {
+      return false;
+    }
+    const Rgb16 color = state.palette->rgb16[state.rng.below(256)];
+    for(uint8_t i = 0; i < state.burst && !state.sparks.full(); i++) {
+      state.sparks.spawn(Particle{state.rockets.pos(r), randomBetween(state.rng, -spread, spread),
+                                  i % 8 ? color : Rgb16{0xFFFF, 0xFFFF, 0xFFFF}, state.rng.range(700000, 1500000), 1});
+    }
+    return true;
+  });
+  state.sparks.update(dtUs, ParticleForces{-gravity / 4, fadeScaleFor(0.94f, dtUs, kEffectStepUs)});
+  state.sparks.removeOutside(numLeds);
+
+  fillKernel(pixels, count, Rgb16{0, 0, 0});
+  state.sparks.draw(pixels, count);
+  state.rockets.draw(pixels, count);
+}
+
+struct SparkleDef : EffectDef {
+  static constexpr const char* kName = "Sparkle";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = SparkleState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("rate", &SparkleState::rate, (uint16_t)10, (uint16_t)2000),
+                           effectParam("life", &SparkleState::lifeMs, (uint16_t)100, (uint16_t)3000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    sparkleKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
+
+struct CometDef : EffectDef {
+  static constexpr const char* kName = "Comet";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = CometState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("count", &CometState::count, (uint8_t)1, (uint8_t)kCometMax),
+                           effectParam("speed", &CometState::speed, (uint16_t)5, (uint16_t)1000));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    cometKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
+
+struct FireworkDef : EffectDef {
+  static constexpr const char* kName = "Firework";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  using State = FireworkState;
+  static constexpr auto params() {
+    return std::make_tuple(effectParam("launch", &FireworkState::launchMs, (uint16_t)200, (uint16_t)5000),
+                           effectParam("burst", &FireworkState::burst, (uint8_t)10, (uint8_t)200));
+  }
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count count, State& state, uint32_t dtUs) {
+    fireworkKernel(fb.pixels, count, state, dtUs);
+    return fb;
+  }
+};
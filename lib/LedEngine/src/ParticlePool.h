@@ -0,0 +1,239 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+
+#include "Framebuffer.h"
+
+// Fixed-capacity particle pool, the engine behind the meteor, sparkle, comet
+// and firework effects.
+//
+// Particles are stored as a structure of arrays, one array per attribute,
+// and the live ones are always the first live() entries: spawn() appends
+// and a particle that dies is replaced by the last live one. Updating and
+// drawing are straight loops over the live particles, so their cost follows
+// the number alive rather than the capacity, and nothing is allocated after
+// construction - the arrays are part of the pool, which lives in the
+// effect's state.
+//
+// Positions are in LEDs with kParticleShift fractional bits, velocities in
+// the same units per second. A particle draws as a head split between the
+// two LEDs around its position plus an optional tail behind its direction
+// of travel, fading out linearly, all added onto the frame (saturating), so
+// overlapping particles brighten instead of hiding each other. A particle
+// with a lifetime dims as it ages and is removed when it runs out.
+
+// Same as kSubPixelShift, so effect positions carry over unchanged
+static const int kParticleShift = 12;
+
+// A new particle, for spawn()
+struct Particle {
+  int32_t pos;      // Fixed point
+  int32_t vel;      // Fixed point per second
+  Rgb16 color;      // At full life
+  uint32_t lifeUs;  // 0: lives until removed
+  uint8_t tail;     // LEDs trailing the head
+};
+
+// Per-frame forces for update()
+struct ParticleForces {
+  int32_t accel = 0;       // Fixed point per second squared
+  uint32_t drag = 0x10000; // Velocity kept per frame, Q16 (see fadeScaleFor())
+};
+
+// How much dimmer each LED of a tail of i LEDs is than the one before, so
+// the tail fades evenly from the head to nothing without a division
+static constexpr std::array<uint16_t, 256> buildTailSteps() {
+  std::array<uint16_t, 256> steps = {};
+  for(int i = 0; i < 256; i++) {
+    steps[i] = (uint16_t)(0xFFFF / (i + 1));
+  }
+  return steps;
+}
+
+inline constexpr std::array<uint16_t, 256> kTailSteps = buildTailSteps();
+
+// Add color * weight (Q16) onto a pixel, saturating
+inline void addWeighted(Rgb16& pixel, Rgb16 color, uint32_t weight) {
+  const uint32_t r = pixel.r + (color.r * weight >> 16);
+  const uint32_t g = pixel.g + (color.g * weight >> 16);
+  const uint32_t b = pixel.b + (color.b * weight >> 16);
+  pixel.r = r > 0xFFFF ? 0xFFFF : r;
+  pixel.g = g > 0xFFFF ? 0xFFFF : g;
+  pixel.b = b > 0xFFFF ? 0xFFFF : b;
+}
+
+template <uint16_t Capacity>
+class ParticlePool {
+ public:
+  static constexpr uint16_t kCapacity = Capacity;
+  static constexpr uint32_t kFullLife = 1u << 24;
+
+  uint16_t live() const { return live_; }
+  bool full() const { return live_ == Capacity; }
+  void clear() { live_ = 0; }
+
+  // Keep at most count particles, the oldest spawned
+  void truncate(uint16_t count) {
+    if(count < live_) {
+      live_ = count;
+    }
+  }
+
+  // Add a particle. False if the pool is full.
+  bool spawn(const Particle& p) {
+    if(live_ == Capacity) {
+      return false;
+    }
+    const uint16_t i = live_++;
+    pos_[i] = p.pos;
+    vel_[i] = p.vel;
+    color_[i] = p.color;
+    tail_[i] = p.tail;
+    life_[i] = kFullLife;
+    // Life lost per 1024 us; lifetimes under 1 ms are rounded up
+    decay_[i] = p.lifeUs ? (uint32_t)(((uint64_t)kFullLife << 10) / (p.lifeUs < 1024 ? 1024 : p.lifeUs)) : 0;
+    return true;
+  }
+
+  // Remove particle i; the last live particle takes its place
+  void kill(uint16_t i) {
+    const uint16_t last = --live_;
+    pos_[i] = pos_[last];
+    vel_[i] = vel_[last];
+    color_[i] = color_[last];
+    tail_[i] = tail_[last];
+    life_[i] = life_[last];
+    decay_[i] = decay_[last];
+  }
+
+  int32_t& pos(uint16_t i) { return pos_[i]; }
+  int32_t& vel(uint16_t i) { return vel_[i]; }
+  int32_t pos(uint16_t i) const { return pos_[i]; }
+  int32_t vel(uint16_t i) const { return vel_[i]; }
+  uint8_t& tail(uint16_t i) { return tail_[i]; }
+  Rgb16 color(uint16_t i) const { return color_[i]; }
+
+  // Age every particle by dtUs, removing those that run out, then apply the
+  // forces and move them
+  void update(uint32_t dtUs, const ParticleForces& forces = ParticleForces()) {
+    // Elapsed time as Q20 seconds, so a move is a multiply and shift
+    const int64_t step = ((int64_t)dtUs << 20) / 1000000;
+    const int32_t dv = (int32_t)(((int64_t)forces.accel * step) >> 20);
+    uint16_t i = 0;
+    while(i < live_) {
+      if(decay_[i]) {
+        const uint64_t lost = (uint64_t)decay_[i] * dtUs >> 10;
+        if(lost >= life_[i]) {
+          kill(i);
+          continue;
+        }
+        life_[i] -= (uint32_t)lost;
+      }
+      vel_[i] = (int32_t)(((int64_t)vel_[i] * forces.drag) >> 16) + dv;
+      pos_[i] += (int32_t)(((int64_t)vel_[i] * step) >> 20);
+      i++;
+    }
+  }
+
+  // Remove the particles for which remove(i) is true
+  template <typename F>
+  void removeIf(F&& remove) {
+    uint16_t i = 0;
+    while(i < live_) {
+      if(remove(i)) {
+        kill(i);
+      } else {
+        i++;
+      }
+    }
+  }
+
+  // Remove particles whose whole tail has left [0, count) LEDs, moving
+  // either way
+  void removeOutside(uint32_t count) {
+    const int32_t end = (int32_t)count << kParticleShift;
+    removeIf([&](uint16_t i) {
+      const int32_t margin = (int32_t)(tail_[i] + 1) << kParticleShift;
+      return pos_[i] < -margin || pos_[i] >= end + margin;
+    });
+  }
+
+  // Particles past an end of [low, high) come back in at the other
+  // (fixed point bounds)
+  void wrap(int32_t low, int32_t high) {
+    const int32_t span = high - low;
+    for(uint16_t i = 0; i < live_; i++) {
+      if(pos_[i] >= high) {
+        pos_[i] -= span;
+      } else if(pos_[i] < low) {
+        pos_[i] += span;
+      }
+    }
+  }
+
+  // Particles past an end of [low, high] turn round, the overshoot
+  // reflected (fixed point bounds)
+  void bounce(int32_t low, int32_t high) {
+    for(uint16_t i = 0; i < live_; i++) {
+      if(pos_[i] > high) {
+        pos_[i] = high - (pos_[i] - high);
+        vel_[i] = -vel_[i];
+      } else if(pos_[i] < low) {
+        pos_[i] = low + (low - pos_[i]);
+        vel_[i] = -vel_[i];
+      }
+    }
+  }
+
+  // Add every particle onto count pixels
+  template <typename Count>
+  void draw(Rgb16* pixels, Count count) const {
+    const uint32_t numLeds = count;
+    for(uint16_t i = 0; i < live_; i++) {
+      const uint32_t level = life_[i] >> 8;  // Up to 0x10000, so a full-life color is exact
+      const Rgb16 c = {(uint16_t)(color_[i].r * level >> 16), (uint16_t)(color_[i].g * level >> 16),
+                       (uint16_t)(color_[i].b * level >> 16)};
+      // Head: split between the LED at or before the position and the next
+      const int32_t head = pos_[i] >> kParticleShift;
+      const uint32_t next = (uint32_t)(pos_[i] & ((1 << kParticleShift) - 1)) << (16 - kParticleShift);
+      if((uint32_t)head < numLeds) {
+        addWeighted(pixels[head], c, 0x10000 - next);
+      }
+      if((uint32_t)(head + 1) < numLeds) {
+        addWeighted(pixels[head + 1], c, next);
+      }
+      // Tail, behind whichever way it moves from the LED nearest the
+      // position, clipped to the strip up front
+      const int length = tail_[i];
+      if(length == 0) {
+        continue;
+      }
+      const int32_t anchor = (pos_[i] + (1 << (kParticleShift - 1))) >> kParticleShift;
+      const int32_t dir = vel_[i] >= 0 ? -1 : 1;
+      const uint32_t step = kTailSteps[length];
+      int first = 1;
+      int last = length;
+      if(dir < 0) {
+        first = anchor >= (int32_t)numLeds ? anchor - (int32_t)numLeds + 1 : 1;
+        last = anchor < length ? anchor : length;
+      } else {
+        first = anchor < 0 ? -anchor : 1;
+        last = anchor + length >= (int32_t)numLeds ? (int32_t)numLeds - 1 - anchor : length;
+      }
+      for(int k = first; k <= last; k++) {
+        addWeighted(pixels[anchor + dir * k], c, 0xFFFF - k * step);
+      }
+    }
+  }
+
+ private:
+  std::array<int32_t, Capacity> pos_ = {};
+  std::array<int32_t, Capacity> vel_ = {};
+  std::array<Rgb16, Capacity> color_ = {};
+  std::array<uint32_t, Capacity> life_ = {};   // Left, of kFullLife
+  std::array<uint32_t, Capacity> decay_ = {};  // Life lost per 1024 us
+  std::array<uint8_t, Capacity> tail_ = {};
+  uint16_t live_ = 0;
+};
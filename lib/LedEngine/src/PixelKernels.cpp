@@ -0,0 +1,269 @@
+#include "PixelKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <array>
+
+// Compile-time x^2.2 for the gamma table: exp(2.2 * ln x) with series that
+// converge over the whole 0-1 range
+static constexpr double constLn(double x) {
+  // x = m * 2^k with m in [0.5, 1), then ln m = 2 atanh((m - 1) / (m + 1))
+  int k = 0;
+  while(x < 0.5) {
+    x *= 2;
+    k--;
+  }
+  double y = (x - 1) / (x + 1);
+  double term = y, sum = 0;
+  for(int n = 1; n < 40; n += 2) {
+    sum += term / n;
+    term *= y * y;
+  }
+  return 2 * sum + k * 0.69314718055994530942;
+}
+
+static constexpr double constExp(double x) {
+  // exp(x) = exp(x / 1024)^1024
+  double y = x / 1024, term = 1, sum = 1;
+  for(int n = 1; n < 12; n++) {
+    term *= y / n;
+    sum += term;
+  }
+  for(int i = 0; i < 10; i++) {
+    sum *= sum;
+  }
+  return sum;
+}
+
+static const int kGammaBits = 12;
+
+static constexpr std::array<uint16_t, 1 << kGammaBits> buildGammaTable() {
+  std::array<uint16_t, 1 << kGammaBits> table = {};
+  const int last = (1 << kGammaBits) - 1;
+  for(int i = 1; i <= last; i++) {
+    double x = (double)i / last;
+    table[i] = (uint16_t)(constExp(2.2 * constLn(x)) * 65535 + 0.5);
+  }
+  return table;
+}
+
+static constexpr std::array<uint16_t, 1 << kGammaBits> kGammaTable = buildGammaTable();
+static_assert(kGammaTable[(1 << kGammaBits) - 1] == 0xFFFF, "gamma table must reach full scale");
+
+void scaleChannels(uint16_t* __restrict data, uint32_t n, uint16_t scale) {
+  for(uint32_t i = 0; i < n; i++) {
+    data[i] = ((uint32_t)data[i] * scale) >> 16;
+  }
+}
+
+void addChannels(uint16_t* dst, const uint16_t* src, uint32_t n) {
+  for(uint32_t i = 0; i < n; i++) {
+    uint32_t v = (uint32_t)dst[i] + src[i];
+    dst[i] = v > 0xFFFF ? 0xFFFF : v;
+  }
+}
+
+void blendChannels(uint16_t* dst, const uint16_t* a, const uint16_t* b, uint32_t n, uint16_t weight) {
+  // a + (b - a) * w: one multiply per channel instead of two. The weight
+  // drops to Q0.15 so the signed product fits 32 bits; it still vectorizes.
+  const int32_t w = weight >> 1;
+  for(uint32_t i = 0; i < n; i++) {
+    dst[i] = (uint16_t)(a[i] + ((((int32_t)b[i] - a[i]) * w) >> 15));
+  }
+}
+
+uint16_t fadeScaleFor(float perStep, uint32_t dtUs, uint32_t stepUs) {
+  if(dtUs == stepUs) {
+    return fadeScale(perStep);
+  }
+  return fadeScale(powf(perStep, (float)dtUs / stepUs));
+}
+
+// Where the output pass reads pixel i from: straight through the frame, or
+// (for PixelMap runs) every step-th pixel, optionally reading black past the
+// end of a short frame
+struct DirectPixels {
+  const Rgb16* __restrict px;
+  Rgb16 operator[](uint32_t i) const { return px[i]; }
+};
+
+struct ReversedPixels {
+  const Rgb16* __restrict px;
+  Rgb16 operator[](uint32_t i) const { return *(px - i); }
+};
+
+struct StridedPixels {
+  const Rgb16* __restrict px;
+  int32_t step;
+  Rgb16 operator[](uint32_t i) const { return px[(int32_t)i * step]; }
+};
+
+struct CheckedPixels {
+  const Rgb16* __restrict px;
+  uint32_t count;
+  uint32_t first;
+  int32_t step;
+  Rgb16 operator[](uint32_t i) const {
+    const uint32_t j = first + i * (uint32_t)step;
+    return j < count ? px[j] : Rgb16{0, 0, 0};
+  }
+};
+
+template <typename Source>
+static uint32_t writePlain(Source px, uint32_t count, uint8_t* __restrict out, uint32_t scale, ColorOrder order) {
+  uint32_t sum = 0;
+  for(uint32_t i = 0; i < count; i++) {
+    const Rgb16 p = px[i];
+    uint32_t r = (p.r * scale) >> 16;
+    uint32_t g = (p.g * scale) >> 16;
+    uint32_t b = (p.b * scale) >> 16;
+    sum += r + g + b;
+    uint8_t* slot = out + i * 3;
+    slot[order.r] = r;
+    slot[order.g] = g;
+    slot[order.b] = b;
+  }
+  return sum;
+}
+
+// 0xFFFF * 256 >> 16 = 255, so full brightness is lossless at full scale
+static uint32_t plainScale(uint8_t brightness) {
+  return (uint32_t)brightness + 1;
+}
+
+uint32_t writeOutput(const Framebuffer16& src, uint8_t* out, uint8_t brightness, ColorOrder order) {
+  return writePlain(DirectPixels{src.pixels}, src.count, out, plainScale(brightness), order);
+}
+
+static constexpr uint8_t reverseBits(uint8_t v) {
+  return (uint8_t)(((v * 0x0802u & 0x22110u) | (v * 0x8020u & 0x88440u)) * 0x10101u >> 16);
+}
+
+// Dither threshold step between neighbouring pixels: odd, so a pixel run
+// covers all 256 offsets, and far from 0/128 so neighbours differ a lot
+static const uint8_t kDitherPixelStep = 167;
+
+// One instantiation per option set, so the per-pixel loop has no branches
+template <bool Gamma, bool Dither, typename Source>
+static uint32_t writeCorrected(Source px, uint32_t count, uint8_t* __restrict out, uint32_t scale, ColorOrder order,
+                               uint8_t t) {
+  uint32_t sum = 0;
+  for(uint32_t i = 0; i < count; i++) {
+    const Rgb16 p = px[i];
+    uint32_t r = Gamma ? kGammaTable[p.r >> (16 - kGammaBits)] : p.r;
+    uint32_t g = Gamma ? kGammaTable[p.g >> (16 - kGammaBits)] : p.g;
+    uint32_t b = Gamma ? kGammaTable[p.b >> (16 - kGammaBits)] : p.b;
+    // 8.8 fixed point output level, at most 255.0 so dithering cannot overflow
+    r = (r * scale) >> 16;
+    g = (g * scale) >> 16;
+    b = (b * scale) >> 16;
+    if(Dither) {
+      // Thresholds per channel a third of the range apart so the channels
+      // do not step up together
+      r = (r + t) >> 8;
+      g = (g + (uint8_t)(t + 85)) >> 8;
+      b = (b + (uint8_t)(t + 170)) >> 8;
+      t += kDitherPixelStep;
+    } else {
+      r >>= 8;
+      g >>= 8;
+      b >>= 8;
+    }
+    sum += r + g + b;
+    uint8_t* slot = out + i * 3;
+    slot[order.r] = r;
+    slot[order.g] = g;
+    slot[order.b] = b;
+  }
+  return sum;
+}
+
+// Brightness 0-255 to 0-256 so that 0 is black even after dithering and
+// 255 is 1.0, times 255 for the 8.8 level of a full-scale channel. The +1
+// makes 0xFFFF land on that level exactly ((x + 1) * 0xFFFF >> 16 == x)
+// rather than just under it, so full white goes out as 255.
+static uint32_t correctedScale(uint8_t brightness) {
+  return ((uint32_t)brightness + (brightness >> 7)) * 255 + 1;
+}
+
+uint32_t writeOutputCorrected(const Framebuffer16& src, uint8_t* out, uint8_t brightness, ColorOrder order,
+                              bool gamma, bool dither, uint8_t ditherFrame) {
+  const DirectPixels px = {src.pixels};
+  const uint32_t scale = correctedScale(brightness);
+  const uint8_t t = reverseBits(ditherFrame);
+  if(gamma && dither) {
+    return writeCorrected<true, true>(px, src.count, out, scale, order, t);
+  } else if(gamma) {
+    return writeCorrected<true, false>(px, src.count, out, scale, order, t);
+  } else if(dither) {
+    return writeCorrected<false, true>(px, src.count, out, scale, order, t);
+  } else {
+    return writeCorrected<false, false>(px, src.count, out, scale, order, t);
+  }
+}
+
+// Walk PixelMap runs: contiguous runs go through the same loop as an
+// unmapped strip, reversed ones (serpentine rows, mirrored halves) through
+// the same loop reading backwards, other steps read strided, gaps are zeroed, and runs
+// reaching past the end of src check every pixel. write(pixels, length, out,
+// led) is called per run with led the run's first LED.
+template <typename Write>
+static uint32_t writeRuns(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                          Write write) {
+  uint32_t sum = 0;
+  uint32_t led = 0;
+  for(uint32_t r = 0; r < runCount; r++) {
+    const PixelRun& run = runs[r];
+    const uint32_t last = run.first + (uint32_t)run.step * (run.length - 1);
+    if(run.first == PixelMap::kGap) {
+      memset(out, 0, run.length * 3);
+    } else if(run.first < src.count && last < src.count && (run.step >= 0) == (last >= run.first)) {
+      if(run.step == 1) {
+        sum += write(DirectPixels{src.pixels + run.first}, run.length, out, led);
+      } else if(run.step == -1) {
+        sum += write(ReversedPixels{src.pixels + run.first}, run.length, out, led);
+      } else {
+        sum += write(StridedPixels{src.pixels + run.first, run.step}, run.length, out, led);
+      }
+    } else {
+      sum += write(CheckedPixels{src.pixels, src.count, run.first, run.step}, run.length, out, led);
+    }
+    out += run.length * 3;
+    led += run.length;
+  }
+  return sum;
+}
+
+uint32_t writeOutputMapped(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                           uint8_t brightness, ColorOrder order) {
+  const uint32_t scale = plainScale(brightness);
+  return writeRuns(src, runs, runCount, out, [&](auto px, uint32_t count, uint8_t* slots, uint32_t) {
+    return writePlain(px, count, slots, scale, order);
+  });
+}
+
+template <bool Gamma, bool Dither>
+static uint32_t writeCorrectedRuns(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                                   uint32_t scale, ColorOrder order, uint8_t t) {
+  // Thresholds carry on across runs as if the LEDs were one unmapped strip
+  return writeRuns(src, runs, runCount, out, [&](auto px, uint32_t count, uint8_t* slots, uint32_t led) {
+    return writeCorrected<Gamma, Dither>(px, count, slots, scale, order, (uint8_t)(t + led * kDitherPixelStep));
+  });
+}
+
+uint32_t writeOutputCorrectedMapped(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                                    uint8_t brightness, ColorOrder order, bool gamma, bool dither,
+                                    uint8_t ditherFrame) {
+  const uint32_t scale = correctedScale(brightness);
+  const uint8_t t = reverseBits(ditherFrame);
+  if(gamma && dither) {
+    return writeCorrectedRuns<true, true>(src, runs, runCount, out, scale, order, t);
+  } else if(gamma) {
+    return writeCorrectedRuns<true, false>(src, runs, runCount, out, scale, order, t);
+  } else if(dither) {
+    return writeCorrectedRuns<false, true>(src, runs, runCount, out, scale, order, t);
+  } else {
+    return writeCorrectedRuns<false, false>(src, runs, runCount, out, scale, order, t);
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Framebuffer.h"
+#include "PixelMap.h"
+
+// Batched kernels over Framebuffer16 channel data. Every kernel treats the
+// buffer as a flat uint16_t array (R, G, B interleaved) and is written as a
+// plain restrict-qualified loop so the compiler can vectorize it; on targets
+// without usable SIMD they are still branch-free integer loops.
+//
+// Scale factors are Q0.16: 0x10000 would be 1.0, so 0xFFFF is "almost 1" and
+// 0x8000 is one half.
+
+// data[i] = data[i] * scale >> 16
+void scaleChannels(uint16_t* data, uint32_t n, uint16_t scale);
+
+// dst[i] = min(dst[i] + src[i], 0xFFFF); dst may alias src
+void addChannels(uint16_t* dst, const uint16_t* src, uint32_t n);
+
+// dst[i] = a[i] + (b[i] - a[i]) * weight >> 16, weight = share of b. dst may
+// be the same buffer as a or b for in-place blends.
+void blendChannels(uint16_t* dst, const uint16_t* a, const uint16_t* b, uint32_t n, uint16_t weight);
+
+// Fade the whole frame towards black
+inline void fadeFrame(Framebuffer16& fb, uint16_t scale) {
+  scaleChannels(fb.channels(), fb.channelCount(), scale);
+}
+
+// Convert the float fade constants the effects were written with
+constexpr uint16_t fadeScale(float factor) {
+  return factor >= 1.0f ? 0xFFFF : factor <= 0.0f ? 0 : (uint16_t)(factor * 65536.0f + 0.5f);
+}
+
+// Fade factor for an elapsed time, given the factor per stepUs. Lets a
+// trail decay at the same speed whatever the frame rate.
+uint16_t fadeScaleFor(float perStep, uint32_t dtUs, uint32_t stepUs);
+
+// Output pass: apply global brightness (0-255) and write 8-bit values in the
+// strip's wire order. This is the only place precision is dropped. Returns
+// the sum of all levels written, which is what the strip's current follows.
+uint32_t writeOutput(const Framebuffer16& src, uint8_t* out, uint8_t brightness, ColorOrder order);
+
+// Corrected output pass: gamma, brightness and temporal dithering fused into
+// one loop over the frame.
+//
+// Each channel goes through a 2.2 gamma table (indexed by the top 12 bits),
+// is scaled by brightness and kept as 8.8 fixed point. With dithering the 8
+// fractional bits are not thrown away: every pixel adds a threshold that
+// steps through all 256 values as ditherFrame advances (bit-reversed, offset
+// per pixel and channel), so averaged over frames the strip shows the exact
+// fractional level. Dark gradients and slow fades stop banding. Brightness 0
+// is fully off. Returns the sum of all levels written, like writeOutput().
+uint32_t writeOutputCorrected(const Framebuffer16& src, uint8_t* out, uint8_t brightness, ColorOrder order,
+                              bool gamma, bool dither, uint8_t ditherFrame);
+
+// The same passes reading through a PixelMap (PixelMap::runsFor): the runs'
+// LEDs are written in order, each showing its logical pixel of src, black
+// for gaps and pixels past the end of src. Contiguous runs take the same
+// loop as the unmapped pass and other runs only step differently, so
+// remapping adds no pass over the frame and next to no work per LED. Output
+// is byte-identical to the unmapped pass over the frame rearranged by hand.
+uint32_t writeOutputMapped(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                           uint8_t brightness, ColorOrder order);
+uint32_t writeOutputCorrectedMapped(const Framebuffer16& src, const PixelRun* runs, uint32_t runCount, uint8_t* out,
+                                    uint8_t brightness, ColorOrder order, bool gamma, bool dither,
+                                    uint8_t ditherFrame);
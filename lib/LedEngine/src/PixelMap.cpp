@@ -0,0 +1,96 @@
+#include "PixelMap.h"
+
+void PixelMap::clear() {
+  table_.clear();
+  logicalCount_ = 0;
+  matrixBase_ = 0;
+  width_ = 0;
+  height_ = 0;
+}
+
+void PixelMap::addSegment(uint32_t first, uint32_t last) {
+  if(first <= last) {
+    for(uint32_t i = first; i <= last; i++) {
+      table_.push_back(i);
+    }
+  } else {
+    for(uint32_t i = first + 1; i-- > last;) {
+      table_.push_back(i);
+    }
+  }
+  const uint32_t high = first > last ? first : last;
+  if(high + 1 > logicalCount_) {
+    logicalCount_ = high + 1;
+  }
+}
+
+void PixelMap::addGap(uint32_t length) {
+  table_.insert(table_.end(), length, kGap);
+}
+
+void PixelMap::addMatrix(uint16_t width, uint16_t height, uint8_t layout) {
+  const uint32_t base = logicalCount_;
+  // Runs are the rows, or the columns when wired that way
+  const bool columns = layout & MATRIX_COLUMNS;
+  const uint32_t runLength = columns ? height : width;
+  const uint32_t runs = columns ? width : height;
+  for(uint32_t run = 0; run < runs; run++) {
+    for(uint32_t k = 0; k < runLength; k++) {
+      const uint32_t along = (layout & MATRIX_SERPENTINE) && (run & 1) ? runLength - 1 - k : k;
+      uint32_t x = columns ? run : along;
+      uint32_t y = columns ? along : run;
+      if(layout & MATRIX_FLIP_X) {
+        x = width - 1 - x;
+      }
+      if(layout & MATRIX_FLIP_Y) {
+        y = height - 1 - y;
+      }
+      table_.push_back(base + y * width + x);
+    }
+  }
+  logicalCount_ = base + (uint32_t)width * height;
+  matrixBase_ = base;
+  width_ = width;
+  height_ = height;
+}
+
+void PixelMap::setIdentity(uint32_t count) {
+  clear();
+  if(count > 0) {
+    addSegment(0, count - 1);
+  }
+}
+
+void PixelMap::runsFor(uint32_t start, uint32_t count, std::vector<PixelRun>& runs) const {
+  runs.clear();
+  for(uint32_t i = start; i < start + count && i < table_.size(); i++) {
+    const uint32_t logical = table_[i];
+    if(!runs.empty()) {
+      PixelRun& run = runs.back();
+      if(logical == kGap && run.first == kGap) {
+        run.length++;
+        continue;
+      }
+      if(logical != kGap && run.first != kGap) {
+        if(run.length == 1) {
+          // Any two pixels are evenly spaced
+          run.step = (int32_t)(logical - run.first);
+        }
+        if(logical == run.first + (uint32_t)run.step * run.length) {
+          run.length++;
+          continue;
+        }
+      }
+    }
+    runs.push_back(PixelRun{logical, 1, 1});
+  }
+}
+
+bool parsePixelMap(const char* spec, PixelMap& map) {
+  PixelMapSizer sizer;
+  if(!walkPixelMap(spec, sizer)) {
+    return false;
+  }
+  map.clear();
+  return walkPixelMap(spec, map);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Logical-to-physical pixel mapping.
+//
+// Effects render a logical strip: index 0 up to logicalCount(), or for a
+// matrix y * width + x with (0, 0) at the top left. How the LEDs are really
+// wired (serpentine rows, a strip folded back on itself, segments shown
+// mirrored, unlit LEDs at a corner) is described once here and applied in the
+// output pass, which reads the frame through the table instead of in order.
+//
+// The table has one entry per physical LED, in wire order, holding the
+// logical pixel it shows or kGap for an LED kept dark. Looking up from the
+// physical side means the output still writes the wire buffer front to back,
+// a logical pixel can appear on any number of LEDs (mirroring) and LEDs
+// without one need no special case beyond the bounds check.
+//
+// Built once at start-up, by the add*() calls or from a spec string:
+// entries separated by commas, appended in wire order:
+//   "A-B"        logical pixels A to B, counting down if B < A (reversed)
+//   "A"          the single logical pixel A
+//   "gap:N"      N dark LEDs
+//   "WxH[:flags]" a W by H matrix continuing the logical numbering, flags
+//                 any of s (serpentine), c (wired in columns), x / y (first
+//                 LED at the right / bottom)
+// e.g. "0-71,71-0" shows one 72-pixel effect mirrored on a 144-LED strip,
+// "16x16:s" a zig-zag wired panel.
+//
+// The output pass does not look up every LED: runsFor() compresses a stretch
+// of the table into runs of evenly spaced logical pixels, so a segment or a
+// matrix row is one run that the kernels read like an unmapped strip (see
+// writeOutputMapped).
+
+enum MatrixLayout : uint8_t {
+  MATRIX_ROWS = 0,
+  MATRIX_SERPENTINE = 1,  // Every other row (column) runs backwards
+  MATRIX_COLUMNS = 2,     // Wired column by column instead of row by row
+  MATRIX_FLIP_X = 4,      // First LED at the right edge
+  MATRIX_FLIP_Y = 8,      // First LED at the bottom edge
+};
+
+struct PixelMapSize {
+  uint32_t logical;   // Pixels the effects render
+  uint32_t physical;  // LEDs on the wire
+};
+
+// length LEDs showing logical pixels first, first + step, ...; first ==
+// PixelMap::kGap for LEDs kept dark
+struct PixelRun {
+  uint32_t first;
+  int32_t step;
+  uint32_t length;
+};
+
+class PixelMap {
+ public:
+  static constexpr uint32_t kGap = 0xFFFFFFFF;
+
+  void clear();
+
+  // Append LEDs in wire order
+  void addSegment(uint32_t first, uint32_t last);
+  void addGap(uint32_t length);
+  void addMatrix(uint16_t width, uint16_t height, uint8_t layout);
+
+  // Straight through, logical i on LED i
+  void setIdentity(uint32_t count);
+
+  uint32_t logicalCount() const { return logicalCount_; }
+  uint32_t physicalCount() const { return (uint32_t)table_.size(); }
+  // Logical pixel on each LED, or kGap
+  const uint32_t* table() const { return table_.data(); }
+
+  // Replace runs with the table from LED start on for count LEDs, as few
+  // runs as it takes
+  void runsFor(uint32_t start, uint32_t count, std::vector<PixelRun>& runs) const;
+
+  // Size of the last matrix added, for effects drawing in 2D; without one
+  // the logical strip as a single row
+  uint16_t width() const { return width_ ? width_ : (uint16_t)logicalCount_; }
+  uint16_t height() const { return width_ ? height_ : 1; }
+  uint32_t xy(uint16_t x, uint16_t y) const { return matrixBase_ + (uint32_t)y * width() + x; }
+
+  // Used by walkPixelMap()
+  void segment(uint32_t first, uint32_t last) { addSegment(first, last); }
+  void gap(uint32_t length) { addGap(length); }
+  void matrix(uint16_t width, uint16_t height, uint8_t layout) { addMatrix(width, height, layout); }
+
+ private:
+  std::vector<uint32_t> table_;
+  uint32_t logicalCount_ = 0;
+  uint32_t matrixBase_ = 0;
+  uint16_t width_ = 0;
+  uint16_t height_ = 0;
+};
+
+// Parse a spec into map, replacing what it held. False (map unchanged) on a
+// syntax error or an empty spec.
+bool parsePixelMap(const char* spec, PixelMap& map);
+
+// Walk a spec, calling sink.segment(), sink.gap() and sink.matrix() per
+// entry. False on a syntax error. constexpr so the sizes can be worked out at
+// compile time (pixelMapSize) by the same code parsePixelMap() runs.
+template <typename Sink>
+constexpr bool walkPixelMap(const char* spec, Sink& sink) {
+  const char* p = spec;
+  if(!*p) {
+    return false;
+  }
+  auto number = [&p](uint32_t& value) {
+    const char* start = p;
+    value = 0;
+    while(*p >= '0' && *p <= '9' && value < 100000000) {
+      value = value * 10 + (*p++ - '0');
+    }
+    return p != start;
+  };
+  while(*p) {
+    uint32_t a = 0, b = 0;
+    if(p[0] == 'g' && p[1] == 'a' && p[2] == 'p' && p[3] == ':') {
+      p += 4;
+      if(!number(a) || a == 0) {
+        return false;
+      }
+      sink.gap(a);
+    } else {
+      if(!number(a)) {
+        return false;
+      }
+      if(*p == 'x') {
+        p++;
+        if(!number(b) || a == 0 || b == 0 || a > 4096 || b > 4096) {
+          return false;
+        }
+        uint8_t layout = MATRIX_ROWS;
+        if(*p == ':') {
+          p++;
+          for(; *p && *p != ','; p++) {
+            const uint8_t flag = *p == 's' ? MATRIX_SERPENTINE : *p == 'c' ? MATRIX_COLUMNS
+                               : *p == 'x' ? MATRIX_FLIP_X : *p == 'y' ? MATRIX_FLIP_Y : 0;
+            if(flag == 0 || (layout & flag)) {
+              return false;
+            }
+            layout |= flag;
+          }
+        }
+        sink.matrix((uint16_t)a, (uint16_t)b, layout);
+      } else if(*p == '-') {
+        p++;
+        if(!number(b)) {
+          return false;
+        }
+        sink.segment(a, b);
+      } else {
+        sink.segment(a, a);
+      }
+    }
+    if(*p == ',') {
+      p++;
+    } else if(*p) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct PixelMapSizer {
+  PixelMapSize size = {0, 0};
+  constexpr void segment(uint32_t first, uint32_t last) {
+    const uint32_t high = first > last ? first : last;
+    if(high + 1 > size.logical) {
+      size.logical = high + 1;
+    }
+    size.physical += (first > last ? first - last : last - first) + 1;
+  }
+  constexpr void gap(uint32_t length) { size.physical += length; }
+  constexpr void matrix(uint16_t width, uint16_t height, uint8_t) {
+    size.logical += (uint32_t)width * height;
+    size.physical += (uint32_t)width * height;
+  }
+};
+
+// Logical and physical size of a spec, {0, 0} if it does not parse
+constexpr PixelMapSize pixelMapSize(const char* spec) {
+  PixelMapSizer sizer;
+  if(!walkPixelMap(spec, sizer)) {
+    return PixelMapSize{0, 0};
+  }
+  return sizer.size;
+}
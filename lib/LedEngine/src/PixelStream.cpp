@@ -0,0 +1,334 @@
+#include "PixelStream.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#if defined(ESP_PLATFORM)
+#include <lwip/sockets.h>
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "LedPlatform.h"
+
+// DDP header: flags, sequence, data type, destination, 32-bit offset,
+// 16-bit length, then an optional 32-bit timecode
+static const uint32_t kDdpHeader = 10;
+static const uint8_t kDdpVersion1 = 0x40;
+static const uint8_t kDdpFlagTimecode = 0x10;
+static const uint8_t kDdpFlagReply = 0x04;
+static const uint8_t kDdpFlagQuery = 0x02;
+static const uint8_t kDdpFlagPush = 0x01;
+static const uint8_t kDdpTypeDefault = 0x00;  // Undefined type, RGB by convention
+static const uint8_t kDdpTypeRgb8 = 0x0B;     // RGB, 8 bits per channel
+static const uint8_t kDdpDisplay = 1;         // Default output device
+static const uint8_t kDdpAll = 255;
+
+// A DDP packet up to this many sequence numbers at or before the last push
+// belongs to a frame already completed. Only checked for the first few
+// packets after a push: the 4-bit sequence wraps within longer frames.
+static const uint8_t kDdpStaleWindow = 4;
+static const uint8_t kDdpStalePackets = 12;
+
+// E1.31 layout (ANSI E1.31-2018): root layer, framing layer, DMP layer
+static const uint8_t kAcnId[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+static const uint32_t kE131RootData = 0x00000004;
+static const uint32_t kE131RootExtended = 0x00000008;
+static const uint32_t kE131FrameData = 0x00000002;
+static const uint32_t kE131FrameSync = 0x00000001;
+static const uint32_t kE131DataHeader = 126;  // Up to and including the start code
+static const uint32_t kE131SyncLength = 49;
+static const uint8_t kE131OptionPreview = 0x80;
+static const uint8_t kE131OptionTerminated = 0x40;
+
+// A universe sequence number this far behind the last one is out of order
+static const int kE131SequenceWindow = 20;
+
+enum : uint8_t {
+  kUniverseSeen = 1,      // Arrived for the frame being assembled
+  kUniverseSequence = 2,  // universeSequence_ holds a real value
+};
+
+static inline uint16_t readU16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int openUdp(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(fd < 0) {
+    return -1;
+  }
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool PixelStream::begin(uint32_t numLeds, uint16_t ddpPort, uint16_t e131Port, uint16_t firstUniverse) {
+  end();
+  for(int i = 0; i < 2; i++) {
+    pixels_[i].assign(numLeds, Rgb16{0, 0, 0});
+  }
+  front_ = Framebuffer16{pixels_[0].data(), numLeds};
+  back_ = Framebuffer16{pixels_[1].data(), numLeds};
+  ready_ = false;
+  assembling_ = false;
+  dirtyFirst_ = UINT32_MAX;
+  dirtyEnd_ = 0;
+  ddpSequence_ = 0;
+  ddpPacketsSincePush_ = 0;
+
+  firstUniverse_ = firstUniverse;
+  universeCount_ = (numLeds + kLedsPerUniverse - 1) / kLedsPerUniverse;
+  universeSequence_.assign(universeCount_, 0);
+  universeSeen_.assign(universeCount_, 0);
+  universesPending_ = universeCount_;
+  syncAddress_ = 0;
+  stats_ = StreamStats();
+  return listen(ddpPort, e131Port);
+}
+
+bool PixelStream::listen(uint16_t ddpPort, uint16_t e131Port) {
+  end();
+  bool ok = true;
+  if(ddpPort) {
+    ddpSocket_ = openUdp(ddpPort);
+    ok &= ddpSocket_ >= 0;
+  }
+  if(e131Port) {
+    e131Socket_ = openUdp(e131Port);
+    ok &= e131Socket_ >= 0;
+  }
+  return ok;
+}
+
+void PixelStream::end() {
+  if(ddpSocket_ >= 0) {
+    close(ddpSocket_);
+    ddpSocket_ = -1;
+  }
+  if(e131Socket_ >= 0) {
+    close(e131Socket_);
+    e131Socket_ = -1;
+  }
+}
+
+uint32_t PixelStream::poll() {
+  uint32_t handled = 0;
+  while(ddpSocket_ >= 0 && handled < kMaxPacketsPerPoll) {
+    ssize_t len = recv(ddpSocket_, packet_, sizeof(packet_), MSG_DONTWAIT);
+    if(len < 0) {
+      break;
+    }
+    handleDdp(packet_, len, micros());
+    handled++;
+  }
+  while(e131Socket_ >= 0 && handled < kMaxPacketsPerPoll) {
+    ssize_t len = recv(e131Socket_, packet_, sizeof(packet_), MSG_DONTWAIT);
+    if(len < 0) {
+      break;
+    }
+    handleE131(packet_, len, micros());
+    handled++;
+  }
+  return handled;
+}
+
+const Framebuffer16& PixelStream::frame() {
+  if(ready_) {
+    ready_ = false;
+    stats_.framesShown++;
+    stats_.lastLatencyUs = micros() - readyStartUs_;
+    if(stats_.lastLatencyUs > stats_.maxLatencyUs) {
+      stats_.maxLatencyUs = stats_.lastLatencyUs;
+    }
+  }
+  return front_;
+}
+
+// Widen 8-bit channel values into the back buffer, starting at a channel
+// index of the strip (3 per LED, RGB). Clipped to the strip.
+void PixelStream::decode(uint32_t channel, const uint8_t* data, uint32_t len) {
+  const uint32_t channels = back_.channelCount();
+  if(channel >= channels) {
+    return;
+  }
+  if(len > channels - channel) {
+    len = channels - channel;
+  }
+  uint16_t* out = back_.channels() + channel;
+  for(uint32_t i = 0; i < len; i++) {
+    out[i] = data[i] * 257;
+  }
+  if(channel < dirtyFirst_) {
+    dirtyFirst_ = channel;
+  }
+  if(channel + len > dirtyEnd_) {
+    dirtyEnd_ = channel + len;
+  }
+}
+
+void PixelStream::completeFrame() {
+  if(ready_) {
+    stats_.framesDropped++;  // The previous frame was never shown
+  }
+  Framebuffer16 shown = front_;
+  front_ = back_;
+  back_ = shown;
+  // The new back buffer holds the frame before; bring it up to this one so
+  // the next frame only has to carry what changes
+  if(dirtyEnd_ > dirtyFirst_) {
+    memcpy(back_.channels() + dirtyFirst_, front_.channels() + dirtyFirst_,
+           (dirtyEnd_ - dirtyFirst_) * sizeof(uint16_t));
+  }
+  dirtyFirst_ = UINT32_MAX;
+  dirtyEnd_ = 0;
+  ready_ = true;
+  readyStartUs_ = frameStartUs_;
+  assembling_ = false;
+  stats_.framesReceived++;
+  resetUniverses();
+}
+
+void PixelStream::resetUniverses() {
+  for(uint8_t& seen : universeSeen_) {
+    seen &= ~kUniverseSeen;
+  }
+  universesPending_ = universeCount_;
+}
+
+void PixelStream::handleDdp(const uint8_t* data, uint32_t len, uint32_t nowUs) {
+  stats_.packets++;
+  if(len < kDdpHeader || (data[0] & 0xC0) != kDdpVersion1 || (data[0] & (kDdpFlagQuery | kDdpFlagReply)) ||
+     (data[2] != kDdpTypeDefault && data[2] != kDdpTypeRgb8) || (data[3] != kDdpDisplay && data[3] != kDdpAll)) {
+    stats_.invalidPackets++;
+    return;
+  }
+  const uint32_t header = kDdpHeader + (data[0] & kDdpFlagTimecode ? 4 : 0);
+  if(len < header) {
+    stats_.invalidPackets++;
+    return;
+  }
+
+  const uint8_t sequence = data[1] & 0x0F;
+  if(sequence && ddpSequence_ && ddpPacketsSincePush_ < kDdpStalePackets &&
+     ((ddpSequence_ - sequence) & 0x0F) < kDdpStaleWindow) {
+    stats_.stalePackets++;
+    return;
+  }
+
+  uint32_t dataLen = readU16(data + 8);
+  if(dataLen > len - header) {
+    dataLen = len - header;
+  }
+  if(!assembling_) {
+    assembling_ = true;
+    frameStartUs_ = nowUs;
+  }
+  decode(readU32(data + 4), data + header, dataLen);
+  if(ddpPacketsSincePush_ < kDdpStalePackets) {
+    ddpPacketsSincePush_++;
+  }
+
+  if(data[0] & kDdpFlagPush) {
+    ddpSequence_ = sequence;
+    ddpPacketsSincePush_ = 0;
+    completeFrame();
+  }
+}
+
+void PixelStream::handlePixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push, uint32_t nowUs) {
+  stats_.packets++;
+  if(!assembling_) {
+    assembling_ = true;
+    frameStartUs_ = nowUs;
+  }
+  if(firstLed < back_.count) {
+    decode(firstLed * 3, rgb, count * 3);
+  }
+  if(push) {
+    completeFrame();
+  }
+}
+
+void PixelStream::handleE131(const uint8_t* data, uint32_t len, uint32_t nowUs) {
+  stats_.packets++;
+  if(len < kE131SyncLength || memcmp(data + 4, kAcnId, sizeof(kAcnId)) != 0) {
+    stats_.invalidPackets++;
+    return;
+  }
+  const uint32_t rootVector = readU32(data + 18);
+  const uint32_t frameVector = readU32(data + 40);
+
+  if(rootVector == kE131RootExtended && frameVector == kE131FrameSync) {
+    if(syncAddress_ && readU16(data + 45) == syncAddress_ && assembling_) {
+      completeFrame();
+    }
+    return;
+  }
+  if(rootVector != kE131RootData || frameVector != kE131FrameData || len < kE131DataHeader ||
+     data[117] != 0x02 || data[125] != 0x00) {
+    stats_.invalidPackets++;  // Not DMX data with the null start code
+    return;
+  }
+  const uint8_t options = data[112];
+  const uint16_t universe = readU16(data + 113);
+  if((options & (kE131OptionPreview | kE131OptionTerminated)) || universe < firstUniverse_ ||
+     universe - firstUniverse_ >= universeCount_) {
+    stats_.invalidPackets++;
+    return;
+  }
+  const uint16_t index = universe - firstUniverse_;
+
+  // Out-of-order check from E1.31 6.7.2
+  const uint8_t sequence = data[111];
+  uint8_t& flags = universeSeen_[index];
+  if(flags & kUniverseSequence) {
+    const int8_t ahead = (int8_t)(sequence - universeSequence_[index]);
+    if(ahead <= 0 && ahead > -kE131SequenceWindow) {
+      stats_.stalePackets++;
+      return;
+    }
+  }
+  universeSequence_[index] = sequence;
+  flags |= kUniverseSequence;
+
+  if(flags & kUniverseSeen) {
+    // The frame in progress never completed; start over with this packet
+    resetUniverses();
+    frameStartUs_ = nowUs;
+  }
+  if(!assembling_) {
+    assembling_ = true;
+    frameStartUs_ = nowUs;
+  }
+
+  uint32_t slots = readU16(data + 123);
+  slots = slots ? slots - 1 : 0;  // The count includes the start code
+  if(slots > len - kE131DataHeader) {
+    slots = len - kE131DataHeader;
+  }
+  if(slots > kLedsPerUniverse * 3) {
+    slots = kLedsPerUniverse * 3;
+  }
+  decode((uint32_t)index * kLedsPerUniverse * 3, data + kE131DataHeader, slots);
+
+  flags |= kUniverseSeen;
+  universesPending_--;
+  syncAddress_ = readU16(data + 109);
+  if(syncAddress_ == 0 && universesPending_ == 0) {
+    completeFrame();
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Framebuffer.h"
+
+// Counters since begin() or resetStats()
+struct StreamStats {
+  uint32_t packets = 0;         // Datagrams received, valid or not
+  uint32_t invalidPackets = 0;  // Not DDP/E1.31 pixel data, or for another output
+  uint32_t stalePackets = 0;    // Older sequence number than data already applied
+  uint32_t framesReceived = 0;  // Frames completed by push/sync/last universe
+  uint32_t framesShown = 0;     // Frames picked up with frame()
+  uint32_t framesDropped = 0;   // Completed but replaced by a newer one before shown
+  uint32_t lastLatencyUs = 0;   // First packet of a frame to frame() picking it up
+  uint32_t maxLatencyUs = 0;
+};
+
+// Real-time pixel input over UDP: DDP (port 4048) and E1.31 / sACN
+// (port 5568), as sent by xLights, LedFx, Resolume and most show-control
+// software.
+//
+// Pixel data is decoded from the datagram straight into the back half of a
+// double-buffered frame, with no per-packet or per-frame staging. A frame may
+// span many packets and arrive out of order; it becomes the front buffer
+// when complete - on the DDP push flag, on an E1.31 sync packet, or when
+// every universe of the strip has arrived - which is a pointer swap. The
+// span that frame wrote is then copied into the new back buffer, so a
+// sender may push only the LEDs that changed and the rest keep their last
+// value. Only the newest complete frame is kept: frames that complete before
+// the previous one was shown are counted and dropped rather than queued, and
+// packets older than data already applied are ignored.
+//
+// Everything runs on the caller's thread: poll() drains the sockets without
+// blocking, so the render task calls it once per frame.
+class PixelStream {
+ public:
+  static const uint16_t kDdpPort = 4048;
+  static const uint16_t kE131Port = 5568;
+  // E1.31 carries 170 RGB LEDs (510 of its 512 slots) per universe
+  static const uint16_t kLedsPerUniverse = 170;
+  static const uint32_t kMaxPacket = 1500;
+  // Upper bound on datagrams handled per poll(), so a flood cannot stall the
+  // render task; the rest wait for the next frame
+  static const uint16_t kMaxPacketsPerPoll = 256;
+
+  // Size the buffers and open the sockets. A port of 0 leaves that protocol
+  // closed. Returns false if a socket could not be opened; packets can still
+  // be fed in with handleDdp()/handleE131().
+  bool begin(uint32_t numLeds, uint16_t ddpPort = kDdpPort, uint16_t e131Port = kE131Port,
+             uint16_t firstUniverse = 1);
+  // Open the sockets later, once the network is up, keeping the buffers and
+  // stats. Replaces any sockets already open; same ports and result as begin().
+  bool listen(uint16_t ddpPort = kDdpPort, uint16_t e131Port = kE131Port);
+  void end();
+
+  // Receive and decode every pending datagram. Returns how many were handled.
+  uint32_t poll();
+
+  // Decode one datagram. nowUs stamps the frame it belongs to for the latency
+  // stats.
+  void handleDdp(const uint8_t* data, uint32_t len, uint32_t nowUs);
+  void handleE131(const uint8_t* data, uint32_t len, uint32_t nowUs);
+  // Pixels from another transport (the serial link): count RGB LEDs from
+  // firstLed on, into the frame being assembled. push completes it.
+  void handlePixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push, uint32_t nowUs);
+
+  // A frame completed since the last call to frame()
+  bool frameReady() const { return ready_; }
+
+  // Newest complete frame (black until the first arrives). Marks it shown.
+  const Framebuffer16& frame();
+
+  uint32_t numLeds() const { return front_.count; }
+  uint16_t universeCount() const { return universeCount_; }
+  const StreamStats& stats() const { return stats_; }
+  void resetStats() { stats_ = StreamStats(); }
+
+ private:
+  void decode(uint32_t channel, const uint8_t* data, uint32_t len);
+  void completeFrame();
+  void resetUniverses();
+
+  std::vector<Rgb16> pixels_[2];
+  Framebuffer16 front_ = {nullptr, 0};
+  Framebuffer16 back_ = {nullptr, 0};
+  bool ready_ = false;
+  bool assembling_ = false;      // back_ holds data of an incomplete frame
+  uint32_t frameStartUs_ = 0;    // First packet of the frame in back_
+  uint32_t readyStartUs_ = 0;    // Same, for the frame in front_
+  // Channels of back_ written since the last completed frame; empty when
+  // dirtyEnd_ <= dirtyFirst_
+  uint32_t dirtyFirst_ = UINT32_MAX;
+  uint32_t dirtyEnd_ = 0;
+
+  int ddpSocket_ = -1;
+  int e131Socket_ = -1;
+  uint8_t packet_[kMaxPacket];
+
+  uint8_t ddpSequence_ = 0;      // Sequence number of the last push, 0 = not used by the sender
+  uint8_t ddpPacketsSincePush_ = 0;
+
+  uint16_t firstUniverse_ = 1;
+  uint16_t universeCount_ = 0;
+  uint16_t universesPending_ = 0;
+  uint16_t syncAddress_ = 0;     // Non-zero: data waits for a sync packet
+  std::vector<uint8_t> universeSequence_;
+  std::vector<uint8_t> universeSeen_;
+
+  StreamStats stats_;
+};
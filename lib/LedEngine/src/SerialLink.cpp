@@ -0,0 +1,405 @@
+#include "SerialLink.h"
+
+#include <string.h>
+
+#include "LedPlatform.h"
+
+#ifndef ARDUINO
+#include <unistd.h>
+#endif
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, MSB first, one table lookup per byte
+struct SerialCrcTable {
+  uint16_t entries[256];
+
+  constexpr SerialCrcTable() : entries() {
+    for(int i = 0; i < 256; i++) {
+      uint16_t crc = (uint16_t)(i << 8);
+      for(int bit = 0; bit < 8; bit++) {
+        crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+static constexpr SerialCrcTable kSerialCrcTable;
+
+static inline uint16_t readU16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void writeU32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+uint16_t serialCrc(const uint8_t* data, size_t size, uint16_t crc) {
+  for(size_t i = 0; i < size; i++) {
+    crc = (uint16_t)((crc << 8) ^ kSerialCrcTable.entries[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+void appendSerialFrame(std::vector<uint8_t>& out, uint8_t type, uint8_t seq, const void* payload,
+                       uint16_t length) {
+  const size_t start = out.size();
+  out.resize(start + kSerialOverhead + length);
+  uint8_t* p = out.data() + start;
+  p[0] = kSerialSync;
+  p[1] = type;
+  p[2] = seq;
+  p[3] = (uint8_t)length;
+  p[4] = (uint8_t)(length >> 8);
+  if(length > 0) {
+    memcpy(p + kSerialHeader, payload, length);
+  }
+  const uint16_t crc = serialCrc(p + 1, kSerialHeader - 1 + length);
+  p[kSerialHeader + length] = (uint8_t)crc;
+  p[kSerialHeader + length + 1] = (uint8_t)(crc >> 8);
+}
+
+void SerialParser::feed(const uint8_t* data, size_t size, SerialSink& sink) {
+  size_t i = 0;
+  while(i < size) {
+    uint32_t held = 0;
+    i += consume(data + i, size - i, sink, held);
+    // A false sync byte: scan what it took in again, in place. A bad frame
+    // found in there leaves its own bytes at the front, followed by the
+    // rest still to scan, so each round holds fewer bytes.
+    while(held > 0) {
+      uint32_t again = 0;
+      const size_t used = consume(frame_, held, sink, again);
+      if(again > 0) {
+        memmove(frame_ + again, frame_ + used, held - used);
+        held = again + (uint32_t)(held - used);
+      } else {
+        held = 0;
+      }
+    }
+  }
+}
+
+// Runs the frame state machine over data until it ends or a frame fails its
+// checks, and returns the bytes used. On a failed frame, held is set to the
+// bytes after its sync byte, which frame_ still holds. Writes to frame_ never
+// pass the byte being read, so data may point into frame_ itself.
+size_t SerialParser::consume(const uint8_t* data, size_t size, SerialSink& sink, uint32_t& held) {
+  size_t i = 0;
+  while(i < size) {
+    switch(state_) {
+      case HUNT: {
+        const uint8_t c = data[i++];
+        if(c == kSerialSync) {
+          state_ = HEADER;
+          have_ = 0;
+        } else {
+          stats_.textBytes++;
+          sink.text(c);
+        }
+        break;
+      }
+      case HEADER:
+        frame_[have_++] = data[i++];
+        if(have_ == kSerialHeader - 1) {
+          length_ = readU16(frame_ + 2);
+          if(length_ > kSerialMaxPayload) {
+            stats_.badLength++;
+            state_ = HUNT;
+            held = have_;
+            return i;
+          }
+          state_ = length_ > 0 ? PAYLOAD : CRC;
+        }
+        break;
+      case PAYLOAD: {
+        // Whole runs of payload at once
+        size_t n = kSerialHeader - 1 + length_ - have_;
+        if(n > size - i) {
+          n = size - i;
+        }
+        memmove(frame_ + have_, data + i, n);
+        have_ += n;
+        i += n;
+        if(have_ == kSerialHeader - 1 + length_) {
+          state_ = CRC;
+        }
+        break;
+      }
+      case CRC:
+        frame_[have_++] = data[i++];
+        if(have_ == kSerialOverhead - 1 + length_) {
+          state_ = HUNT;
+          const uint8_t* payload = frame_ + kSerialHeader - 1;
+          if(serialCrc(frame_, kSerialHeader - 1 + length_) != readU16(payload + length_)) {
+            stats_.badCrc++;
+            held = have_;
+            return i;
+          }
+          stats_.frames++;
+          sink.frame(SerialFrame{frame_[0], frame_[1], length_, payload});
+        }
+        break;
+    }
+  }
+  return i;
+}
+
+void SerialLink::begin(SerialPort& port, SerialLinkHandler& handler, uint32_t maxBytesPerPoll) {
+  port_ = &port;
+  handler_ = &handler;
+  maxBytesPerPoll_ = maxBytesPerPoll;
+  parser_.reset();
+  tx_.clear();
+  tx_.reserve(kMaxPendingReplies);
+  txFrame_ = 0;
+  txSent_ = 0;
+  stats_ = SerialLinkStats();
+}
+
+uint32_t SerialLink::poll() {
+  if(port_ == nullptr) {
+    return 0;
+  }
+  handled_ = 0;
+  flush();
+  uint32_t budget = maxBytesPerPoll_;
+  while(budget > 0) {
+    const size_t n = port_->read(rx_, budget < sizeof(rx_) ? budget : sizeof(rx_));
+    if(n == 0) {
+      break;
+    }
+    stats_.bytesIn += n;
+    budget -= n;
+    parser_.feed(rx_, n, *this);
+  }
+  flush();
+  return handled_;
+}
+
+void SerialLink::frame(const SerialFrame& frame) {
+  const uint8_t* p = frame.payload;
+  bool valid = true;
+  switch(frame.type) {
+    case SERIAL_COMMANDS: {
+      valid = frame.length % kSerialCommandSize == 0;
+      if(!valid) {
+        break;
+      }
+      uint16_t accepted = 0;
+      for(uint16_t i = 0; i < frame.length; i += kSerialCommandSize) {
+        const LedCommand cmd = {(LedCommandType)p[i], readU32(p + i + 1)};
+        accepted += cmd.type <= CMD_SET_PARAM && handler_->command(cmd);
+      }
+      stats_.commands += accepted;
+      reply(SERIAL_ACK, frame.seq, &accepted, sizeof(accepted));
+      break;
+    }
+    case SERIAL_PIXELS: {
+      valid = frame.length >= kSerialPixelHeader && (frame.length - kSerialPixelHeader) % 3 == 0;
+      if(!valid) {
+        break;
+      }
+      const uint16_t count = (frame.length - kSerialPixelHeader) / 3;
+      handler_->pixels(readU32(p + 1), p + kSerialPixelHeader, count, p[0] & SERIAL_PIXELS_PUSH);
+      stats_.pixelMessages++;
+      if(p[0] & SERIAL_PIXELS_ACK) {
+        reply(SERIAL_ACK, frame.seq, &count, sizeof(count));
+      }
+      break;
+    }
+    case SERIAL_QUERY: {
+      SerialStatsReply stats = {};
+      handler_->stats(stats);
+      stats.linkFrames = parser_.stats().frames;
+      stats.linkBadFrames = stats_.badFrames + parser_.stats().badCrc + parser_.stats().badLength;
+      stats.commands = stats_.commands;
+      reply(SERIAL_STATS, frame.seq, &stats, sizeof(stats));
+      break;
+    }
+    case SERIAL_PING:
+      reply(SERIAL_PONG, frame.seq, p, frame.length);
+      break;
+    default:
+      valid = false;
+      break;
+  }
+  if(valid) {
+    handled_++;
+  } else {
+    stats_.badFrames++;
+    reply(SERIAL_ERROR, frame.seq, &frame.type, 1);
+  }
+}
+
+void SerialLink::text(uint8_t c) {
+  handler_->text(c);
+}
+
+void SerialLink::reply(uint8_t type, uint8_t seq, const void* payload, uint16_t length) {
+  if(tx_.size() + kSerialOverhead + length > kMaxPendingReplies) {
+    stats_.repliesDropped++;
+    return;
+  }
+  appendSerialFrame(tx_, type, seq, payload, length);
+  stats_.replies++;
+}
+
+// Write replies one frame per call, so nothing written to the port by
+// anyone else can land inside one
+void SerialLink::flush() {
+  while(txSent_ < tx_.size()) {
+    const uint32_t end = txFrame_ + kSerialOverhead + readU16(tx_.data() + txFrame_ + 3);
+    const size_t n = port_->write(tx_.data() + txSent_, end - txSent_);
+    if(n == 0) {
+      return;
+    }
+    txSent_ += n;
+    if(txSent_ == end) {
+      txFrame_ = end;
+    }
+  }
+  tx_.clear();
+  txFrame_ = 0;
+  txSent_ = 0;
+}
+
+#if defined(ARDUINO)
+size_t UsbSerialPort::read(uint8_t* data, size_t size) {
+  const int available = Serial.available();
+  if(available <= 0) {
+    return 0;
+  }
+  return Serial.read(data, size < (size_t)available ? size : (size_t)available);
+}
+
+bool UsbSerialPort::begin(size_t txBuffer) {
+  if(Serial.setTxBufferSize(txBuffer) != txBuffer) {
+    return false;
+  }
+  txBuffer_ = txBuffer;
+  return true;
+}
+
+size_t UsbSerialPort::write(const uint8_t* data, size_t size) {
+  const size_t room = (size_t)Serial.availableForWrite();
+  if(room < size) {
+    // Whole frames only, unless one can never fit
+    if(size <= txBuffer_ || room == 0) {
+      return 0;
+    }
+    size = room;
+  }
+  return Serial.write(data, size);
+}
+#endif
+
+#ifndef ARDUINO
+size_t FdSerialPort::read(uint8_t* data, size_t size) {
+  const ssize_t n = ::read(fd_, data, size);
+  return n > 0 ? (size_t)n : 0;
+}
+
+size_t FdSerialPort::write(const uint8_t* data, size_t size) {
+  const ssize_t n = ::write(fd_, data, size);
+  return n > 0 ? (size_t)n : 0;
+}
+
+uint8_t SerialClient::queue(uint8_t type, const void* payload, uint16_t length) {
+  appendSerialFrame(tx_, type, seq_, payload, length);
+  return seq_++;
+}
+
+uint8_t SerialClient::commands(const LedCommand* cmds, uint32_t count) {
+  const uint32_t perFrame = kSerialMaxPayload / kSerialCommandSize;
+  uint8_t seq = seq_;
+  for(uint32_t first = 0; first < count; first += perFrame) {
+    const uint32_t n = count - first < perFrame ? count - first : perFrame;
+    scratch_.resize(n * kSerialCommandSize);
+    for(uint32_t i = 0; i < n; i++) {
+      scratch_[i * kSerialCommandSize] = cmds[first + i].type;
+      writeU32(&scratch_[i * kSerialCommandSize + 1], cmds[first + i].value);
+    }
+    seq = queue(SERIAL_COMMANDS, scratch_.data(), (uint16_t)scratch_.size());
+  }
+  return seq;
+}
+
+uint8_t SerialClient::pixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push, bool ack) {
+  uint8_t seq = seq_;
+  uint32_t sent = 0;
+  do {
+    const uint32_t n = count - sent < kSerialMaxPixels ? count - sent : kSerialMaxPixels;
+    const bool last = sent + n == count;
+    scratch_.resize(kSerialPixelHeader + n * 3);
+    scratch_[0] = (uint8_t)(last ? (push ? SERIAL_PIXELS_PUSH : 0) | (ack ? SERIAL_PIXELS_ACK : 0) : 0);
+    writeU32(&scratch_[1], firstLed + sent);
+    memcpy(&scratch_[kSerialPixelHeader], rgb + sent * 3, n * 3);
+    seq = queue(SERIAL_PIXELS, scratch_.data(), (uint16_t)scratch_.size());
+    sent += n;
+  } while(sent < count);
+  return seq;
+}
+
+uint8_t SerialClient::query() {
+  return queue(SERIAL_QUERY, nullptr, 0);
+}
+
+uint8_t SerialClient::ping(const void* payload, uint16_t length) {
+  return queue(SERIAL_PING, payload, length);
+}
+
+bool SerialClient::send() {
+  while(txSent_ < tx_.size()) {
+    const size_t n = port_.write(tx_.data() + txSent_, tx_.size() - txSent_);
+    if(n == 0) {
+      return false;
+    }
+    txSent_ += n;
+  }
+  tx_.clear();
+  txSent_ = 0;
+  return true;
+}
+
+uint32_t SerialClient::receive() {
+  const uint32_t before = parser_.stats().frames;
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = port_.read(buffer, sizeof(buffer))) > 0) {
+    parser_.feed(buffer, n, *this);
+  }
+  return parser_.stats().frames - before;
+}
+
+void SerialClient::frame(const SerialFrame& frame) {
+  switch(frame.type) {
+    case SERIAL_ACK:
+      if(frame.length == 2) {
+        ackSeq_ = frame.seq;
+        ackValue_ = readU16(frame.payload);
+        acks_++;
+      }
+      break;
+    case SERIAL_STATS:
+      if(frame.length == sizeof(stats_)) {
+        memcpy(&stats_, frame.payload, sizeof(stats_));
+        statsReplies_++;
+      }
+      break;
+    case SERIAL_PONG:
+      pongSeq_ = frame.seq;
+      pongs_++;
+      break;
+    case SERIAL_ERROR:
+      errors_++;
+      break;
+  }
+}
+#endif
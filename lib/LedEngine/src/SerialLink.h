@@ -0,0 +1,287 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "LedCommand.h"
+
+// Binary control and pixel protocol over the USB CDC serial port.
+//
+// Every message is one frame:
+//
+//   0xA5  type  seq  length (2)  payload (length bytes)  CRC-16 (2)
+//
+// Multi-byte fields are little-endian. The CRC is CRC-16/CCITT-FALSE over
+// type, seq, length and payload. seq is the sender's and is echoed in the
+// reply, so a client can match replies to requests. Bytes outside frames
+// are text: the sync byte is not ASCII, so typed commands ('p', 'r') and
+// log lines share the port with the protocol.
+//
+// Requests and their replies:
+//
+//   SERIAL_COMMANDS  n x {type (1), value (4)}, LedCommand as is. Applied in
+//                    order; answered by SERIAL_ACK {accepted (2)}.
+//   SERIAL_PIXELS    {flags (1), first LED (4)} then RGB, 3 bytes per LED,
+//                    written into the frame being assembled. With
+//                    SERIAL_PIXELS_PUSH the frame is complete and shown;
+//                    with SERIAL_PIXELS_ACK it is answered by SERIAL_ACK
+//                    {LEDs written (2)}. A frame larger than one payload is
+//                    sent as several messages, the last one pushing.
+//   SERIAL_QUERY     Answered by SERIAL_STATS, a SerialStatsReply.
+//   SERIAL_PING      Answered by SERIAL_PONG with the same payload.
+//
+// A frame that fails its CRC, or whose type or payload makes no sense, is
+// counted and dropped; a malformed request is answered by SERIAL_ERROR
+// {request type (1)}. The client resends whatever it needs.
+
+static const uint8_t kSerialSync = 0xA5;
+static const uint32_t kSerialHeader = 5;    // Sync, type, seq, length
+static const uint32_t kSerialOverhead = 7;  // Header and CRC
+static const uint16_t kSerialMaxPayload = 4096;
+static const uint32_t kSerialPixelHeader = 5;
+static const uint16_t kSerialMaxPixels = (kSerialMaxPayload - kSerialPixelHeader) / 3;
+static const uint16_t kSerialCommandSize = 5;
+
+enum SerialMessage : uint8_t {
+  SERIAL_COMMANDS = 0x01,
+  SERIAL_PIXELS = 0x02,
+  SERIAL_QUERY = 0x03,
+  SERIAL_PING = 0x04,
+  // Replies
+  SERIAL_ACK = 0x81,
+  SERIAL_STATS = 0x83,
+  SERIAL_PONG = 0x84,
+  SERIAL_ERROR = 0xFF,
+};
+
+enum : uint8_t {
+  SERIAL_PIXELS_PUSH = 0x01,
+  SERIAL_PIXELS_ACK = 0x02,
+};
+
+// SERIAL_STATS payload, as laid out on the wire
+struct __attribute__((packed)) SerialStatsReply {
+  uint32_t uptimeMs;
+  uint8_t effect;
+  uint8_t brightness;
+  uint16_t fps;              // LED frame rate, in 1/10 frames per second
+  uint32_t framesPresented;  // LED frames sent to the strips
+  uint32_t framesShown;      // Pushed pixel frames shown (serial and network)
+  uint32_t framesDropped;    // Pushed, but replaced before they were shown
+  uint32_t linkFrames;       // Frames received on this link
+  uint32_t linkBadFrames;    // Dropped: CRC, length or payload
+  uint32_t commands;         // Commands applied from this link
+};
+
+uint16_t serialCrc(const uint8_t* data, size_t size, uint16_t crc = 0xFFFF);
+
+// Append one frame to out
+void appendSerialFrame(std::vector<uint8_t>& out, uint8_t type, uint8_t seq, const void* payload,
+                       uint16_t length);
+
+struct SerialFrame {
+  uint8_t type;
+  uint8_t seq;
+  uint16_t length;
+  const uint8_t* payload;  // Valid until the parser is fed again
+};
+
+// Receiver of what SerialParser finds
+class SerialSink {
+ public:
+  virtual ~SerialSink() {}
+
+  virtual void frame(const SerialFrame& frame) = 0;
+  // A byte outside any frame
+  virtual void text(uint8_t c) { (void)c; }
+};
+
+struct SerialParserStats {
+  uint32_t frames = 0;
+  uint32_t badCrc = 0;
+  uint32_t badLength = 0;  // Longer than kSerialMaxPayload
+  uint32_t textBytes = 0;
+};
+
+// Incremental frame parser. Takes bytes as they arrive, in any split, and
+// hands each complete frame with a good CRC to the sink; holds at most one
+// frame. Never blocks and never allocates after construction.
+//
+// A sync byte in text or in a damaged frame starts a frame that fails its
+// length or CRC check. The bytes it took in are then scanned again from the
+// one after it, so a real frame among them is still found.
+class SerialParser {
+ public:
+  void feed(const uint8_t* data, size_t size, SerialSink& sink);
+  void reset() { state_ = HUNT; }
+
+  const SerialParserStats& stats() const { return stats_; }
+
+ private:
+  enum State : uint8_t { HUNT, HEADER, PAYLOAD, CRC };
+
+  size_t consume(const uint8_t* data, size_t size, SerialSink& sink, uint32_t& held);
+
+  State state_ = HUNT;
+  uint32_t have_ = 0;  // Bytes of the current frame after its sync byte
+  uint16_t length_ = 0;
+  // Type, seq, length, payload and CRC, as received
+  uint8_t frame_[kSerialOverhead - 1 + kSerialMaxPayload];
+  SerialParserStats stats_;
+};
+
+// Byte transport. Both calls return at once with what they could move; a
+// write either takes the whole frame it is given or returns 0, except on
+// transports nothing else writes to.
+class SerialPort {
+ public:
+  virtual ~SerialPort() {}
+
+  virtual size_t read(uint8_t* data, size_t size) = 0;
+  virtual size_t write(const uint8_t* data, size_t size) = 0;
+};
+
+// What the device does with requests
+class SerialLinkHandler {
+ public:
+  virtual ~SerialLinkHandler() {}
+
+  // False if the command was not accepted
+  virtual bool command(const LedCommand& cmd) = 0;
+  virtual void pixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push) = 0;
+  virtual void stats(SerialStatsReply& reply) = 0;
+  virtual void text(uint8_t c) { (void)c; }
+};
+
+struct SerialLinkStats {
+  uint32_t bytesIn = 0;
+  uint32_t badFrames = 0;  // CRC, length, or a malformed request
+  uint32_t commands = 0;
+  uint32_t pixelMessages = 0;
+  uint32_t replies = 0;
+  uint32_t repliesDropped = 0;  // The client was not reading
+};
+
+// Device end of the link: drains the port without blocking, answers
+// requests and hands commands and pixels to the handler, on the caller's
+// thread. Replies wait in a buffer until the port takes them.
+class SerialLink : private SerialSink {
+ public:
+  // Room for the largest reply, a PONG of a full payload, with more behind it
+  static const uint32_t kMaxPendingReplies = 2 * (kSerialOverhead + kSerialMaxPayload);
+
+  // Read at most maxBytesPerPoll per poll(), so a flood of pixels cannot
+  // hold up the caller; the rest waits in the port.
+  void begin(SerialPort& port, SerialLinkHandler& handler, uint32_t maxBytesPerPoll = 16384);
+
+  // Returns the number of requests handled
+  uint32_t poll();
+
+  const SerialLinkStats& stats() const { return stats_; }
+  const SerialParserStats& parserStats() const { return parser_.stats(); }
+
+ private:
+  void frame(const SerialFrame& frame) override;
+  void text(uint8_t c) override;
+  void reply(uint8_t type, uint8_t seq, const void* payload, uint16_t length);
+  void flush();
+
+  SerialPort* port_ = nullptr;
+  SerialLinkHandler* handler_ = nullptr;
+  uint32_t maxBytesPerPoll_ = 16384;
+  uint32_t handled_ = 0;
+  SerialParser parser_;
+  uint8_t rx_[512];
+  std::vector<uint8_t> tx_;
+  uint32_t txFrame_ = 0;  // Start of the reply being written
+  uint32_t txSent_ = 0;   // Bytes of tx_ already written
+  SerialLinkStats stats_;
+};
+
+#if defined(ARDUINO)
+// The Arduino Serial object: USB CDC on the Tab5
+class UsbSerialPort : public SerialPort {
+ public:
+  // Grow the transmit buffer so a whole reply fits in it: the hardware CDC
+  // default of 256 bytes never has room for a large one. False if it could
+  // not; frames larger than the buffer then go out in pieces.
+  bool begin(size_t txBuffer = SerialLink::kMaxPendingReplies);
+
+  size_t read(uint8_t* data, size_t size) override;
+  size_t write(const uint8_t* data, size_t size) override;
+
+ private:
+  size_t txBuffer_ = 256;
+};
+#endif
+
+#ifndef ARDUINO
+// A non-blocking file descriptor, e.g. one end of a pseudo-terminal
+class FdSerialPort : public SerialPort {
+ public:
+  explicit FdSerialPort(int fd = -1) : fd_(fd) {}
+
+  size_t read(uint8_t* data, size_t size) override;
+  size_t write(const uint8_t* data, size_t size) override;
+
+  int fd() const { return fd_; }
+
+ private:
+  int fd_;
+};
+
+// Host end of the link: builds requests, batching as many as fit in one
+// frame, and parses replies.
+class SerialClient : private SerialSink {
+ public:
+  explicit SerialClient(SerialPort& port) : port_(port) {}
+
+  // Requests are queued and go out with send()
+  uint8_t commands(const LedCommand* cmds, uint32_t count);
+  // Pixels from firstLed on, split over as many messages as needed. The
+  // last one pushes if push is set and asks for an ack if ack is set.
+  // Returns the last message's seq.
+  uint8_t pixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push, bool ack);
+  uint8_t query();
+  uint8_t ping(const void* payload, uint16_t length);
+
+  // Write what the port takes. True when everything queued is out.
+  bool send();
+  bool sending() const { return txSent_ < tx_.size(); }
+
+  // Read and parse what has arrived. Returns the number of replies.
+  uint32_t receive();
+
+  // Most recent reply of each kind
+  const SerialStatsReply& lastStats() const { return stats_; }
+  uint32_t statsReplies() const { return statsReplies_; }
+  uint8_t lastAckSeq() const { return ackSeq_; }
+  uint16_t lastAckValue() const { return ackValue_; }
+  uint8_t lastPongSeq() const { return pongSeq_; }
+  uint32_t acks() const { return acks_; }
+  uint32_t pongs() const { return pongs_; }
+  uint32_t errors() const { return errors_; }
+  const SerialParserStats& parserStats() const { return parser_.stats(); }
+
+ private:
+  void frame(const SerialFrame& frame) override;
+  uint8_t queue(uint8_t type, const void* payload, uint16_t length);
+
+  SerialPort& port_;
+  SerialParser parser_;
+  std::vector<uint8_t> tx_;
+  uint32_t txSent_ = 0;
+  std::vector<uint8_t> scratch_;
+  uint8_t seq_ = 0;
+  SerialStatsReply stats_ = {};
+  uint32_t statsReplies_ = 0;
+  uint8_t ackSeq_ = 0;
+  uint16_t ackValue_ = 0;
+  uint8_t pongSeq_ = 0;
+  uint32_t acks_ = 0;
+  uint32_t pongs_ = 0;
+  uint32_t errors_ = 0;
+};
+#endif
@@ -0,0 +1,127 @@
+#include "SettingsStore.h"
+
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "nvs.h"
+#endif
+
+// Stored layout: version first, so a record from another version is
+// recognized and ignored rather than misread
+struct SettingsRecord {
+  uint8_t version;
+  uint8_t effect;
+  uint8_t brightness;
+  uint8_t reserved;
+  uint32_t color;
+};
+
+void SettingsStore::begin(SettingsBackend& backend, const SavedSettings& defaults, uint32_t quietMs,
+                          uint32_t maxDelayMs) {
+  backend_ = &backend;
+  quietMs_ = quietMs;
+  maxDelayMs_ = maxDelayMs;
+  pending_ = false;
+  stats_ = SettingsStats();
+  current_ = defaults;
+  SettingsRecord record;
+  loaded_ = backend.read(&record, sizeof(record)) && record.version == kVersion;
+  if(loaded_) {
+    current_.effect = record.effect;
+    current_.brightness = record.brightness;
+    current_.color = record.color;
+  }
+  stored_ = current_;
+}
+
+void SettingsStore::set(const SavedSettings& settings, uint32_t nowMs) {
+  if(settings == current_) {
+    return;
+  }
+  current_ = settings;
+  stats_.changes++;
+  if(current_ == stored_) {
+    pending_ = false;
+    return;
+  }
+  if(!pending_) {
+    pending_ = true;
+    firstChangeMs_ = nowMs;
+  }
+  lastChangeMs_ = nowMs;
+}
+
+bool SettingsStore::update(uint32_t nowMs) {
+  if(!pending_ || (nowMs - lastChangeMs_ < quietMs_ && nowMs - firstChangeMs_ < maxDelayMs_)) {
+    return false;
+  }
+  return write(nowMs);
+}
+
+bool SettingsStore::flush() {
+  return pending_ && write(lastChangeMs_);
+}
+
+bool SettingsStore::write(uint32_t nowMs) {
+  if(backend_ == nullptr) {
+    return false;
+  }
+  SettingsRecord record;
+  memset(&record, 0, sizeof(record));
+  record.version = kVersion;
+  record.effect = current_.effect;
+  record.brightness = current_.brightness;
+  record.color = current_.color;
+  if(!backend_->write(&record, sizeof(record))) {
+    // Still pending; tried again after quietMs
+    stats_.failedWrites++;
+    firstChangeMs_ = nowMs;
+    lastChangeMs_ = nowMs;
+    return false;
+  }
+  pending_ = false;
+  stored_ = current_;
+  stats_.writes++;
+  return true;
+}
+
+#if defined(ESP_PLATFORM)
+bool NvsSettingsBackend::read(void* data, size_t size) {
+  nvs_handle_t handle;
+  if(nvs_open(space_, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+  size_t length = size;
+  const esp_err_t err = nvs_get_blob(handle, key_, data, &length);
+  nvs_close(handle);
+  return err == ESP_OK && length == size;
+}
+
+bool NvsSettingsBackend::write(const void* data, size_t size) {
+  nvs_handle_t handle;
+  if(nvs_open(space_, NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, key_, data, size);
+  if(err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+#endif
+
+#ifndef ARDUINO
+bool MemorySettingsBackend::read(void* data, size_t size) {
+  if(record.size() != size) {
+    return false;
+  }
+  memcpy(data, record.data(), size);
+  return true;
+}
+
+bool MemorySettingsBackend::write(const void* data, size_t size) {
+  record.assign((const uint8_t*)data, (const uint8_t*)data + size);
+  return true;
+}
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What survives a power cycle
+struct SavedSettings {
+  uint8_t effect = 0;
+  uint8_t brightness = 128;
+  uint32_t color = 0;  // 0x00RRGGBB, the Solid effect's
+
+  bool operator==(const SavedSettings& o) const {
+    return effect == o.effect && brightness == o.brightness && color == o.color;
+  }
+  bool operator!=(const SavedSettings& o) const { return !(*this == o); }
+};
+
+// Where the settings record is kept: NVS on the device, memory on the host
+class SettingsBackend {
+ public:
+  virtual ~SettingsBackend() {}
+
+  // Read the record into data; false if there is none of exactly size bytes
+  virtual bool read(void* data, size_t size) = 0;
+  virtual bool write(const void* data, size_t size) = 0;
+};
+
+// Counters since begin()
+struct SettingsStats {
+  uint32_t changes = 0;  // set() calls that changed something
+  uint32_t writes = 0;   // Records written
+  uint32_t failedWrites = 0;
+};
+
+// Persisted UI state with coalesced writes.
+//
+// The UI reports its state as often as it likes; set() only compares. A
+// change is written once it has been left alone for quietMs, or at the
+// latest maxDelayMs after the first unsaved change, so a slider drag is one
+// write rather than one per touch sample. A change that comes back to what
+// is already stored cancels the write. Flash writes also stall the other
+// core briefly, which is one more reason to keep them rare.
+class SettingsStore {
+ public:
+  static const uint8_t kVersion = 1;
+
+  // Load the stored record, or keep defaults if there is none (or it was
+  // written by another version)
+  void begin(SettingsBackend& backend, const SavedSettings& defaults, uint32_t quietMs = 2000,
+             uint32_t maxDelayMs = 10000);
+
+  // The settings came from the backend rather than the defaults
+  bool loaded() const { return loaded_; }
+  const SavedSettings& settings() const { return current_; }
+
+  // The UI's state at nowMs
+  void set(const SavedSettings& settings, uint32_t nowMs);
+
+  // Write the pending change if it is due. Returns true if it wrote.
+  bool update(uint32_t nowMs);
+
+  // Write the pending change now, e.g. before a deliberate restart
+  bool flush();
+
+  bool pending() const { return pending_; }
+  const SettingsStats& stats() const { return stats_; }
+
+ private:
+  bool write(uint32_t nowMs);
+
+  SettingsBackend* backend_ = nullptr;
+  SavedSettings current_;
+  SavedSettings stored_;
+  uint32_t quietMs_ = 2000;
+  uint32_t maxDelayMs_ = 10000;
+  uint32_t firstChangeMs_ = 0;
+  uint32_t lastChangeMs_ = 0;
+  bool pending_ = false;
+  bool loaded_ = false;
+  SettingsStats stats_;
+};
+
+#if defined(ESP_PLATFORM)
+// One NVS blob. The Arduino core has initialized the NVS partition by the
+// time setup() runs.
+class NvsSettingsBackend : public SettingsBackend {
+ public:
+  explicit NvsSettingsBackend(const char* space = "ledctl", const char* key = "settings")
+      : space_(space), key_(key) {}
+
+  bool read(void* data, size_t size) override;
+  bool write(const void* data, size_t size) override;
+
+ private:
+  const char* space_;
+  const char* key_;
+};
+#endif
+
+#ifndef ARDUINO
+#include <vector>
+
+// Host stand-in: the record in memory
+class MemorySettingsBackend : public SettingsBackend {
+ public:
+  bool read(void* data, size_t size) override;
+  bool write(const void* data, size_t size) override;
+
+  std::vector<uint8_t> record;
+};
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer. One core pushes,
+// the other pops; neither ever blocks or takes a lock. Head and tail sit on
+// separate cache lines so the two cores do not false-share.
+template <typename T, uint32_t Capacity>
+class SpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  // Producer side. Returns false (and drops nothing) when the queue is full.
+  bool push(const T& item) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if(head - tail_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    items_[head & (Capacity - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when the queue is empty.
+  bool pop(T& item) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if(head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    item = items_[tail & (Capacity - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called from the side that is not being modified
+  uint32_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+  static constexpr uint32_t capacity() { return Capacity; }
+
+ private:
+  alignas(64) std::atomic<uint32_t> head_{0};  // Written by the producer only
+  alignas(64) std::atomic<uint32_t> tail_{0};  // Written by the consumer only
+  alignas(64) T items_[Capacity];
+};
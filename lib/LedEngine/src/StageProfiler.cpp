@@ -0,0 +1,112 @@
+#include "StageProfiler.h"
+
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+uint32_t profileCycles() {
+  return esp_cpu_get_cycle_count();
+}
+
+uint32_t profileCyclesPerUs() {
+  return esp_rom_get_cpu_ticks_per_us();
+}
+#else
+#include <chrono>
+
+uint32_t profileCycles() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint32_t profileCyclesPerUs() {
+  return 1000;
+}
+#endif
+
+uint32_t StageProfiler::bucketOf(uint32_t cycles) {
+  if(cycles < (1u << kSubBits)) {
+    return cycles;
+  }
+  // Top kSubBits + 1 bits: the octave and where in it the value falls
+  const uint32_t shift = 31 - __builtin_clz(cycles) - kSubBits;
+  return ((shift + 1) << kSubBits) + ((cycles >> shift) & ((1u << kSubBits) - 1));
+}
+
+uint32_t StageProfiler::bucketUpperEdge(uint32_t bucket) {
+  if(bucket < (1u << kSubBits)) {
+    return bucket;
+  }
+  const uint32_t shift = (bucket >> kSubBits) - 1;
+  const uint32_t lower = ((1u << kSubBits) + (bucket & ((1u << kSubBits) - 1))) << shift;
+  return lower + ((1u << shift) - 1);
+}
+
+void StageProfiler::begin(const char* const* names, uint8_t count) {
+  count_ = count < kMaxStages ? count : kMaxStages;
+  for(uint8_t i = 0; i < count_; i++) {
+    stages_[i].name = names[i];
+  }
+  reset();
+}
+
+void StageProfiler::collect() {
+  for(uint8_t i = 0; i < count_; i++) {
+    Stage& s = stages_[i];
+    uint32_t cycles;
+    while(s.ring.pop(cycles)) {
+      if(s.count == 0 || cycles < s.min) {
+        s.min = cycles;
+      }
+      if(cycles > s.max) {
+        s.max = cycles;
+      }
+      s.count++;
+      s.total += cycles;
+      s.histogram[bucketOf(cycles)]++;
+    }
+  }
+}
+
+StageSummary StageProfiler::summary(uint8_t stage) const {
+  const Stage& s = stages_[stage];
+  StageSummary result = {};
+  result.count = s.count;
+  result.dropped = s.dropped.load(std::memory_order_relaxed) - s.droppedBefore;
+  if(s.count == 0) {
+    return result;
+  }
+  const float cyclesPerUs = (float)profileCyclesPerUs();
+  result.minUs = s.min / cyclesPerUs;
+  result.maxUs = s.max / cyclesPerUs;
+  result.avgUs = (float)((double)s.total / s.count / cyclesPerUs);
+
+  // Smallest bucket with at least 99% of the samples at or below it
+  const uint32_t rank = s.count - s.count / 100;
+  uint32_t seen = 0;
+  for(uint32_t b = 0; b < kBuckets; b++) {
+    seen += s.histogram[b];
+    if(seen >= rank) {
+      uint32_t edge = bucketUpperEdge(b);
+      result.p99Us = (edge < s.max ? edge : s.max) / cyclesPerUs;
+      break;
+    }
+  }
+  return result;
+}
+
+void StageProfiler::reset() {
+  collect();
+  for(uint8_t i = 0; i < count_; i++) {
+    Stage& s = stages_[i];
+    s.droppedBefore = s.dropped.load(std::memory_order_relaxed);
+    s.count = 0;
+    s.min = 0;
+    s.max = 0;
+    s.total = 0;
+    memset(s.histogram, 0, sizeof(s.histogram));
+  }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "SpscQueue.h"
+
+// Hot-path stage timing.
+//
+// Each stage of the UI loop and the render task is timed with the CPU cycle
+// counter and the sample pushed into that stage's lock-free ring, so timing a
+// stage costs two counter reads and a ring push and never blocks the core it
+// runs on. A consumer (the UI loop) drains the rings now and then and folds
+// the samples into a log-scale histogram per stage, from which min, average,
+// p99 and max are read. Samples that arrive while a ring is full are counted
+// and dropped.
+//
+// Every stage has exactly one producing thread; collect() and summary() run
+// on one consumer thread.
+
+// Free-running cycle counter: the core's cycle count on the ESP32-P4, a
+// nanosecond clock on the host. Wraps, so only differences are meaningful.
+uint32_t profileCycles();
+uint32_t profileCyclesPerUs();
+
+struct StageSummary {
+  uint32_t count;
+  uint32_t dropped;  // Samples lost to a full ring
+  float minUs;
+  float avgUs;
+  float p99Us;       // Upper edge of the bucket holding the 99th percentile
+  float maxUs;
+};
+
+class StageProfiler {
+ public:
+  static const uint8_t kMaxStages = 12;
+  static const uint32_t kRingSize = 128;  // Samples buffered between collect() calls
+
+  // Histogram: 8 buckets per power of two, so p99 is within 12.5%
+  static const uint32_t kSubBits = 3;
+  static const uint32_t kBuckets = (32 - kSubBits + 1) << kSubBits;
+
+  // Stage names, in id order. The strings are not copied.
+  void begin(const char* const* names, uint8_t count);
+  uint8_t stageCount() const { return count_; }
+  const char* stageName(uint8_t stage) const { return stages_[stage].name; }
+
+  // Producer side, from the stage's own thread
+  void record(uint8_t stage, uint32_t cycles) {
+    Stage& s = stages_[stage];
+    if(!s.ring.push(cycles)) {
+      s.dropped.store(s.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+  }
+
+  // Consumer side: drain every ring into its histogram
+  void collect();
+  StageSummary summary(uint8_t stage) const;
+  // Forget everything collected so far
+  void reset();
+
+  static uint32_t bucketOf(uint32_t cycles);
+  static uint32_t bucketUpperEdge(uint32_t bucket);
+
+ private:
+  struct Stage {
+    const char* name = nullptr;
+    SpscQueue<uint32_t, kRingSize> ring;
+    std::atomic<uint32_t> dropped{0};
+
+    // Consumer only
+    uint32_t droppedBefore = 0;  // dropped at the last reset()
+    uint32_t count = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    uint64_t total = 0;
+    uint32_t histogram[kBuckets];
+  };
+
+  Stage stages_[kMaxStages];
+  uint8_t count_ = 0;
+};
@@ -0,0 +1,103 @@
+#include "StripTopology.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t StripTopology::totalLeds() const {
+  uint32_t total = 0;
+  for(uint8_t i = 0; i < laneCount; i++) {
+    total += lanes[i].length;
+  }
+  return total;
+}
+
+uint32_t StripTopology::longestLane() const {
+  uint32_t longest = 0;
+  for(uint8_t i = 0; i < laneCount; i++) {
+    if(lanes[i].length > longest) {
+      longest = lanes[i].length;
+    }
+  }
+  return longest;
+}
+
+uint32_t StripTopology::laneOffset(uint8_t lane) const {
+  uint32_t offset = 0;
+  for(uint8_t i = 0; i < lane && i < laneCount; i++) {
+    offset += lanes[i].length;
+  }
+  return offset;
+}
+
+bool parseColorOrder(const char* name, ColorOrder& order) {
+  if(strlen(name) != 3) {
+    return false;
+  }
+  int r = -1, g = -1, b = -1;
+  for(int i = 0; i < 3; i++) {
+    switch(name[i]) {
+      case 'R': case 'r': r = i; break;
+      case 'G': case 'g': g = i; break;
+      case 'B': case 'b': b = i; break;
+      default: return false;
+    }
+  }
+  if(r < 0 || g < 0 || b < 0) {
+    return false;
+  }
+  order = ColorOrder{(uint8_t)r, (uint8_t)g, (uint8_t)b};
+  return true;
+}
+
+bool parseTopology(const char* spec, StripTopology& topology) {
+  StripTopology parsed;
+  const char* p = spec;
+  while(*p) {
+    if(parsed.laneCount == StripTopology::kMaxLanes) {
+      return false;
+    }
+    LaneConfig lane = {0, 0, kOrderGRB};
+
+    char* end;
+    lane.pin = strtol(p, &end, 10);
+    if(end == p || *end != ':') {
+      return false;
+    }
+    p = end + 1;
+    lane.length = strtoul(p, &end, 10);
+    if(end == p || lane.length == 0) {
+      return false;
+    }
+    p = end;
+    if(*p == ':') {
+      char name[4] = {0};
+      int n = 0;
+      p++;
+      while(*p && *p != ',' && n < 3) {
+        name[n++] = *p++;
+      }
+      if(!parseColorOrder(name, lane.order)) {
+        return false;
+      }
+      if(*p == ':') {
+        p++;
+        lane.maxMa = strtoul(p, &end, 10);
+        if(end == p) {
+          return false;
+        }
+        p = end;
+      }
+    }
+    if(*p == ',') {
+      p++;
+    } else if(*p) {
+      return false;
+    }
+    parsed.lanes[parsed.laneCount++] = lane;
+  }
+  if(parsed.laneCount == 0) {
+    return false;
+  }
+  topology = parsed;
+  return true;
+}
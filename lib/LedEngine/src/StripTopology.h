@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Framebuffer.h"
+
+// Physical layout of the strips: N output lanes, each on its own GPIO with
+// its own length and color order. Effects render into one logical buffer of
+// totalLeds() pixels; lane i takes the next lanes[i].length of them.
+struct LaneConfig {
+  int pin;
+  uint32_t length;
+  ColorOrder order;
+  uint32_t maxMa = 0;  // Current budget of the strip's supply, 0 = LedOutput's default
+};
+
+struct StripTopology {
+  // The ESP32-P4 has four RMT TX channels
+  static const uint8_t kMaxLanes = 4;
+
+  LaneConfig lanes[kMaxLanes];
+  uint8_t laneCount = 0;
+
+  uint32_t totalLeds() const;
+  uint32_t longestLane() const;
+
+  // First logical pixel of a lane
+  uint32_t laneOffset(uint8_t lane) const;
+};
+
+// Parse "pin:length[:order[:mA]],..." e.g. "54:144:GRB,53:300:RGB:6000". The
+// order defaults to GRB and the current budget to LedOutput's. Returns false
+// (leaving topology untouched) on bad input.
+bool parseTopology(const char* spec, StripTopology& topology);
+
+// Total LEDs of a topology spec at compile time, or 0 if parseTopology()
+// would reject it, so a build can be specialized on the configured length:
+//   static_assert(topologyLeds(LED_LANES) > 0, "bad LED_LANES");
+constexpr uint32_t topologyLeds(const char* spec) {
+  uint32_t total = 0;
+  uint8_t lanes = 0;
+  const char* p = spec;
+  while(*p) {
+    if(lanes++ == StripTopology::kMaxLanes) {
+      return 0;
+    }
+    // pin:length, both decimal
+    const char* start = p;
+    while(*p >= '0' && *p <= '9') {
+      p++;
+    }
+    if(p == start || *p++ != ':') {
+      return 0;
+    }
+    uint32_t length = 0;
+    start = p;
+    while(*p >= '0' && *p <= '9') {
+      length = length * 10 + (*p++ - '0');
+    }
+    if(p == start || length == 0) {
+      return 0;
+    }
+    // Optional three-letter order, then optional budget
+    if(*p == ':') {
+      p++;
+      int seen = 0;  // Bit per channel, each exactly once
+      for(int i = 0; i < 3; i++, p++) {
+        const char c = *p | 0x20;
+        const int bit = c == 'r' ? 1 : c == 'g' ? 2 : c == 'b' ? 4 : 0;
+        if(bit == 0 || (seen & bit)) {
+          return 0;
+        }
+        seen |= bit;
+      }
+      if(*p == ':') {
+        start = ++p;
+        while(*p >= '0' && *p <= '9') {
+          p++;
+        }
+        if(p == start) {
+          return 0;
+        }
+      }
+    }
+    if(*p == ',') {
+      p++;
+    } else if(*p) {
+      return 0;
+    }
+    total += length;
+  }
+  return total;
+}
+
+// Parse "RGB", "GRB", "BRG", ... into byte offsets
+bool parseColorOrder(const char* name, ColorOrder& order);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Coarse spatial index for touch hit-testing. The screen is split into
+// square cells and each cell lists the ids whose hit rect overlaps it, so a
+// touch only has to test the one or two widgets in its cell instead of
+// walking every widget on screen.
+template <uint16_t Width, uint16_t Height, uint16_t CellSize, uint8_t MaxPerCell>
+class TouchGrid {
+ public:
+  static const uint16_t kCols = (Width + CellSize - 1) / CellSize;
+  static const uint16_t kRows = (Height + CellSize - 1) / CellSize;
+
+  void clear() { memset(counts_, 0, sizeof(counts_)); }
+
+  // Register id over a rect (clipped to the screen). Returns false if some
+  // cell was already full, in which case the id is missing from it.
+  bool add(uint8_t id, int x, int y, int w, int h) {
+    int c0 = clampCol(x), c1 = clampCol(x + w - 1);
+    int r0 = clampRow(y), r1 = clampRow(y + h - 1);
+    bool ok = true;
+    for(int r = r0; r <= r1; r++) {
+      for(int c = c0; c <= c1; c++) {
+        uint16_t cell = r * kCols + c;
+        if(counts_[cell] < MaxPerCell) {
+          ids_[cell][counts_[cell]++] = id;
+        } else {
+          ok = false;
+        }
+      }
+    }
+    return ok;
+  }
+
+  // Ids registered in the cell under (x, y), in the order they were added
+  uint8_t lookup(int x, int y, const uint8_t** ids) const {
+    if(x < 0 || y < 0 || x >= Width || y >= Height) {
+      return 0;
+    }
+    uint16_t cell = (y / CellSize) * kCols + x / CellSize;
+    *ids = ids_[cell];
+    return counts_[cell];
+  }
+
+ private:
+  static int clampCol(int x) { return x < 0 ? 0 : x >= Width ? kCols - 1 : x / CellSize; }
+  static int clampRow(int y) { return y < 0 ? 0 : y >= Height ? kRows - 1 : y / CellSize; }
+
+  uint8_t ids_[kRows * kCols][MaxPerCell];
+  uint8_t counts_[kRows * kCols] = {};
+};
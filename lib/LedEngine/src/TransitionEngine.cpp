@@ -0,0 +1,80 @@
+#include "TransitionEngine.h"
+
+#include "PixelKernels.h"
+
+void TransitionEngine::begin(uint32_t numLeds, EffectRenderFn render, void* context) {
+  render_ = render;
+  context_ = context;
+  for(Layer& layer : layers_) {
+    layer.pixels.assign(numLeds, Rgb16{0, 0, 0});
+    layer.fb = Framebuffer16{layer.pixels.data(), numLeds};
+  }
+  mixPixels_.assign(numLeds, Rgb16{0, 0, 0});
+  mix_ = Framebuffer16{mixPixels_.data(), numLeds};
+  cut(0);
+}
+
+void TransitionEngine::assign(uint8_t i, uint8_t effect) {
+  layers_[i].effect = effect;
+  layers_[i].fb.clear();
+}
+
+void TransitionEngine::cut(uint8_t effect) {
+  assign(current_, effect);
+  fading_ = false;
+  elapsedUs_ = 0;
+  weight_ = 0xFFFF;
+}
+
+void TransitionEngine::select(uint8_t effect) {
+  const uint8_t other = current_ ^ 1;
+  if(durationUs_ == 0) {
+    cut(effect);
+    return;
+  }
+  if(!fading_) {
+    if(effect == layers_[current_].effect) {
+      return;
+    }
+    current_ = other;
+    assign(current_, effect);
+  } else if(effect == layers_[current_].effect) {
+    return;
+  } else if(effect == layers_[other].effect) {
+    // Fade back out from where we are; both layers keep their state
+    current_ = other;
+    elapsedUs_ = durationUs_ - elapsedUs_;
+    return;
+  } else {
+    // Keep the layer that dominates the picture as the outgoing one, so the
+    // jump is at most half a crossfade
+    if(elapsedUs_ * 2 >= durationUs_) {
+      current_ = other;
+    }
+    assign(current_, effect);
+  }
+  fading_ = true;
+  elapsedUs_ = 0;
+  weight_ = 0;
+}
+
+const Framebuffer16& TransitionEngine::render(uint32_t dtUs) {
+  Layer& in = layers_[current_];
+  if(fading_) {
+    elapsedUs_ += dtUs;
+    if(elapsedUs_ >= durationUs_) {
+      fading_ = false;
+    }
+  }
+  if(!fading_) {
+    weight_ = 0xFFFF;
+    return render_(in.fb, in.effect, dtUs, context_);
+  }
+
+  Layer& out = layers_[current_ ^ 1];
+  const Framebuffer16& from = render_(out.fb, out.effect, dtUs, context_);
+  const Framebuffer16& to = render_(in.fb, in.effect, dtUs, context_);
+  weight_ = (uint16_t)(((uint64_t)elapsedUs_ << 16) / durationUs_);
+  blendChannels(mix_.channels(), from.channels(), to.channels(), mix_.channelCount(), weight_);
+  return mix_;
+}
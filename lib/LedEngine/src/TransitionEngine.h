@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Framebuffer.h"
+
+// Renders one effect into a framebuffer dtUs microseconds after the previous
+// call and returns the frame to show: normally fb itself, but an effect that
+// owns its pixels (the network stream) may hand back its own buffer instead
+// of copying it. The engine only knows effects by number; the caller maps
+// them to the actual effect functions and their state.
+typedef const Framebuffer16& (*EffectRenderFn)(Framebuffer16& fb, uint8_t effect, uint32_t dtUs, void* context);
+
+// Timed crossfades between effects.
+//
+// Every effect renders into a buffer of its own (a layer), so an effect that
+// fades or adds onto the previous frame - meteor, KITT - starts from black
+// instead of inheriting whatever the last effect left behind. Outside a
+// transition only the current layer renders and is shown as is. While one
+// runs, the outgoing and incoming layers both render and a single
+// blendChannels() pass mixes them into a third buffer, so a transition frame
+// costs two effect frames plus one blend.
+class TransitionEngine {
+ public:
+  // Size the layers and mix buffer. Starts on effect 0 with no transition.
+  void begin(uint32_t numLeds, EffectRenderFn render, void* context = nullptr);
+
+  // Crossfade length; 0 switches effects instantly
+  void setDurationUs(uint32_t us) { durationUs_ = us; }
+  uint32_t durationUs() const { return durationUs_; }
+
+  // Crossfade from what is showing to effect. Selecting the effect that is
+  // fading out reverses the transition from where it is; a third effect
+  // mid-transition replaces whichever layer currently weighs less.
+  void select(uint8_t effect);
+
+  // Switch to effect immediately, without a transition
+  void cut(uint8_t effect);
+
+  // Advance by dtUs and render. Returns the frame to show: the current
+  // layer, or the mix buffer while a transition runs.
+  const Framebuffer16& render(uint32_t dtUs);
+
+  uint8_t effect() const { return layers_[current_].effect; }  // Current or incoming effect
+  bool transitioning() const { return fading_; }
+  // Share of the incoming effect in the last mixed frame, Q0.16
+  uint16_t weight() const { return weight_; }
+  uint32_t numLeds() const { return mix_.count; }
+
+ private:
+  struct Layer {
+    uint8_t effect = 0;
+    std::vector<Rgb16> pixels;
+    Framebuffer16 fb = {nullptr, 0};
+  };
+
+  // Put effect on layer i, starting from a black buffer
+  void assign(uint8_t i, uint8_t effect);
+
+  Layer layers_[2];
+  std::vector<Rgb16> mixPixels_;
+  Framebuffer16 mix_ = {nullptr, 0};
+  EffectRenderFn render_ = nullptr;
+  void* context_ = nullptr;
+  uint8_t current_ = 0;  // Layer showing, or fading in; the other fades out
+  bool fading_ = false;
+  uint32_t durationUs_ = 500000;
+  uint32_t elapsedUs_ = 0;
+  uint16_t weight_ = 0;
+};
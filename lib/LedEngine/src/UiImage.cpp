@@ -0,0 +1,77 @@
+#include "UiImage.h"
+
+#include <stdio.h>
+
+uint32_t uiImageKey(uint32_t key, const void* data, size_t size) {
+  const uint8_t* p = (const uint8_t*)data;
+  for(size_t i = 0; i < size; i++) {
+    key = (key ^ p[i]) * 16777619u;
+  }
+  return key;
+}
+
+void encodeUiImage(const uint16_t* pixels, uint32_t count, std::vector<uint16_t>& out) {
+  out.clear();
+  uint32_t i = 0;
+  while(i < count) {
+    const uint16_t color = pixels[i];
+    uint32_t run = 1;
+    while(i + run < count && run < 0xFFFF && pixels[i + run] == color) {
+      run++;
+    }
+    out.push_back((uint16_t)run);
+    out.push_back(color);
+    i += run;
+  }
+}
+
+bool decodeUiImage(const uint16_t* words, uint32_t wordCount, uint16_t* pixels, uint32_t count) {
+  uint32_t filled = 0;
+  for(uint32_t w = 0; w + 1 < wordCount; w += 2) {
+    const uint32_t run = words[w];
+    const uint16_t color = words[w + 1];
+    if(run == 0 || run > count - filled) {
+      return false;
+    }
+    uint16_t* out = pixels + filled;
+    for(uint32_t k = 0; k < run; k++) {
+      out[k] = color;
+    }
+    filled += run;
+  }
+  return filled == count && wordCount % 2 == 0;
+}
+
+bool saveUiImage(const char* path, uint32_t key, const uint16_t* pixels, uint16_t width, uint16_t height) {
+  std::vector<uint16_t> words;
+  encodeUiImage(pixels, (uint32_t)width * height, words);
+  const UiImageHeader header = {kUiImageMagic, key, width, height, (uint32_t)words.size()};
+  FILE* f = fopen(path, "wb");
+  if(f == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(words.data(), sizeof(uint16_t), words.size(), f) == words.size();
+  ok &= fclose(f) == 0;
+  if(!ok) {
+    remove(path);  // Never leave a truncated image behind
+  }
+  return ok;
+}
+
+bool loadUiImage(const char* path, uint32_t key, uint16_t* pixels, uint16_t width, uint16_t height) {
+  FILE* f = fopen(path, "rb");
+  if(f == nullptr) {
+    return false;
+  }
+  UiImageHeader header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == kUiImageMagic && header.key == key &&
+            header.width == width && header.height == height && header.words <= (uint32_t)width * height * 2;
+  std::vector<uint16_t> words;
+  if(ok) {
+    words.resize(header.words);
+    ok = fread(words.data(), sizeof(uint16_t), words.size(), f) == words.size();
+  }
+  fclose(f);
+  return ok && decodeUiImage(words.data(), words.size(), pixels, (uint32_t)width * height);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Prebuilt image of the static UI, so a boot blits one picture instead of
+// redrawing every widget primitive by primitive.
+//
+// The screen is mostly flat fills, horizontal gradients and text, so it is
+// stored as runs: (length, color) pairs of 16-bit words, row after row, with
+// runs crossing row ends. A 720x1280 RGB565 screen (1.8 MB) packs to a few
+// tens of kB and decodes with one store per pixel. Pixels are kept exactly as
+// given, in whatever byte order the caller's buffer uses.
+//
+// The header carries a key for what was drawn (layout, build); an image
+// whose key does not match is stale and is drawn and saved again.
+
+static const uint32_t kUiImageMagic = 0x474D4955;  // "UIMG"
+
+struct UiImageHeader {
+  uint32_t magic;
+  uint32_t key;
+  uint16_t width;
+  uint16_t height;
+  uint32_t words;  // Encoded words after the header
+};
+
+// FNV-1a over size bytes, continuing from key (start with kUiImageKeySeed)
+static const uint32_t kUiImageKeySeed = 2166136261u;
+uint32_t uiImageKey(uint32_t key, const void* data, size_t size);
+
+void encodeUiImage(const uint16_t* pixels, uint32_t count, std::vector<uint16_t>& out);
+
+// False unless the runs fill exactly count pixels
+bool decodeUiImage(const uint16_t* words, uint32_t wordCount, uint16_t* pixels, uint32_t count);
+
+// Encode width x height pixels and write them to path. False on any I/O
+// error.
+bool saveUiImage(const char* path, uint32_t key, const uint16_t* pixels, uint16_t width, uint16_t height);
+
+// Read path into width x height pixels if it holds an image with this key
+// and size. False (pixels undefined) if not.
+bool loadUiImage(const char* path, uint32_t key, uint16_t* pixels, uint16_t width, uint16_t height);
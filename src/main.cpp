@@ -1,22 +1,243 @@
 #include <M5Unified.h>
 #include <M5GFX.h>
-#include <Adafruit_NeoPixel.h>
+#include <LittleFS.h>
+#include <WiFi.h>
 
-#define LED_PIN   54
-#define NUM_LEDS  144
+#include "AudioEffects.h"
+#include "EffectRegistry.h"
+#include "Effects.h"
+#include "LedAnimation.h"
+#include "FrameScheduler.h"
+#include "IdleGovernor.h"
+#include "LedCommand.h"
+#include "LedOutput.h"
+#include "LedPreview.h"
+#include "ParticleEffects.h"
+#include "PixelMap.h"
+#include "PixelStream.h"
+#include "SerialLink.h"
+#include "SettingsStore.h"
+#include "StageProfiler.h"
+#include "TouchGrid.h"
+#include "TransitionEngine.h"
+#include "UiImage.h"
+
+// Output lanes as "pin:length:order", comma separated, up to 4. Lanes are
+// sent in parallel and form one logical strip in the order listed. A fourth
+// field sets that strip's current budget in mA, e.g. "54:144:GRB:2000".
+#define LED_LANES "54:144:GRB"
+#define LED_MAX_MA 4000   // Current budget per strip unless LED_LANES sets one, 0 for no limit
+// How the effects' pixels land on the LEDs (see PixelMap.h), e.g. "16x16:s"
+// for a serpentine panel or "0-71,71-0" to mirror a 72-pixel effect on 144
+// LEDs. Must cover every LED of LED_LANES; empty maps straight through.
+#define LED_MAP ""
+#define FIRE_SEGMENTS 1  // Independent flames along the strip (mirrored in pairs)
+#define TARGET_FPS 60     // LED frame rate: 60, 120 or 240
+#define RENDER_CORE 0     // LED render/output core; touch and LCD stay on the Arduino loop core
+#define PREVIEW_FPS 30    // Max update rate of the on-screen LED preview
+#define LED_GAMMA 1       // Gamma-correct the output (1) or send linear values (0)
+#define LED_DITHER 1      // Temporal dithering, keeps dark fades and gradients smooth
+#define TRANSITION_MS 500 // Crossfade between effects, 0 to switch instantly
+
+// Idle frames: frames that would not change (Solid, Off, a Stream between
+// packets) are not rendered or sent. After IDLE_SLEEP_MS of that the render
+// core drops to one tick per IDLE_TICK_MS and touch polling slows to
+// IDLE_POLL_MS, until a touch or command wakes them. 0 renders every frame.
+#define IDLE_SLEEP_MS 2000
+#define IDLE_TICK_MS 100
+#define IDLE_POLL_MS 20
+
+// Stage timing: each step of loop() and of the render task is timed with the
+// cycle counter. Send 'p' over serial for min/avg/p99 per stage, 'r' to start
+// over. 0 compiles all of it out.
+#define STAGE_PROFILE 0
+#define FPS_OVERLAY 1     // With STAGE_PROFILE: LED fps and frame time in the header
+
+// Network for the Stream effect: DDP on UDP 4048 and E1.31 on UDP 5568.
+// Leave WIFI_SSID empty to run without WiFi.
+#define WIFI_SSID ""
+#define WIFI_PASSWORD ""
+#define STREAM_UNIVERSE 1  // First E1.31 universe, 170 LEDs each
+
+// Music-reactive effects (Spectrum, Beat, VU) from the onboard microphone,
+// analyzed on the UI core. 0 leaves the microphone off and them dark.
+#define AUDIO_INPUT 1
+#define AUDIO_RATE 16000  // Mic sample rate; a 256-sample hop is 16 ms
+
+// Recording played by the Show effect (see tools/ledanim). Upload data/ to
+// flash with "pio run -t uploadfs", or point this at a mounted SD card.
+#define ANIM_FILE "/littlefs/show.lan"
+
+// Fast boot: the effect, brightness and color are saved to NVS
+// SETTINGS_SAVE_MS after the last change (a drag is one write) and the LEDs
+// restart from them before the display is initialized. The static UI is
+// blitted from UI_IMAGE, saved on the first boot of each build.
+#define SETTINGS_SAVE_MS 2000
+#define UI_IMAGE "/littlefs/ui.img"
+
+// Binary protocol on the USB serial port (see SerialLink.h): batched
+// commands, stats queries and pixel frames for the Stream effect. Read by
+// the render core, at most SERIAL_POLL_BYTES per frame, from a receive
+// buffer of SERIAL_RX_BUFFER bytes. 'p' and 'r' still reach the profiler.
+// 0 leaves the port to the profiler alone.
+#define SERIAL_LINK 1
+#define SERIAL_RX_BUFFER 32768
+#define SERIAL_POLL_BYTES 16384
 
 // Display	5 Inch IPS TFT (1280×720, 720P), Driver IC: ST7123
 
-// Canvas is tied to the single, M5Unified-owned display
-M5Canvas canvas(&M5.Display);
-Adafruit_NeoPixel strip(NUM_LEDS, LED_PIN, NEO_GRB + NEO_KHZ800);
+// WS2812 output: frames are encoded up front and sent by the RMT peripheral
+// in the background, double-buffered so the next frame renders meanwhile
+StripTopology ledTopology;
+RmtTransmitter laneTransmitters[StripTopology::kMaxLanes];
+LedOutput ledOutput;
+
+// Paces LED frames on a fixed grid and hands effects the elapsed time
+FrameScheduler frameScheduler;
+
+// Skips frames that would not change and sends the render core to sleep
+// once nothing has for IDLE_SLEEP_MS. Render core only; the UI core reads
+// asleep() and the stats without a lock.
+IdleGovernor idleGovernor;
 
-// Effect mode and animation variables
-uint8_t currentEffect = 5;  // 0 = Rainbow, 1 = Fire, 2 = Meteor, 3 = KITT, 4 = OFF, 5 = Solid Color
-uint16_t rainbowOffset = 0;
-uint16_t animationCounter = 0;
+// Effects render into 16-bit layers of their own and crossfade on a switch;
+// showFrame() applies the brightness and encodes the result for the strips
+// in one pass. Sized from the topology in setup().
+TransitionEngine transitions;
+
+PixelStream pixelStream;  // Stream effect: frames from show-control software
+FileAnimSource animSource;  // Show effect: ANIM_FILE, read through the player's small buffer
+AnimPlayer animPlayer;
+
+// Stream: received straight into the stream's own buffers, shown without a copy
+struct StreamDef : EffectDef {
+  static constexpr const char* kName = "Stream";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  struct State {
+    PixelStream* stream = &pixelStream;
+  };
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16&, Count, State& state, uint32_t) {
+    state.stream->poll();
+    return state.stream->frame();
+  }
+  // Until the next complete frame arrives
+  static bool still(State& state) {
+    state.stream->poll();
+    return !state.stream->frameReady();
+  }
+};
+
+// Show: decoded from ANIM_FILE, stays dark if there is none
+struct ShowDef : EffectDef {
+  static constexpr const char* kName = "Show";
+  static constexpr EffectButton kButton = EFFECT_BUTTON;
+  struct State {
+    AnimPlayer* player = &animPlayer;
+  };
+  template <typename Count>
+  static const Framebuffer16& render(Framebuffer16& fb, Count, State& state, uint32_t dtUs) {
+    state.player->update(fb, dtUs);
+    return fb;
+  }
+  static void onSelect(State& state) {
+    state.player->resync();  // Its layer may have been cleared
+  }
+  static bool still(State& state) { return !state.player->isOpen(); }
+};
+
+// Microphone analysis, handed to the audio effects through audioFeed.
+// Three blocks: the microphone driver fills two while the third is analyzed.
+AudioAnalyzer audioAnalyzer;
+AudioFeed audioFeed;
+int16_t audioBlocks[3][AudioAnalyzer::kHop];
+TaskHandle_t audioTaskHandle = nullptr;
+
+// Every effect, in id order. The kernels are built for the logical length:
+// LED_MAP's, or without one LED_LANES'. The UI's tiles and buttons are laid
+// out from this list.
+static constexpr uint32_t kStripLeds = LED_MAP[0] ? pixelMapSize(LED_MAP).logical : topologyLeds(LED_LANES);
+static_assert(topologyLeds(LED_LANES) > 0, "LED_LANES is not a valid topology");
+static_assert(!LED_MAP[0] || pixelMapSize(LED_MAP).physical == topologyLeds(LED_LANES),
+              "LED_MAP must cover exactly the LEDs of LED_LANES");
+typedef EffectRegistry<kStripLeds, RainbowDef, FireDef, MeteorDef, KittDef, OffDef, SolidDef, StreamDef, ShowDef,
+                       SpectrumDef, BeatDef, VuDef, SparkleDef, CometDef, FireworkDef>
+    EffectSet;
+
+// Effect animation state and parameters - only touched by the render task
+EffectSet effects;
+
+// Render task settings; the effect on show is tracked by transitions. Owned
+// by the render core and changed only by draining ledCommands.
+uint8_t renderBrightness = 128;
+
+#if STAGE_PROFILE
+// Stages, in the order they run. The UI loop's stages are recorded on the
+// UI core and the rest on the render core; collected by the UI loop.
+enum ProfileStage : uint8_t {
+  STAGE_M5_UPDATE,
+  STAGE_TOUCH,     // Hit-testing and widget handlers, selection redraws included
+  STAGE_SLIDER,    // Slider redraw
+  STAGE_PREVIEW,   // Preview downsample and blit
+  STAGE_LOOP,      // The whole loop() pass, excluding its delay
+  STAGE_COMMANDS,
+  STAGE_EFFECT,    // Effects and crossfade
+  STAGE_ENCODE,    // Output pass
+  STAGE_PRESENT,   // Waiting for the previous frame to leave the wire
+  STAGE_FRAME,     // The whole LED frame
+  STAGE_COUNT
+};
+const char* const kStageNames[STAGE_COUNT] = {
+  "m5.update", "touch", "slider", "preview", "loop", "commands", "effect", "encode", "present", "frame",
+};
+StageProfiler stageProfiler;
+uint32_t overlayLastMs = 0;
+uint32_t overlayLastFrames = 0;  // ledOutput.framesPresented() at the last overlay update
+
+// Run the statement(s) and record their duration under stage
+#define PROFILE_STAGE(stage, ...)                                \
+  do {                                                           \
+    const uint32_t profileStart = profileCycles();               \
+    __VA_ARGS__;                                                 \
+    stageProfiler.record(stage, profileCycles() - profileStart); \
+  } while(0)
+#else
+#define PROFILE_STAGE(stage, ...) \
+  do {                            \
+    __VA_ARGS__;                  \
+  } while(0)
+#endif
+
+// UI -> render core command queue (lock-free, single producer/consumer)
+LedCommandQueue ledCommands;
+// Render -> UI core: commands the serial link applied, so the screen and
+// the saved settings follow, and the text bytes it passed over
+LedCommandQueue remoteChanges;
+SpscQueue<uint8_t, 16> serialKeys;
+TaskHandle_t renderTaskHandle = nullptr;
+volatile uint32_t lastCommandUs = 0;  // micros() of the latest command, for the wake latency
+
+// UI state: what the screen shows. Owned by the UI (Arduino loop) core;
+// changes are forwarded to the render core with sendCommand().
+uint8_t currentEffect = EffectSet::id<SolidDef>();
 uint8_t ledBrightness = 128;  // Current LED brightness (0-255), 50% = 128
-uint32_t solidColor = 0;  // Stored solid color for effect 5
+uint32_t solidColor = 0;  // Stored solid color for the Solid effect
+
+// The three above, as of the last power cycle. UI core only.
+NvsSettingsBackend settingsBackend;
+SettingsStore settingsStore;
+
+// Boot milestones, micros() since the app started
+struct BootTimes {
+  uint32_t firstLedUs;  // First frame of the saved state on the wire
+  uint32_t renderUs;    // Render task running
+  uint32_t displayUs;   // M5.begin() done
+  uint32_t uiUs;        // Interface on the panel
+  uint32_t readyUs;     // Sprites built, touch live
+  bool restored;        // Settings came from NVS
+  bool prebuilt;        // Interface came from UI_IMAGE
+};
+BootTimes bootTimes = {};
 
 // Color definitions for the modern dark theme
 #define BG_COLOR 0x20E4  // Dark gray background (RGB: 33, 37, 41)
@@ -24,60 +245,341 @@ uint32_t solidColor = 0;  // Stored solid color for effect 5
 #define TEXT_WHITE 0xFFFF
 #define SLIDER_BG 0x4228  // Dark slider background
 #define SLIDER_FILL 0x0D7F  // Blue slider fill
-#define OFF_BUTTON_COLOR 0x0D7F  // Blue for off button
+#define BUTTON_COLOR 0x0D7F  // Blue for the Off, Stream and Show buttons
+
+// Forward declarations
+struct Widget;
+void drawInterface();
+void drawHeader(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawEffectTile(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawColorCircle(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawBrightnessSlider(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawButton(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawPreviewBar(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+void drawGradientBackground(LovyanGFX& gfx, int x, int y, int w, int h, int effectType);
+void refreshSelection();
+void updateBrightnessSlider();
+void updatePreview();
+void showFrame(const Framebuffer16& frame);
+void sendCommand(LedCommandType type, uint32_t value);
+int readSerialKey();
+
+// Draws a widget with its top-left corner at (x, y) of gfx: (0, 0) when
+// painting its sprite, its screen position when drawing straight to the panel
+typedef void (*WidgetDrawFn)(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected);
+
+enum WidgetKind : uint8_t {
+  WIDGET_HEADER,
+  WIDGET_EFFECT,
+  WIDGET_COLOR,
+  WIDGET_SLIDER,
+  WIDGET_BUTTON,
+  WIDGET_PREVIEW,
+};
 
-// Button definitions for 2x2 grid layout
-struct Button {
-  int x, y, w, h;
+// One element on screen. Its geometry drives drawing, sprite caching and
+// touch hit-testing alike. Each look (plain, and selected if it has one) is
+// pre-rendered into a PSRAM sprite at boot; redraws are then a single
+// pushSprite() of the widget's rect. If PSRAM runs out the widget is drawn
+// straight to the panel instead.
+struct Widget {
+  WidgetKind kind;
+  uint8_t index;       // Effect or color number
+  int x, y, w, h;      // Bounds as drawn, selection border included
+  int hitPad;          // Touch slop around the bounds, < 0 = not touchable
+  bool round;          // Hit-test the circle inscribed in the bounds
   const char* label;
-  bool selected;
+  WidgetDrawFn draw;
+  uint8_t looks;       // 2 if the widget has a selected look
+  M5Canvas canvas[2];
+  bool ready;
+  bool shownSelected;  // Look currently on the panel
 };
 
-// Effect buttons in 2x2 grid
-Button effectButtons[4] = {
-  {60, 190, 280, 280, "Rainbow", false},   // Top-left
-  {380, 190, 280, 280, "Fire", false},     // Top-right
-  {60, 490, 280, 280, "Meteor", false},    // Bottom-left
-  {380, 490, 280, 280, "KITT", false}      // Bottom-right
+// Live preview of the strips below the row of buttons: the presented frame
+// downsampled to one screen column per pixel
+#define PREVIEW_W 600
+#define PREVIEW_H 40
+
+// The screen, top to bottom: header, a 2x2 grid of effect tiles, 8 color
+// swatches, the brightness slider, a row of effect buttons and the preview.
+// Tiles and buttons come from EffectSet; layoutWidgets() places everything.
+static const int kNumTiles = EffectSet::buttonCount(EFFECT_TILE);
+static const int kNumButtons = EffectSet::buttonCount(EFFECT_BUTTON);
+static const int kNumSwatches = 8;
+static_assert(kNumTiles <= 4, "the effect grid has room for 4 tiles");
+static_assert(kNumButtons >= 1 && kNumButtons <= 12, "the button rows have room for 1-12 buttons");
+
+static const int kNumWidgets = 1 + kNumTiles + kNumSwatches + 1 + kNumButtons + 1;
+Widget widgets[kNumWidgets];
+// Widgets the UI updates directly, by position in the table
+Widget& sliderWidget = widgets[1 + kNumTiles + kNumSwatches];
+Widget& previewWidget = widgets[kNumWidgets - 1];
+
+// Touch lookup: 80 px cells, at most 4 widgets overlap any one cell
+TouchGrid<720, 1280, 80, 4> touchGrid;
+
+// Slider drags are merged: touch samples only update pendingBrightness, and
+// the slider and LEDs follow at most once per display frame
+#define DISPLAY_FPS 60
+bool sliderDragging = false;
+int pendingBrightness = -1;
+uint32_t lastSliderUpdateUs = 0;
+
+uint16_t previewColumns[PREVIEW_W];  // Latest downsample
+uint16_t previewShown[PREVIEW_W];    // What is on the panel now
+uint32_t previewLastFrame = 0;  // ledOutput.framesPresented() at last update
+uint32_t previewLastUs = 0;
+
+// Preview cost per update (downsample + blit), reported every few seconds
+struct PreviewStats {
+  uint32_t updates;
+  uint64_t totalUs;
+  uint32_t maxUs;
+  uint32_t overBudget;  // Updates slower than kPreviewBudgetUs
+  uint32_t lastReportMs;
 };
+PreviewStats previewStats = {};
 
-// Off button at bottom
-Button offButton = {60, 1070, 600, 100, "Off", false};
+// Redraw timings, reported over serial
+struct UiTimings {
+  uint32_t buildUs;        // Rendering every sprite at boot
+  uint32_t fullRedrawUs;   // Blitting the whole interface
+  uint32_t interactions;   // Redraws timed by recordInteraction()
+  const char* lastInteraction;
+  uint32_t lastInteractionUs;
+  uint32_t maxInteractionUs;
+};
+UiTimings uiTimings = {};
 
-// Forward declarations
-void drawInterface();
-void drawHeader();
-void drawEffectButtons();
-void drawBrightnessSlider();
-void drawColorCircles();
-void drawOffButton();
-void drawGradientBackground(int x, int y, int w, int h, int effectType);
-void updateButtonSelection(int oldSelection, int newSelection);
-void solidColorEffect();
+uint32_t streamReportMs = 0;  // Last Stream stats printout
+uint32_t powerReportMs = 0;   // Last current estimate printout
+uint32_t powerReportLimited = 0;  // ledOutput.framesLimited() at that printout
+uint32_t outputReportMs = 0;      // Last transmit error printout
+uint32_t outputReportErrors = 0;  // ledOutput.transmitErrors() at that printout
+uint32_t uiReportMs = 0;            // Last redraw timing printout
+uint32_t uiReportInteractions = 0;  // uiTimings.interactions at that printout
+uint32_t idleReportMs = 0;        // Last idle frame printout
+uint32_t idleReportSkipped = 0;   // IdleStats::skipped at that printout
 
-// Helper function to generate rainbow colors
-uint32_t Wheel(byte WheelPos) {
-  WheelPos = 255 - WheelPos;
-  if(WheelPos < 85) {
-    return strip.Color(255 - WheelPos * 3, 0, WheelPos * 3);
+// Solid colors offered by the swatches (the same 8 hues as the rainbow button)
+const Rgb& swatchColor(int i) {
+  return kSineRainbowPalette.rgb[i * 32];
+}
+
+bool widgetSelected(const Widget& widget) {
+  return widget.looks > 1 && widget.index == currentEffect;
+}
+
+// Paint one look of a widget into its sprite
+void renderWidget(Widget& widget, bool selected) {
+  if(!widget.ready) {
+    return;
   }
-  if(WheelPos < 170) {
-    WheelPos -= 85;
-    return strip.Color(0, WheelPos * 3, 255 - WheelPos * 3);
+  M5Canvas& canvas = widget.canvas[selected];
+  canvas.fillSprite(BG_COLOR);
+  widget.draw(canvas, widget, 0, 0, selected);
+}
+
+bool createWidgetSprites(Widget& widget) {
+  widget.ready = true;
+  for(int look = 0; look < widget.looks; look++) {
+    widget.canvas[look].setColorDepth(16);
+    widget.canvas[look].setPsram(true);
+    widget.ready &= widget.canvas[look].createSprite(widget.w, widget.h) != nullptr;
+  }
+  for(int look = 0; look < widget.looks; look++) {
+    renderWidget(widget, look);
+  }
+  return widget.ready;
+}
+
+// Copy the widget's current look to the panel
+void blitWidget(Widget& widget) {
+  bool selected = widgetSelected(widget);
+  if(widget.ready) {
+    widget.canvas[selected].pushSprite(&M5.Display, widget.x, widget.y);
+  } else {
+    M5.Display.fillRect(widget.x, widget.y, widget.w, widget.h, BG_COLOR);
+    widget.draw(M5.Display, widget, widget.x, widget.y, selected);
+  }
+  widget.shownSelected = selected;
+}
+
+void placeWidget(int i, WidgetKind kind, uint8_t index, int x, int y, int w, int h, int hitPad, bool round,
+                 const char* label, WidgetDrawFn draw, uint8_t looks) {
+  Widget& widget = widgets[i];
+  widget.kind = kind;
+  widget.index = index;
+  widget.x = x;
+  widget.y = y;
+  widget.w = w;
+  widget.h = h;
+  widget.hitPad = hitPad;
+  widget.round = round;
+  widget.label = label;
+  widget.draw = draw;
+  widget.looks = looks;
+}
+
+// Fill in the widget table: the fixed elements, plus a tile or button for
+// every effect EffectSet offers as one
+void layoutWidgets() {
+  int n = 0;
+  placeWidget(n++, WIDGET_HEADER, 0, 0, 0, 720, 180, -1, false, nullptr, drawHeader, 1);
+  // Effect tiles in a 2x2 grid, 280 px tiles plus a 3 px selection border
+  int tile = 0;
+  for(uint8_t e = 0; e < EffectSet::kCount; e++) {
+    if(EffectSet::button(e) == EFFECT_TILE) {
+      placeWidget(n++, WIDGET_EFFECT, e, 57 + (tile % 2) * 320, 187 + (tile / 2) * 300, 286, 286, 0, false,
+                  EffectSet::name(e), drawEffectTile, 2);
+      tile++;
+    }
+  }
+  // Color swatch row: centers 75 px apart, 25 px radius, 40 px hit radius
+  for(int i = 0; i < kNumSwatches; i++) {
+    placeWidget(n++, WIDGET_COLOR, i, 53 + i * 75, 823, 54, 54, 13, true, nullptr, drawColorCircle, 1);
+  }
+  // Label, value and track; the track is inset 25 px so the handle fits
+  placeWidget(n++, WIDGET_SLIDER, 0, 35, 915, 650, 85, 0, false, "Brightness", drawBrightnessSlider, 1);
+  // Buttons: one row of up to 4, 100 px high, two rows of 80 px or three
+  // of 54 px. Each row is 600 px split evenly with 21 px gaps.
+  const int rows = kNumButtons > 8 ? 3 : kNumButtons > 4 ? 2 : 1;
+  const int perRow = (kNumButtons + rows - 1) / rows;
+  const int buttonW = (600 - 21 * (perRow - 1)) / perRow;
+  int button = 0;
+  for(uint8_t e = 0; e < EffectSet::kCount; e++) {
+    if(EffectSet::button(e) == EFFECT_BUTTON) {
+      const int row = button / perRow;
+      const int x = 60 + (button % perRow) * (buttonW + 21);
+      const int y = rows == 1 ? 1070 : rows == 2 ? 1015 + row * 92 : 1013 + row * 62;
+      const int h = rows == 1 ? 100 : rows == 2 ? 80 : 54;
+      placeWidget(n++, WIDGET_BUTTON, e, x, y, buttonW, h, 0, false, EffectSet::name(e), drawButton, 2);
+      button++;
+    }
+  }
+  placeWidget(n++, WIDGET_PREVIEW, 0, 60, 1200, PREVIEW_W, PREVIEW_H, -1, false, nullptr, drawPreviewBar, 1);
+}
+
+// Render the widgets' sprites once and index the touchable ones. The
+// widgets are laid out already.
+void buildUi() {
+  uint32_t start = micros();
+  bool allReady = true;
+  touchGrid.clear();
+  for(int i = 0; i < kNumWidgets; i++) {
+    Widget& widget = widgets[i];
+    allReady &= createWidgetSprites(widget);
+    if(widget.hitPad >= 0) {
+      touchGrid.add(i, widget.x - widget.hitPad, widget.y - widget.hitPad, widget.w + 2 * widget.hitPad,
+                    widget.h + 2 * widget.hitPad);
+    }
+  }
+  uiTimings.buildUs = micros() - start;
+  if(!allReady) {
+    Serial.println("UI: out of PSRAM for sprites, drawing some elements directly");
+  }
+}
+
+// What UI_IMAGE must have been drawn from: this build and this layout
+uint32_t uiImageKey() {
+  const char* build = __DATE__ " " __TIME__;
+  uint32_t key = uiImageKey(kUiImageKeySeed, build, strlen(build));
+  for(int i = 0; i < kNumWidgets; i++) {
+    const Widget& widget = widgets[i];
+    const int32_t geometry[6] = {widget.kind, widget.index, widget.x, widget.y, widget.w, widget.h};
+    key = uiImageKey(key, geometry, sizeof(geometry));
+  }
+  return key;
+}
+
+// Put the static UI on the panel in one blit from UI_IMAGE, then the parts
+// that depend on the state: the selected effect and the slider. The image
+// holds every widget's plain look. False if there is no current image.
+bool showUiImage() {
+  M5Canvas screen(&M5.Display);
+  screen.setColorDepth(16);
+  screen.setPsram(true);
+  if(screen.createSprite(M5.Display.width(), M5.Display.height()) == nullptr) {
+    return false;
+  }
+  bool ok = loadUiImage(UI_IMAGE, uiImageKey(), (uint16_t*)screen.getBuffer(), screen.width(), screen.height());
+  if(ok) {
+    screen.pushSprite(0, 0);
+    for(int i = 0; i < kNumWidgets; i++) {
+      if(widgetSelected(widgets[i])) {
+        blitWidget(widgets[i]);
+      }
+    }
+    blitWidget(sliderWidget);
+    memset(previewShown, 0, sizeof(previewShown));
+    M5.Display.waitDisplay();
+  }
+  screen.deleteSprite();
+  return ok;
+}
+
+// Draw every widget's plain look over the background and save it as
+// UI_IMAGE for the next boot
+void cacheUiImage() {
+  M5Canvas screen(&M5.Display);
+  screen.setColorDepth(16);
+  screen.setPsram(true);
+  if(screen.createSprite(M5.Display.width(), M5.Display.height()) == nullptr) {
+    return;
+  }
+  screen.fillSprite(BG_COLOR);
+  for(int i = 0; i < kNumWidgets; i++) {
+    widgets[i].draw(screen, widgets[i], widgets[i].x, widgets[i].y, false);
+  }
+  if(!saveUiImage(UI_IMAGE, uiImageKey(), (const uint16_t*)screen.getBuffer(), screen.width(), screen.height())) {
+    Serial.printf("UI: could not save %s\n", UI_IMAGE);
+  }
+  screen.deleteSprite();
+}
+
+// Touchable widget under (x, y), or nullptr
+Widget* widgetAt(int x, int y) {
+  const uint8_t* ids;
+  uint8_t count = touchGrid.lookup(x, y, &ids);
+  for(uint8_t i = 0; i < count; i++) {
+    Widget& widget = widgets[ids[i]];
+    if(widget.round) {
+      int radius = widget.w / 2 + widget.hitPad;
+      int dx = x - (widget.x + widget.w / 2);
+      int dy = y - (widget.y + widget.h / 2);
+      if(dx * dx + dy * dy <= radius * radius) {
+        return &widget;
+      }
+    } else if(x >= widget.x - widget.hitPad && x < widget.x + widget.w + widget.hitPad &&
+              y >= widget.y - widget.hitPad && y < widget.y + widget.h + widget.hitPad) {
+      return &widget;
+    }
+  }
+  return nullptr;
+}
+
+// Time one interaction's redraw, including the panel flush. Kept for
+// reportUi(), not printed here: this runs every slider flush, and a client
+// on the serial link that is not reading would stall the UI core.
+void recordInteraction(const char* what, uint32_t start) {
+  M5.Display.waitDisplay();
+  uint32_t us = micros() - start;
+  uiTimings.interactions++;
+  uiTimings.lastInteraction = what;
+  uiTimings.lastInteractionUs = us;
+  if(us > uiTimings.maxInteractionUs) {
+    uiTimings.maxInteractionUs = us;
   }
-  WheelPos -= 170;
-  return strip.Color(WheelPos * 3, 255 - WheelPos * 3, 0);
 }
 
 // Draw gradient backgrounds for effect buttons
-void drawGradientBackground(int x, int y, int w, int h, int effectType) {
-  auto& lcd = M5.Display;
-  
+void drawGradientBackground(LovyanGFX& gfx, int x, int y, int w, int h, int effectType) {
   // First draw the rounded rectangle background
-  lcd.fillRoundRect(x, y, w, h, 15, CARD_COLOR);
+  gfx.fillRoundRect(x, y, w, h, 15, CARD_COLOR);
   
   switch(effectType) {
-    case 0: { // Rainbow gradient - optimized with bands instead of pixels
+    case EffectSet::id<RainbowDef>(): { // Rainbow gradient - optimized with bands instead of pixels
       // Draw rainbow bands inside the button area with padding
       int innerX = x + 5;
       int innerY = y + 5;
@@ -86,543 +588,956 @@ void drawGradientBackground(int x, int y, int w, int h, int effectType) {
       
       int bands = 8;
       for(int i = 0; i < bands; i++) {
-        float hue = (float)i / bands;
-        uint8_t r = (sin(hue * 6.28318 + 0) * 127 + 128);
-        uint8_t g = (sin(hue * 6.28318 + 2.094395) * 127 + 128);
-        uint8_t b = (sin(hue * 6.28318 + 4.18879) * 127 + 128);
-        uint16_t color = lcd.color565(r, g, b);
+        uint16_t color = kSineRainbowPalette.rgb565[i * 256 / bands];
         
         // Draw vertical bands for simplicity
         int bandX = innerX + (i * innerW / bands);
         int bandWidth = innerW / bands + 1;
-        lcd.fillRect(bandX, innerY, bandWidth, innerH - 30, color);
+        gfx.fillRect(bandX, innerY, bandWidth, innerH - 30, color);
       }
       break;
     }
       
-    case 1: { // Fire gradient (orange to red)
+    case EffectSet::id<FireDef>(): { // Fire gradient (orange to red)
       // First ensure we have a dark rounded background
-      lcd.fillRoundRect(x, y, w, h, 15, lcd.color565(100, 20, 0));
+      gfx.fillRoundRect(x, y, w, h, 15, gfx.color565(100, 20, 0));
       // Draw gradient inside the button with padding
       for(int i = 0; i < h - 35; i++) {
-        float gradient = (float)i / (h - 35);
-        uint8_t r = 255;
-        uint8_t g = 140 - (gradient * 100);
-        uint8_t b = 0;
-        uint16_t color = lcd.color565(r, g, b);
-        lcd.fillRect(x + 5, y + 5 + i, w - 10, 1, color);
+        uint16_t color = kEmberPalette.rgb565[i * 255 / (h - 36)];
+        gfx.fillRect(x + 5, y + 5 + i, w - 10, 1, color);
       }
       break;
     }
       
-    case 2: // Meteor (dark with streaks)
+    case EffectSet::id<MeteorDef>(): // Meteor (dark with streaks)
       // Draw diagonal streaks inside the button
-      lcd.fillRoundRect(x, y, w, h, 15, 0x2104);  // Very dark background
+      gfx.fillRoundRect(x, y, w, h, 15, 0x2104);  // Very dark background
       for(int i = 0; i < 4; i++) {
         int sx = x + 20 + i * 60;
         int sy = y + 10;
-        lcd.drawLine(sx, sy, sx + 80, sy + h - 40, 0xC618);
-        lcd.drawLine(sx + 1, sy, sx + 81, sy + h - 40, 0x8410);
+        gfx.drawLine(sx, sy, sx + 80, sy + h - 40, 0xC618);
+        gfx.drawLine(sx + 1, sy, sx + 81, sy + h - 40, 0x8410);
       }
       break;
       
-    case 3: { // KITT (black with red scanner)
-      lcd.fillRoundRect(x, y, w, h, 15, TFT_BLACK);
+    case EffectSet::id<KittDef>(): { // KITT (black with red scanner)
+      gfx.fillRoundRect(x, y, w, h, 15, TFT_BLACK);
       // Draw red scanner bar
       int barY = y + h - 60;
-      lcd.fillRect(x + 20, barY, w - 40, 8, TFT_RED);
+      gfx.fillRect(x + 20, barY, w - 40, 8, TFT_RED);
       // Add glow effect
-      lcd.fillRect(x + 20, barY - 4, w - 40, 4, lcd.color565(128, 0, 0));
-      lcd.fillRect(x + 20, barY + 8, w - 40, 4, lcd.color565(128, 0, 0));
+      gfx.fillRect(x + 20, barY - 4, w - 40, 4, gfx.color565(128, 0, 0));
+      gfx.fillRect(x + 20, barY + 8, w - 40, 4, gfx.color565(128, 0, 0));
       break;
     }
   }
 }
 
-// Draw the main interface
+// Draw the main interface: one blit per widget. The background between
+// widgets is painted once by fillScreen() in setup(), unless UI_IMAGE put
+// the whole interface up instead.
 void drawInterface() {
-  auto& lcd = M5.Display;
-  lcd.fillScreen(BG_COLOR);
-  
-  drawHeader();
-  drawEffectButtons();
-  drawColorCircles();
-  drawBrightnessSlider();
-  drawOffButton();
+  uint32_t start = micros();
+  for(int i = 0; i < kNumWidgets; i++) {
+    blitWidget(widgets[i]);
+  }
+  memset(previewShown, 0, sizeof(previewShown));
+  M5.Display.waitDisplay();
+  uiTimings.fullRedrawUs = micros() - start;
+  Serial.printf("UI: sprites built in %u us, full redraw %u us\n", (unsigned)uiTimings.buildUs,
+                (unsigned)uiTimings.fullRedrawUs);
 }
 
 // Draw the header with title and icons
-void drawHeader() {
-  auto& lcd = M5.Display;
+void drawHeader(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  (void)selected;
   
   // Draw WiFi icon (simplified)
-  lcd.setTextColor(0x07E0);  // Green for WiFi
-  lcd.fillCircle(60, 70, 4, 0x07E0);
-  lcd.drawCircle(60, 70, 12, 0x07E0);
-  lcd.drawCircle(60, 70, 20, 0x07E0);
-  lcd.drawCircle(60, 70, 28, 0x07E0);
+  gfx.setTextColor(0x07E0);  // Green for WiFi
+  gfx.fillCircle(x + 60, y + 70, 4, 0x07E0);
+  gfx.drawCircle(x + 60, y + 70, 12, 0x07E0);
+  gfx.drawCircle(x + 60, y + 70, 20, 0x07E0);
+  gfx.drawCircle(x + 60, y + 70, 28, 0x07E0);
   
   // Title
-  lcd.setTextDatum(textdatum_t::middle_center);
-  lcd.setTextColor(TEXT_WHITE);
-  lcd.setTextSize(4);
-  lcd.drawString("LED Control", lcd.width()/2, 70);
+  gfx.setTextDatum(textdatum_t::middle_center);
+  gfx.setTextColor(TEXT_WHITE);
+  gfx.setTextSize(4);
+  gfx.drawString("LED Control", x + widget.w/2, y + 70);
   
   // Settings icon (gear - simplified)
-  lcd.fillCircle(660, 70, 20, 0x7BEF);  // Gray gear
-  lcd.fillCircle(660, 70, 12, BG_COLOR);  // Inner hole
+  int gearX = x + widget.w - 60;
+  gfx.fillCircle(gearX, y + 70, 20, 0x7BEF);  // Gray gear
+  gfx.fillCircle(gearX, y + 70, 12, BG_COLOR);  // Inner hole
   // Gear teeth
   for(int i = 0; i < 8; i++) {
     float angle = i * 0.785398;  // 45 degrees in radians
-    int x1 = 660 + cos(angle) * 18;
-    int y1 = 70 + sin(angle) * 18;
-    int x2 = 660 + cos(angle) * 24;
-    int y2 = 70 + sin(angle) * 24;
-    lcd.drawLine(x1, y1, x2, y2, 0x7BEF);
-    lcd.drawLine(x1+1, y1, x2+1, y2, 0x7BEF);
-    lcd.drawLine(x1, y1+1, x2, y2+1, 0x7BEF);
+    int x1 = gearX + cos(angle) * 18;
+    int y1 = y + 70 + sin(angle) * 18;
+    int x2 = gearX + cos(angle) * 24;
+    int y2 = y + 70 + sin(angle) * 24;
+    gfx.drawLine(x1, y1, x2, y2, 0x7BEF);
+    gfx.drawLine(x1+1, y1, x2+1, y2, 0x7BEF);
+    gfx.drawLine(x1, y1+1, x2, y2+1, 0x7BEF);
   }
   
   // "Effects" label
-  lcd.setTextDatum(textdatum_t::top_left);
-  lcd.setTextSize(3);
-  lcd.setTextColor(TEXT_WHITE);
-  lcd.drawString("Effects", 60, 140);
+  gfx.setTextDatum(textdatum_t::top_left);
+  gfx.setTextSize(3);
+  gfx.setTextColor(TEXT_WHITE);
+  gfx.drawString("Effects", x + 60, y + 140);
 }
 
-// Draw the 2x2 grid of effect buttons
-void drawEffectButtons() {
-  auto& lcd = M5.Display;
+// Draw one effect button inside its 3 px selection border
+void drawEffectTile(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  int w = widget.w - 6;
+  int h = widget.h - 6;
+  x += 3;
+  y += 3;
+
+  // Draw gradient background
+  drawGradientBackground(gfx, x, y, w, h, widget.index);
   
-  for(int i = 0; i < 4; i++) {
-    // Draw gradient background
-    drawGradientBackground(effectButtons[i].x, effectButtons[i].y, 
-                          effectButtons[i].w, effectButtons[i].h, i);
-    
-    // Draw selection border if selected
-    if(i == currentEffect) {
-      lcd.drawRoundRect(effectButtons[i].x - 2, effectButtons[i].y - 2, 
-                       effectButtons[i].w + 4, effectButtons[i].h + 4, 15, TEXT_WHITE);
-      lcd.drawRoundRect(effectButtons[i].x - 3, effectButtons[i].y - 3, 
-                       effectButtons[i].w + 6, effectButtons[i].h + 6, 15, TEXT_WHITE);
-    }
-    
-    // Draw label at bottom of each button
-    lcd.setTextDatum(textdatum_t::bottom_center);
-    lcd.setTextSize(3);
-    lcd.setTextColor(TEXT_WHITE);
-    lcd.drawString(effectButtons[i].label, 
-                  effectButtons[i].x + effectButtons[i].w/2, 
-                  effectButtons[i].y + effectButtons[i].h - 10);
+  // Draw selection border if selected
+  if(selected) {
+    gfx.drawRoundRect(x - 2, y - 2, w + 4, h + 4, 15, TEXT_WHITE);
+    gfx.drawRoundRect(x - 3, y - 3, w + 6, h + 6, 15, TEXT_WHITE);
   }
+  
+  // Draw label at bottom of each button
+  gfx.setTextDatum(textdatum_t::bottom_center);
+  gfx.setTextSize(3);
+  gfx.setTextColor(TEXT_WHITE);
+  gfx.drawString(widget.label, x + w/2, y + h - 10);
 }
 
-// Draw color selection circles above brightness slider
-void drawColorCircles() {
-  auto& lcd = M5.Display;
-  
-  // Calculate the 8 rainbow colors (same as used in rainbow button)
-  uint32_t rainbowColors[8];
-  int circleY = 850;  // Y position above brightness slider (25px spacing above and below)
-  int startX = 80;
-  int spacing = 75;
+// Draw one color selection circle
+void drawColorCircle(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  (void)selected;
+  int cx = x + widget.w/2;
+  int cy = y + widget.h/2;
   int radius = 25;
   
-  // Generate the same 8 colors used in the rainbow effect
-  for(int i = 0; i < 8; i++) {
-    float hue = (float)i / 8;
-    uint8_t r = (sin(hue * 6.28318 + 0) * 127 + 128);
-    uint8_t g = (sin(hue * 6.28318 + 2.094395) * 127 + 128);
-    uint8_t b = (sin(hue * 6.28318 + 4.18879) * 127 + 128);
-    
-    // Store as RGB565 color for display
-    uint16_t color565 = lcd.color565(r, g, b);
-    
-    // Store as NeoPixel color (RGB format)
-    rainbowColors[i] = strip.Color(r, g, b);
-    
-    // Draw the circle
-    int circleX = startX + (i * spacing);
-    lcd.fillCircle(circleX, circleY, radius, color565);
-    
-    // Add white border for better visibility
-    lcd.drawCircle(circleX, circleY, radius, TEXT_WHITE);
-  }
+  gfx.fillCircle(cx, cy, radius, kSineRainbowPalette.rgb565[widget.index * 32]);
+  
+  // Add white border for better visibility
+  gfx.drawCircle(cx, cy, radius, TEXT_WHITE);
 }
 
-// Draw the brightness slider
-void drawBrightnessSlider() {
-  auto& lcd = M5.Display;
-  
-  // Static variable to track last handle position
-  static int lastHandleX = -1;
+// Slider track in screen coordinates
+int sliderTrackX() { return sliderWidget.x + 25; }
+int sliderTrackW() { return sliderWidget.w - 50; }
+
+// Draw the brightness label, value and slider for the current ledBrightness
+void drawBrightnessSlider(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  (void)selected;
+  int trackX = x + 25;
+  int trackW = widget.w - 50;
   
-  // "Brightness" label (only draw if not already there)
-  if(lastHandleX == -1) {
-    lcd.setTextDatum(textdatum_t::top_left);
-    lcd.setTextSize(3);
-    lcd.setTextColor(TEXT_WHITE);
-    lcd.drawString("Brightness", 60, 920);
-  }
+  // "Brightness" label
+  gfx.setTextDatum(textdatum_t::top_left);
+  gfx.setTextSize(3);
+  gfx.setTextColor(TEXT_WHITE);
+  gfx.drawString(widget.label, trackX, y + 5);
   
-  // Percentage value - clear old value first
-  lcd.fillRect(580, 920, 80, 30, BG_COLOR);
-  lcd.setTextDatum(textdatum_t::top_right);
-  lcd.setTextSize(3);
-  lcd.setTextColor(TEXT_WHITE);
+  // Percentage value
+  gfx.setTextDatum(textdatum_t::top_right);
   int percentage = map(ledBrightness, 0, 255, 0, 100);
   char percStr[10];
   sprintf(percStr, "%d%%", percentage);
-  lcd.drawString(percStr, 660, 920);
+  gfx.drawString(percStr, trackX + trackW, y + 5);
   
   // Slider track position
-  int sliderY = 970;
-  int sliderX = 60;
-  int sliderW = 600;
+  int sliderY = y + 55;
   int sliderH = 8;
   
-  // Calculate new handle position
-  int fillWidth = map(ledBrightness, 0, 255, 0, sliderW);
-  int newHandleX = sliderX + fillWidth;
+  // Calculate handle position
+  int fillWidth = map(ledBrightness, 0, 255, 0, trackW);
+  int handleX = trackX + fillWidth;
   
-  // Only redraw if handle moved
-  if(lastHandleX != newHandleX) {
-    // Clear the entire slider area including handle space (bigger clear area)
-    lcd.fillRect(sliderX - 25, sliderY - 25, sliderW + 50, 50, BG_COLOR);
-    
-    // Redraw slider track
-    lcd.fillRoundRect(sliderX, sliderY, sliderW, sliderH, 4, SLIDER_BG);
-    
-    // Draw slider fill
-    if(fillWidth > 0) {
-      lcd.fillRoundRect(sliderX, sliderY, fillWidth, sliderH, 4, SLIDER_FILL);
+  // Slider track
+  gfx.fillRoundRect(trackX, sliderY, trackW, sliderH, 4, SLIDER_BG);
+  
+  // Slider fill
+  if(fillWidth > 0) {
+    gfx.fillRoundRect(trackX, sliderY, fillWidth, sliderH, 4, SLIDER_FILL);
+  }
+  
+  // Handle
+  gfx.fillCircle(handleX, sliderY + sliderH/2, 18, SLIDER_FILL);
+  gfx.drawCircle(handleX, sliderY + sliderH/2, 18, TEXT_WHITE);
+}
+
+// Re-render the slider off-screen and blit it, so dragging never flickers
+void updateBrightnessSlider() {
+  renderWidget(sliderWidget, false);
+  blitWidget(sliderWidget);
+}
+
+// UI core: apply the latest slider position, at most once per display frame
+// however many touch samples arrived since the last one
+void flushSlider() {
+  uint32_t now = micros();
+  if(pendingBrightness < 0 || now - lastSliderUpdateUs < 1000000 / DISPLAY_FPS) {
+    return;
+  }
+  if(pendingBrightness != ledBrightness) {
+    ledBrightness = pendingBrightness;
+    sendCommand(CMD_SET_BRIGHTNESS, ledBrightness);
+    updateBrightnessSlider();
+    recordInteraction("slider", now);
+  }
+  pendingBrightness = -1;
+  lastSliderUpdateUs = now;
+}
+
+// Preview bar starts out black; updatePreview() paints it column by column
+void drawPreviewBar(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  (void)selected;
+  gfx.fillRect(x, y, widget.w, widget.h, TFT_BLACK);
+}
+
+// UI core: refresh the preview from the last frame the render core
+// presented, at most PREVIEW_FPS times a second. Reads the output buffer in
+// place and never touches the render core, so it cannot slow the LEDs down;
+// a read the render core overlapped is dropped.
+// Only changed columns are redrawn and only their span is pushed.
+void updatePreview() {
+  uint32_t now = micros();
+  uint32_t presented = ledOutput.framesPresented();
+  if(now - previewLastUs < 1000000 / PREVIEW_FPS || presented == previewLastFrame) {
+    return;
+  }
+  previewLastUs = now;
+  if(!previewFrame(ledOutput, previewColumns, PREVIEW_W)) {
+    return;  // Torn by a present; the next update reads the frame after
+  }
+  previewLastFrame = presented;
+
+  // Dirty span
+  int first = 0;
+  while(first < PREVIEW_W && previewColumns[first] == previewShown[first]) {
+    first++;
+  }
+  if(first < PREVIEW_W) {
+    int last = PREVIEW_W - 1;
+    while(previewColumns[last] == previewShown[last]) {
+      last--;
     }
-    
-    // Draw new handle
-    lcd.fillCircle(newHandleX, sliderY + sliderH/2, 18, SLIDER_FILL);
-    lcd.drawCircle(newHandleX, sliderY + sliderH/2, 18, TEXT_WHITE);
-    
-    lastHandleX = newHandleX;
+    for(int c = first; c <= last; c++) {
+      if(previewColumns[c] != previewShown[c]) {
+        if(previewWidget.ready) {
+          previewWidget.canvas[0].drawFastVLine(c, 0, PREVIEW_H, previewColumns[c]);
+        } else {
+          M5.Display.drawFastVLine(previewWidget.x + c, previewWidget.y, PREVIEW_H, previewColumns[c]);
+        }
+        previewShown[c] = previewColumns[c];
+      }
+    }
+    if(previewWidget.ready) {
+      M5.Display.setClipRect(previewWidget.x + first, previewWidget.y, last - first + 1, PREVIEW_H);
+      previewWidget.canvas[0].pushSprite(&M5.Display, previewWidget.x, previewWidget.y);
+      M5.Display.clearClipRect();
+    }
+    M5.Display.waitDisplay();
+  }
+
+  uint32_t us = micros() - now;
+  previewStats.updates++;
+  previewStats.totalUs += us;
+  if(us > previewStats.maxUs) {
+    previewStats.maxUs = us;
+  }
+  previewStats.overBudget += us > kPreviewBudgetUs;
+
+  uint32_t ms = millis();
+  if(ms - previewStats.lastReportMs >= 5000) {
+    Serial.printf("Preview: %u updates, avg %u us, max %u us, %u over %u us budget\n",
+                  (unsigned)previewStats.updates, (unsigned)(previewStats.totalUs / previewStats.updates),
+                  (unsigned)previewStats.maxUs, (unsigned)previewStats.overBudget, (unsigned)kPreviewBudgetUs);
+    previewStats = {};
+    previewStats.lastReportMs = ms;
   }
 }
 
-// Draw the Off button
-void drawOffButton() {
-  auto& lcd = M5.Display;
-  
-  // Draw button background
-  if(currentEffect == 4) {
-    lcd.fillRoundRect(offButton.x, offButton.y, offButton.w, offButton.h, 20, 0x4228);
-    lcd.drawRoundRect(offButton.x, offButton.y, offButton.w, offButton.h, 20, TEXT_WHITE);
-  } else {
-    lcd.fillRoundRect(offButton.x, offButton.y, offButton.w, offButton.h, 20, OFF_BUTTON_COLOR);
+// UI core: while the Stream effect is on, print what is arriving every few
+// seconds. The counters belong to the render core; a torn read only skews
+// one report.
+void reportStream() {
+  uint32_t ms = millis();
+  if(currentEffect != EffectSet::id<StreamDef>() || ms - streamReportMs < 5000) {
+    return;
   }
-  
-  // Draw button text
-  lcd.setTextDatum(textdatum_t::middle_center);
-  lcd.setTextSize(4);
-  lcd.setTextColor(TEXT_WHITE);
-  lcd.drawString("Off", offButton.x + offButton.w/2, offButton.y + offButton.h/2);
+  streamReportMs = ms;
+  const StreamStats& stats = pixelStream.stats();
+  Serial.printf("Stream: %u packets (%u invalid, %u stale), %u frames, %u shown, %u dropped, latency %u us (max %u us)\n",
+                (unsigned)stats.packets, (unsigned)stats.invalidPackets, (unsigned)stats.stalePackets,
+                (unsigned)stats.framesReceived, (unsigned)stats.framesShown, (unsigned)stats.framesDropped,
+                (unsigned)stats.lastLatencyUs, (unsigned)stats.maxLatencyUs);
 }
 
-// Update only the selection borders without redrawing everything
-void updateButtonSelection(int oldSelection, int newSelection) {
-  auto& lcd = M5.Display;
-  
-  // Clear old selection border for effect buttons (0-3)
-  if(oldSelection >= 0 && oldSelection < 4) {
-    // Draw over the old border with background color
-    lcd.drawRoundRect(effectButtons[oldSelection].x - 2, effectButtons[oldSelection].y - 2, 
-                     effectButtons[oldSelection].w + 4, effectButtons[oldSelection].h + 4, 15, BG_COLOR);
-    lcd.drawRoundRect(effectButtons[oldSelection].x - 3, effectButtons[oldSelection].y - 3, 
-                     effectButtons[oldSelection].w + 6, effectButtons[oldSelection].h + 6, 15, BG_COLOR);
+// UI core: print the estimated LED current every few seconds while the
+// limiter is holding brightness back. Same torn-read caveat as above.
+void reportPower() {
+  uint32_t ms = millis();
+  if(ms - powerReportMs < 5000) {
+    return;
   }
-  
-  // Draw new selection border for effect buttons (0-3)
-  if(newSelection >= 0 && newSelection < 4) {
-    lcd.drawRoundRect(effectButtons[newSelection].x - 2, effectButtons[newSelection].y - 2, 
-                     effectButtons[newSelection].w + 4, effectButtons[newSelection].h + 4, 15, TEXT_WHITE);
-    lcd.drawRoundRect(effectButtons[newSelection].x - 3, effectButtons[newSelection].y - 3, 
-                     effectButtons[newSelection].w + 6, effectButtons[newSelection].h + 6, 15, TEXT_WHITE);
+  powerReportMs = ms;
+  uint32_t limited = ledOutput.framesLimited();
+  if(limited == powerReportLimited) {
+    return;
   }
-  
-  // Update Off button appearance if needed
-  if((oldSelection == 4 && newSelection != 4) || (oldSelection != 4 && newSelection == 4)) {
-    drawOffButton();
+  Serial.printf("Power: %u mA, brightness %u of %u, %u frames limited\n", (unsigned)ledOutput.currentMa(),
+                (unsigned)ledOutput.limitedBrightness(), (unsigned)renderBrightness,
+                (unsigned)(limited - powerReportLimited));
+  for(uint8_t i = 0; i < ledOutput.laneCount(); i++) {
+    Serial.printf("  lane %u: %u mA\n", (unsigned)i, (unsigned)ledOutput.laneCurrentMa(i));
   }
+  powerReportLimited = limited;
 }
 
-// Effect 1: Moving Rainbow
-void rainbowEffect() {
-  for(int i = 0; i < NUM_LEDS; i++) {
-    int pixelHue = ((i * 256 / NUM_LEDS) + rainbowOffset) & 255;
-    strip.setPixelColor(i, Wheel(pixelHue));
+// UI core: every few seconds while lane frames fail to start, how many
+void reportOutputErrors() {
+  uint32_t ms = millis();
+  if(ms - outputReportMs < 5000) {
+    return;
+  }
+  outputReportMs = ms;
+  uint32_t errors = ledOutput.transmitErrors();
+  if(errors == outputReportErrors) {
+    return;
   }
-  rainbowOffset = (rainbowOffset + 1) & 255;
+  Serial.printf("LED: %u lane frames failed to start\n", (unsigned)(errors - outputReportErrors));
+  outputReportErrors = errors;
 }
 
-// Effect 2: Fire effect with flickering flames
-void fireEffect() {
-  static byte heat[144];
-  
-  // Cool down every cell a little
-  for(int i = 0; i < NUM_LEDS; i++) {
-    int cooling = heat[i] - random(0, ((55 * 10) / NUM_LEDS) + 2);
-    heat[i] = (cooling < 0) ? 0 : cooling;
+// UI core: every few seconds while the interface is being used, how many
+// redraws and how long they took
+void reportUi() {
+  uint32_t ms = millis();
+  if(ms - uiReportMs < 5000) {
+    return;
   }
-  
-  // Heat from each cell drifts up and diffuses
-  for(int k = NUM_LEDS - 1; k >= 2; k--) {
-    heat[k] = (heat[k - 1] + heat[k - 2] + heat[k - 2]) / 3;
+  uiReportMs = ms;
+  if(uiTimings.interactions == uiReportInteractions) {
+    return;
   }
-  
-  // Randomly ignite new sparks near the bottom
-  if(random(255) < 120) {
-    int y = random(7);
-    int heating = heat[y] + random(160, 255);
-    heat[y] = (heating > 255) ? 255 : heating;
+  Serial.printf("UI: %u redraws, last %s %u us (max %u us)\n",
+                (unsigned)(uiTimings.interactions - uiReportInteractions), uiTimings.lastInteraction,
+                (unsigned)uiTimings.lastInteractionUs, (unsigned)uiTimings.maxInteractionUs);
+  uiReportInteractions = uiTimings.interactions;
+}
+
+// UI core: every few seconds while frames are being skipped, how many, how
+// idle the render core has been and how long waking it took. Same torn-read
+// caveat as above.
+void reportIdle() {
+  uint32_t ms = millis();
+  if(ms - idleReportMs < 5000) {
+    return;
   }
-  
-  // Convert heat to LED colors
-  for(int j = 0; j < NUM_LEDS; j++) {
-    byte temperature = heat[j];
-    byte t192 = round((temperature / 255.0) * 191);
-    
-    byte heatramp = t192 & 0x3F; // 0..63
-    heatramp <<= 2; // scale up to 0..252
-    
-    if(t192 > 0x80) {
-      // Hottest: white
-      strip.setPixelColor(j, strip.Color(255, 255, heatramp));
-    } else if(t192 > 0x40) {
-      // Medium: yellow to orange
-      strip.setPixelColor(j, strip.Color(255, heatramp, 0));
-    } else {
-      // Coolest: black to red
-      strip.setPixelColor(j, strip.Color(heatramp, 0, 0));
+  idleReportMs = ms;
+  const IdleStats& stats = idleGovernor.stats();
+  if(stats.skipped == idleReportSkipped) {
+    return;
+  }
+  Serial.printf("Idle: %u of %u frames skipped, %u refreshed for dithering, render core %.0f%% idle%s\n",
+                (unsigned)stats.skipped, (unsigned)stats.frames, (unsigned)stats.refreshed,
+                stats.idleFraction() * 100, idleGovernor.asleep() ? ", asleep" : "");
+  Serial.printf("  %u wakeups, latency %u us (avg %u us, max %u us)\n", (unsigned)stats.wakeups,
+                (unsigned)stats.lastWakeUs, (unsigned)stats.avgWakeUs(), (unsigned)stats.maxWakeUs);
+  idleReportSkipped = stats.skipped;
+}
+
+#if STAGE_PROFILE
+void printProfile() {
+  Serial.printf("%-10s %8s %8s %10s %10s %10s %10s\n", "stage", "count", "dropped", "min us", "avg us", "p99 us",
+                "max us");
+  for(uint8_t i = 0; i < STAGE_COUNT; i++) {
+    StageSummary s = stageProfiler.summary(i);
+    Serial.printf("%-10s %8u %8u %10.1f %10.1f %10.1f %10.1f\n", stageProfiler.stageName(i), (unsigned)s.count,
+                  (unsigned)s.dropped, s.minUs, s.avgUs, s.p99Us, s.maxUs);
+  }
+}
+
+// LED frame rate over the last half second and frame time since the last
+// reset, over the space under the title
+void drawFpsOverlay(uint32_t ms) {
+  uint32_t frames = ledOutput.framesPresented();
+  float fps = (frames - overlayLastFrames) * 1000.0f / (ms - overlayLastMs);
+  overlayLastFrames = frames;
+  StageSummary frame = stageProfiler.summary(STAGE_FRAME);
+  StageSummary ui = stageProfiler.summary(STAGE_LOOP);
+  char text[64];
+  snprintf(text, sizeof(text), "%.1f fps  frame %.2f/%.2f ms  ui %.2f ms", fps, frame.avgUs / 1000,
+           frame.p99Us / 1000, ui.p99Us / 1000);
+  // Between the title and the "Effects" label, padded with the background
+  // to the widest the line gets so the old text is overwritten in one pass
+  M5.Display.setTextDatum(textdatum_t::middle_center);
+  M5.Display.setTextColor(0x7BEF, BG_COLOR);
+  M5.Display.setTextSize(2);
+  M5.Display.setTextPadding(M5.Display.textWidth("999.9 fps  frame 99.99/99.99 ms  ui 99.99 ms"));
+  M5.Display.drawString(text, 360, 112);
+  M5.Display.setTextPadding(0);
+}
+
+// UI core: drain the stage rings, answer serial requests and refresh the
+// overlay twice a second
+void updateProfile() {
+  stageProfiler.collect();
+  int c;
+  while((c = readSerialKey()) >= 0) {
+    if(c == 'p') {
+      printProfile();
+    } else if(c == 'r') {
+      stageProfiler.reset();
+      Serial.println("Profile: reset");
     }
   }
+  uint32_t ms = millis();
+  if(FPS_OVERLAY && ms - overlayLastMs >= 500) {
+    drawFpsOverlay(ms);
+    overlayLastMs = ms;
+  }
 }
+#endif
 
-// Effect 3: Meteor shower effect
-void meteorEffect() {
-  static int meteorPos[3] = {0, 48, 96};  // 3 meteors
-  static int meteorSpeed[3] = {2, 3, 2};
-  
-  // Fade all LEDs
-  for(int i = 0; i < NUM_LEDS; i++) {
-    uint32_t color = strip.getPixelColor(i);
-    uint8_t r = (color >> 16) & 0xFF;
-    uint8_t g = (color >> 8) & 0xFF;
-    uint8_t b = color & 0xFF;
-    strip.setPixelColor(i, strip.Color(r * 0.85, g * 0.85, b * 0.85));
+// Draw the Off, Stream or Show button; selected = that effect is on
+void drawButton(LovyanGFX& gfx, const Widget& widget, int x, int y, bool selected) {
+  // Draw button background
+  if(selected) {
+    gfx.fillRoundRect(x, y, widget.w, widget.h, 20, 0x4228);
+    gfx.drawRoundRect(x, y, widget.w, widget.h, 20, TEXT_WHITE);
+  } else {
+    gfx.fillRoundRect(x, y, widget.w, widget.h, 20, BUTTON_COLOR);
   }
   
-  // Draw meteors
-  for(int m = 0; m < 3; m++) {
-    // Draw meteor tail
-    for(int i = 0; i < 12; i++) {
-      int pos = meteorPos[m] - i;
-      if(pos >= 0 && pos < NUM_LEDS) {
-        uint8_t brightness = 255 - (i * 20);
-        // Cycle through colors for each meteor
-        if(m == 0) strip.setPixelColor(pos, strip.Color(brightness, brightness/2, brightness));  // Blue-white
-        else if(m == 1) strip.setPixelColor(pos, strip.Color(brightness, brightness/4, brightness/2));  // Purple
-        else strip.setPixelColor(pos, strip.Color(brightness/2, brightness, brightness/3));  // Cyan
-      }
+  // Draw button text, a size smaller if the label does not fit
+  gfx.setTextDatum(textdatum_t::middle_center);
+  gfx.setTextSize(4);
+  if(gfx.textWidth(widget.label) > widget.w - 20) {
+    gfx.setTextSize(3);
+  }
+  gfx.setTextColor(TEXT_WHITE);
+  gfx.drawString(widget.label, x + widget.w/2, y + widget.h/2);
+}
+
+// Blit the widgets whose selected look no longer matches currentEffect
+void refreshSelection() {
+  for(int i = 0; i < kNumWidgets; i++) {
+    if(widgetSelected(widgets[i]) != widgets[i].shownSelected) {
+      blitWidget(widgets[i]);
     }
-    
-    // Move meteor
-    meteorPos[m] += meteorSpeed[m];
-    if(meteorPos[m] >= NUM_LEDS + 12) {
-      meteorPos[m] = -12;
+  }
+}
+
+// UI core: switch effect and update the selection on screen
+void selectEffect(uint8_t effect, const char* what) {
+  uint32_t redrawStart = micros();
+  currentEffect = effect;
+  sendCommand(CMD_SET_EFFECT, currentEffect);
+  refreshSelection();
+  recordInteraction(what, redrawStart);
+}
+
+// UI core: act on a tap
+void onWidgetPressed(const Widget& widget, int x) {
+  switch(widget.kind) {
+    case WIDGET_EFFECT:
+    case WIDGET_BUTTON:
+      if(currentEffect != widget.index) {  // Only update if selection changed
+        selectEffect(widget.index, widget.label);
+      }
+      break;
+    case WIDGET_COLOR:
+      // Set solid color and switch to solid color effect
+      solidColor = packColor(swatchColor(widget.index));
+      sendCommand(CMD_SET_COLOR, solidColor);
+      selectEffect(EffectSet::id<SolidDef>(), "color");
+      break;
+    case WIDGET_SLIDER:
+      sliderDragging = true;
+      pendingBrightness = constrain(map(x, sliderTrackX(), sliderTrackX() + sliderTrackW(), 0, 255), 0, 255);
+      break;
+    default:
+      break;
+  }
+}
+
+// Encode a rendered frame at renderBrightness and queue it for the strip.
+// Returns as soon as transmission has started; only waits if the previous
+// frame is still on the wire.
+void showFrame(const Framebuffer16& frame) {
+  PROFILE_STAGE(STAGE_ENCODE, ledOutput.encode(frame, renderBrightness));
+  PROFILE_STAGE(STAGE_PRESENT, ledOutput.present());
+}
+
+// UI core: hand a change to the render core. The queue is drained every
+// frame, so it only fills up if the render task is stalled; wait rather than
+// lose an effect change.
+void sendCommand(LedCommandType type, uint32_t value) {
+  LedCommand cmd = {type, value};
+  lastCommandUs = micros();
+  while(!ledCommands.push(cmd)) {
+    delay(1);
+  }
+  // Cuts a low-power tick short; ignored while the render core runs frames
+  xTaskNotifyGive(renderTaskHandle);
+}
+
+// Render core: apply one command from the UI or the serial link. False if
+// it is out of range (only the link can send one).
+bool applyCommand(const LedCommand& cmd) {
+  switch(cmd.type) {
+    case CMD_SET_EFFECT:
+      if(cmd.value >= EffectSet::kCount) {
+        return false;
+      }
+      effects.onSelect(cmd.value);
+      transitions.select(cmd.value);
+      return true;
+    case CMD_SET_BRIGHTNESS:
+      if(cmd.value > 255) {
+        return false;
+      }
+      renderBrightness = cmd.value;
+      return true;
+    case CMD_SET_COLOR:
+      effects.state<SolidDef>().color = toRgb16(unpackColor(cmd.value));
+      return true;
+    case CMD_SET_PARAM:
+      return effects.setParam(cmd.value >> 24, (cmd.value >> 16) & 0xFF, cmd.value & 0xFFFF);
+  }
+  return false;
+}
+
+// Render core: apply everything the UI has sent since the last frame.
+// Returns true if there was anything.
+bool applyCommands() {
+  LedCommand cmd;
+  bool applied = false;
+  while(ledCommands.pop(cmd)) {
+    applied = true;
+    applyCommand(cmd);
+  }
+  return applied;
+}
+
+#if SERIAL_LINK
+// Render core: the serial link's requests. Commands apply at once and are
+// passed on to the UI; pixels go into the Stream effect's frame.
+class LinkHandler : public SerialLinkHandler {
+ public:
+  bool command(const LedCommand& cmd) override {
+    if(!applyCommand(cmd)) {
+      return false;
     }
+    remoteChanges.push(cmd);
+    return true;
+  }
+
+  void pixels(uint32_t firstLed, const uint8_t* rgb, uint32_t count, bool push) override {
+    pixelStream.handlePixels(firstLed, rgb, count, push, micros());
+  }
+
+  void stats(SerialStatsReply& reply) override {
+    const uint32_t ms = millis();
+    const uint32_t frames = ledOutput.framesPresented();
+    reply.uptimeMs = ms;
+    reply.effect = transitions.effect();
+    reply.brightness = renderBrightness;
+    // Since the previous query
+    reply.fps = ms != lastQueryMs_ ? (uint16_t)((frames - lastFrames_) * 10000ULL / (ms - lastQueryMs_)) : 0;
+    reply.framesPresented = frames;
+    reply.framesShown = pixelStream.stats().framesShown;
+    reply.framesDropped = pixelStream.stats().framesDropped;
+    lastQueryMs_ = ms;
+    lastFrames_ = frames;
+  }
+
+  void text(uint8_t c) override {
+    serialKeys.push(c);
+  }
+
+ private:
+  uint32_t lastQueryMs_ = 0;
+  uint32_t lastFrames_ = 0;
+};
+
+UsbSerialPort serialPort;
+LinkHandler linkHandler;
+SerialLink serialLink;
+#endif
+
+// Render core: drain the serial link. Returns true if it changed anything.
+bool pollSerialLink() {
+#if SERIAL_LINK
+  if(serialLink.poll() == 0) {
+    return false;
   }
+  idleGovernor.request(micros());
+  return true;
+#else
+  return false;
+#endif
 }
 
-// Effect 4: KITT Knight Rider scanner effect
-void kittEffect() {
-  static int position = 0;
-  static int direction = 4;  // Move 4 LEDs at a time for much faster speed
-  
-  // Fade all LEDs
-  for(int i = 0; i < NUM_LEDS; i++) {
-    uint32_t color = strip.getPixelColor(i);
-    uint8_t r = (color >> 16) & 0xFF;
-    uint8_t g = (color >> 8) & 0xFF;
-    uint8_t b = color & 0xFF;
-    strip.setPixelColor(i, strip.Color(r * 0.75, g * 0.75, b * 0.75));
+// UI core: follow what the serial link changed on the render core
+void applyRemoteChanges() {
+  LedCommand cmd;
+  while(remoteChanges.pop(cmd)) {
+    switch(cmd.type) {
+      case CMD_SET_EFFECT:
+        currentEffect = cmd.value;
+        refreshSelection();
+        break;
+      case CMD_SET_BRIGHTNESS:
+        ledBrightness = cmd.value;
+        updateBrightnessSlider();
+        break;
+      case CMD_SET_COLOR:
+        solidColor = cmd.value;
+        break;
+      case CMD_SET_PARAM:
+        break;
+    }
   }
-  
-  // Draw the scanner with trailing effect
-  int scannerWidth = 8;
-  for(int i = 0; i < scannerWidth; i++) {
-    int pos = position - i;
-    if(pos >= 0 && pos < NUM_LEDS) {
-      // Create brightness falloff for the trail
-      uint8_t brightness = 255 - (i * 30);
-      strip.setPixelColor(pos, strip.Color(brightness, 0, 0));
+}
+
+// UI core: next byte typed on the serial port, or -1
+int readSerialKey() {
+#if SERIAL_LINK
+  uint8_t c;
+  return serialKeys.pop(c) ? c : -1;
+#else
+  return Serial.available() > 0 ? Serial.read() : -1;
+#endif
+}
+
+#if AUDIO_INPUT
+// Microphone capture and analysis, on the UI core so the render core never
+// waits for audio. record() queues a block and returns once the driver has
+// room for it, by which time the block queued two calls earlier is full.
+void audioTask(void* param) {
+  (void)param;
+  uint32_t n = 0;
+  for(;;) {
+    if(!M5.Mic.record(audioBlocks[n % 3], AudioAnalyzer::kHop, AUDIO_RATE)) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    if(n >= 2 && audioAnalyzer.process(audioBlocks[(n + 1) % 3], AudioAnalyzer::kHop) > 0) {
+      audioFeed.publish(audioAnalyzer.features());
     }
+    n++;
   }
-  
-  // Move the scanner much faster
-  position += direction;
-  
-  // Bounce at the ends
-  if(position >= NUM_LEDS - 1) {
-    direction = -4;
-    position = NUM_LEDS - 1;
-  } else if(position <= 0) {
-    direction = 4;
-    position = 0;
+}
+#endif
+
+// Render core: dithering only matters while it still changes the bytes on
+// the wire; a black or full-level frame comes out the same every time
+bool ditherVisible = true;
+
+// Render core: what this frame slot needs, from whether anything changed
+FrameWork idleFrameWork(bool commands) {
+  if(IDLE_SLEEP_MS == 0) {
+    return FRAME_RENDER;
   }
+  if(commands) {
+    idleGovernor.request(lastCommandUs);
+  }
+  const bool dirty = commands || transitions.transitioning() || !effects.still(transitions.effect()) ||
+                     !ledOutput.limitSettled();
+  const FrameWork work = idleGovernor.frame(micros(), dirty, LED_DITHER && ditherVisible);
+  if(work == FRAME_RENDER) {
+    ditherVisible = true;
+  }
+  return work;
 }
 
-// Solid color effect - fill entire strip with selected color
-void solidColorEffect() {
-  for(int i = 0; i < NUM_LEDS; i++) {
-    strip.setPixelColor(i, solidColor);
+// LED render/output loop, pinned to RENDER_CORE so LCD redraws and touch
+// handling on the other core can no longer stall the animation
+void renderTask(void* param) {
+  (void)param;
+  frameScheduler.begin(micros(), TARGET_FPS);
+  idleGovernor.begin(micros(), IDLE_SLEEP_MS * 1000UL);
+  const Framebuffer16* frame = &transitions.render(0);
+  for(;;) {
+    bool rendered = false;
+    if(frameScheduler.frameDue(micros())) {
+      PROFILE_STAGE(STAGE_FRAME, {
+        bool commands;
+        PROFILE_STAGE(STAGE_COMMANDS, commands = applyCommands() | pollSerialLink());
+        switch(idleFrameWork(commands)) {
+          case FRAME_RENDER:
+            PROFILE_STAGE(STAGE_EFFECT, frame = &transitions.render(frameScheduler.frameDeltaUs()));
+            showFrame(*frame);
+            idleGovernor.frameRendered(micros());
+            break;
+          case FRAME_REFRESH:
+            // Unchanged frame, encoded again for the next dither step; not
+            // sent if that changes nothing
+            PROFILE_STAGE(STAGE_ENCODE, ledOutput.encode(*frame, renderBrightness));
+            if(ledOutput.encodedUnchanged()) {
+              ditherVisible = false;
+            } else {
+              PROFILE_STAGE(STAGE_PRESENT, ledOutput.present());
+            }
+            break;
+          case FRAME_SETTLE:
+            // Left on the strip while asleep, so without dithering
+            ledOutput.setCorrection(LED_GAMMA, false);
+            showFrame(*frame);
+            ledOutput.setCorrection(LED_GAMMA, LED_DITHER);
+            break;
+          case FRAME_SKIP:
+            break;
+        }
+      });
+      frameScheduler.frameDone(micros());
+      rendered = true;
+    }
+
+    if(idleGovernor.asleep()) {
+      // Low-power tick: block until sendCommand() notifies or the tick is up,
+      // then restart the frame grid without counting the gap as missed
+      const uint32_t start = micros();
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_TICK_MS));
+      idleGovernor.idle(micros() - start);
+      frameScheduler.resume(micros());
+      continue;
+    }
+
+    // Sleep off whole ticks until the next deadline and poll the last
+    // partial one so frames start on time. Never run a whole frame without
+    // blocking at least once, or the idle task (and its watchdog) starves.
+    uint32_t idleUs = frameScheduler.usUntilNextFrame(micros());
+    const uint32_t start = micros();
+    if(idleUs >= 1000) {
+      vTaskDelay(pdMS_TO_TICKS(idleUs / 1000));
+    } else if(rendered && idleUs == 0) {
+      vTaskDelay(1);
+    }
+    idleGovernor.idle(micros() - start);
   }
 }
 
+// Boot milestones over serial
+void reportBoot() {
+  Serial.printf("Boot: first LED frame %u us (%s), render task %u us, display %u us, UI %u us (%s), ready %u us\n",
+                (unsigned)bootTimes.firstLedUs, bootTimes.restored ? "saved state" : "defaults",
+                (unsigned)bootTimes.renderUs, (unsigned)bootTimes.displayUs, (unsigned)bootTimes.uiUs,
+                bootTimes.prebuilt ? "image" : "drawn", (unsigned)bootTimes.readyUs);
+}
+
+// Boot order is by what the user sees first: the LEDs come back in their
+// saved state before anything else, the render task starts, and only then
+// the display and the UI, which takes the longest
 void setup() {
+  // Last power cycle's state
+  settingsStore.begin(settingsBackend, SavedSettings{currentEffect, ledBrightness, solidColor}, SETTINGS_SAVE_MS);
+  const SavedSettings& saved = settingsStore.settings();
+  if(saved.effect < EffectSet::kCount) {
+    currentEffect = saved.effect;
+  }
+  ledBrightness = saved.brightness;
+  solidColor = saved.color;
+  bootTimes.restored = settingsStore.loaded();
+
+  // LED strips
+  const bool topologyValid = parseTopology(LED_LANES, ledTopology);
+  if(!topologyValid) {
+    parseTopology("54:144:GRB", ledTopology);
+  }
+  LedTransmitter* transmitters[StripTopology::kMaxLanes];
+  uint8_t failedLanes = 0;  // Bit per lane whose RMT channel did not start
+  for(uint8_t i = 0; i < ledTopology.laneCount; i++) {
+    if(!laneTransmitters[i].begin(ledTopology.lanes[i].pin)) {
+      failedLanes |= 1 << i;
+    }
+    transmitters[i] = &laneTransmitters[i];
+  }
+  ledOutput.begin(ledTopology, transmitters);
+  if(strlen(LED_MAP) > 0) {
+    // The output keeps the map as runs per lane
+    PixelMap pixelMap;
+    parsePixelMap(LED_MAP, pixelMap);
+    ledOutput.setPixelMap(&pixelMap);
+  }
+  ledOutput.setCorrection(LED_GAMMA, LED_DITHER);
+  ledOutput.setPowerLimit(LED_MAX_MA);
+#if STAGE_PROFILE
+  stageProfiler.begin(kStageNames, STAGE_COUNT);
+#endif
+  // Effects render through the registry, built for the logical length. The
+  // Stream effect's buffers exist from here; its sockets open below.
+  effects.state<FireDef>().engine.begin(kStripLeds, FIRE_SEGMENTS, true);
+  bool streamOpen = pixelStream.begin(kStripLeds, 0, 0, STREAM_UNIVERSE);
+  transitions.begin(kStripLeds, EffectSet::renderFn, &effects);
+  transitions.setDurationUs(TRANSITION_MS * 1000UL);
+  renderBrightness = ledBrightness;
+  effects.state<SolidDef>().color = toRgb16(unpackColor(solidColor));
+  effects.onSelect(currentEffect);
+  transitions.cut(currentEffect);
+  showFrame(transitions.render(0));
+  bootTimes.firstLedUs = micros();
+
+  // Recording for the Show effect, streamed from flash as it plays
+  bool animFound = false;
+  if(LittleFS.begin()) {
+    FILE* animFile = fopen(ANIM_FILE, "rb");
+    if(animFile != nullptr) {
+      animFound = true;
+      animSource.begin(animFile);
+      animPlayer.open(animSource);
+    }
+  }
+
+  // Network input for the Stream effect. WiFi connects in the background and
+  // the sockets receive once it is up; without WiFi the effect stays dark.
+  if(strlen(WIFI_SSID) > 0) {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    streamOpen &= pixelStream.listen(PixelStream::kDdpPort, PixelStream::kE131Port);
+  }
+#if AUDIO_INPUT
+  // Audio effects stay silent until the microphone delivers
+  effects.state<SpectrumDef>().feed = &audioFeed;
+  effects.state<BeatDef>().feed = &audioFeed;
+  effects.state<VuDef>().feed = &audioFeed;
+#endif
+#if SERIAL_LINK
+  // USB CDC is up before setup(); room for a few frames between polls, and
+  // for whole replies on the way out
+  Serial.setRxBufferSize(SERIAL_RX_BUFFER);
+  const bool serialTxGrown = serialPort.begin();
+  serialLink.begin(serialPort, linkHandler, SERIAL_POLL_BYTES);
+#endif
+  xTaskCreatePinnedToCore(renderTask, "render", 8192, nullptr, configMAX_PRIORITIES - 2,
+                          &renderTaskHandle, RENDER_CORE);
+  bootTimes.renderUs = micros();
+
   auto cfg = M5.config();
   cfg.output_power  = true;   // keep Grove 5V on
-  cfg.clear_display = true;   // force clean panel each boot
+  cfg.clear_display = false;  // the UI is drawn over the whole panel below
+  cfg.serial_baudrate = 0;    // USB CDC is already up, and the render core reads it
   M5.begin(cfg);
-
-  delay(50);                  // let LCD/backlight settle
+  // Strips powered from the Grove port only light up now; send the frame again
+  sendCommand(CMD_SET_BRIGHTNESS, ledBrightness);
 
   auto& lcd = M5.Display;     // single display owner
   lcd.setColorDepth(16);      // RGB565
   lcd.setSwapBytes(false);    // if you still get green, change to 'true'
-  lcd.fillScreen(BG_COLOR);
+  bootTimes.displayUs = micros();
 
-  // NeoPixel
-  strip.begin();
-  strip.clear();
-  strip.setBrightness(ledBrightness);
-  strip.show();
-  
-  // Draw initial UI
-  drawInterface();
+  // The interface: in one blit from UI_IMAGE if this build saved one,
+  // otherwise from sprites further down
+  layoutWidgets();
+  bootTimes.prebuilt = showUiImage();
+  if(bootTimes.prebuilt) {
+    bootTimes.uiUs = micros();
+  }
+
+  // Reported now that serial is up
+  if(!topologyValid) {
+    Serial.println("Invalid LED_LANES, fell back to 54:144:GRB");
+  }
+  for(uint8_t i = 0; i < ledTopology.laneCount; i++) {
+    if(failedLanes & (1 << i)) {
+      Serial.printf("LED: lane %u on GPIO %d did not start, it stays dark\n", (unsigned)i, ledTopology.lanes[i].pin);
+    }
+  }
+  if(animPlayer.isOpen()) {
+    Serial.printf("Show: %s, %u frames of %u LEDs\n", ANIM_FILE, (unsigned)animPlayer.header().frameCount,
+                  (unsigned)animPlayer.header().numLeds);
+  } else if(animFound) {
+    Serial.printf("Show: %s is not a .lan recording\n", ANIM_FILE);
+  }
+  if(!streamOpen) {
+    Serial.println("Stream: could not open the UDP sockets");
+  }
+#if SERIAL_LINK
+  if(!serialTxGrown) {
+    Serial.println("Serial: transmit buffer not grown, large replies go out in pieces");
+  }
+#endif
+
+#if AUDIO_INPUT
+  // The microphone shares its I2S bus with the speaker
+  M5.Speaker.end();
+  if(M5.Mic.begin()) {
+    audioAnalyzer.begin(AUDIO_RATE);
+    xTaskCreatePinnedToCore(audioTask, "audio", 4096, nullptr, 1, &audioTaskHandle, xPortGetCoreID());
+  } else {
+    Serial.println("Audio: microphone did not start");
+  }
+#endif
+
+  // Pre-render the UI into sprites for redraws. Without an image the first
+  // draw waits for them, and its result is saved for the next boot.
+  buildUi();
+  if(!bootTimes.prebuilt) {
+    lcd.fillScreen(BG_COLOR);
+    drawInterface();
+    bootTimes.uiUs = micros();
+    cacheUiImage();
+  }
+  bootTimes.readyUs = micros();
+  reportBoot();
 }
 
-void loop() {
-  M5.update();
-  
-  // Check for touch input
+// Touch dispatch: hit-test new presses and track slider drags
+void handleTouch() {
   if(M5.Touch.getCount()) {
     auto touch = M5.Touch.getDetail();
     
-    // Check for button presses
     if(touch.wasPressed()) {
-      // Check for color circle taps
-      int circleY = 820;
-      int startX = 80;
-      int spacing = 75;
-      int radius = 25;
-      int hitRadius = 40;  // Larger hit radius for easier tapping
-      
-      for(int i = 0; i < 8; i++) {
-        int circleX = startX + (i * spacing);
-        int dx = touch.x - circleX;
-        int dy = touch.y - circleY;
-        int distance = sqrt(dx*dx + dy*dy);
-        
-        if(distance <= hitRadius) {
-          // Calculate the color for this circle (same as in drawColorCircles)
-          float hue = (float)i / 8;
-          uint8_t r = (sin(hue * 6.28318 + 0) * 127 + 128);
-          uint8_t g = (sin(hue * 6.28318 + 2.094395) * 127 + 128);
-          uint8_t b = (sin(hue * 6.28318 + 4.18879) * 127 + 128);
-          
-          // Set solid color and switch to solid color effect
-          solidColor = strip.Color(r, g, b);
-          int oldEffect = currentEffect;
-          currentEffect = 5;  // Solid color mode
-          
-          // Fill strip immediately
-          for(int led = 0; led < NUM_LEDS; led++) {
-            strip.setPixelColor(led, solidColor);
-          }
-          strip.show();
-          
-          updateButtonSelection(oldEffect, currentEffect);
-          break;
-        }
-      }
-      
-      // Check which effect button was pressed
-      for(int i = 0; i < 4; i++) {
-        if(touch.x >= effectButtons[i].x && touch.x <= effectButtons[i].x + effectButtons[i].w &&
-           touch.y >= effectButtons[i].y && touch.y <= effectButtons[i].y + effectButtons[i].h) {
-          if(currentEffect != i) {  // Only update if selection changed
-            int oldEffect = currentEffect;
-            currentEffect = i;
-            updateButtonSelection(oldEffect, currentEffect);  // Just update borders
-          }
-          break;
-        }
-      }
-      
-      // Check if Off button was pressed
-      if(touch.x >= offButton.x && touch.x <= offButton.x + offButton.w &&
-         touch.y >= offButton.y && touch.y <= offButton.y + offButton.h) {
-        if(currentEffect != 4) {  // Only update if not already OFF
-          int oldEffect = currentEffect;
-          currentEffect = 4;  // Set to OFF mode
-          strip.clear();
-          strip.show();
-          updateButtonSelection(oldEffect, currentEffect);  // Just update selection
-        }
+      Widget* widget = widgetAt(touch.x, touch.y);
+      if(widget != nullptr) {
+        onWidgetPressed(*widget, touch.x);
       }
+    } else if(sliderDragging && touch.isPressed()) {
+      // Once grabbed, the slider follows the finger anywhere on screen
+      pendingBrightness = constrain(map(touch.x, sliderTrackX(), sliderTrackX() + sliderTrackW(), 0, 255), 0, 255);
     }
-    
-    // Check for slider interaction (both press and drag)
-    if(touch.isPressed() || touch.wasPressed()) {
-      int sliderX = 60;
-      int sliderY = 920;
-      int sliderW = 600;
-      int sliderH = 60;  // Increased hit area for easier interaction (bigger touch radius)
-      
-      if(touch.y >= sliderY - 30 && touch.y <= sliderY + sliderH &&
-         touch.x >= sliderX && touch.x <= sliderX + sliderW) {
-        // Calculate new brightness based on touch position
-        int newBrightness = map(touch.x, sliderX, sliderX + sliderW, 0, 255);
-        newBrightness = constrain(newBrightness, 0, 255);
-        
-        if(newBrightness != ledBrightness) {
-          ledBrightness = newBrightness;
-          strip.setBrightness(ledBrightness);
-          drawBrightnessSlider();  // Update slider display
-        }
-      }
+    if(touch.wasReleased()) {
+      sliderDragging = false;
     }
+  } else {
+    sliderDragging = false;
   }
-  
-  // Run current effect
-  switch(currentEffect) {
-    case 0:
-      rainbowEffect();
-      break;
-    case 1:
-      fireEffect();
-      break;
-    case 2:
-      meteorEffect();
-      break;
-    case 3:
-      kittEffect();
-      break;
-    case 4:
-      // OFF - do nothing, LEDs stay cleared
-      break;
-    case 5:
-      solidColorEffect();
-      break;
+}
+
+void loop() {
+  PROFILE_STAGE(STAGE_LOOP, {
+    PROFILE_STAGE(STAGE_M5_UPDATE, M5.update());
+    PROFILE_STAGE(STAGE_TOUCH, handleTouch());
+    PROFILE_STAGE(STAGE_SLIDER, flushSlider());
+    PROFILE_STAGE(STAGE_PREVIEW, updatePreview());
+  });
+  applyRemoteChanges();
+  // Saved once it has stopped changing
+  settingsStore.set(SavedSettings{currentEffect, ledBrightness, solidColor}, millis());
+  settingsStore.update(millis());
+  reportStream();
+  reportPower();
+  reportOutputErrors();
+  reportUi();
+  reportIdle();
+#if STAGE_PROFILE
+  updateProfile();
+#endif
+
+#if SERIAL_LINK
+  // The render core reads the link; wake it rather than let bytes wait out
+  // a low-power tick
+  if(idleGovernor.asleep() && Serial.available() > 0) {
+    xTaskNotifyGive(renderTaskHandle);
   }
-  
-  strip.show();
-  delay(20);
+#endif
+
+  // LED rendering runs in renderTask on the other core; just pace touch
+  // polling here, slower while the LEDs sleep
+  delay(IDLE_SLEEP_MS > 0 && idleGovernor.asleep() ? IDLE_POLL_MS : 5);
 }
@@ -0,0 +1,196 @@
+// Host encoder/decoder for recorded LED animations (.lan, see
+// lib/LedEngine/src/LedAnimation.h).
+//
+//   pio run -e ledanim && .pio/build/ledanim/program <command> ...
+//
+//   record <effect> <leds> <seconds> <out.lan> [fps]
+//       Render rainbow, fire, meteor or kitt with the same engine code the
+//       Tab5 runs and record it
+//   import <leds> <fps> <in.rgb> <out.lan>
+//       Encode raw 8-bit RGB frames, e.g. a pre-rendered show from
+//       ffmpeg -i show.mp4 -vf scale=<leds>:1 -f rawvideo -pix_fmt rgb24 show.rgb
+//   export <in.lan> <out.rgb>
+//       Decode every frame back to raw RGB
+//   info <in.lan>
+//       Print the header and compression ratio
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Effects.h"
+#include "LedAnimation.h"
+
+static const uint16_t kKeyInterval = 60;
+
+static int usage() {
+  fprintf(stderr,
+          "usage: ledanim record <rainbow|fire|meteor|kitt> <leds> <seconds> <out.lan> [fps]\n"
+          "       ledanim import <leds> <fps> <in.rgb> <out.lan>\n"
+          "       ledanim export <in.lan> <out.rgb>\n"
+          "       ledanim info <in.lan>\n");
+  return 2;
+}
+
+static int finish(AnimWriter& writer, FILE* out, const char* path) {
+  bool ok = writer.finish();
+  fclose(out);
+  if(!ok) {
+    fprintf(stderr, "error writing %s\n", path);
+    return 1;
+  }
+  printf("%s: %u frames, %u bytes\n", path, (unsigned)writer.framesWritten(), (unsigned)writer.bytesWritten());
+  return 0;
+}
+
+static int record(const char* effect, uint32_t leds, double seconds, const char* path, uint32_t fps) {
+  FILE* out = fopen(path, "wb");
+  if(out == nullptr) {
+    perror(path);
+    return 1;
+  }
+  const uint32_t frameUs = 1000000 / fps;
+  AnimWriter writer;
+  writer.begin(out, leds, frameUs, kKeyInterval);
+
+  std::vector<Rgb16> pixels(leds);
+  Framebuffer16 fb = {pixels.data(), leds};
+  RainbowState rainbow;
+  FireEngine fire;
+  fire.begin(leds);
+  MeteorState meteor;
+  KittState kitt;
+
+  const uint32_t frames = (uint32_t)(seconds * fps);
+  for(uint32_t f = 0; f < frames; f++) {
+    if(strcmp(effect, "rainbow") == 0) {
+      rainbowEffect(fb, rainbow, frameUs);
+    } else if(strcmp(effect, "fire") == 0) {
+      fire.update(fb, frameUs);
+    } else if(strcmp(effect, "meteor") == 0) {
+      meteorEffect(fb, meteor, frameUs);
+    } else if(strcmp(effect, "kitt") == 0) {
+      kittEffect(fb, kitt, frameUs);
+    } else {
+      fclose(out);
+      return usage();
+    }
+    writer.addFrame(fb);
+  }
+  return finish(writer, out, path);
+}
+
+static int import(uint32_t leds, uint32_t fps, const char* inPath, const char* outPath) {
+  FILE* in = fopen(inPath, "rb");
+  if(in == nullptr) {
+    perror(inPath);
+    return 1;
+  }
+  FILE* out = fopen(outPath, "wb");
+  if(out == nullptr) {
+    perror(outPath);
+    fclose(in);
+    return 1;
+  }
+  AnimWriter writer;
+  writer.begin(out, leds, 1000000 / fps, kKeyInterval);
+  std::vector<uint8_t> frame(leds * 3);
+  while(fread(frame.data(), 1, frame.size(), in) == frame.size()) {
+    writer.addFrame(frame.data());
+  }
+  fclose(in);
+  return finish(writer, out, outPath);
+}
+
+static bool openAnim(const char* path, FILE*& file, FileAnimSource& source, AnimPlayer& player) {
+  file = fopen(path, "rb");
+  if(file == nullptr) {
+    perror(path);
+    return false;
+  }
+  source.begin(file);
+  if(!player.open(source)) {
+    fprintf(stderr, "%s: not a .lan file\n", path);
+    fclose(file);
+    return false;
+  }
+  return true;
+}
+
+static int exportFrames(const char* inPath, const char* outPath) {
+  FILE* in;
+  FileAnimSource source;
+  AnimPlayer player;
+  if(!openAnim(inPath, in, source, player)) {
+    return 1;
+  }
+  FILE* out = fopen(outPath, "wb");
+  if(out == nullptr) {
+    perror(outPath);
+    fclose(in);
+    return 1;
+  }
+  const AnimHeader& header = player.header();
+  std::vector<Rgb16> pixels(header.numLeds);
+  Framebuffer16 fb = {pixels.data(), header.numLeds};
+  std::vector<uint8_t> frame(header.numLeds * 3);
+  bool ok = player.seek(fb, 0);
+  for(uint32_t f = 0; ok && f < header.frameCount; f++) {
+    if(f > 0) {
+      player.update(fb, header.frameUs);
+      ok = player.frame() == f;
+    }
+    for(uint32_t i = 0; i < header.numLeds * 3; i++) {
+      frame[i] = fb.channels()[i] >> 8;
+    }
+    ok = ok && fwrite(frame.data(), 1, frame.size(), out) == frame.size();
+  }
+  fclose(out);
+  fclose(in);
+  if(!ok) {
+    fprintf(stderr, "%s: decode failed\n", inPath);
+    return 1;
+  }
+  return 0;
+}
+
+static int info(const char* path) {
+  FILE* file;
+  FileAnimSource source;
+  AnimPlayer player;
+  if(!openAnim(path, file, source, player)) {
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fclose(file);
+  const AnimHeader& header = player.header();
+  const double raw = (double)header.numLeds * 3 * header.frameCount;
+  printf("%s: %u LEDs, %u frames at %.2f fps (%.1f s), keyframe every %u\n", path, (unsigned)header.numLeds,
+         (unsigned)header.frameCount, 1e6 / header.frameUs, header.frameCount * header.frameUs / 1e6,
+         (unsigned)header.keyInterval);
+  printf("%ld bytes, %.1fx smaller than raw RGB\n", size, raw / size);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc >= 6 && strcmp(argv[1], "record") == 0) {
+    const int leds = atoi(argv[3]);
+    const int fps = argc > 6 ? atoi(argv[6]) : 60;
+    return leds > 0 && fps > 0 ? record(argv[2], leds, atof(argv[4]), argv[5], fps) : usage();
+  }
+  if(argc == 6 && strcmp(argv[1], "import") == 0) {
+    const int leds = atoi(argv[2]);
+    const int fps = atoi(argv[3]);
+    return leds > 0 && fps > 0 ? import(leds, fps, argv[4], argv[5]) : usage();
+  }
+  if(argc == 4 && strcmp(argv[1], "export") == 0) {
+    return exportFrames(argv[2], argv[3]);
+  }
+  if(argc == 3 && strcmp(argv[1], "info") == 0) {
+    return info(argv[2]);
+  }
+  return usage();
+}
@@ -0,0 +1,425 @@
+// The simulator's virtual clock and task scheduler, and the Arduino,
+// FreeRTOS, M5 and device backends src/main.cpp runs against.
+
+#include "Sim.h"
+
+#include <stdarg.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <M5Unified.h>
+#include <WiFi.h>
+
+#include "SimDevice.h"
+
+SimScheduler simScheduler;
+SimWorld sim;
+
+uint64_t simRealNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+SimTask* SimScheduler::spawn(void (*fn)(void*), void* param, const char* name) {
+  tasks_.emplace_back(new SimTask);
+  SimTask* task = tasks_.back().get();
+  task->name = name;
+  task->fn = fn;
+  task->param = param;
+  task->id = tasks_.size() - 1;
+  task->wakeUs = nowUs_;
+  // Parked until the scheduler picks it, then never joined: the scenario
+  // ends with every task blocked
+  task->thread = std::thread(start, this, task);
+  task->thread.detach();
+  return task;
+}
+
+void SimScheduler::start(SimScheduler* scheduler, SimTask* task) {
+  {
+    std::unique_lock<std::mutex> lock(scheduler->mutex_);
+    task->cv.wait(lock, [&] { return scheduler->running_ == task; });
+    scheduler->spins_ = 0;
+    scheduler->runStartNs_ = simRealNs();
+  }
+  task->fn(task->param);
+  // A task that returns is gone; FreeRTOS would not allow it either
+  task->wakeUs = UINT64_MAX;
+  scheduler->block(task);
+}
+
+void SimScheduler::run(uint64_t endUs) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for(;;) {
+    SimTask* next = nullptr;
+    for(const std::unique_ptr<SimTask>& task : tasks_) {
+      if(next == nullptr || task->wakeUs < next->wakeUs) {
+        next = task.get();
+      }
+    }
+    if(next == nullptr || next->wakeUs > endUs) {
+      nowUs_ = std::max(nowUs_, endUs);
+      return;
+    }
+    nowUs_ = std::max(nowUs_, next->wakeUs);
+    running_ = next;
+    next->cv.notify_one();
+    driverCv_.wait(lock, [this] { return running_ == nullptr; });
+  }
+}
+
+// Give the baton back and wait for it
+void SimScheduler::block(SimTask* task) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const uint64_t ns = simRealNs() - runStartNs_;
+  task->cpuNs += ns;
+  running_ = nullptr;
+  if(runHook_ != nullptr) {
+    runHook_(*task, ns);
+  }
+  driverCv_.notify_one();
+  task->cv.wait(lock, [&] { return running_ == task; });
+  spins_ = 0;
+  runStartNs_ = simRealNs();
+}
+
+uint64_t SimScheduler::read() {
+  if(running_ != nullptr && ++spins_ > kSpinCalls) {
+    nowUs_++;
+  }
+  return nowUs_;
+}
+
+uint64_t SimScheduler::cpuNs() const {
+  return running_ != nullptr ? running_->cpuNs + simRealNs() - runStartNs_ : 0;
+}
+
+void SimScheduler::sleepUntil(uint64_t us) {
+  SimTask* task = running_;
+  task->wakeUs = std::max(us, nowUs_);
+  block(task);
+}
+
+uint32_t SimScheduler::take(bool clear, uint64_t timeoutUs) {
+  SimTask* task = running_;
+  if(task->notified == 0 && timeoutUs > 0) {
+    task->waitingNotify = true;
+    task->wakeUs = timeoutUs == UINT64_MAX ? UINT64_MAX : nowUs_ + timeoutUs;
+    block(task);
+    task->waitingNotify = false;
+  }
+  const uint32_t value = task->notified;
+  if(clear) {
+    task->notified = 0;
+  } else if(value > 0) {
+    task->notified--;
+  }
+  return value;
+}
+
+void SimScheduler::give(SimTask* task) {
+  if(task == nullptr) {
+    return;
+  }
+  task->notified++;
+  if(task->waitingNotify && task->wakeUs > nowUs_) {
+    task->wakeUs = nowUs_;
+  }
+}
+
+// Arduino core
+
+static uint32_t simRandomState = 0x12345678;
+
+long random(long howbig) {
+  if(howbig <= 0) {
+    return 0;
+  }
+  // xorshift32, as the host shim in LedPlatform.cpp
+  uint32_t x = simRandomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  simRandomState = x;
+  return x % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if(howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if(seed != 0) {
+    simRandomState = seed;
+  }
+}
+
+uint32_t micros() {
+  return (uint32_t)simScheduler.read();
+}
+
+uint32_t millis() {
+  return (uint32_t)(simScheduler.read() / 1000);
+}
+
+void delay(uint32_t ms) {
+  simScheduler.sleepUntil(simScheduler.now() + ms * 1000ULL);
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+HardwareSerial Serial;
+
+// Serial output with -v, each line stamped with the virtual time
+static size_t simPrint(const char* text) {
+  static bool lineStart = true;
+  const size_t length = strlen(text);
+  if(!sim.verbose) {
+    return length;
+  }
+  for(const char* p = text; *p != '\0'; p++) {
+    if(lineStart) {
+      printf("[%9.3f] ", simScheduler.now() / 1e6);
+    }
+    putchar(*p);
+    lineStart = *p == '\n';
+  }
+  return length;
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+  char text[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return simPrint(text);
+}
+
+size_t HardwareSerial::print(const char* text) {
+  return simPrint(text);
+}
+
+size_t HardwareSerial::println(const char* text) {
+  return simPrint(text) + simPrint("\n");
+}
+
+// FreeRTOS
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  (void)stackDepth;
+  (void)priority;
+  (void)core;
+  SimTask* task = simScheduler.spawn(fn, param, name);
+  if(handle != nullptr) {
+    *handle = task;
+  }
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  simScheduler.sleepUntil(simScheduler.now() + ticks * 1000ULL);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  return simScheduler.take(clearOnExit, ticksToWait == portMAX_DELAY ? UINT64_MAX : ticksToWait * 1000ULL);
+}
+
+void xTaskNotifyGive(TaskHandle_t task) {
+  simScheduler.give(task);
+}
+
+// M5Unified
+
+M5Unified M5;
+LittleFSFS LittleFS;
+WiFiClass WiFi;
+
+void SimTouch::update() {
+  const uint64_t nowUs = simScheduler.now();
+  const bool wasDown = detail_.pressed;
+  detail_.pressed = false;
+  for(const SimStroke& stroke : sim.strokes) {
+    const uint64_t startUs = stroke.startMs * 1000ULL;
+    const uint64_t lengthUs = stroke.durationMs * 1000ULL;
+    if(nowUs >= startUs && nowUs < startUs + lengthUs) {
+      const double t = (double)(nowUs - startUs) / lengthUs;
+      detail_.x = (int16_t)lround(stroke.x0 + (stroke.x1 - stroke.x0) * t);
+      detail_.y = (int16_t)lround(stroke.y0 + (stroke.y1 - stroke.y0) * t);
+      detail_.pressed = true;
+      break;
+    }
+  }
+  detail_.justPressed = detail_.pressed && !wasDown;
+  detail_.justReleased = !detail_.pressed && wasDown;
+}
+
+// M5GFX
+
+LovyanGFX::LovyanGFX(int32_t width, int32_t height, bool panel)
+    : width_(width), height_(height), panel_(panel), clipW_(width), clipH_(height) {}
+
+void LovyanGFX::draw(int32_t x, int32_t y, int32_t w, int32_t h) {
+  if(!panel_) {
+    sim.draw.spriteCalls++;
+    return;
+  }
+  sim.draw.panelCalls++;
+  const int32_t x0 = std::max(x, clipX_);
+  const int32_t y0 = std::max(y, clipY_);
+  const int32_t x1 = std::min(x + w, clipX_ + clipW_);
+  const int32_t y1 = std::min(y + h, clipY_ + clipH_);
+  if(x1 > x0 && y1 > y0) {
+    sim.draw.panelPixels += (uint64_t)(x1 - x0) * (y1 - y0);
+  }
+}
+
+void LovyanGFX::fillScreen(uint16_t) {
+  draw(0, 0, width_, height_);
+}
+
+void LovyanGFX::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t) {
+  draw(x, y, w, h);
+}
+
+void LovyanGFX::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t) {
+  draw(x, y, w, h);
+}
+
+void LovyanGFX::fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t, uint16_t) {
+  draw(x, y, w, h);
+}
+
+void LovyanGFX::drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t, uint16_t) {
+  draw(x, y, w, h);
+}
+
+void LovyanGFX::fillCircle(int32_t x, int32_t y, int32_t r, uint16_t) {
+  draw(x - r, y - r, 2 * r + 1, 2 * r + 1);
+}
+
+void LovyanGFX::drawCircle(int32_t x, int32_t y, int32_t r, uint16_t) {
+  draw(x - r, y - r, 2 * r + 1, 2 * r + 1);
+}
+
+void LovyanGFX::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint16_t) {
+  draw(std::min(x0, x1), std::min(y0, y1), abs(x1 - x0) + 1, abs(y1 - y0) + 1);
+}
+
+void LovyanGFX::drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t) {
+  draw(x, y, 1, h);
+}
+
+void LovyanGFX::drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t) {
+  draw(x, y, w, 1);
+}
+
+void LovyanGFX::drawPixel(int32_t x, int32_t y, uint16_t) {
+  draw(x, y, 1, 1);
+}
+
+void LovyanGFX::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t*) {
+  draw(x, y, w, h);
+}
+
+void LovyanGFX::drawString(const char* text, int32_t x, int32_t y) {
+  const int32_t w = std::max(textWidth(text), (int32_t)textPadding_);
+  const int32_t h = (int32_t)(8 * textSize_);
+  const int32_t column = datum_ % 3;
+  const int32_t row = datum_ / 3;
+  draw(x - column * w / 2, y - row * h / 2, w, h);
+}
+
+void LovyanGFX::setClipRect(int32_t x, int32_t y, int32_t w, int32_t h) {
+  clipX_ = x;
+  clipY_ = y;
+  clipW_ = w;
+  clipH_ = h;
+}
+
+void* M5Canvas::createSprite(int32_t w, int32_t h) {
+  buffer_.assign((size_t)w * h, 0);
+  width_ = w;
+  height_ = h;
+  clearClipRect();
+  return buffer_.data();
+}
+
+void M5Canvas::deleteSprite() {
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+  width_ = 0;
+  height_ = 0;
+}
+
+void M5Canvas::pushSprite(LovyanGFX* dst, int32_t x, int32_t y) {
+  if(dst != nullptr) {
+    dst->draw(x, y, width_, height_);
+  }
+}
+
+// Device backends
+
+bool RmtTransmitter::begin(int gpio, bool withDma) {
+  (void)gpio;
+  (void)withDma;
+  static uint8_t lanes = 0;
+  lane_ = lanes++;
+  return true;
+}
+
+bool RmtTransmitter::transmit(const uint32_t* symbols, uint32_t count) {
+  // One symbol per bit, MSB first; a 1 is high for longer than low. The
+  // last symbol is the latch.
+  uint64_t hash = 1469598103934665603ull;
+  uint64_t ticks = 0;
+  uint8_t bits = 0;
+  for(uint32_t i = 0; i < count; i++) {
+    const uint32_t s = symbols[i];
+    ticks += (s & 0x7FFF) + ((s >> 16) & 0x7FFF);
+    if(i + 1 == count) {
+      break;
+    }
+    bits = (uint8_t)(bits << 1 | ((s & 0x7FFF) > ((s >> 16) & 0x7FFF)));
+    if(i % 8 == 7) {
+      hash = (hash ^ bits) * 1099511628211ull;
+    }
+  }
+  const uint64_t nowUs = simScheduler.now();
+  sim.frames.push_back(SimFrame{(uint32_t)nowUs, lane_, hash});
+  doneUs_ = nowUs + ticks * 1000000 / kWs2812TickHz;
+  return true;
+}
+
+bool RmtTransmitter::busy() const {
+  return simScheduler.now() < doneUs_;
+}
+
+void RmtTransmitter::waitDone() {
+  if(busy()) {
+    simScheduler.sleepUntil(doneUs_);
+  }
+}
+
+bool NvsSettingsBackend::read(void* data, size_t size) {
+  if(record_.size() != size) {
+    return false;
+  }
+  memcpy(data, record_.data(), size);
+  return true;
+}
+
+bool NvsSettingsBackend::write(const void* data, size_t size) {
+  record_.assign((const uint8_t*)data, (const uint8_t*)data + size);
+  sim.settingsWrites++;
+  return true;
+}
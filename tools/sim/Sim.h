@@ -0,0 +1,114 @@
+#pragma once
+
+// Simulator core: a virtual clock, the firmware's FreeRTOS tasks run one
+// at a time on it, the touch trace they see and what they put out.
+//
+// Tasks are threads, but only the one holding the baton runs. It runs until
+// it blocks (delay(), vTaskDelay(), ulTaskNotifyTake(), waiting for an LED
+// frame to leave the wire), which takes no virtual time; the scheduler then
+// moves the clock to the earliest wake-up and hands the baton over, the
+// task created first winning a tie. The same scenario therefore always
+// interleaves the UI loop and the render task the same way, and every LED
+// frame comes out bit for bit the same.
+//
+// Code that polls micros() in a loop without blocking (the render task
+// waiting out the last part of a millisecond) would never see time move,
+// so after kSpinCalls reads in one run each further read advances the
+// clock by 1 us.
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SimTask {
+  std::string name;
+  void (*fn)(void*);
+  void* param;
+  uint32_t id;
+  std::thread thread;
+  std::condition_variable cv;
+  uint64_t wakeUs = 0;
+  bool waitingNotify = false;
+  uint32_t notified = 0;
+  uint64_t cpuNs = 0;  // Real time spent running, summed
+};
+
+class SimScheduler {
+ public:
+  static const uint32_t kSpinCalls = 64;
+
+  // Called with the task and the real time of each run that just ended
+  typedef void (*RunHook)(SimTask& task, uint64_t ns);
+
+  // A new task, runnable now
+  SimTask* spawn(void (*fn)(void*), void* param, const char* name);
+  // Run tasks until the next wake-up is past endUs
+  void run(uint64_t endUs);
+  void setRunHook(RunHook hook) { runHook_ = hook; }
+
+  // From the running task
+  uint64_t now() const { return nowUs_; }
+  uint64_t read();  // now(), with the spin rule above
+  SimTask* current() const { return running_; }
+  uint64_t cpuNs() const;  // The running task's cpuNs, this run included
+  void sleepUntil(uint64_t us);
+  uint32_t take(bool clear, uint64_t timeoutUs);
+  void give(SimTask* task);
+
+ private:
+  static void start(SimScheduler* scheduler, SimTask* task);
+  void block(SimTask* task);
+
+  std::vector<std::unique_ptr<SimTask>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable driverCv_;
+  SimTask* running_ = nullptr;  // nullptr: the scheduler itself
+  uint64_t nowUs_ = 0;
+  uint32_t spins_ = 0;
+  uint64_t runStartNs_ = 0;
+  RunHook runHook_ = nullptr;
+};
+
+extern SimScheduler simScheduler;
+
+// One finger stroke of the touch trace: down at startMs at (x0, y0),
+// moving in a straight line to (x1, y1) and lifted after durationMs. A tap
+// is a stroke that does not move.
+struct SimStroke {
+  uint32_t startMs;
+  uint32_t durationMs;
+  int16_t x0, y0, x1, y1;
+};
+
+// An LED frame as it left one lane
+struct SimFrame {
+  uint32_t us;
+  uint8_t lane;
+  uint64_t hash;  // FNV-1a of the wire bytes
+};
+
+struct SimDrawStats {
+  uint64_t panelCalls = 0;
+  uint64_t panelPixels = 0;  // Area covered by those calls
+  uint64_t spriteCalls = 0;
+};
+
+// What the firmware saw and did during a scenario
+struct SimWorld {
+  uint32_t seed = 1;
+  std::vector<SimStroke> strokes;
+  bool verbose = false;
+
+  std::vector<SimFrame> frames;
+  SimDrawStats draw;
+  uint32_t settingsWrites = 0;
+};
+
+extern SimWorld sim;
+
+uint64_t simRealNs();
@@ -0,0 +1,37 @@
+#pragma once
+
+// The device backends main.cpp names, as the simulator provides them. The
+// ESP_PLATFORM versions in lib/LedEngine are not built here.
+
+#include "LedOutput.h"
+#include "SettingsStore.h"
+
+// An LED lane: each frame is decoded back into bytes and recorded with its
+// hash, and stays busy for its wire time on the virtual clock
+class RmtTransmitter : public LedTransmitter {
+ public:
+  bool begin(int gpio, bool withDma = true);
+
+  bool transmit(const uint32_t* symbols, uint32_t count) override;
+  bool busy() const override;
+  void waitDone() override;
+
+ private:
+  uint8_t lane_ = 0;
+  uint64_t doneUs_ = 0;
+};
+
+// NVS in memory, empty at boot; writes are counted
+class NvsSettingsBackend : public SettingsBackend {
+ public:
+  explicit NvsSettingsBackend(const char* space = "ledctl", const char* key = "settings") {
+    (void)space;
+    (void)key;
+  }
+
+  bool read(void* data, size_t size) override;
+  bool write(const void* data, size_t size) override;
+
+ private:
+  std::vector<uint8_t> record_;
+};
@@ -0,0 +1,421 @@
+// Headless simulator: runs the firmware's own setup() and loop() from
+// src/main.cpp, render task included, on a virtual clock against stand-in
+// M5 and LED backends (see Sim.h), replaying a scripted touch trace.
+//
+//   pio run -e sim && .pio/build/sim/program [options] [scenario ...]
+//
+//   --record     Write the goldens instead of checking against them
+//   --no-timing  Skip the frame and loop time gates (e.g. on a loaded host)
+//   --dir <dir>  Where scenarios/ and golden/ are (default: tools/sim)
+//   -v           Print the firmware's serial output
+//
+// Scenarios are tools/sim/scenarios/<name>.sim, all of them by default:
+//
+//   seed <n>                                  random() seed (default 1)
+//   duration <ms>
+//   tap <ms> <x> <y> [hold ms]                Finger down for 80 ms
+//   drag <ms> <x0> <y0> <x1> <y1> <ms>        Straight line, then lifted
+//
+// Each runs in a process of its own and is checked against
+// golden/<name>.golden: every LED frame's hash and time must match, the LCD
+// draw calls, area drawn and settings writes must not go up, and the p99
+// frame and loop times (real time on this host) must stay within
+// kTimeFactor of the golden's.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+
+#include "FrameScheduler.h"
+#include "IdleGovernor.h"
+#include "Sim.h"
+
+void setup();
+void loop();
+
+extern FrameScheduler frameScheduler;
+extern IdleGovernor idleGovernor;
+
+static const double kTimeFactor = 3;
+static const double kTimeSlackUs = 100;  // Below this nothing counts as a regression
+
+struct Options {
+  bool record = false;
+  bool timing = true;
+  std::string dir = "tools/sim";
+};
+
+struct Scenario {
+  std::string name;
+  uint32_t seed = 1;
+  uint32_t durationMs = 10000;
+  std::vector<SimStroke> strokes;
+};
+
+static bool loadScenario(const std::string& path, Scenario& scenario) {
+  FILE* in = fopen(path.c_str(), "r");
+  if(in == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  char line[256];
+  int number = 0;
+  bool ok = true;
+  while(ok && fgets(line, sizeof(line), in) != nullptr) {
+    number++;
+    if(char* comment = strchr(line, '#')) {
+      *comment = '\0';
+    }
+    char command[16];
+    if(sscanf(line, "%15s", command) != 1) {
+      continue;
+    }
+    int a[6];
+    const int n = sscanf(line, "%*s %d %d %d %d %d %d", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5]);
+    if(strcmp(command, "seed") == 0 && n == 1) {
+      scenario.seed = a[0];
+    } else if(strcmp(command, "duration") == 0 && n == 1) {
+      scenario.durationMs = a[0];
+    } else if(strcmp(command, "tap") == 0 && (n == 3 || n == 4)) {
+      scenario.strokes.push_back(SimStroke{(uint32_t)a[0], (uint32_t)(n == 4 ? a[3] : 80), (int16_t)a[1],
+                                           (int16_t)a[2], (int16_t)a[1], (int16_t)a[2]});
+    } else if(strcmp(command, "drag") == 0 && n == 6) {
+      scenario.strokes.push_back(SimStroke{(uint32_t)a[0], (uint32_t)a[5], (int16_t)a[1], (int16_t)a[2],
+                                           (int16_t)a[3], (int16_t)a[4]});
+    } else {
+      fprintf(stderr, "%s:%d: cannot read '%s'\n", path.c_str(), number, command);
+      ok = false;
+    }
+  }
+  fclose(in);
+  return ok;
+}
+
+// What a run measured. The counters are deterministic; the times are real
+// time on this host.
+struct Capture {
+  std::vector<SimFrame> frames;
+  uint64_t bootCalls = 0;  // LCD calls in setup()
+  uint64_t loopCalls = 0;  // LCD calls in every loop() after it
+  uint64_t maxLoopCalls = 0;
+  uint64_t pixels = 0;
+  uint32_t settingsWrites = 0;
+  double setupUs = 0;
+  double loopP99Us = 0;
+  double frameP99Us = 0;
+};
+
+// Per-run measurements, filled in by the app task and the run hook
+static uint64_t setupNs = 0;
+static std::vector<uint32_t> loopNs;
+static std::vector<uint32_t> frameNs;  // Render task runs that sent a frame
+static uint64_t bootCalls = 0;
+static uint64_t maxLoopCalls = 0;
+static size_t framesSeen = 0;
+
+// The Arduino loop task: setup() once, then loop() for ever
+static void appTask(void*) {
+  uint64_t start = simScheduler.cpuNs();
+  setup();
+  setupNs = simScheduler.cpuNs() - start;
+  bootCalls = sim.draw.panelCalls;
+  for(;;) {
+    const uint64_t calls = sim.draw.panelCalls;
+    start = simScheduler.cpuNs();
+    loop();
+    loopNs.push_back((uint32_t)(simScheduler.cpuNs() - start));
+    maxLoopCalls = std::max(maxLoopCalls, sim.draw.panelCalls - calls);
+  }
+}
+
+static void onRun(SimTask& task, uint64_t ns) {
+  if(task.name == "render" && sim.frames.size() != framesSeen) {
+    frameNs.push_back((uint32_t)ns);
+    framesSeen = sim.frames.size();
+  }
+}
+
+static double p99Us(std::vector<uint32_t> ns) {
+  if(ns.empty()) {
+    return 0;
+  }
+  std::sort(ns.begin(), ns.end());
+  return ns[ns.size() * 99 / 100] / 1000.0;
+}
+
+static double avgUs(const std::vector<uint32_t>& ns) {
+  uint64_t total = 0;
+  for(uint32_t v : ns) {
+    total += v;
+  }
+  return ns.empty() ? 0 : total / 1000.0 / ns.size();
+}
+
+static double maxUs(const std::vector<uint32_t>& ns) {
+  return ns.empty() ? 0 : *std::max_element(ns.begin(), ns.end()) / 1000.0;
+}
+
+static Capture runScenario(const Scenario& scenario) {
+  sim.seed = scenario.seed;
+  sim.strokes = scenario.strokes;
+  randomSeed(scenario.seed);
+  simScheduler.setRunHook(onRun);
+  simScheduler.spawn(appTask, nullptr, "loop");
+  simScheduler.run(scenario.durationMs * 1000ULL);
+
+  Capture capture;
+  capture.frames = sim.frames;
+  capture.bootCalls = bootCalls;
+  capture.loopCalls = sim.draw.panelCalls - bootCalls;
+  capture.maxLoopCalls = maxLoopCalls;
+  capture.pixels = sim.draw.panelPixels;
+  capture.settingsWrites = sim.settingsWrites;
+  capture.setupUs = setupNs / 1000.0;
+  capture.loopP99Us = p99Us(loopNs);
+  capture.frameP99Us = p99Us(frameNs);
+
+  const FrameStats& pacing = frameScheduler.stats();
+  const IdleStats& idle = idleGovernor.stats();
+  printf("%-22s %u over %.1f s, %u slots skipped idle, %u deadlines missed\n", "led frames",
+         (unsigned)capture.frames.size(), scenario.durationMs / 1000.0, (unsigned)idle.skipped,
+         (unsigned)pacing.missedDeadlines);
+  printf("%-22s boot %llu, loop %llu (max %llu per pass), %.2f Mpx, %llu sprite calls\n", "lcd draw calls",
+         (unsigned long long)capture.bootCalls, (unsigned long long)capture.loopCalls,
+         (unsigned long long)capture.maxLoopCalls, capture.pixels / 1e6, (unsigned long long)sim.draw.spriteCalls);
+  printf("%-22s %u\n", "settings writes", (unsigned)capture.settingsWrites);
+  printf("%-22s %10s %10s %10s %8s\n", "stage", "avg us", "p99 us", "max us", "count");
+  printf("%-22s %10.1f %10.1f %10.1f %8u\n", "setup", capture.setupUs, capture.setupUs, capture.setupUs, 1);
+  printf("%-22s %10.1f %10.1f %10.1f %8u\n", "loop", avgUs(loopNs), capture.loopP99Us, maxUs(loopNs),
+         (unsigned)loopNs.size());
+  printf("%-22s %10.1f %10.1f %10.1f %8u\n", "render frame", avgUs(frameNs), capture.frameP99Us, maxUs(frameNs),
+         (unsigned)frameNs.size());
+  return capture;
+}
+
+static std::string goldenPath(const Options& options, const std::string& name) {
+  return options.dir + "/golden/" + name + ".golden";
+}
+
+static bool writeGolden(const std::string& path, const std::string& name, const Capture& capture) {
+  FILE* out = fopen(path.c_str(), "w");
+  if(out == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  fprintf(out, "# %s, written by --record\n", name.c_str());
+  fprintf(out, "lcd-boot-calls %llu\n", (unsigned long long)capture.bootCalls);
+  fprintf(out, "lcd-loop-calls %llu\n", (unsigned long long)capture.loopCalls);
+  fprintf(out, "lcd-max-calls %llu\n", (unsigned long long)capture.maxLoopCalls);
+  fprintf(out, "lcd-pixels %llu\n", (unsigned long long)capture.pixels);
+  fprintf(out, "settings-writes %u\n", (unsigned)capture.settingsWrites);
+  fprintf(out, "setup-us %.1f\n", capture.setupUs);
+  fprintf(out, "loop-p99-us %.1f\n", capture.loopP99Us);
+  fprintf(out, "frame-p99-us %.1f\n", capture.frameP99Us);
+  // LED frames: virtual time, lane, hash of the bytes on the wire
+  for(const SimFrame& frame : capture.frames) {
+    fprintf(out, "frame %u %u %016llx\n", (unsigned)frame.us, (unsigned)frame.lane, (unsigned long long)frame.hash);
+  }
+  const bool ok = fclose(out) == 0;
+  printf("%-22s %s, %u frames\n", "recorded", path.c_str(), (unsigned)capture.frames.size());
+  return ok;
+}
+
+static bool readGolden(const std::string& path, Capture& golden) {
+  FILE* in = fopen(path.c_str(), "r");
+  if(in == nullptr) {
+    return false;
+  }
+  uint64_t settingsWrites = 0;
+  const struct {
+    const char* key;
+    uint64_t* count;
+    double* us;
+  } fields[] = {
+    {"lcd-boot-calls", &golden.bootCalls, nullptr},  {"lcd-loop-calls", &golden.loopCalls, nullptr},
+    {"lcd-max-calls", &golden.maxLoopCalls, nullptr}, {"lcd-pixels", &golden.pixels, nullptr},
+    {"settings-writes", &settingsWrites, nullptr},    {"setup-us", nullptr, &golden.setupUs},
+    {"loop-p99-us", nullptr, &golden.loopP99Us},      {"frame-p99-us", nullptr, &golden.frameP99Us},
+  };
+  char line[128];
+  while(fgets(line, sizeof(line), in) != nullptr) {
+    char key[32];
+    unsigned long long us, hash;
+    unsigned lane;
+    double value;
+    if(sscanf(line, "frame %llu %u %llx", &us, &lane, &hash) == 3) {
+      golden.frames.push_back(SimFrame{(uint32_t)us, (uint8_t)lane, hash});
+    } else if(sscanf(line, "%31s %lf", key, &value) == 2) {
+      for(const auto& field : fields) {
+        if(strcmp(key, field.key) == 0 && field.count != nullptr) {
+          *field.count = (uint64_t)value;
+        } else if(strcmp(key, field.key) == 0) {
+          *field.us = value;
+        }
+      }
+    }
+  }
+  golden.settingsWrites = (uint32_t)settingsWrites;
+  fclose(in);
+  return true;
+}
+
+// A deterministic counter: more than the golden fails, fewer is reported
+static int checkCount(const char* what, uint64_t value, uint64_t golden) {
+  if(value > golden) {
+    printf("FAIL %-17s %llu, golden %llu\n", what, (unsigned long long)value, (unsigned long long)golden);
+    return 1;
+  }
+  if(value < golden) {
+    printf("%-22s %llu, golden %llu (improved; --record to keep)\n", what, (unsigned long long)value,
+           (unsigned long long)golden);
+  }
+  return 0;
+}
+
+static int checkTime(const char* what, double us, double golden) {
+  const double limit = std::max(golden * kTimeFactor, golden + kTimeSlackUs);
+  if(us > limit) {
+    printf("FAIL %-17s %.1f us, golden %.1f us (limit %.1f us)\n", what, us, golden, limit);
+    return 1;
+  }
+  return 0;
+}
+
+static int checkGolden(const Options& options, const Capture& capture, const Capture& golden) {
+  int failures = 0;
+  const size_t common = std::min(capture.frames.size(), golden.frames.size());
+  size_t diverged = common;
+  for(size_t i = 0; i < common; i++) {
+    const SimFrame& a = capture.frames[i];
+    const SimFrame& b = golden.frames[i];
+    if(a.us != b.us || a.lane != b.lane || a.hash != b.hash) {
+      diverged = i;
+      break;
+    }
+  }
+  if(diverged < common || capture.frames.size() != golden.frames.size()) {
+    printf("FAIL %-17s %u frames, golden %u", "led output", (unsigned)capture.frames.size(),
+           (unsigned)golden.frames.size());
+    if(diverged < common) {
+      const SimFrame& a = capture.frames[diverged];
+      const SimFrame& b = golden.frames[diverged];
+      printf("; frame %u differs: %.3f s lane %u %016llx, golden %.3f s lane %u %016llx", (unsigned)diverged,
+             a.us / 1e6, (unsigned)a.lane, (unsigned long long)a.hash, b.us / 1e6, (unsigned)b.lane,
+             (unsigned long long)b.hash);
+    }
+    printf("\n");
+    failures++;
+  }
+  failures += checkCount("lcd boot calls", capture.bootCalls, golden.bootCalls);
+  failures += checkCount("lcd loop calls", capture.loopCalls, golden.loopCalls);
+  failures += checkCount("lcd calls per pass", capture.maxLoopCalls, golden.maxLoopCalls);
+  failures += checkCount("lcd pixels", capture.pixels, golden.pixels);
+  failures += checkCount("settings writes", capture.settingsWrites, golden.settingsWrites);
+  if(options.timing) {
+    failures += checkTime("setup", capture.setupUs, golden.setupUs);
+    failures += checkTime("loop p99", capture.loopP99Us, golden.loopP99Us);
+    failures += checkTime("render frame p99", capture.frameP99Us, golden.frameP99Us);
+  }
+  return failures;
+}
+
+// Child process: one scenario from a clean boot
+static int runOne(const Options& options, const std::string& name) {
+  Scenario scenario;
+  scenario.name = name;
+  if(!loadScenario(options.dir + "/scenarios/" + name + ".sim", scenario)) {
+    return 1;
+  }
+  printf("\n== %s (seed %u, %u strokes) ==\n", name.c_str(), (unsigned)scenario.seed,
+         (unsigned)scenario.strokes.size());
+  const Capture capture = runScenario(scenario);
+  const std::string path = goldenPath(options, name);
+  if(options.record) {
+    return writeGolden(path, name, capture) ? 0 : 1;
+  }
+  Capture golden;
+  if(!readGolden(path, golden)) {
+    printf("FAIL no golden %s (--record to create it)\n", path.c_str());
+    return 1;
+  }
+  const int failures = checkGolden(options, capture, golden);
+  printf("%-22s %s\n", name.c_str(), failures ? "FAIL" : "ok");
+  return failures ? 1 : 0;
+}
+
+static std::vector<std::string> allScenarios(const Options& options) {
+  std::vector<std::string> names;
+  const std::string dir = options.dir + "/scenarios";
+  if(DIR* d = opendir(dir.c_str())) {
+    while(dirent* entry = readdir(d)) {
+      const std::string file = entry->d_name;
+      if(file.size() > 4 && file.compare(file.size() - 4, 4, ".sim") == 0) {
+        names.push_back(file.substr(0, file.size() - 4));
+      }
+    }
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+static int usage() {
+  fprintf(stderr, "usage: sim [--record] [--no-timing] [--dir <dir>] [-v] [scenario ...]\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  std::vector<std::string> names;
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--record") == 0) {
+      options.record = true;
+    } else if(strcmp(argv[i], "--no-timing") == 0) {
+      options.timing = false;
+    } else if(strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      options.dir = argv[++i];
+    } else if(strcmp(argv[i], "-v") == 0) {
+      sim.verbose = true;
+    } else if(argv[i][0] == '-') {
+      return usage();
+    } else {
+      names.push_back(argv[i]);
+    }
+  }
+  if(names.empty()) {
+    names = allScenarios(options);
+  }
+  if(names.empty()) {
+    fprintf(stderr, "no scenarios in %s/scenarios\n", options.dir.c_str());
+    return 1;
+  }
+
+  // The firmware's globals and tasks cannot be reset, so every scenario
+  // boots in a fresh process
+  int failed = 0;
+  for(const std::string& name : names) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    if(pid == 0) {
+      const int status = runOne(options, name);
+      fflush(stdout);
+      _exit(status);
+    }
+    int status = 1;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      failed++;
+    }
+  }
+  printf("\n%u of %u scenarios %s\n", (unsigned)(names.size() - failed), (unsigned)names.size(),
+         options.record ? "recorded" : "passed");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// The part of the Arduino core and FreeRTOS that src/main.cpp and
+// lib/LedEngine use, for the simulator. Time is the simulator's virtual
+// clock, random() is seeded per scenario and tasks run one at a time (see
+// Sim.h).
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// USB CDC: output is printed with -v, nothing ever arrives
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t setRxBufferSize(size_t size) { return size; }
+  size_t setTxBufferSize(size_t size) {
+    txBuffer_ = size;
+    return size;
+  }
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t read(uint8_t* data, size_t size) {
+    (void)data;
+    (void)size;
+    return 0;
+  }
+  int availableForWrite() { return (int)txBuffer_; }  // Drained at once
+  size_t write(const uint8_t* data, size_t size) {
+    (void)data;
+    return size;
+  }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char* text);
+  size_t println(const char* text = "");
+  void flush() {}
+  operator bool() const { return true; }
+
+ private:
+  size_t txBuffer_ = 256;  // The hardware CDC default
+};
+extern HardwareSerial Serial;
+
+// FreeRTOS, one tick per ms
+struct SimTask;
+typedef SimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define configMAX_PRIORITIES 25
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY 0xFFFFFFFFu
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+void xTaskNotifyGive(TaskHandle_t task);
+inline BaseType_t xPortGetCoreID() {
+  return 1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// No flash in the simulator: the mount fails as on an unformatted
+// partition, so there is no Show recording and no saved UI image
+class LittleFSFS {
+ public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    return false;
+  }
+};
+
+extern LittleFSFS LittleFS;
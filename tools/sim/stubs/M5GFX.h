@@ -0,0 +1,113 @@
+#pragma once
+
+// LovyanGFX/M5GFX stand-ins for the simulator. Nothing is rasterized:
+// every call is counted, on the panel or in a sprite, with the area of what
+// it covers (its bounding box, clipped to the panel's clip rect). Sprites
+// keep a pixel buffer so getBuffer() works.
+
+#include <Arduino.h>
+
+#include <vector>
+
+enum textdatum_t : uint8_t {
+  top_left,
+  top_center,
+  top_right,
+  middle_left,
+  middle_center,
+  middle_right,
+  bottom_left,
+  bottom_center,
+  bottom_right,
+};
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+#define TFT_RED 0xF800
+
+class LovyanGFX {
+ public:
+  virtual ~LovyanGFX() {}
+
+  int32_t width() const { return width_; }
+  int32_t height() const { return height_; }
+
+  void setColorDepth(int bits) { (void)bits; }
+  void setSwapBytes(bool swap) { (void)swap; }
+  uint16_t color565(uint8_t r, uint8_t g, uint8_t b) const {
+    return (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+  }
+
+  void fillScreen(uint16_t color);
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+  void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);
+  void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color);
+  void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color);
+  void fillCircle(int32_t x, int32_t y, int32_t r, uint16_t color);
+  void drawCircle(int32_t x, int32_t y, int32_t r, uint16_t color);
+  void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint16_t color);
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t color);
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t color);
+  void drawPixel(int32_t x, int32_t y, uint16_t color);
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* data);
+
+  // Text in the built-in 6x8 font, scaled by the text size
+  void setTextColor(uint16_t fg) { (void)fg; }
+  void setTextColor(uint16_t fg, uint16_t bg) {
+    (void)fg;
+    (void)bg;
+  }
+  void setTextDatum(textdatum_t datum) { datum_ = datum; }
+  void setTextSize(float size) { textSize_ = size; }
+  void setTextPadding(uint32_t padding) { textPadding_ = padding; }
+  int32_t textWidth(const char* text) const { return (int32_t)(strlen(text) * 6 * textSize_); }
+  void drawString(const char* text, int32_t x, int32_t y);
+
+  void setClipRect(int32_t x, int32_t y, int32_t w, int32_t h);
+  void clearClipRect() { setClipRect(0, 0, width_, height_); }
+
+  void startWrite() {}
+  void endWrite() {}
+  void waitDisplay() {}
+
+ protected:
+  friend class M5Canvas;
+
+  LovyanGFX(int32_t width, int32_t height, bool panel);
+
+  // Count one call covering (x, y, w, h)
+  void draw(int32_t x, int32_t y, int32_t w, int32_t h);
+
+  int32_t width_;
+  int32_t height_;
+  bool panel_;
+  int32_t clipX_ = 0, clipY_ = 0, clipW_, clipH_;
+  textdatum_t datum_ = top_left;
+  float textSize_ = 1;
+  uint32_t textPadding_ = 0;
+};
+
+// The Tab5 panel, 720x1280 in portrait
+class M5GFX : public LovyanGFX {
+ public:
+  M5GFX() : LovyanGFX(720, 1280, true) {}
+};
+
+class M5Canvas : public LovyanGFX {
+ public:
+  M5Canvas() : LovyanGFX(0, 0, false) {}
+  explicit M5Canvas(LovyanGFX* parent) : LovyanGFX(0, 0, false), parent_(parent) {}
+
+  void setPsram(bool psram) { (void)psram; }
+  void* createSprite(int32_t w, int32_t h);
+  void deleteSprite();
+  void* getBuffer() { return buffer_.empty() ? nullptr : buffer_.data(); }
+
+  void fillSprite(uint16_t color) { fillScreen(color); }
+  void pushSprite(int32_t x, int32_t y) { pushSprite(parent_, x, y); }
+  void pushSprite(LovyanGFX* dst, int32_t x, int32_t y);
+
+ private:
+  LovyanGFX* parent_ = nullptr;
+  std::vector<uint16_t> buffer_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+// M5Unified stand-in for the simulator: the panel counts draw calls, touch
+// replays the scenario's trace, and there is no microphone. On the device
+// M5Unified also brings in the ESP-IDF headers; here SimDevice.h supplies
+// the LED and NVS backends main.cpp uses in their place.
+
+#include <M5GFX.h>
+
+#include "SimDevice.h"
+
+class SimTouch {
+ public:
+  struct Detail {
+    int16_t x = 0;
+    int16_t y = 0;
+    bool pressed = false;
+    bool justPressed = false;
+    bool justReleased = false;
+
+    bool isPressed() const { return pressed; }
+    bool wasPressed() const { return justPressed; }
+    bool wasReleased() const { return justReleased; }
+  };
+
+  // Points down, or on their release pass
+  uint8_t getCount() const { return detail_.pressed || detail_.justReleased; }
+  Detail getDetail(uint8_t index = 0) const {
+    (void)index;
+    return detail_;
+  }
+
+  // Sample the trace at the current virtual time (M5.update())
+  void update();
+
+ private:
+  Detail detail_;
+};
+
+class SimMic {
+ public:
+  bool begin() { return false; }
+  bool record(int16_t* data, size_t samples, uint32_t rate) {
+    (void)data;
+    (void)samples;
+    (void)rate;
+    return false;
+  }
+};
+
+class SimSpeaker {
+ public:
+  bool begin() { return true; }
+  void end() {}
+};
+
+class M5Unified {
+ public:
+  struct config_t {
+    bool output_power = true;
+    bool clear_display = true;
+    bool internal_mic = true;
+    uint32_t serial_baudrate = 115200;
+  };
+
+  config_t config() const { return config_t(); }
+  void begin(const config_t& cfg) { (void)cfg; }
+  void update() { Touch.update(); }
+
+  M5GFX Display;
+  SimTouch Touch;
+  SimMic Mic;
+  SimSpeaker Speaker;
+};
+
+extern M5Unified M5;
@@ -0,0 +1,15 @@
+#pragma once
+
+// No network in the simulator; main.cpp only starts WiFi with a WIFI_SSID
+#define WIFI_STA 1
+
+class WiFiClass {
+ public:
+  void mode(int mode) { (void)mode; }
+  void begin(const char* ssid, const char* password) {
+    (void)ssid;
+    (void)password;
+  }
+};
+
+extern WiFiClass WiFi;